@@ -113,13 +113,17 @@ ControlPanel::ControlPanel(QWidget *parent)
     VL = new QVBoxLayout;
     VL->addLayout(RHL);
     VL->addLayout(BHL);
+
+    IPSLabel = new QLabel("0.000 MIPS");
+    IPSLabel->setAlignment(Qt::AlignRight);
+    VL->addWidget(IPSLabel);
     setLayout(VL);
 }
 
 // No destructor. QT frees all children, so no need to delete everything.
 // This feels wrong.
 
-// Slot - called when the CPU Spinner wants to update the screen.
+// Slot - called by the CPU Worker with the latest state the CPU Spinner published.
 void ControlPanel::UpdateFromCPU(CPUInternalState *NewState)
 {
     for (int i = 0; i < NUMREGS; i++)
@@ -131,6 +135,10 @@ void ControlPanel::UpdateFromCPU(CPUInternalState *NewState)
     FD->SetHaltedState(NewState->Halted);
     LastIHAP = NewState->IHAP_Base;
     LastFHAP = NewState->FHAP_Base;
+    // The meter only moves a few times a second, so only touch the label when it does
+    double ips = Meter.Get();
+    if (Meter.Sample(NewState->Cycles) != ips)
+        IPSLabel->setText(QString::number(Meter.Get() / 1e6, 'f', 3) + " MIPS");
 }
 
 void ControlPanel::DetermineScreenSize()
@@ -24,6 +24,7 @@
 #include <QVBoxLayout>
 #include <QPushButton>
 #include <QFrame>
+#include <QLabel>
 #include "registerset.hpp"
 #include "flagdisplay.hpp"
 #include <cpu.hpp>
@@ -40,7 +41,7 @@ public:
 
 
 public slots:
-    // signal comes from CPU Spinner class
+    // called by the CPU Worker each time the screen is redrawn
     void UpdateFromCPU(CPUInternalState *NewState);
 
 private:
@@ -49,6 +50,8 @@ private:
     QVBoxLayout *VL;  // overarching vertical layout
     QHBoxLayout *RHL; // registers and flags
     QHBoxLayout *BHL; // buttons
+    QLabel *IPSLabel; // execution rate, below the buttons
+    IPSMeter Meter;
     uint32_t LastIHAP; // IHAP and FHAP values from CPU, cached for display
     uint32_t LastFHAP;
     bool SmallScreen {false};
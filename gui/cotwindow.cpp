@@ -117,7 +117,7 @@ void COTWindow::Hide()
     COTBox->hide();
 }
 
-// Slot for the CPU Spinner to call in order to...
+// Slot for the CPU Worker to call with the latest state the CPU Spinner published, in order to...
 void COTWindow::UpdateBlinkyLights(bool Writing, bool Reading)
 {
     IndS->SetState(Reading);
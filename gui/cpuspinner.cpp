@@ -27,20 +27,22 @@
                               // a clock speed of about 770kHz. Not bad for 1956!
                               // Raising the value did not materially affect speeds,
                               // so we will leave it at this value for good responsiveness.
-                              // Some tweaking in the CPU and/or Instruction classes would
-                              // likely help speed this up, if it becomes necessary.
+                              // "make bench" in tools times CPU steps by instruction type,
+                              // so check there before and after tweaking the CPU classes.
                               // Use an odd number, an even number may make it appear that
                               // bit 2 of the PC is stuck.
 
 // Constructor. This does not start the thread; this is done by the owner
 // of this object when it calls inherited function start().
-CPUSpinner::CPUSpinner(QObject *parent, CPU *CT6K, PrintOTron *POT, CardOTronPunch *COTP, CardOTronScan *COTS)
+CPUSpinner::CPUSpinner(QObject *parent, CPU *CT6K, PrintOTron *POT, CardOTronPunch *COTP, CardOTronScan *COTS,
+                       PanelBuffer *Panel)
 {
     setParent(parent);
     MyCPU = CT6K;
     MyPOT = POT;
     MyCOTS = COTS;
     MyCOTP = COTP;
+    MyPanel = Panel;
     RunState = CR_STOPPED;
 
 }
@@ -57,14 +59,29 @@ CPUSpinner::~CPUSpinner()
 
 }
 
+// Count each full-speed batch with the host's performance counters. Must be called before the thread is
+// started, as the counters are opened by the thread itself; they are closed again when it exits, so a
+// new spinner can pick them up.
+void CPUSpinner::SetHostCounters(HostCounters *Counters)
+{
+    MyHost = Counters;
+}
+
+// Serve a debugger from this thread. Must be called before the thread is started. While one is
+// connected it has the CPU, and the run state can't be changed from the UI.
+void CPUSpinner::SetGdbStub(GdbStub *Stub)
+{
+    MyGdb = Stub;
+}
+
 // Pass the new run state through the mutex to the thread executing
 // run(). If the thread is stopped, kick it.
 void CPUSpinner::ChangeState(CPURunState NewState)
 {
     Mutex.lock();
     CPURunState OldState = RunState;
-    if ((RunState == CR_HALTED) || (RunState == CR_EXITING)) {
-        // Don't execute, we are done.
+    if ((RunState == CR_HALTED) || (RunState == CR_REMOTE) || (RunState == CR_EXITING)) {
+        // Don't execute, we are done, or the debugger is in charge.
         Mutex.unlock();
         return;
     }
@@ -80,10 +97,25 @@ void CPUSpinner::ChangeState(CPURunState NewState)
 // the CPU and sending signals to the UI when and update is required.
 void CPUSpinner::run()
 {
+    if (MyHost != nullptr) {
+        std::string Error;
+        if (MyHost->Open(Error))
+            MyHost = nullptr; // the worker checked when it set them up, so this shouldn't happen
+    }
     forever {
+        // A debugger that connects takes over, whatever we were doing.
+        bool Connected {false};
+        if (MyGdb != nullptr) {
+            if (!MyGdb->IsConnected())
+                MyGdb->Poll(0);
+            Connected = MyGdb->IsConnected();
+        }
+
         // Cache the run state locally, under mutex. The "real" RunState can
         // be updated at any time, which could cause Problems.
         Mutex.lock();
+        if (Connected && (RunState != CR_EXITING))
+            RunState = CR_REMOTE;
         CPURunState LocalState = RunState;
         Mutex.unlock();
 
@@ -102,11 +134,14 @@ void CPUSpinner::run()
                 RunThenWait(MSEC60HZ);
                 break;
             case CR_FULL:
-                for (int i = 0; i < FAST_RUN_CYCLES; i++) {
-                    MyCPU->Step();
-                    if (MyCPU->IsBroken())
-                        break;
-                }
+                if (MyHost != nullptr)
+                    MyHost->Run(*MyCPU, FAST_RUN_CYCLES);
+                else
+                    MyCPU->Run(FAST_RUN_CYCLES);
+                break;
+            case CR_REMOTE:
+                // The stub runs the CPU a slice at a time when the debugger lets it go
+                MyGdb->Poll(GDB_POLL_MS);
                 break;
             case CR_HALTED:
             case CR_STOPPED:
@@ -114,28 +149,36 @@ void CPUSpinner::run()
                 // don't do anything
                 break;
         }
-        // Do I need a mutex here? Only one producer and one consumer,
-        // but it's certianly not an atomic update. No problems seen
-        // without one so far...
-        if (LocalState != CR_EXITING) {
-            CurrentState = MyCPU->DumpInternalState();
-            emit UpdatePanel(&CurrentState);
+        // Publish the state for the UI to pick up when it next redraws. This
+        // never waits on the UI, however slow it is; it just sees the latest.
+        // Assume that if we have a puncher, we also have a scanner.
+        if ((LocalState != CR_EXITING) && (MyPanel != nullptr)) {
+            PanelState &State = MyPanel->Back();
+            State.CPU = MyCPU->DumpInternalState();
+            State.Punching = (MyCOTP != nullptr) && MyCOTP->IsPunching();
+            State.Reading = (MyCOTS != nullptr) && MyCOTS->IsReading();
+            MyPanel->Publish();
         }
         // Check to see if the printer has any output. Need to check in a loop
         // to make sure we get all output, even after a HALT.
         if (MyPOT != nullptr)
             while (MyPOT->IsOutputReady())
                     emit UpdatePrinterWindow(MyPOT->GetOutputLine().c_str());
-
-        // Update Card-o-Tron. Assume that if we have a puncher, we also have a scanner.
-        if (MyCOTP != nullptr)
-            emit UpdateCOTBlinkyLights(MyCOTP->IsPunching(), MyCOTS->IsReading());
         // Update run state if needed, check if we are done.
         Mutex.lock();
         if (RunState == CR_EXITING) {
             Mutex.unlock();
+            if (MyHost != nullptr)
+                MyHost->Close();
             return;
         }
+        if (RunState == CR_REMOTE) {
+            // The debugger deals with halts and breakpoints itself. When it goes, leave the CPU stopped.
+            if (!MyGdb->IsConnected())
+                RunState = CR_STOPPED;
+            Mutex.unlock();
+            continue;
+        }
         if (MyCPU->IsHalted())
             RunState = CR_HALTED; // This overrides all other running states
         // Logically, this should be in the switch above but we need this
@@ -143,19 +186,25 @@ void CPUSpinner::run()
         if ((RunState == CR_STEP) || MyCPU->IsBroken())
             RunState = CR_STOPPED;
         // Wait on HALTED as well as STOPPED becaue we still need to wake
-        // the thread in order to exit.
-        if ((RunState == CR_STOPPED) || (RunState == CR_HALTED))
-            WaitCondition.wait(&Mutex);
+        // the thread in order to exit. With a debugger server, wake up now and
+        // then to see if one has connected.
+        if ((RunState == CR_STOPPED) || (RunState == CR_HALTED)) {
+            if (MyGdb != nullptr)
+                WaitCondition.wait(&Mutex, GDB_POLL_MS);
+            else
+                WaitCondition.wait(&Mutex);
+        }
         Mutex.unlock();
     } // forever
 }
 
 // Helper function for the slow speeds. Execute one step of the CPU then
-// sleep for the specified number of milliseconds.
+// sleep for the specified number of milliseconds. This uses Run() rather
+// than Step() so that it stops at breakpoints.
 void CPUSpinner::RunThenWait(int msec)
 {
-    MyCPU->Step();
-    if (!MyCPU->IsHalted())
+    MyCPU->Run(1);
+    if (!MyCPU->IsHalted() && !MyCPU->IsBroken())
         msleep(msec);
 }
 
@@ -25,6 +25,9 @@
 #include <cpu.hpp>
 #include <printotron.hpp>
 #include <cardotron.hpp>
+#include <hostperf.hpp>
+#include <gdbstub.hpp>
+#include "panelbuffer.hpp"
 
 // Run state of CPU Spinner thread. Set by buttons on the UI, checked by the spinner thread
 // each time through the loop.
@@ -36,25 +39,27 @@ enum CPURunState {
     CR_60HZ,
     CR_FULL,
     CR_HALTED,
+    CR_REMOTE,  // a debugger is connected and has the CPU; set and cleared by the thread itself
     CR_EXITING, // used internally
 };
 
 
 // CPUSpinner class, runs in a separate thread from the rest of the application. Controls
-// the (emulated) CPU at various speeds and reports (via QT signal) to the UI.
+// the (emulated) CPU at various speeds and publishes its state to the UI through a PanelBuffer.
+// Printer output still goes by QT signal, one line at a time.
 class CPUSpinner : public QThread
 {
     Q_OBJECT
 public:
     CPUSpinner(QObject *parent = nullptr, CPU *CT6K = nullptr, PrintOTron *POT = nullptr,
-               CardOTronPunch *COTP = nullptr, CardOTronScan *COTS = nullptr);
+               CardOTronPunch *COTP = nullptr, CardOTronScan *COTS = nullptr, PanelBuffer *Panel = nullptr);
     ~CPUSpinner();
     void ChangeState(CPURunState NewState);
+    void SetHostCounters(HostCounters *Counters);
+    void SetGdbStub(GdbStub *Stub);
 
 signals:
-    void UpdatePanel(CPUInternalState *state);
     void UpdatePrinterWindow(QString OutLine);
-    void UpdateCOTBlinkyLights(bool Writing, bool Reading);
 
 protected:
     void run() override;
@@ -64,11 +69,13 @@ private:
     QMutex Mutex;
     CPURunState RunState;
     QWaitCondition WaitCondition;
-    CPUInternalState CurrentState;
     CPU *MyCPU;
     PrintOTron *MyPOT;
     CardOTronPunch *MyCOTP;
     CardOTronScan *MyCOTS;
+    PanelBuffer *MyPanel;
+    HostCounters *MyHost {nullptr};
+    GdbStub *MyGdb {nullptr};
     void RunThenWait(int msec);
 
 };
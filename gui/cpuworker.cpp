@@ -24,9 +24,14 @@
 #include <QPushButton>
 #include <QObject>
 #include <QString>
+#include <QGuiApplication>
+#include <QScreen>
+#include <algorithm>
 #include <cpu.hpp>
+#include <condition.hpp>
 #include "qobjectdefs.h"
 #include <loadprog.h>
+#include <sstream>
 
 // Constructor. This instantiates the CPU as well as the Spinner to run it in
 // a separate thread.
@@ -34,9 +39,7 @@ CPUWorker::CPUWorker(QObject *parent)
     : QObject{parent}
 {
     MainWindow *M = (MainWindow *)parent;
-    ControlPanel *P = (ControlPanel *)M->centralWidget();
     PrinterWindow *PW = (PrinterWindow *)M->PW;
-    COTWindow *COTW = (COTWindow *)M->CW;
     CT6K = new CPU(); // default mem size
     POT = new PrintOTron();
     CT6K->AddDevice(POT);
@@ -44,12 +47,18 @@ CPUWorker::CPUWorker(QObject *parent)
     CT6K->AddDevice(COTP);
     COTS = new CardOTronScan();
     CT6K->AddDevice(COTS);
-    CT6K->AddROM(ROMImage, ROM_START, sizeof(ROMImage));
-    Spinner = new CPUSpinner(this, CT6K, POT, COTP, COTS);
-    QObject::connect(Spinner, SIGNAL(UpdatePanel(CPUInternalState*)), P, SLOT(UpdateFromCPU(CPUInternalState*)));
+    CT6K->AddROM(ROMImage, ROM_START, sizeof(ROMImage) / sizeof(ROMImage[0]));
+    Spinner = new CPUSpinner(this, CT6K, POT, COTP, COTS, &Panel);
     QObject::connect(Spinner, SIGNAL(UpdatePrinterWindow(QString)), PW, SLOT(UpdatePrinterWindow(QString)));
-    QObject::connect(Spinner, SIGNAL(UpdateCOTBlinkyLights(bool,bool)), COTW, SLOT(UpdateBlinkyLights(bool,bool)));
     Spinner->start();
+    // Redraw the panel from whatever the spinner last published, as often as the screen does
+    QScreen *Screen = QGuiApplication::primaryScreen();
+    double Hz = (Screen != nullptr) ? Screen->refreshRate() : 0;
+    if (Hz < 1)
+        Hz = PANEL_REFRESH_HZ;
+    Refresh = new QTimer(this);
+    QObject::connect(Refresh, SIGNAL(timeout()), this, SLOT(RefreshPanel()));
+    Refresh->start(std::max(1, (int)(1000 / Hz)));
 }
 
 // Unlike widgets, we do need a destructor here as the CPU class doesn't respect QT parentage,
@@ -57,6 +66,10 @@ CPUWorker::CPUWorker(QObject *parent)
 CPUWorker::~CPUWorker()
 {
     delete Spinner;
+    delete Gdb;
+    delete Host;
+    CT6K->SetHeatmap(nullptr);
+    delete Heat;
     delete CT6K;
     delete POT;
     delete COTS;
@@ -111,14 +124,28 @@ void CPUWorker::ResetCPU()
     POT->PowerOnReset();
     COTS->PowerOnReset();
     COTP->PowerOnReset();
+    // The spinner is gone, so we can publish the reset state ourselves. Anything it
+    // published that the panel hasn't picked up yet is older, and is replaced.
+    PanelState &State = Panel.Back();
+    State.CPU = CT6K->DumpInternalState();
+    State.Punching = false;
+    State.Reading = false;
+    Panel.Publish();
+    RefreshPanel();
+    Go();
+}
+
+// Timer slot - show the latest state the spinner published, if it's new.
+void CPUWorker::RefreshPanel()
+{
+    PanelState State;
+    if (Panel.Read(State))
+        return;
     MainWindow *M = (MainWindow *)this->parent();
     ControlPanel *P = (ControlPanel *)M->centralWidget();
     COTWindow *COTW = (COTWindow *)M->CW;
-    CPUInternalState State = CT6K->DumpInternalState();
-    // Directly call the Control Panel update slot
-    P->UpdateFromCPU(&State);
-    COTW->UpdateBlinkyLights(false, false);
-    Go();
+    P->UpdateFromCPU(&State.CPU);
+    COTW->UpdateBlinkyLights(State.Punching, State.Reading);
 }
 
 void CPUWorker::SetCOTSInput(std::ifstream *InFile)
@@ -152,6 +179,120 @@ uint32_t CPUWorker::ReadMem(uint32_t Address)
     return CT6K->ReadMem(Address);
 }
 
+// Execution counters and cycle count. As with ReadMem(), the spinner must be stopped.
+CPUStats CPUWorker::GetStats()
+{
+    if (Spinner != nullptr)
+        return CPUStats {};
+    return CT6K->GetStats();
+}
+
+uint64_t CPUWorker::GetCycles()
+{
+    if (Spinner != nullptr)
+        return 0;
+    return CT6K->GetCycles();
+}
+
+// Start counting memory accesses, if that isn't already happening. It carries on until the application
+// exits, and a reset clears it. The spinner must be stopped.
+// Returns true if it can't be done, because the spinner is running or the counters aren't built in.
+bool CPUWorker::StartHeatmap()
+{
+    if (Spinner != nullptr)
+        return true;
+    if (Heat != nullptr)
+        return false;
+    Heat = new MemHeatmap();
+    if (CT6K->SetHeatmap(Heat)) {
+        delete Heat;
+        Heat = nullptr;
+        return true;
+    }
+    return false;
+}
+
+// Count full-speed runs with the host's performance counters, sampling instructions by kind. The counters
+// are opened here only to see if the host has them; each spinner opens them again on its own thread.
+// The spinner must be stopped. Returns true, with the reason in Error, if the host can't count.
+bool CPUWorker::StartHostCounters(std::string &Error)
+{
+    if (Spinner != nullptr) {
+        Error = "the CPU is running";
+        return true;
+    }
+    if (Host != nullptr)
+        return false;
+    Host = new HostCounters(HOSTPERF_DEFAULT_SAMPLE);
+    if (Host->Open(Error)) {
+        delete Host;
+        Host = nullptr;
+        return true;
+    }
+    Host->Close();
+    return false;
+}
+
+// Stop counting and throw the counts away. The spinner must be stopped.
+void CPUWorker::StopHostCounters()
+{
+    if (Spinner != nullptr)
+        return;
+    delete Host;
+    Host = nullptr;
+}
+
+// The host counter report, as text. The spinner must be stopped. Returns true if nothing is being counted.
+bool CPUWorker::GetHostReport(std::string &Report)
+{
+    if ((Spinner != nullptr) || (Host == nullptr))
+        return true;
+    std::ostringstream Out;
+    Host->WriteReport(Out);
+    Report = Out.str();
+    return false;
+}
+
+// Wait for a debugger speaking the GDB remote protocol on a TCP port of the local host, or a Unix socket.
+// Once one connects it has the CPU until it goes. The spinner must be stopped. Returns true, with the
+// reason in Error, if we can't listen there.
+bool CPUWorker::StartGdbServer(const std::string &Where, std::string &Error)
+{
+    if (Spinner != nullptr) {
+        Error = "the CPU is running";
+        return true;
+    }
+    delete Gdb;
+    Gdb = new GdbStub(*CT6K);
+    if (Gdb->Listen(Where, Error)) {
+        delete Gdb;
+        Gdb = nullptr;
+        return true;
+    }
+    return false;
+}
+
+// Stop serving the debugger, dropping it if it is connected. The spinner must be stopped.
+void CPUWorker::StopGdbServer()
+{
+    if (Spinner != nullptr)
+        return;
+    delete Gdb;
+    Gdb = nullptr;
+}
+
+// Copy out the heatmap's page counts and working set samples. The spinner must be stopped.
+// Returns true if there is nothing to copy.
+bool CPUWorker::GetHeatmap(std::vector<HeatPage> &Pages, std::vector<HeatSample> &Samples, uint64_t &Window)
+{
+    if ((Spinner != nullptr) || (Heat == nullptr))
+        return true;
+    Heat->GetPages(Pages);
+    Heat->GetSamples(Samples);
+    Window = Heat->GetWindow();
+    return false;
+}
+
 void CPUWorker::WriteMem(uint32_t Address, uint32_t Value)
 {
     CT6K->WriteMem(Address, Value);
@@ -173,13 +314,143 @@ void CPUWorker::WriteReg(uint8_t Index, uint32_t Value)
         CT6K->WriteReg(Index, Value);
 }
 
+// Set a breakpoint, or clear it if there is one already. A full-speed run stops before the instruction
+// at a breakpoint, and so do the slow speeds. Like ReadMem(), the spinner must be stopped.
+// Returns true if the breakpoint is now set.
+bool CPUWorker::ToggleBreakpoint(uint32_t Address)
+{
+    if (CT6K->AddBreakpoint(Address)) {
+        CT6K->RemoveBreakpoint(Address);
+        return false;
+    }
+    return true;
+}
+
+void CPUWorker::ClearBreakpoints()
+{
+    CT6K->ClearBreakpoints();
+}
+
+std::vector<uint32_t> CPUWorker::GetBreakpoints()
+{
+    return CT6K->GetBreakpoints();
+}
+
+// Compile a condition, see condition.hpp. Returns null if the text is empty, or if it has an error, in
+// which case Error says what it is.
+static BreakCondition *CompileCondition(const std::string &Text, std::string &Error)
+{
+    Error.clear();
+    if (Text.empty())
+        return nullptr;
+    BreakCondition *Cond = new BreakCondition;
+    if (Cond->Compile(Text, nullptr, Error)) {
+        delete Cond;
+        return nullptr;
+    }
+    return Cond;
+}
+
+// Give the breakpoint at the address a condition, so the run only stops there when it holds. The spinner
+// must be stopped. Returns true if the condition has an error, or there is no breakpoint.
+bool CPUWorker::SetBreakCondition(uint32_t Address, const std::string &Text, std::string &Error)
+{
+    BreakCondition *Cond = CompileCondition(Text, Error);
+    if (Cond == nullptr)
+        return !Error.empty();
+    if (CT6K->SetBreakCondition(Address, Cond)) {
+        delete Cond;
+        Error = "no breakpoint to go with it";
+        return true;
+    }
+    return false;
+}
+
+// The text of the breakpoint's condition, empty if it has none.
+std::string CPUWorker::GetBreakCondition(uint32_t Address)
+{
+    const BreakCondition *Cond = CT6K->GetBreakCondition(Address);
+    return (Cond != nullptr) ? Cond->GetText() : "";
+}
+
+// Clear the watchpoints that start at the address, or if there aren't any, watch Len words from there.
+// The CPU stops after an instruction that makes one of the given kinds of access to them, if the condition
+// is empty or holds. The spinner must be stopped. Returns true if the range can't be watched, or the
+// condition has an error, in which case Error says what it is.
+bool CPUWorker::ToggleWatchpoint(uint32_t Address, uint32_t Len, uint32_t Kinds, const std::string &Condition,
+                                 std::string &Error)
+{
+    Error.clear();
+    if (!CT6K->RemoveWatchpoint(Address))
+        return false;
+    BreakCondition *Cond = CompileCondition(Condition, Error);
+    if (!Error.empty())
+        return true;
+    if (CT6K->AddWatchpoint(Address, Len, Kinds, Cond)) {
+        delete Cond;
+        return true;
+    }
+    return false;
+}
+
+void CPUWorker::ClearWatchpoints()
+{
+    CT6K->ClearWatchpoints();
+}
+
+std::vector<Watchpoint> CPUWorker::GetWatchpoints()
+{
+    return CT6K->GetWatchpoints();
+}
+
+// What the instruction the CPU stopped after did to a watched address.
+// Returns true if it wasn't a watchpoint that stopped it.
+bool CPUWorker::GetWatchHit(WatchHit &Hit)
+{
+    return CT6K->GetWatchHit(Hit);
+}
+
+// Stop watching the register, or if it isn't watched, stop the run whenever an instruction changes it and
+// the condition is empty or holds. The spinner must be stopped. Returns true if the register can't be
+// watched, or the condition has an error, in which case Error says what it is.
+bool CPUWorker::ToggleRegisterWatch(uint8_t Index, const std::string &Condition, std::string &Error)
+{
+    Error.clear();
+    if (!CT6K->UnwatchRegister(Index))
+        return false;
+    BreakCondition *Cond = CompileCondition(Condition, Error);
+    if (!Error.empty())
+        return true;
+    if (CT6K->WatchRegister(Index, Cond)) {
+        delete Cond;
+        return true;
+    }
+    return false;
+}
+
+// One bit per watched register.
+uint32_t CPUWorker::GetRegisterWatches()
+{
+    return CT6K->GetRegisterWatches();
+}
+
+// The text of the register watch's condition, empty if it has none.
+std::string CPUWorker::GetRegisterCondition(uint8_t Index)
+{
+    const BreakCondition *Cond = CT6K->GetRegisterCondition(Index);
+    return (Cond != nullptr) ? Cond->GetText() : "";
+}
+
 // Stop the spinner while we access memory or registers. Keep it quiet by
 // the simple expedient of killing it. "Dead threads tell no tales."
+// Then bring the panel up to date with the last thing it published, so
+// the panel's cached IHAP and FHAP are current.
 void CPUWorker::Quiesce()
 {
     if (Spinner != nullptr) {
         delete Spinner;
         Spinner = nullptr;
+        RefreshPanel();
     }
 }
 
@@ -189,14 +460,12 @@ void CPUWorker::Quiesce()
 void CPUWorker::Go()
 {
     if (Spinner == nullptr) {
-        Spinner = new CPUSpinner(this, CT6K, POT, COTP, COTS);
+        Spinner = new CPUSpinner(this, CT6K, POT, COTP, COTS, &Panel);
         MainWindow *M = (MainWindow *)this->parent();
-        ControlPanel *P = (ControlPanel *)M->centralWidget();
         PrinterWindow *PW = (PrinterWindow *)M->PW;
-        COTWindow *COTW = (COTWindow *)M->CW;
-        QObject::connect(Spinner, SIGNAL(UpdatePanel(CPUInternalState*)), P, SLOT(UpdateFromCPU(CPUInternalState*)));
         QObject::connect(Spinner, SIGNAL(UpdatePrinterWindow(QString)), PW, SLOT(UpdatePrinterWindow(QString)));
-        QObject::connect(Spinner, SIGNAL(UpdateCOTBlinkyLights(bool,bool)), COTW, SLOT(UpdateBlinkyLights(bool,bool)));
+        Spinner->SetHostCounters(Host);
+        Spinner->SetGdbStub(Gdb);
         Spinner->start();
     }
 }
@@ -20,11 +20,19 @@
 #define CPUWORKER_H
 #include <QObject>
 #include <QThread>
+#include <QTimer>
 #include <cstdint>
 #include <iostream>
+#include <vector>
 #include <cpu.hpp>
+#include <heatmap.hpp>
+#include <hostperf.hpp>
+#include <gdbstub.hpp>
 // cpu.hpp includes periph.hpp
 #include "cpuspinner.hpp"
+#include "panelbuffer.hpp"
+
+#define PANEL_REFRESH_HZ 60     // how often to redraw the panel if the screen doesn't say
 
 // CPUWorker class - control interface to CPU Spinner and the CPU from the UI.
 // This is the class that actually instantiates the CPU and owns it, along
@@ -40,6 +48,28 @@ public:
     void WriteMem(uint32_t Address, uint32_t Value);
     uint32_t ReadReg(uint8_t Index);
     void WriteReg(uint8_t Index, uint32_t Value);
+    bool ToggleBreakpoint(uint32_t Address);
+    void ClearBreakpoints();
+    std::vector<uint32_t> GetBreakpoints();
+    bool SetBreakCondition(uint32_t Address, const std::string &Text, std::string &Error);
+    std::string GetBreakCondition(uint32_t Address);
+    bool ToggleWatchpoint(uint32_t Address, uint32_t Len, uint32_t Kinds, const std::string &Condition,
+                          std::string &Error);
+    void ClearWatchpoints();
+    std::vector<Watchpoint> GetWatchpoints();
+    bool GetWatchHit(WatchHit &Hit);
+    bool ToggleRegisterWatch(uint8_t Index, const std::string &Condition, std::string &Error);
+    uint32_t GetRegisterWatches();
+    std::string GetRegisterCondition(uint8_t Index);
+    CPUStats GetStats();
+    uint64_t GetCycles();
+    bool StartHeatmap();
+    bool GetHeatmap(std::vector<HeatPage> &Pages, std::vector<HeatSample> &Samples, uint64_t &Window);
+    bool StartHostCounters(std::string &Error);
+    void StopHostCounters();
+    bool GetHostReport(std::string &Report);
+    bool StartGdbServer(const std::string &Where, std::string &Error);
+    void StopGdbServer();
     void Quiesce();
     void Go();
     CardOTronPunch *COTP;
@@ -55,11 +85,17 @@ public slots:
     void ResetCPU();
     void SetCOTSInput(std::ifstream *InFile);
     void SetCOTPOutput(std::ofstream *OutFile);
+    void RefreshPanel();
 
 private:
     CPU *CT6K;
     PrintOTron *POT;
     CPUSpinner *Spinner;
+    MemHeatmap *Heat {nullptr};
+    HostCounters *Host {nullptr};
+    GdbStub *Gdb {nullptr};
+    PanelBuffer Panel;      // outlives the spinners, which come and go
+    QTimer *Refresh;
 };
 
 #endif // CPUWORKER_H
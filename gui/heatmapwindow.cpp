@@ -0,0 +1,163 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022-2023 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// heatmapwindow.cpp - Function definitions for the HeatmapWindow and HeatGrid classes
+#include "heatmapwindow.hpp"
+#include <QPainter>
+#include <QToolTip>
+#include <QHelpEvent>
+#include <algorithm>
+#include <cmath>
+
+HeatGrid::HeatGrid(QWidget *Parent)
+    : QWidget{Parent}
+{
+    setMinimumWidth(HEAT_GRID_COLUMNS * HEAT_CELL_SIZE);
+}
+
+void HeatGrid::SetData(const std::vector<HeatPage> &NewPages, const std::vector<HeatSample> &NewSamples)
+{
+    Pages = NewPages;
+    Samples = NewSamples;
+    updateGeometry();
+    update();
+}
+
+int HeatGrid::GridRows() const
+{
+    return std::max<int>(1, (Pages.size() + HEAT_GRID_COLUMNS - 1) / HEAT_GRID_COLUMNS);
+}
+
+QSize HeatGrid::sizeHint() const
+{
+    return QSize(HEAT_GRID_COLUMNS * HEAT_CELL_SIZE, GridRows() * HEAT_CELL_SIZE + HEAT_GRAPH_HEIGHT + 10);
+}
+
+// Cells are shaded on a log scale, since the busiest page (usually the code) is often thousands of times
+// busier than the rest.
+void HeatGrid::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), QColorConstants::Black);
+
+    uint64_t most {1};
+    for (auto &p : Pages)
+        most = std::max(most, p.Reads + p.Writes + p.Fetches);
+    for (size_t i = 0; i < Pages.size(); i++) {
+        uint64_t count = Pages[i].Reads + Pages[i].Writes + Pages[i].Fetches;
+        double heat = std::log1p((double)count) / std::log1p((double)most);
+        QColor c = (heat < 0.5) ? QColor::fromRgbF(0.0, 0.0, 0.3 + 1.4 * heat)
+                                : QColor::fromRgbF(2.0 * heat - 1.0, 2.0 * heat - 1.0, 1.0);
+        painter.fillRect((i % HEAT_GRID_COLUMNS) * HEAT_CELL_SIZE + 1, (i / HEAT_GRID_COLUMNS) * HEAT_CELL_SIZE + 1,
+                         HEAT_CELL_SIZE - 2, HEAT_CELL_SIZE - 2, c);
+    }
+
+    // Working set graph, scaled to its peak and squeezed to fit the width
+    int top = GridRows() * HEAT_CELL_SIZE + 10;
+    uint32_t peak {1};
+    for (auto &s : Samples)
+        peak = std::max(peak, s.Pages);
+    painter.setPen(QColorConstants::DarkGray);
+    painter.drawRect(0, top, width() - 1, HEAT_GRAPH_HEIGHT - 1);
+    painter.setPen(QColorConstants::Green);
+    for (size_t i = 1; i < Samples.size(); i++) {
+        int x0 = (int)((i - 1) * (width() - 1) / Samples.size());
+        int x1 = (int)(i * (width() - 1) / Samples.size());
+        painter.drawLine(x0, top + HEAT_GRAPH_HEIGHT - 1 - Samples[i - 1].Pages * (HEAT_GRAPH_HEIGHT - 2) / peak,
+                         x1, top + HEAT_GRAPH_HEIGHT - 1 - Samples[i].Pages * (HEAT_GRAPH_HEIGHT - 2) / peak);
+    }
+}
+
+// Hovering over a cell shows the page address and its counts.
+bool HeatGrid::event(QEvent *event)
+{
+    if (event->type() == QEvent::ToolTip) {
+        QHelpEvent *help = static_cast<QHelpEvent *>(event);
+        int col = help->pos().x() / HEAT_CELL_SIZE;
+        size_t i = (help->pos().y() / HEAT_CELL_SIZE) * HEAT_GRID_COLUMNS + col;
+        if ((col < HEAT_GRID_COLUMNS) && (i < Pages.size())) {
+            QToolTip::showText(help->globalPos(), QString("0x%1: %2 reads, %3 writes, %4 fetches")
+                                   .arg(Pages[i].Addr, 8, 16, QChar('0')).arg(Pages[i].Reads)
+                                   .arg(Pages[i].Writes).arg(Pages[i].Fetches));
+        } else {
+            QToolTip::hideText();
+            event->ignore();
+        }
+        return true;
+    }
+    return QWidget::event(event);
+}
+
+// Constructor, sets up the window. It starts out empty; the main window fills it in with Update().
+HeatmapWindow::HeatmapWindow(QObject *parent)
+    : QObject{parent}
+{
+    HeatBox = new QDialog();
+    HeatBox->setWindowFlags(Qt::Window);
+    HeatBox->setWindowTitle("Memory Heatmap");
+    HeatBox->setModal(false);
+
+    VL = new QVBoxLayout;
+    Grid = new HeatGrid(nullptr);
+    VL->addWidget(Grid);
+    Summary = new QLabel("");
+    Summary->setTextFormat(Qt::RichText);
+    VL->addWidget(Summary);
+    PBR = new QPushButton(nullptr);
+    PBR->setText("REFRESH");
+    VL->addWidget(PBR);
+    HeatBox->setLayout(VL);
+}
+
+// Destructor
+HeatmapWindow::~HeatmapWindow()
+{
+    HeatBox->hide();
+    delete HeatBox;
+}
+
+void HeatmapWindow::Show()
+{
+    HeatBox->show();
+}
+
+void HeatmapWindow::Hide()
+{
+    HeatBox->hide();
+}
+
+// Take a new copy of the counts, and list the busiest few pages under the grid.
+void HeatmapWindow::Update(const std::vector<HeatPage> &Pages, const std::vector<HeatSample> &Samples, uint64_t Window)
+{
+    Grid->SetData(Pages, Samples);
+
+    std::vector<HeatPage> busy = Pages;
+    auto total = [](const HeatPage &p) { return p.Reads + p.Writes + p.Fetches; };
+    std::sort(busy.begin(), busy.end(), [&total](const HeatPage &a, const HeatPage &b) { return total(a) > total(b); });
+    uint32_t peak {0};
+    for (auto &s : Samples)
+        peak = std::max(peak, s.Pages);
+    QString OutBuf = QString("<tt>%1 pages touched. Working set: %2 now, %3 at peak, per %4 cycles<br><br>")
+                         .arg(Pages.size()).arg(Samples.empty() ? 0 : Samples.back().Pages).arg(peak).arg(Window);
+    for (size_t i = 0; (i < busy.size()) && (i < 5); i++)
+        OutBuf += QString("0x%1&nbsp;&nbsp;%2 reads, %3 writes, %4 fetches<br>").arg(busy[i].Addr, 8, 16, QChar('0'))
+                      .arg(busy[i].Reads).arg(busy[i].Writes).arg(busy[i].Fetches);
+    OutBuf += "</tt>";
+    Summary->setText(OutBuf);
+    HeatBox->adjustSize();
+}
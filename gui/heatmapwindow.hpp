@@ -0,0 +1,73 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022-2023 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// heatmapwindow.hpp - declarations for the HeatmapWindow and HeatGrid classes
+
+#ifndef HEATMAPWINDOW_HPP
+#define HEATMAPWINDOW_HPP
+
+#include <QObject>
+#include <QWidget>
+#include <QLabel>
+#include <QDialog>
+#include <QPushButton>
+#include <QVBoxLayout>
+#include <vector>
+#include <heatmap.hpp>
+
+#define HEAT_GRID_COLUMNS 32
+#define HEAT_CELL_SIZE 14
+#define HEAT_GRAPH_HEIGHT 80
+
+// HeatGrid class - draws one cell for each page the program has touched, lowest address first, shaded
+// from dark blue to white by how busy it is, with the working set graphed over time underneath.
+class HeatGrid : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit HeatGrid(QWidget *Parent = nullptr);
+    void SetData(const std::vector<HeatPage> &NewPages, const std::vector<HeatSample> &NewSamples);
+    QSize sizeHint() const override;
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    bool event(QEvent *event) override;
+private:
+    std::vector<HeatPage> Pages;
+    std::vector<HeatSample> Samples;
+    int GridRows() const;
+};
+
+class HeatmapWindow : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HeatmapWindow(QObject *parent = nullptr);
+    ~HeatmapWindow();
+    void Show();
+    void Hide();
+    void Update(const std::vector<HeatPage> &Pages, const std::vector<HeatSample> &Samples, uint64_t Window);
+    // Button is public so we can connect it to the main window
+    QPushButton *PBR;
+
+private:
+    QDialog *HeatBox;
+    HeatGrid *Grid;
+    QLabel *Summary;
+    QVBoxLayout *VL;
+};
+
+#endif // HEATMAPWINDOW_HPP
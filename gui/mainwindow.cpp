@@ -29,7 +29,10 @@
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QDebug>
+#include <algorithm>
+#include <fstream>
 #include <arch.h>
+#include <condition.hpp>
 
 #include "controlpanel.hpp"
 #include "ct6k-info.h"
@@ -46,6 +49,7 @@ MainWindow::MainWindow(QWidget *parent)
 
     PW = new PrinterWindow(this);
     CW = new COTWindow(this);
+    HW = new HeatmapWindow(this);
     OffImg = new QPixmap(":/ct6k/ib-off.jpg");
     OnImg = new QPixmap(":/ct6k/ib-on.jpg");
 
@@ -73,6 +77,7 @@ MainWindow::MainWindow(QWidget *parent)
     QObject::connect(CP->BtnFull, SIGNAL(clicked()), Worker, SLOT(RunFull()));
     QObject::connect (CW, SIGNAL(SetCOTSInput(std::ifstream*)), Worker, SLOT(SetCOTSInput(std::ifstream*)));
     QObject::connect (CW, SIGNAL(SetCOTPOutput(std::ofstream*)), Worker, SLOT(SetCOTPOutput(std::ofstream*)));
+    QObject::connect(HW->PBR, SIGNAL(clicked()), this, SLOT(UpdateHeatmap()));
     RegistersLocked = true;
 }
 
@@ -83,6 +88,8 @@ MainWindow::~MainWindow()
     delete PW;
     CW->Hide();
     delete CW;
+    HW->Hide();
+    delete HW;
     delete ui;
 }
 
@@ -177,6 +184,167 @@ void MainWindow::on_actionShow_IHAP_triggered()
     Box.exec();
 }
 
+// Menu item slot Debug/Execution Counts
+// Shows the busiest opcodes, then faults and memory traffic by kind of memory.
+void MainWindow::on_actionExecution_Counts_triggered()
+{
+    Worker->Quiesce();
+    CPUStats Stats = Worker->GetStats();
+    uint64_t Cycles = Worker->GetCycles();
+    Worker->Go();
+
+    std::vector<int> Ops;
+    for (int i = 0; i < STAT_NUM_OPCODES; i++)
+        if (Stats.Opcodes[i])
+            Ops.push_back(i);
+    std::sort(Ops.begin(), Ops.end(), [&Stats](int a, int b) { return Stats.Opcodes[a] > Stats.Opcodes[b]; });
+    QString OutBuf = "<tt>" + QString::number(Cycles) + " cycles<br><br>";
+    for (size_t i = 0; (i < Ops.size()) && (i < 16); i++) {
+        const OpMap *Map = FindFromOpcode(Ops[i]);
+        OutBuf += QString("%1").arg((Map->Opcode == Ops[i]) ? Map->Name : "???", -8).replace(" ", "&nbsp;");
+        OutBuf += QString("%1").arg(Stats.Opcodes[Ops[i]], 12).replace(" ", "&nbsp;") + "<br>";
+    }
+    OutBuf += QString("<br>Faults: %1 instr, %2 addr, %3 stack, %4 page, %5 double<br>")
+                  .arg(Stats.Faults[FAULT_BAD_INSTR]).arg(Stats.Faults[FAULT_BAD_ADDR])
+                  .arg(Stats.Faults[FAULT_STACK]).arg(Stats.Faults[FAULT_PAGE]).arg(Stats.Faults[0]);
+    OutBuf += QString("Interrupts: %1, direct values: %2<br>").arg(Stats.Interrupts).arg(Stats.DirectFetches);
+    OutBuf += QString("Fetches: %1 RAM, %2 ROM<br>").arg(Stats.Fetches[stat_ram]).arg(Stats.Fetches[stat_rom]);
+    OutBuf += QString("Reads: %1 RAM, %2 ROM, %3 I/O<br>").arg(Stats.Reads[stat_ram]).arg(Stats.Reads[stat_rom])
+                  .arg(Stats.Reads[stat_io]);
+    OutBuf += QString("Writes: %1 RAM, %2 I/O</tt>").arg(Stats.Writes[stat_ram]).arg(Stats.Writes[stat_io]);
+    QMessageBox MB;
+    MB.setText(OutBuf);
+    MB.exec();
+}
+
+// Menu item slot Debug/Save Counts
+// Writes the same counters as JSON, in the format batch6k --stats uses.
+void MainWindow::on_actionSave_Counts_triggered()
+{
+    QString Filename = QFileDialog::getSaveFileName(this, tr("Save Execution Counts"), ".", tr("JSON (*.json)"));
+    if (Filename.isEmpty())
+        return;
+    Worker->Quiesce();
+    CPUStats Stats = Worker->GetStats();
+    uint64_t Cycles = Worker->GetCycles();
+    Worker->Go();
+
+    std::ofstream OutFile(Filename.toStdString(), std::ios::out | std::ios::trunc);
+    if (!OutFile.is_open()) {
+        QMessageBox Box;
+        Box.setText("Error: unable to open " + Filename);
+        Box.setIcon(QMessageBox::Warning);
+        Box.exec();
+        return;
+    }
+    WriteStatsJSON(OutFile, Stats, Cycles);
+}
+
+// Menu item slot Debug/Memory Heatmap
+// Counting starts the first time the window is opened, so it costs nothing until then.
+void MainWindow::on_actionMemory_Heatmap_triggered()
+{
+    Worker->Quiesce();
+    bool Failed = Worker->StartHeatmap();
+    Worker->Go();
+    if (Failed) {
+        QMessageBox Box;
+        Box.setText("Error: this build has no execution counters, so no heatmap.");
+        Box.setIcon(QMessageBox::Warning);
+        Box.exec();
+        return;
+    }
+    UpdateHeatmap();
+    HW->Show();
+}
+
+// Refresh the heatmap window with a fresh copy of the counts.
+void MainWindow::UpdateHeatmap()
+{
+    std::vector<HeatPage> Pages;
+    std::vector<HeatSample> Samples;
+    uint64_t Window {0};
+
+    Worker->Quiesce();
+    bool Failed = Worker->GetHeatmap(Pages, Samples, Window);
+    Worker->Go();
+    if (!Failed)
+        HW->Update(Pages, Samples, Window);
+}
+
+// Menu item slot Debug/Host Counters
+// Counts full-speed runs with the host CPU's performance counters, to see what the emulator costs per
+// guest instruction. Unchecking it throws the counts away.
+void MainWindow::on_actionHost_Counters_triggered(bool checked)
+{
+    std::string Error;
+    bool Failed {false};
+
+    Worker->Quiesce();
+    if (checked)
+        Failed = Worker->StartHostCounters(Error);
+    else
+        Worker->StopHostCounters();
+    Worker->Go();
+    if (Failed) {
+        ui->actionHost_Counters->setChecked(false);
+        QMessageBox Box;
+        Box.setText(QString("Error: ") + Error.c_str());
+        Box.setIcon(QMessageBox::Warning);
+        Box.exec();
+    }
+}
+
+// Menu item slot Debug/Host Counter Report
+void MainWindow::on_actionHost_Counter_Report_triggered()
+{
+    std::string Report;
+
+    Worker->Quiesce();
+    bool Failed = Worker->GetHostReport(Report);
+    Worker->Go();
+    QMessageBox Box;
+    if (Failed)
+        Box.setText("Turn on Debug/Host Counters and run at full speed first.");
+    else
+        Box.setText("<pre>" + QString(Report.c_str()).toHtmlEscaped() + "</pre>");
+    Box.exec();
+}
+
+// Menu item slot Debug/GDB Server
+// Waits for a debugger speaking the GDB remote protocol, on a TCP port of this host or a Unix socket.
+// Once one connects it has the CPU, and the run buttons do nothing until it goes. Unchecking it drops
+// the debugger.
+void MainWindow::on_actionGDB_Server_triggered(bool checked)
+{
+    std::string Error;
+    bool Failed {false};
+
+    if (checked) {
+        bool OK;
+        QString Where = QInputDialog::getText(this, "GDB Server", "Port or Unix socket path:", QLineEdit::Normal,
+                                              QString::number(GDB_DEFAULT_PORT), &OK);
+        if (!OK || Where.trimmed().isEmpty()) {
+            ui->actionGDB_Server->setChecked(false);
+            return;
+        }
+        Worker->Quiesce();
+        Failed = Worker->StartGdbServer(Where.trimmed().toStdString(), Error);
+        Worker->Go();
+    } else {
+        Worker->Quiesce();
+        Worker->StopGdbServer();
+        Worker->Go();
+    }
+    if (Failed) {
+        ui->actionGDB_Server->setChecked(false);
+        QMessageBox Box;
+        Box.setText(QString("Error: ") + Error.c_str());
+        Box.setIcon(QMessageBox::Warning);
+        Box.exec();
+    }
+}
+
 // Menu item slot Debug/Dump Memory
 void MainWindow::on_actionDump_Memory_triggered()
 {
@@ -197,19 +365,6 @@ void MainWindow::on_actionDump_Memory_triggered()
     }
 }
 
-// Print the instruction based upon the value(s) given. If Count is specified, update the count of
-// words used for the instruction.
-QString FormatDisasm(uint32_t Val, uint32_t Val2, uint32_t *Count)
-{
-    std::string outstr;
-    auto i = new Instruction(Val, Val2);
-    i->Print(outstr);
-    if (Count != nullptr)
-        *Count = i->SizeInMemory();
-    delete i;
-    return QString::fromStdString(outstr);
-}
-
 
 // Menu item slot Debug/Disassemble
 void MainWindow::on_actionDisassemble_triggered()
@@ -222,7 +377,7 @@ void MainWindow::on_actionDisassemble_triggered()
         Worker->Quiesce();
         for (int i = 0; i < 16 ; i++) {
             OutBuf += HexVal(Base) + ": ";
-            OutBuf += FormatDisasm(Worker->ReadMem(Base),Worker->ReadMem(Base + 1), &Count);
+            OutBuf += QString::fromStdString(FormatDisasm(Worker->ReadMem(Base),Worker->ReadMem(Base + 1), &Count));
             OutBuf += "<br>";
             Base += Count;
         }
@@ -321,6 +476,178 @@ uint8_t RegName(QString Input)
     return retval;
 }
 
+// Show a warning about a condition that didn't compile.
+void ShowConditionError(const std::string &Error)
+{
+    QMessageBox Box;
+    Box.setText("Error: the condition has " + QString::fromStdString(Error) + ".");
+    Box.setIcon(QMessageBox::Warning);
+    Box.exec();
+}
+
+// Menu item slot Debug/Breakpoints
+// Shows the breakpoints and asks for an address or register to set one at, or clear it if there is one
+// already, until the user cancels. Anything after the address is a condition for the new breakpoint, such as
+// "0x100 R6 < 3 && [0x2000] == 0"; the run only stops there when it holds.
+void MainWindow::on_actionBreakpoints_triggered()
+{
+    bool OK {true};
+    std::string Error;
+
+    Worker->Quiesce();
+    while (OK) {
+        std::vector<uint32_t> Addrs = Worker->GetBreakpoints();
+        QString Label = QString::number(Addrs.size()) + " breakpoints";
+        QString Conds;
+        int Plain {0};
+        for (auto Addr : Addrs) {
+            std::string Cond = Worker->GetBreakCondition(Addr);
+            if (!Cond.empty())
+                Conds += "\n" + HexVal(Addr) + "  if " + QString::fromStdString(Cond);
+            else
+                Label += ((Plain++ % 4) ? "  " : "\n") + HexVal(Addr);
+        }
+        Label += Conds + "\n\nEnter an address or register to set or clear, and any condition:";
+        QString RawText = QInputDialog::getText(this, "Breakpoints", Label, QLineEdit::Normal, "IP", &OK);
+        RawText = RawText.trimmed();
+        if (!OK || RawText.isEmpty())
+            break;
+        QString AddrText = RawText.section(' ', 0, 0);
+        QString CondText = RawText.section(' ', 1, -1, QString::SectionSkipEmpty);
+        uint8_t Reg = RegName(AddrText);
+        uint32_t Addr = (Reg == NO_REG) ? AddrText.toULong(&OK, 0) : Worker->ReadReg(Reg);
+        if (OK && Worker->ToggleBreakpoint(Addr) && !CondText.isEmpty() &&
+            Worker->SetBreakCondition(Addr, CondText.toStdString(), Error))
+            ShowConditionError(Error);
+        OK = true;
+    }
+    Worker->Go();
+}
+
+// Menu item slot Debug/Clear Breakpoints
+void MainWindow::on_actionClear_Breakpoints_triggered()
+{
+    Worker->Quiesce();
+    Worker->ClearBreakpoints();
+    Worker->Go();
+}
+
+// Describe what the instruction the CPU stopped after did to a watched address or register.
+QString DescribeWatchHit(const WatchHit &Hit)
+{
+    QString Text = "Stopped after " + HexVal(Hit.IP);
+    if (Hit.Kind == WATCH_REG)
+        return Text + " changed R" + QString::number(Hit.Addr) + " to " + HexVal(Hit.Value) + ", was " +
+               HexVal(Hit.Old);
+    Text += ((Hit.Kind == WATCH_READ) ? " read " : " wrote ") + HexVal(Hit.Value);
+    Text += ((Hit.Kind == WATCH_READ) ? " from " : " to ") + HexVal(Hit.Addr);
+    if ((Hit.Kind == WATCH_WRITE) && (Hit.Addr < BASE_IO_MEM))
+        Text += ", was " + HexVal(Hit.Old);
+    return Text;
+}
+
+// Menu item slot Debug/Watchpoints
+// Shows the watchpoints, and what tripped the last one, then asks for a new one as an address, a length
+// and any of R, W and C for read, write and change, such as "0x1000 16 W", then optionally a condition
+// such as "VALUE > 100". Entering the address of one clears it; a new one with no length or kinds watches
+// writes to one word. Carries on until the user cancels.
+void MainWindow::on_actionWatchpoints_triggered()
+{
+    bool OK {true};
+    WatchHit Hit;
+    std::string Error;
+
+    Worker->Quiesce();
+    while (OK) {
+        std::vector<Watchpoint> Watches = Worker->GetWatchpoints();
+        QString Label = QString::number(Watches.size()) + " watchpoints";
+        for (auto &W : Watches) {
+            Label += "\n" + HexVal(W.Addr) + " - " + HexVal(W.Addr + W.Len - 1) + "  ";
+            Label += QString((W.Kinds & WATCH_READ) ? "R" : "") + ((W.Kinds & WATCH_WRITE) ? "W" : "") +
+                     ((W.Kinds & WATCH_CHANGE) ? "C" : "");
+            if (W.Cond != nullptr)
+                Label += "  if " + QString::fromStdString(W.Cond->GetText());
+        }
+        if (!Worker->GetWatchHit(Hit))
+            Label += "\n\n" + DescribeWatchHit(Hit);
+        Label += "\n\nEnter address, words, R/W/C and any condition to watch, or an address to clear:";
+        QString RawText = QInputDialog::getText(this, "Watchpoints", Label, QLineEdit::Normal, "", &OK);
+        QStringList Parts = RawText.split(' ', Qt::SkipEmptyParts);
+        if (!OK || Parts.isEmpty())
+            break;
+        uint32_t Addr = Parts[0].toULong(&OK, 0);
+        uint32_t Len = (Parts.size() > 1) ? Parts[1].toULong(&OK, 0) : 1;
+        uint32_t Kinds {0};
+        QString KindText = (Parts.size() > 2) ? Parts[2].toUpper() : "W";
+        Kinds |= KindText.contains('R') ? WATCH_READ : 0;
+        Kinds |= KindText.contains('W') ? WATCH_WRITE : 0;
+        Kinds |= KindText.contains('C') ? WATCH_CHANGE : 0;
+        std::string CondText = RawText.section(' ', 3, -1, QString::SectionSkipEmpty).toStdString();
+        if (OK && Worker->ToggleWatchpoint(Addr, Len, Kinds, CondText, Error)) {
+            if (!Error.empty()) {
+                ShowConditionError(Error);
+            } else {
+                QMessageBox Box;
+                Box.setText("Error: that range can't be watched.");
+                Box.setIcon(QMessageBox::Warning);
+                Box.exec();
+            }
+        }
+        OK = true;
+    }
+    Worker->Go();
+}
+
+// Menu item slot Debug/Register Watches
+// Shows the watched registers, and what tripped the last watch, then asks for a register to watch for
+// changes, or to stop watching if it is watched already. Anything after the register is a condition, such
+// as "R6 VALUE == 0"; VALUE is the new value and OLD the one before. Carries on until the user cancels.
+void MainWindow::on_actionRegister_Watches_triggered()
+{
+    bool OK {true};
+    WatchHit Hit;
+    std::string Error;
+
+    Worker->Quiesce();
+    while (OK) {
+        uint32_t Watched = Worker->GetRegisterWatches();
+        QString Label = "Watched registers:";
+        for (uint8_t Reg = 0; Reg < NUMREGS; Reg++) {
+            if (!((Watched >> Reg) & 1))
+                continue;
+            Label += "\nR" + QString::number(Reg);
+            std::string Cond = Worker->GetRegisterCondition(Reg);
+            if (!Cond.empty())
+                Label += "  if " + QString::fromStdString(Cond);
+        }
+        if (!Worker->GetWatchHit(Hit))
+            Label += "\n\n" + DescribeWatchHit(Hit);
+        Label += "\n\nEnter a register to watch, and any condition, or a watched one to stop:";
+        QString RawText = QInputDialog::getText(this, "Register Watches", Label, QLineEdit::Normal, "", &OK);
+        RawText = RawText.trimmed();
+        if (!OK || RawText.isEmpty())
+            break;
+        uint8_t Reg = RegName(RawText.section(' ', 0, 0));
+        std::string CondText = RawText.section(' ', 1, -1, QString::SectionSkipEmpty).toStdString();
+        if ((Reg == NO_REG) || Worker->ToggleRegisterWatch(Reg, CondText, Error)) {
+            QMessageBox Box;
+            Box.setText(Error.empty() ? QString("Error: that register can't be watched.") :
+                        "Error: the condition has " + QString::fromStdString(Error) + ".");
+            Box.setIcon(QMessageBox::Warning);
+            Box.exec();
+        }
+    }
+    Worker->Go();
+}
+
+// Menu item slot Debug/Clear Watchpoints
+void MainWindow::on_actionClear_Watchpoints_triggered()
+{
+    Worker->Quiesce();
+    Worker->ClearWatchpoints();
+    Worker->Go();
+}
+
 // Convenience function to display an input dialog and parse a uint32 value from it.
 // This variation allows a regsiter argument, i.e. the user can type R10 or PC
 uint32_t MainWindow::GetAddrFromUser(QString Title, QString Message, QString Seed, bool *Success)
@@ -25,6 +25,7 @@
 #include "controlpanel.hpp"
 #include "printerwindow.hpp"
 #include "cotwindow.hpp"
+#include "heatmapwindow.hpp"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -44,6 +45,7 @@ public:
     ControlPanel *CP;
     PrinterWindow *PW;
     COTWindow *CW;
+    HeatmapWindow *HW;
 
 private slots:
     void on_actionExit_triggered();
@@ -51,10 +53,22 @@ private slots:
     void on_actionReset_triggered();
     void on_actionShow_FHAP_triggered();
     void on_actionShow_IHAP_triggered();
+    void on_actionExecution_Counts_triggered();
+    void on_actionSave_Counts_triggered();
+    void on_actionMemory_Heatmap_triggered();
+    void UpdateHeatmap();
+    void on_actionHost_Counters_triggered(bool checked);
+    void on_actionHost_Counter_Report_triggered();
+    void on_actionGDB_Server_triggered(bool checked);
     void on_actionDump_Memory_triggered();
     void on_actionDisassemble_triggered();
     void on_actionModify_Registers_triggered(bool checked);
     void on_actionModify_Memory_triggered();
+    void on_actionBreakpoints_triggered();
+    void on_actionClear_Breakpoints_triggered();
+    void on_actionWatchpoints_triggered();
+    void on_actionClear_Watchpoints_triggered();
+    void on_actionRegister_Watches_triggered();
     void on_actionInstructions_triggered();
     void on_actionAbout_triggered();
     void on_actionCaution_triggered();
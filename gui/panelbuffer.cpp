@@ -0,0 +1,55 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022-2023 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// panelbuffer.cpp - function definitions for the PanelBuffer class
+
+#include "panelbuffer.hpp"
+
+#define PANEL_FRESH 0x04    // set in Middle when the writer has published since the last Read()
+#define PANEL_INDEX 0x03
+
+PanelBuffer::PanelBuffer()
+{
+    for (Slot &S : Slots)
+        S.State = PanelState {};
+}
+
+// The writer's slot, to fill in before calling Publish()
+PanelState &PanelBuffer::Back()
+{
+    return Slots[BackIndex].State;
+}
+
+// Hand the writer's slot over to the reader and take the middle one in its place. The release half of
+// the exchange makes everything written to the slot visible to a reader that picks it up.
+void PanelBuffer::Publish()
+{
+    uint8_t Old = Middle.exchange(BackIndex | PANEL_FRESH, std::memory_order_acq_rel);
+    BackIndex = Old & PANEL_INDEX;
+}
+
+// Copy out the latest published state. Returns true, leaving State alone, if nothing has been published
+// since the last call.
+bool PanelBuffer::Read(PanelState &State)
+{
+    if ((Middle.load(std::memory_order_relaxed) & PANEL_FRESH) == 0)
+        return true;
+    uint8_t Old = Middle.exchange(FrontIndex, std::memory_order_acq_rel);
+    FrontIndex = Old & PANEL_INDEX;
+    State = Slots[FrontIndex].State;
+    return false;
+}
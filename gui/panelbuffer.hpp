@@ -0,0 +1,60 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022-2023 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// panelbuffer.hpp - declarations for the PanelBuffer class
+// The spinner thread publishes what the front panel shows through a PanelBuffer, and the UI picks up the
+// latest of it on a timer. It is a triple buffer: the spinner fills its own slot and swaps it with the
+// middle one, and the UI swaps the middle one with its own when there is something new there. One
+// atomic exchange each way, so neither side ever waits on the other, and each only ever looks at a slot
+// the other isn't touching, so the UI never sees half of one update and half of the next. States the
+// UI was too slow to see are simply replaced.
+//
+// One writer and one reader at a time. The worker can write to it itself while the spinner is stopped.
+
+#ifndef PANELBUFFER_HPP
+#define PANELBUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cpu.hpp>
+
+// Everything the panel and device windows show, taken at one moment
+struct PanelState {
+    CPUInternalState CPU;
+    bool Punching;  // Card-o-Tron lights
+    bool Reading;
+};
+
+class PanelBuffer {
+public:
+    PanelBuffer();
+    PanelState &Back();
+    void Publish();
+    bool Read(PanelState &State);
+
+private:
+    // Each slot on its own cache line, so the two threads don't fight over them
+    struct alignas(64) Slot {
+        PanelState State;
+    };
+    Slot Slots[3];
+    int BackIndex {0};                  // writer's own
+    int FrontIndex {1};                 // reader's own
+    std::atomic<uint8_t> Middle {2};    // index of the shared slot, with PANEL_FRESH if unread
+};
+
+#endif // PANELBUFFER_HPP
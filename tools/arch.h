@@ -31,6 +31,7 @@ Flags (R13) (R/0)
 	Bit 1: Borrow/Underflow
 	Bit 2: Sign
 	Bit 3: Zero
+	Bit 28: MMU enabled
 	Bit 29: Signed arithemetic active
 	Bit 30: Interrupt Enable (global)
 	Bit 31: Fault
@@ -55,15 +56,19 @@ NOT - logical not of all bits in value indicated by dest
 AND
 OR
 XOR
-SHIFTR - src1 is value, src2 is number of bits to shift, fault if > 31
-SHIFTL - src1 is value, src2 is number of bits to shift, fault if > 31
+SHIFTR - src1 is value, src2 is number of bits to shift, result is zero if > 31
+SHIFTL - src1 is value, src2 is number of bits to shift, result is zero if > 31
+CAS - compare and swap, src1 is expected value, src2 is new value, dest must be indirect
 PUSH
 POP
 INCR - increments value indicated by dest
 DECR - decrements value indicated by dest
+COREID - puts the number of the executing core in dest
 SSTATE - saves all registers on stack
 LSTATE - restores all registers except R0 and IP from stack
          IP for obvious reasons, R0 for return value.
+SSTATEM - saves only the registers selected by a 16-bit mask (direct value)
+LSTATEM - restores only the registers selected by a 16-bit mask (direct value)
 
 [Flow, if address is used, it may be in dest or direct value]
 JZERO
@@ -74,6 +79,8 @@ JUNDER
 JNUNDER
 JMP
 CALL - does not save state on stack, just return address (next IP)
+LOOP - decrements the counter register given in src1, then jumps if the
+       result is not zero. Flags are NOT modified.
 RETURN - does not restore state from stack, just pops IP
 IRET - DOES restore all state from stack
 SIGNED
@@ -88,6 +95,16 @@ BRK - stops and waits for interrupt or user interaction
 SETFHAP
 SETIHAP
 
+[Multiprocessing, core number in src1]
+IPI - raises the inter-processor interrupt on the given core
+
+[MMU control]
+SETPTB - sets the page table base (physical address) from src1, flushes the TLB
+SETPTL - sets the page table length (number of entries) from src1, flushes the TLB
+MMUENA - turns on address translation
+MMUDIS - turns off address translation
+TLBFLUSH - discards all cached translations
+
 All instructions 32 bits.
 High byte - opcode
 2nd byte - src1 reg
@@ -100,7 +117,8 @@ Reg byte bits
 7: Value in reg
 
 For MOVE, if src1 and src2 bytes are 0xFFFF then the next 32bits is a direct value to be placed in destination.
-SHIFTL and SHIFTR shift src1 by number of bits in src2, result in dest. Shift values > 31 generate overflow/underflow.
+SHIFTL and SHIFTR shift src1 by number of bits in src2, result in dest. Shift values > 31 shift out
+every bit, giving zero, with overflow/underflow unless src1 was zero.
 Both SHIFTL and SHIFTR fill with zeros.
 
 For JMP and related control-flow instructions, setting src1, src2 and dest register bytes to 0xFFFFFF
@@ -108,6 +126,14 @@ indicates a direct value for the jump destination. Otherwise, the address to whi
 is specified in the destination register. This is a little weird architecturally because the CPU is actually
 reading from the destination register, but makes sense semantically to humans: "Jump to this destination".
 
+LOOP is the exception: src1 holds the loop counter (either a register or an indirect memory location),
+and the destination is given in the dest register or as a direct value, exactly as for JMP. In the
+assembler this is written
+    LOOP R6, $TOP
+The counter is always decremented as an unsigned value, regardless of the SIGNED flag, and wraps from 0
+to 0xFFFFFFFF without setting UNDER. A counter that starts at zero will therefore loop 2^32 times.
+LOOP replaces the common DECR / JNZERO pair with a single instruction.
+
 Memory:
 All accesses 32-bits. Memory granularity is 32 bits. No endianness.
 
@@ -117,10 +143,12 @@ Faults:
 0: Invalid Instruction
 1: Invalid Memory
 2: Stack Fault
-3: Double fault
+3: Page Fault
+Double fault is indicated by the high bit.
 
 Interrupts:
 0: Clock
+3: Inter-processor interrupt
 
 Flags:
 For CMP instruction, the CPU compares src1 and destination, and updates flags.
@@ -131,6 +159,9 @@ For CMP instruction, the CPU compares src1 and destination, and updates flags.
 For logical instructions, the ZERO flag is updated if the result is zero. Other flags are
 unmodified.
 
+For LOOP, no flags are modified. In particular, ZERO does NOT reflect the final counter value.
+Code that needs to test the counter after the loop should use CMP or OR.
+
 For math instructions, including INCR and DECR, the following flags are set:
  - ZERO flag is set if the result is zero
  - OVER flag is set if the value overflows
@@ -158,6 +189,78 @@ CALL and RETURN do not save any state except IP.
 SSTATE and LSTATE save and restore machine state to stack. IP and R0 are NOT restored.
 (R0 is expected to be used for return value.)
 
+SSTATEM and LSTATEM are the masked forms of SSTATE and LSTATE. The register mask is given as a direct
+value following the instruction, with bit N selecting register RN:
+    SSTATEM 0x0046      * save R1, R2, and R6
+    ...
+    LSTATEM 0x0046      * and restore them
+The dest register byte must be 0xFF to indicate the direct value. Bits 16-31 of the mask are ignored.
+Selected registers are stored in ascending order, one word each, and SP advances by the number of
+registers selected. LSTATEM reads the same layout back, so the same mask must be used for both.
+As with LSTATE, the slots for R0, SP and IP are consumed but those registers are not restored;
+SP is simply moved back below the saved registers. No flags are modified (unless FLG is restored).
+A stack fault occurs if the selected registers will not fit above SP (SSTATEM) or if SP is lower than
+the number of selected registers (LSTATEM). Registers that are not selected are never touched, which
+makes these much cheaper than a full SSTATE/LSTATE for short subroutines.
+
+Virtual Memory:
+The MMU is optional and off at reset. When it is off, every address is physical. When it is on (MMUENA,
+bit 28 of FLG), every instruction fetch and every memory access made by an instruction, including stack
+operations and the FHAP lookup, goes through a single-level page table:
+    virtual page number = address >> 10     (pages are 1024 words)
+    PTE                 = physical word at (page table base + virtual page number)
+    physical address    = (PTE & 0xFFFFFC00) | (address & 0x3FF)
+PTE bits:
+    Bit 0: Valid - page may be read
+    Bit 1: Write - page may be written
+    Bit 2: Exec  - instructions (and their direct values) may be fetched from the page
+    Bits 10-31: physical base address of the page frame
+The page table itself is always read with physical addresses. Addresses in I/O space (0xFFF00000 and
+up) are never translated.
+An access to a page past the end of the table, to a page without the Valid bit, or one not allowed by
+the Write/Exec bits raises a Page Fault. Page faults are precise: registers are put back the way they
+were before the faulting instruction began, the saved IP points at the instruction itself, and the
+faulting virtual address is pushed on the stack after the machine state. The handler should POP the
+address, fix up the page table, and IRET to retry the instruction. Because translation stays on while
+the handler runs, the handler, its stack and the FHAP must be mapped in every address space; mapping
+them at the same virtual and physical address is the simplest way to do that. The MMU enable bit is
+part of FLG, so IRET (and LSTATE) restore it along with everything else.
+The CPU caches translations. Any change to a PTE that is already in use must be followed by TLBFLUSH.
+SETPTB and SETPTL flush implicitly, so switching address spaces is a single SETPTB.
+
+Multiprocessing:
+A machine may have up to 16 cores sharing one memory, ROM and set of devices. Each core has its own
+registers, FHAP, IHAP and MMU state. All cores start at 0 like a single-core machine, so early boot code
+should use COREID to send all but core 0 off to wait (HALT or a spin loop) while core 0 sets things up.
+Cores are numbered from 0, and the boot core is always 0.
+
+Memory ordering: single words are never torn. Each core's writes become visible to other cores in the
+order they were made, and a core that sees a word written by another core also sees everything that
+core wrote before it. Nothing stops a core from seeing its own write before other cores do, though, so
+two cores each writing one flag and then reading the other's can both read the old value. Use CAS
+wherever that matters; it is a full barrier.
+
+CAS compares the word pointed to by dest with src1. If they match, src2 is stored there and ZERO is
+set; otherwise memory is unchanged and ZERO is cleared. The check and the store are one atomic step
+across all cores. A simple lock:
+    MOVE 1, R2
+$SPIN
+    CAS R0, R2, I1      * R0 is zero, R1 points at the lock
+    JNZERO $SPIN
+    ...                 * critical section
+    MOVE R0, I1         * release
+CAS on I/O space is an invalid address fault.
+
+IPI raises interrupt 3 on the core named by src1. An IPI to a core that does not exist is an invalid
+address fault. The interrupt stays pending until that core takes it, and sending more IPIs before then
+has no further effect. Device register accesses are serialized between cores, so the device drivers
+do not change, but two cores sharing one device still need a lock around multi-word sequences.
+
+Interrupt delivery: before each instruction, a core takes the lowest numbered pending interrupt if
+INTENA is set, that interrupt's FLG_INTENx bit is set, and it is not already handling an interrupt or
+fault. The state is pushed as for a fault, the in-interrupt flag is set, and execution continues at
+the address found in the IHAP. IRET returns.
+
 Initialization:
 Execution begins at 0.
 All registers set to 0.
@@ -182,17 +285,22 @@ TODO: preload a register with mem size?
 #define OP_XOR		0x15
 #define OP_SHIFTR	0x16
 #define OP_SHIFTL	0x17
+#define OP_CAS		0x18
 
 /* Take single src value */
 #define OP_PUSH		0x30
 #define OP_SETFHAP	0x3A
 #define OP_SETIHAP	0x3B
+#define OP_SETPTB	0x3D
+#define OP_SETPTL	0x3E
+#define OP_IPI		0x3F
 
 /* Take single dest value */
 #define OP_POP		0x31
 #define OP_NOT		0x20
 #define OP_INCR		0x21
 #define OP_DECR		0x22
+#define OP_COREID	0x23
 #define OP_JZERO	0x32
 #define OP_JNZERO	0x33
 #define OP_JOVER	0x34
@@ -202,6 +310,9 @@ TODO: preload a register with mem size?
 #define OP_JMP		0x38
 #define OP_CALL		0x39
 
+/* Take single src value (counter) and a dest value or direct value (target) */
+#define OP_LOOP		0x3C
+
 /* Take no register arguments */
 #define OP_SSTATE	0x50
 #define OP_LSTATE	0x51
@@ -211,6 +322,13 @@ TODO: preload a register with mem size?
 #define OP_UNSIGNED	0x55
 #define OP_INTENA	0x56
 #define OP_INTDIS	0x57
+#define OP_MMUENA	0x5A
+#define OP_MMUDIS	0x5B
+#define OP_TLBFLUSH	0x5C
+
+/* Take a direct value only */
+#define OP_SSTATEM	0x58
+#define OP_LSTATEM	0x59
 #define OP_NOP		0xF0
 #define OP_BRK		0xFE
 #define OP_HALT		0xFF
@@ -279,15 +397,22 @@ TODO: preload a register with mem size?
 #define FLG_INTEN1  0x00020000
 #define FLG_INTEN2  0x00040000
 #define FLG_INTEN3  0x00080000
+#define FLG_MMUENA	0x10000000      // Controlled by MMUENA and MMUDIS
 #define FLG_SIGNED	0x20000000
 #define FLG_INTENA	0x40000000      // Global, controlled by INTENA and INTDIS
 #define	FLG_FAULT	0x80000000
 
+/* Interrupt lines */
+#define INT_CLOCK		0
+#define INT_IPI			3
+#define NUM_INTS		4
+
 /* Fault codes */
 #define FAULT_NO_FAULT	0		// used internally
 #define FAULT_BAD_INSTR	0x00000001
 #define FAULT_BAD_ADDR	0x00000002
 #define FAULT_STACK		0x00000003
+#define FAULT_PAGE		0x00000004
 #define	FAULT_DOUBLE	0x80000000
 
 /* Convenience */
@@ -295,9 +420,20 @@ TODO: preload a register with mem size?
 #define STATE_SIZE			16 //words
 #define MAX_STATE_PUSH		(MAX_ADDR - STATE_SIZE)
 #define MIN_STATE_POP		(STATE_SIZE)
+#define STATE_MASK_ALL		0x0000FFFF
 #define FHAP_SIZE			16
 #define MAX_FHAP			(MAX_ADDR - FHAP_SIZE)
 #define IHAP_SIZE			32
+#define MAX_CORES			16
 #define MAX_IHAP			(MAX_ADDR - IHAP_SIZE)
 
+/* MMU */
+#define MMU_PAGE_SHIFT		10
+#define MMU_PAGE_SIZE		(1 << MMU_PAGE_SHIFT) // words
+#define MMU_OFFSET_MASK		(MMU_PAGE_SIZE - 1)
+#define PTE_VALID			0x00000001
+#define PTE_WRITE			0x00000002
+#define PTE_EXEC			0x00000004
+#define PTE_FRAME_MASK		(~(uint32_t)MMU_OFFSET_MASK)
+
 #endif /* !__ARCH_H__ */
@@ -24,13 +24,14 @@
 #include <string_view>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
 #include "symref.hpp"
 #include "segment.hpp"
 #include "instruction.hpp"
 
 #define ASM_VER_MAJOR "2"
-#define ASM_VER_MINOR "1"
-#define ASM_VER_SUB "1"
+#define ASM_VER_MINOR "2"
+#define ASM_VER_SUB "0"
 #define ASM_VER_STRING "Comp-o-Tron 6000 symbolic assembler, version " ASM_VER_MAJOR "." ASM_VER_MINOR "." ASM_VER_SUB
 
 // Super simple assembler. Most of the work is done by build_instruction(), so this code just
@@ -89,6 +90,9 @@
 // - .TXTN .TXTM .TXTL for text (not packed, packed MSB first, packed LSB first)
 // - .VALUE to define a fixed value
 //
+// Version 2.2 additions:
+// - Symbol map output (-m) for the profiler
+//
 
 
 // Remove whitespace from beginning of string
@@ -141,6 +145,7 @@ int Usage(char *Cmd)
     std::cout << "\t-b raw binary output format\n";
     std::cout << "\t-c Card-O-Tron card deck output format\n";
     std::cout << "\t-l produce complete listing\n";
+    std::cout << "\t-m produce symbol map (outfile.map) for the profiler\n";
     std::cout << "\nRaw binary files can be loaded directly by the emulator but must start at\n";
     std::cout << "address 0. Generally, this is for short programs that can run on the raw\n";
     std::cout << "hardware. For more flexiblity, or to assemble multiple files in multiple\n";
@@ -186,19 +191,6 @@ bool WriteBin(std::vector<CodeSegment *>Segs, std::ofstream &File)
     return false;
 }
 
-// Print the instruction based upon the value(s) given. If Count is specified, update the count of
-// words used for the instruction.
-std::string FormatDisasm(uint32_t Val, uint32_t Val2, uint32_t *Count)
-{
-    std::string outstr;
-    auto i = new Instruction(Val, Val2);
-    i->Print(outstr);
-    if (Count != nullptr)
-        *Count = i->SizeInMemory();
-    delete i;
-    return outstr;
-}
-
 // Output a formatted hexadecimal digit to the specified stream.
 // Output will be as if we used 0x%8.8x in C
 void HexOut(std::ofstream &File, uint32_t Value)
@@ -242,6 +234,44 @@ void DumpListing(std::vector<CodeSegment *>Segs,  std::ofstream &File)
     File << " --- END OF LISTING ---\n\n";
 }
 
+// Write the symbol map: the source files, the segments, the source line of each word and the address
+// of each label. The format is described in symmap.hpp. Like the listing, this is done after we write
+// the binary, so no error checking needs to be done.
+void WriteMap(std::vector<CodeSegment *>Segs, const SymbolTable &Syms, std::ofstream &File)
+{
+    std::vector<std::string> files;
+    auto fileindex = [&files](const std::string &Name) {
+        auto it = std::find(files.begin(), files.end(), Name);
+        return it - files.begin();
+    };
+
+    File << "* " << ASM_VER_STRING << " symbol map\n";
+    for (auto s : Segs) {
+        if (fileindex(s->GetFilename()) == (long)files.size()) {
+            File << "FILE " << files.size() << " " << s->GetFilename() << "\n";
+            files.push_back(s->GetFilename());
+        }
+    }
+    File << std::hex << std::showbase;
+    for (auto s : Segs) {
+        auto file = fileindex(s->GetFilename());
+        if (s->GetLen() == 0)
+            continue;
+        File << "SEG " << s->GetBase() << " " << s->GetLen() << std::dec << " " << file << std::hex << "\n";
+        uint32_t last {0};
+        for (std::size_t i = 0; i < s->GetLen(); i++) {
+            uint32_t line = s->GetSrcLine(i);
+            if (line != last)
+                File << "LINE " << s->GetBase() + i << std::dec << " " << file << " " << line << std::hex << "\n";
+            last = line;
+        }
+    }
+    for (auto sym : Syms.GetLabels())
+        File << "SYM " << sym->Seg->GetBase() + sym->Offset << " " << sym->Name << std::dec << " "
+             << fileindex(sym->Seg->GetFilename()) << " " << sym->SrcLine << std::hex << "\n";
+    File << std::dec << std::noshowbase;
+}
+
 // Dump a C++ header file of the completed program to the given file. This is done after we write
 // the binary, so no error checking needs to be done.
 void DumpROM(std::vector<CodeSegment *>Segs,  std::ofstream &File)
@@ -250,7 +280,7 @@ void DumpROM(std::vector<CodeSegment *>Segs,  std::ofstream &File)
     File << "// Comp-o-Tron ROM file generated from asm6k\n\n";
     uint32_t start = Segs[0]->GetBase();
     File << "#define ROM_START " << std::hex << std::showbase << start << "\n\n";
-    File << "static uint32_t ROMImage[] = {\n";
+    File << "static const uint32_t ROMImage[] = {\n";
     for (auto s : Segs) {
         for (std::size_t i = 0; i < s->GetLen(); i++) {
             File << s->ReadWord(i) << ", ";
@@ -432,16 +462,16 @@ bool AssembleSegment(std::ifstream *InFile, CodeSegment *CurrentSeg, SymbolTable
                 case 'N': // no encoding, one char per word (wasteful)
                     for (auto c : Data) {
                         uint32_t word = (uint32_t)c;
-                        CurrentSeg->AddWord(word);
+                        CurrentSeg->AddWord(word, *CurrentLine);
                     }
                     break;
                 case 'L': // 4 chars per word, LSB first
                     while (Data.length())
-                        CurrentSeg->AddWord(PackLSB(Data));
+                        CurrentSeg->AddWord(PackLSB(Data), *CurrentLine);
                     break;
                 case 'M': // 4 chars per word, MSB first
                     while (Data.length())
-                        CurrentSeg->AddWord(PackMSB(Data));
+                        CurrentSeg->AddWord(PackMSB(Data), *CurrentLine);
                     break;
                 default:
                     std::cerr << "Fatal: invalid directive " << directive << " on line " << *CurrentLine << "\n";
@@ -488,9 +518,9 @@ bool AssembleSegment(std::ifstream *InFile, CodeSegment *CurrentSeg, SymbolTable
             return true;
         }
         // Add the resultant word(s) to the segment
-        CurrentSeg->AddWord(word);
+        CurrentSeg->AddWord(word, *CurrentLine);
         if (extra_present) {
-            CurrentSeg->AddWord(extra_word);
+            CurrentSeg->AddWord(extra_word, *CurrentLine);
         }
     }
     return false;
@@ -510,6 +540,7 @@ int main(int argc, char *argv[])
     bool OutputBin {true};
     bool GotOutputType {false};
     bool ProduceListing {false};
+    bool ProduceMap {false};
     bool OutputROM {false};
 
     std::cout << ASM_VER_STRING << "\n";
@@ -541,6 +572,10 @@ int main(int argc, char *argv[])
             ProduceListing = true;
             continue;
         }
+        if (TmpArg == "-m") {
+            ProduceMap = true;
+            continue;
+        }
         if (TmpArg == "-r") {
             OutputROM = true;
             continue;
@@ -671,6 +706,20 @@ int main(int argc, char *argv[])
         listfile.close();
     }
 
+    if (ProduceMap) {
+        std::ofstream mapfile;
+        std::string mapname = outname + ".map";
+        mapfile.open(mapname, std::ios::out | std::ios::trunc);
+        if (!mapfile.is_open()) {
+            std::cerr << "Error opening map file " << mapname << "\n";
+            for (auto s = Segs.begin(); s != Segs.end(); s++)
+               delete *s;
+            return -1;
+        }
+        WriteMap(Segs, syms, mapfile);
+        mapfile.close();
+    }
+
     if (OutputROM) {
         std::ofstream romfile;
         std::string romname = outname + ".h";
@@ -0,0 +1,851 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// batch_main.cpp - headless runner for the Comp-o-Tron 6000.
+// Loads a program, runs it flat out with no UI, and reports how it went. Meant for scripts.
+// Given a manifest, runs a whole list of jobs on separate machines across all host cores and checks
+// their output. Jobs running the same program can be run side by side in a Lockstep engine.
+
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include "arch.h"
+#include "cpu.hpp"
+#include "batchjob.hpp"
+#include "workpool.hpp"
+#include "lockstep.hpp"
+#include "jobsocket.hpp"
+#include "profiler.hpp"
+#include "symmap.hpp"
+#include "calltrack.hpp"
+#include "trace.hpp"
+#include "timeline.hpp"
+#include "coverage.hpp"
+#include "hostperf.hpp"
+
+// Display usage. Caller passes in argv[0] so that we can display the name of the command.
+int Usage(char *Cmd)
+{
+    std::cerr << "Usage: " << Cmd << " [options] [binfile]\n";
+    std::cerr << "       " << Cmd << " -j manifest [-t threads] [-l [--verify]]\n";
+    std::cerr << "Options:\n";
+    std::cerr << "\t-b binfile      load raw binary at address 0 and start there\n";
+    std::cerr << "\t-c deckfile     load a card deck directly into memory, start at its first card\n";
+    std::cerr << "\t-r deckfile     boot a card deck through the loader ROM\n";
+    std::cerr << "\t-i deckfile     put a deck in the Card-o-Tron scanner for the program to read\n";
+    std::cerr << "\t-p punchfile    punch cards to this file\n";
+    std::cerr << "\t-d diskfile     attach a Stor-o-Tron using this data file, created if needed\n";
+    std::cerr << "\t-o printfile    send Print-o-Tron output here instead of stdout\n";
+    std::cerr << "\t-m, --max-cycles N\n";
+    std::cerr << "\t                stop after N cycles (default " << DEFAULT_MAX_CYCLES << ")\n";
+    std::cerr << "\t-q              don't print the register dump\n";
+    std::cerr << "\t--stats file    write the CPU's execution counters to file as JSON\n";
+    std::cerr << "\t--profile file  sample IP while running and write a profile to file\n";
+    std::cerr << "\t--sample N      with --profile, sample every N cycles (default " << PROFILE_DEFAULT_INTERVAL
+              << ")\n";
+    std::cerr << "\t--callgraph file\n";
+    std::cerr << "\t                track calls and write cycles per routine to file\n";
+    std::cerr << "\t--folded file   track calls and write folded stacks for a flame graph to file\n";
+    std::cerr << "\t--map mapfile   name routines in the above using a map from asm6k -m\n";
+    std::cerr << "\t--trace file    record every instruction executed to file, for trace6k\n";
+    std::cerr << "\t--timeline file write device activity and status polls to file, as Chrome trace JSON\n";
+    std::cerr << "\t--coverage file record which instructions ran and which way branches went, for cov6k;\n";
+    std::cerr << "\t                with -j, a directory to write one file per program to\n";
+    std::cerr << "\t--hostperf file count host cycles, instructions, branch and cache misses and write\n";
+    std::cerr << "\t                them per guest instruction to file (Linux only)\n";
+    std::cerr << "\t--hostperf-sample N\n";
+    std::cerr << "\t                with --hostperf, also count 1 in N instructions alone, by kind\n";
+    std::cerr << "\t-j manifest     run every job in the manifest and check the results\n";
+    std::cerr << "\t-t threads      threads for -j (default one per host core)\n";
+    std::cerr << "\t-l, --lockstep  with -j, run jobs that share a program in lockstep, up to\n";
+    std::cerr << "\t                " << LOCKSTEP_MAX_LANES << " at a time\n";
+    std::cerr << "\t--verify        with -l, run every job again on its own and compare\n";
+    std::cerr << "\t-S socket       send the job to a serve6k server instead of running it here\n";
+    std::cerr << "\nExit status is 0 on HALT, 2 if the cycle limit was reached, 3 if the CPU\n";
+    std::cerr << "halted while handling a fault, and 1 for any other error. With -j it is 0\n";
+    std::cerr << "if every job passed and 4 otherwise.\n";
+    std::cerr << "\nEach manifest line is one job:\n";
+    std::cerr << "\tname bin=file|deck=file|boot=file [in=deck] [disk=file] [print=file] [punch=file]\n";
+    std::cerr << "\t     [cycles=N] [took=N]\n";
+    std::cerr << "print and punch name files holding the expected output, and took is the exact\n";
+    std::cerr << "number of cycles the job should take. Paths are relative to the manifest. Jobs\n";
+    std::cerr << "must not share a disk file. Blank lines and lines starting with * or # are ignored.\n";
+    return EXIT_ERROR;
+}
+
+// Profiling and tracing for a single job. Whichever of the profiler, call tracker, trace recorder, device
+// timeline, coverage map and host counters are set up run alongside the job, and write their reports to
+// the given streams once it stops.
+class ToolHooks : public JobHooks {
+public:
+    ~ToolHooks() { delete Prof; delete Calls; delete Trace; delete Timeline; delete Cover; delete Host; }
+    void Start(CPU &C) override
+    {
+        if (Cover != nullptr)
+            C.SetCoverage(Cover);
+        if (Timeline != nullptr)
+            Timeline->Attach(C);
+        if (Calls != nullptr)
+            C.SetCallTracker(Calls);
+        if (Trace != nullptr)
+            C.SetTraceRecorder(Trace);
+    }
+    uint64_t Run(CPU &C, uint64_t MaxCycles) override
+    {
+        if (Host != nullptr)
+            return Host->Run(C, MaxCycles);
+        return (Prof != nullptr) ? Prof->Run(C, MaxCycles) : C.Run(MaxCycles);
+    }
+    void Finish(CPU &C) override
+    {
+        if (Prof != nullptr) {
+            Prof->WriteFlat(*ProfOut, Map);
+            *ProfOut << "\n";
+            Prof->WriteListing(*ProfOut, Map, C);
+        }
+        if (Calls != nullptr) {
+            Calls->Finish(C.GetCycles());
+            C.SetCallTracker(nullptr);
+            if (CallOut != nullptr)
+                Calls->WriteReport(*CallOut, Map);
+            if (FoldOut != nullptr)
+                Calls->WriteFolded(*FoldOut, Map);
+        }
+        if (Trace != nullptr) {
+            C.SetTraceRecorder(nullptr);
+            if (Trace->Close())
+                std::cerr << "Error writing trace, it is incomplete\n";
+        }
+        if (Timeline != nullptr) {
+            Timeline->Detach();
+            Timeline->WriteJSON(*TimelineOut);
+        }
+        if (Cover != nullptr) {
+            C.SetCoverage(nullptr);
+            Cover->AddRuns(1);
+            Cover->Write(*CoverOut);
+        }
+        if (Host != nullptr)
+            Host->WriteReport(*HostOut);
+    }
+    SymbolMap Map;
+    Profiler *Prof {nullptr};
+    std::ostream *ProfOut {nullptr};
+    CallTracker *Calls {nullptr};
+    std::ostream *CallOut {nullptr};
+    std::ostream *FoldOut {nullptr};
+    TraceRecorder *Trace {nullptr};
+    DeviceTimeline *Timeline {nullptr};
+    std::ostream *TimelineOut {nullptr};
+    Coverage *Cover {nullptr};
+    std::ostream *CoverOut {nullptr};
+    HostCounters *Host {nullptr};
+    std::ostream *HostOut {nullptr};
+};
+
+// Coverage for one job of a manifest. The jobs' maps are merged by program once they have all run.
+class CoverHooks : public JobHooks {
+public:
+    void Start(CPU &C) override { C.SetCoverage(&Cover); }
+    void Finish(CPU &C) override
+    {
+        C.SetCoverage(nullptr);
+        Cover.AddRuns(1);
+    }
+    Coverage Cover;
+};
+
+// The file a job's program comes from.
+static const std::string &ProgramFile(const BatchJob &Job)
+{
+    if (!Job.Binary.empty())
+        return Job.Binary;
+    return Job.Deck.empty() ? Job.Boot : Job.Deck;
+}
+
+// Open one of the report files. Returns true on error.
+static bool OpenReport(const std::string &Name, std::ofstream &File)
+{
+    if (Name.empty())
+        return false;
+    File.open(Name, std::ios::out | std::ios::trunc);
+    if (!File.is_open()) {
+        std::cerr << "Error opening " << Name << "\n";
+        return true;
+    }
+    return false;
+}
+
+// Run a group of jobs that share a program and cycle limit side by side in a Lockstep engine. Each
+// still has its own machine; only the stepping is shared, along with the memory pages none of them
+// has written. Jobs that fail to load drop out.
+// Returns the number of instructions run in lockstep and on their own through VecInstr and ScalarInstr.
+void RunGroup(const std::vector<const BatchJob *> &Jobs, std::vector<std::ostream *> &PrintOut,
+              std::vector<std::ostream *> &PunchOut, std::vector<BatchResult *> &Results,
+              uint64_t &VecInstr, uint64_t &ScalarInstr)
+{
+    std::vector<JobMachine *> machines;
+    std::vector<CPU *> lanes;
+    std::vector<std::size_t> which;
+
+    for (std::size_t i = 0; i < Jobs.size(); i++) {
+        JobMachine *m = new JobMachine;
+        Results[i]->Status = EXIT_ERROR;
+        if (m->Load(*Jobs[i], PunchOut[i], Results[i]->Error, machines.empty() ? nullptr : machines[0])) {
+            delete m;
+            continue;
+        }
+        machines.push_back(m);
+        lanes.push_back(&m->Core);
+        which.push_back(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Lockstep engine(lanes, Jobs[0]->MaxCycles);
+    while (!engine.IsDone()) {
+        engine.Run(BATCH_CHUNK_CYCLES);
+        for (std::size_t l = 0; l < machines.size(); l++)
+            machines[l]->DrainPrinter(*PrintOut[which[l]]);
+    }
+    engine.Sync();
+    auto stop = std::chrono::steady_clock::now();
+
+    for (std::size_t l = 0; l < machines.size(); l++) {
+        machines[l]->Finish(engine.GetCycles(l), *Results[which[l]]);
+        Results[which[l]]->Secs = std::chrono::duration<double>(stop - start).count();
+    }
+    for (auto m : machines)
+        delete m;
+    VecInstr = engine.GetVectorInstructions();
+    ScalarInstr = engine.GetScalarInstructions();
+}
+
+// Dump the registers in four columns.
+void DumpRegisters(const uint32_t *Registers)
+{
+    char buf[32];
+
+    for (int i = 0; i < NUMREGS; i++) {
+        snprintf(buf, sizeof(buf), "R%-2d 0x%08x%s", i, Registers[i], ((i & 3) == 3) ? "\n" : "   ");
+        std::cerr << buf;
+    }
+}
+
+// Read an entire file into a string. Returns true on error.
+bool ReadWholeFile(const std::string &Name, std::string &Contents)
+{
+    std::ifstream infile(Name, std::ios::in | std::ios::binary);
+
+    if (!infile.is_open())
+        return true;
+    std::ostringstream buf;
+    buf << infile.rdbuf();
+    Contents = buf.str();
+    return false;
+}
+
+// Parse the manifest into a list of jobs. Returns true on error, after saying why.
+bool ReadManifest(const std::string &Name, std::vector<BatchJob> &Jobs)
+{
+    std::ifstream infile(Name, std::ios::in);
+    std::filesystem::path base = std::filesystem::path(Name).parent_path();
+    std::string line;
+    int linenum {0};
+
+    if (!infile.is_open()) {
+        std::cerr << "Error opening " << Name << "\n";
+        return true;
+    }
+    while (std::getline(infile, line)) {
+        std::istringstream words(line);
+        std::string word;
+        BatchJob job;
+
+        linenum++;
+        if (!(words >> job.Name) || (job.Name[0] == '*') || (job.Name[0] == '#'))
+            continue;
+        while (words >> word) {
+            auto eq = word.find('=');
+            std::string key = word.substr(0, eq);
+            std::string value = (eq == std::string::npos) ? "" : word.substr(eq + 1);
+            std::string path = value.empty() ? "" : (base / value).string();
+
+            if (value.empty()) {
+                std::cerr << Name << ":" << linenum << ": expected key=value, got " << word << "\n";
+                return true;
+            }
+            if (key == "bin") {
+                job.Binary = path;
+            } else if (key == "deck") {
+                job.Deck = path;
+            } else if (key == "boot") {
+                job.Boot = path;
+            } else if (key == "in") {
+                job.Input = path;
+            } else if (key == "disk") {
+                job.Disk = path;
+            } else if (key == "print") {
+                job.ExpectPrint = path;
+            } else if (key == "punch") {
+                job.ExpectPunch = path;
+            } else if ((key == "cycles") || (key == "took")) {
+                try {
+                    (key == "cycles" ? job.MaxCycles : job.ExpectCycles) = std::stoull(value, nullptr, 0);
+                } catch (...) {
+                    std::cerr << Name << ":" << linenum << ": bad cycle count " << value << "\n";
+                    return true;
+                }
+            } else {
+                std::cerr << Name << ":" << linenum << ": unknown key " << key << "\n";
+                return true;
+            }
+        }
+        if (job.Binary.empty() + job.Deck.empty() + job.Boot.empty() != 2) {
+            std::cerr << Name << ":" << linenum << ": job needs exactly one of bin, deck or boot\n";
+            return true;
+        }
+        Jobs.push_back(job);
+    }
+    return false;
+}
+
+// Compare a finished job's output against what the manifest expects, and note any difference in the
+// result's error.
+void CheckJob(const BatchJob &Job, const std::string &Printed, const std::string &Punched, BatchResult &Result)
+{
+    std::string expected;
+
+    if (Result.Status != EXIT_HALTED)
+        return;
+    if (!Job.ExpectPrint.empty()) {
+        if (ReadWholeFile(Job.ExpectPrint, expected))
+            Result.Error = "error opening " + Job.ExpectPrint;
+        else if (Printed != expected)
+            Result.Error = "printer output differs from " + Job.ExpectPrint;
+    }
+    if (Result.Error.empty() && !Job.ExpectPunch.empty()) {
+        if (ReadWholeFile(Job.ExpectPunch, expected))
+            Result.Error = "error opening " + Job.ExpectPunch;
+        else if (Punched != expected)
+            Result.Error = "punched cards differ from " + Job.ExpectPunch;
+    }
+    if (Result.Error.empty() && (Job.ExpectCycles != 0) && (Result.Cycles != Job.ExpectCycles))
+        Result.Error = "took " + std::to_string(Result.Cycles) + " cycles, expected " +
+                       std::to_string(Job.ExpectCycles);
+}
+
+// Run a job again on its own, and make sure it comes out exactly the same as it did in lockstep.
+void VerifyJob(const BatchJob &Job, const std::string &Printed, const std::string &Punched, BatchResult &Result)
+{
+    std::ostringstream printed, punched;
+    BatchResult scalar;
+    std::string diff;
+
+    RunJob(Job, printed, Job.ExpectPunch.empty() ? nullptr : &punched, scalar);
+    if (scalar.Status != Result.Status)
+        diff = "exit status";
+    else if (scalar.Cycles != Result.Cycles)
+        diff = "cycle count";
+    else if (!std::equal(scalar.Registers, scalar.Registers + NUMREGS, Result.Registers))
+        diff = "registers";
+    else if (printed.str() != Printed)
+        diff = "printer output";
+    else if (punched.str() != Punched)
+        diff = "punched cards";
+    if (!diff.empty()) {
+        Result.Status = EXIT_ERROR;
+        Result.Error = "lockstep " + diff + " differs from a scalar run";
+    }
+}
+
+// Run the jobs in lockstep groups: jobs with the same program and cycle limit, up to LOCKSTEP_MAX_LANES
+// at a time. Each group is one task for the pool. A job with a disk gets a group to itself, since the
+// other lanes would need disks of their own anyway.
+void AddLockstepGroups(std::vector<BatchJob> &Jobs, std::vector<BatchResult> &Results, bool Verify,
+                       std::vector<uint64_t> &Counts, WorkPool &Pool)
+{
+    std::vector<std::vector<std::size_t>> groups;
+    std::vector<std::string> keys;
+
+    for (std::size_t i = 0; i < Jobs.size(); i++) {
+        std::string key = Jobs[i].Binary + "|" + Jobs[i].Deck + "|" + Jobs[i].Boot + "|" +
+                          std::to_string(Jobs[i].MaxCycles);
+        if (!Jobs[i].Disk.empty())
+            key += "|" + std::to_string(i);
+        std::size_t g;
+        for (g = 0; g < groups.size(); g++)
+            if ((keys[g] == key) && (groups[g].size() < LOCKSTEP_MAX_LANES))
+                break;
+        if (g == groups.size()) {
+            groups.emplace_back();
+            keys.push_back(key);
+        }
+        groups[g].push_back(i);
+    }
+    Counts.assign(groups.size() * 2, 0);
+    for (std::size_t g = 0; g < groups.size(); g++) {
+        Pool.Add([&Jobs, &Results, &Counts, Verify, group = groups[g], g] {
+            std::size_t n = group.size();
+            std::vector<std::ostringstream> printed(n), punched(n);
+            std::vector<const BatchJob *> jobs;
+            std::vector<std::ostream *> printout, punchout;
+            std::vector<BatchResult *> results;
+
+            for (std::size_t i = 0; i < n; i++) {
+                jobs.push_back(&Jobs[group[i]]);
+                printout.push_back(&printed[i]);
+                punchout.push_back(Jobs[group[i]].ExpectPunch.empty() ? nullptr : &punched[i]);
+                results.push_back(&Results[group[i]]);
+            }
+            RunGroup(jobs, printout, punchout, results, Counts[g * 2], Counts[g * 2 + 1]);
+            for (std::size_t i = 0; i < n; i++) {
+                if (Verify)
+                    VerifyJob(*jobs[i], printed[i].str(), punched[i].str(), *results[i]);
+                CheckJob(*jobs[i], printed[i].str(), punched[i].str(), *results[i]);
+            }
+        });
+    }
+}
+
+// Run every job in the manifest through the work pool, then report the results in manifest order.
+// Merge the coverage of jobs that ran the same program, and write one file for each program to CoverDir,
+// named after the program. Returns true on error.
+static bool WriteManifestCoverage(const std::vector<BatchJob> &Jobs, std::vector<CoverHooks> &Covers,
+                                  const std::string &CoverDir)
+{
+    std::map<std::string, Coverage> merged;
+    for (std::size_t i = 0; i < Jobs.size(); i++) {
+        Coverage &c = merged[ProgramFile(Jobs[i])];
+        c.Merge(Covers[i].Cover);
+        c.SetProgram(std::filesystem::path(ProgramFile(Jobs[i])).filename().string());
+    }
+    std::filesystem::create_directories(CoverDir);
+    for (auto &m : merged) {
+        std::string name = (std::filesystem::path(CoverDir) / m.second.GetProgram()).string() + ".cov";
+        std::ofstream out(name, std::ios::out | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Error opening " << name << "\n";
+            return true;
+        }
+        m.second.Write(out);
+    }
+    std::cout << "coverage for " << merged.size() << " programs written to " << CoverDir << "\n";
+    return false;
+}
+
+int RunManifest(const std::string &Name, unsigned Threads, bool UseLockstep, bool Verify,
+                const std::string &CoverDir)
+{
+    std::vector<BatchJob> jobs;
+    std::vector<uint64_t> counts;
+
+    if (ReadManifest(Name, jobs))
+        return EXIT_ERROR;
+
+    std::vector<BatchResult> results(jobs.size());
+    std::vector<CoverHooks> covers(CoverDir.empty() ? 0 : jobs.size());
+    WorkPool pool(Threads);
+    if (UseLockstep) {
+        AddLockstepGroups(jobs, results, Verify, counts, pool);
+    } else {
+        for (std::size_t i = 0; i < jobs.size(); i++) {
+            pool.Add([&jobs, &results, &covers, i] {
+                std::ostringstream printed, punched;
+
+                RunJob(jobs[i], printed, jobs[i].ExpectPunch.empty() ? nullptr : &punched, results[i],
+                       covers.empty() ? nullptr : &covers[i]);
+                CheckJob(jobs[i], printed.str(), punched.str(), results[i]);
+            });
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    pool.Run();
+    auto stop = std::chrono::steady_clock::now();
+
+    int passed {0};
+    uint64_t cycles {0};
+    uint64_t privpages {0}, sharedpages {0};
+    char buf[256];
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+        BatchResult &r = results[i];
+        bool pass = (r.Status == EXIT_HALTED) && r.Error.empty();
+        snprintf(buf, sizeof(buf), "%s %-24s %12llu cycles %9.3f s %8.2f MIPS", pass ? "PASS" : "FAIL",
+                 jobs[i].Name.c_str(), (unsigned long long)r.Cycles, r.Secs,
+                 (r.Secs > 0) ? (r.Cycles / r.Secs / 1e6) : 0.0);
+        std::cout << buf;
+        if (!pass)
+            std::cout << "  " << r.Error;
+        std::cout << "\n";
+        passed += pass;
+        cycles += r.Cycles;
+        privpages += r.Pages.Private;
+        sharedpages += r.Pages.Shared;
+    }
+    double secs = std::chrono::duration<double>(stop - start).count();
+    snprintf(buf, sizeof(buf), "%d of %zu jobs passed, %llu cycles in %.3f s on %u threads, %.2f MIPS\n",
+             passed, jobs.size(), (unsigned long long)cycles, secs, pool.GetThreads(),
+             (secs > 0) ? (cycles / secs / 1e6) : 0.0);
+    std::cout << buf;
+    snprintf(buf, sizeof(buf), "memory: %llu private pages, %llu shared between jobs (%u words each)\n",
+             (unsigned long long)privpages, (unsigned long long)sharedpages, MEM_PAGE_WORDS);
+    std::cout << buf;
+    if (UseLockstep) {
+        uint64_t vec {0}, total {0};
+        for (std::size_t g = 0; g < counts.size(); g += 2) {
+            vec += counts[g];
+            total += counts[g] + counts[g + 1];
+        }
+        snprintf(buf, sizeof(buf), "%.1f%% of instructions ran in lockstep\n",
+                 (total > 0) ? (100.0 * vec / total) : 0.0);
+        std::cout << buf;
+    }
+    if (!covers.empty() && WriteManifestCoverage(jobs, covers, CoverDir))
+        return EXIT_ERROR;
+    return (passed == (int)jobs.size()) ? EXIT_HALTED : EXIT_JOBS_FAILED;
+}
+
+// Send a job to a serve6k server and collect its output, as RunJob() would have produced locally.
+// See jobsocket.hpp for the protocol.
+void SubmitJob(const std::string &Socket, const BatchJob &Job, std::ostream &PrintOut, std::ostream *PunchOut,
+               BatchResult &Result)
+{
+    std::string request, contents, line;
+    std::string progname = !Job.Binary.empty() ? Job.Binary : (!Job.Deck.empty() ? Job.Deck : Job.Boot);
+
+    Result.Status = EXIT_ERROR;
+    if (ReadWholeFile(progname, contents)) {
+        Result.Error = "error opening " + progname;
+        return;
+    }
+    request = (!Job.Binary.empty() ? "bin " : (!Job.Deck.empty() ? "deck " : "boot ")) +
+              std::to_string(contents.size()) + "\n" + contents;
+    if (!Job.Input.empty()) {
+        if (ReadWholeFile(Job.Input, contents)) {
+            Result.Error = "error opening " + Job.Input;
+            return;
+        }
+        request += "in " + std::to_string(contents.size()) + "\n" + contents;
+    }
+    request += "cycles " + std::to_string(Job.MaxCycles) + "\n";
+    if (PunchOut != nullptr)
+        request += "punch\n";
+    request += "run\n";
+
+    int fd = ConnectJobSocket(Socket);
+    if (fd < 0) {
+        Result.Error = "can't connect to " + Socket;
+        return;
+    }
+    JobSocket sock(fd);
+    auto start = std::chrono::steady_clock::now();
+    if (!sock.Write(request)) {
+        Result.Error = "lost connection to " + Socket;
+        return;
+    }
+    while (sock.ReadLine(line)) {
+        std::size_t sp = line.find(' ');
+        std::string key = line.substr(0, sp);
+        std::string rest = (sp == std::string::npos) ? "" : line.substr(sp + 1);
+        std::istringstream words(rest);
+
+        if (key == "print") {
+            PrintOut << rest << "\n";
+        } else if (key == "punch") {
+            if (PunchOut != nullptr)
+                *PunchOut << rest << "\n";
+        } else if (key == "regs") {
+            for (int i = 0; i < NUMREGS; i++)
+                words >> std::hex >> Result.Registers[i];
+        } else if (key == "pages") {
+            words >> Result.Pages.Private >> Result.Pages.Shared >> Result.Pages.Zero;
+        } else if (key == "done") {
+            unsigned long long cycles {0};
+            words >> Result.Status >> cycles;
+            Result.Cycles = cycles;
+            std::getline(words >> std::ws, Result.Error);
+            Result.Secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return;
+        }
+    }
+    Result.Status = EXIT_ERROR;
+    Result.Error = "lost connection to " + Socket;
+}
+
+int main(int argc, char *argv[])
+{
+    BatchJob job;
+    std::string punchname, printname, manifest, server, statsname, profname, mapname, callname, foldname,
+                tracename, timename, covername, hostname;
+    uint64_t interval {PROFILE_DEFAULT_INTERVAL};
+    uint64_t hostsample {0};
+    unsigned threads {0};
+    bool quiet {false};
+    bool lockstep {false};
+    bool verify {false};
+
+    for (auto i = 1; i < argc; i++) {
+        std::string TmpArg = argv[i];
+        std::string *target {nullptr};
+
+        if (TmpArg == "-q") {
+            quiet = true;
+            continue;
+        }
+        if ((TmpArg == "-l") || (TmpArg == "--lockstep")) {
+            lockstep = true;
+            continue;
+        }
+        if (TmpArg == "--verify") {
+            verify = true;
+            continue;
+        }
+        if ((TmpArg == "-m") || (TmpArg == "--max-cycles") || (TmpArg == "-t") || (TmpArg == "--sample") ||
+            (TmpArg == "--hostperf-sample")) {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            try {
+                if (TmpArg == "-t")
+                    threads = std::stoul(argv[i], nullptr, 0);
+                else if (TmpArg == "--sample")
+                    interval = std::stoull(argv[i], nullptr, 0);
+                else if (TmpArg == "--hostperf-sample")
+                    hostsample = std::stoull(argv[i], nullptr, 0);
+                else
+                    job.MaxCycles = std::stoull(argv[i], nullptr, 0);
+            } catch (...) {
+                return Usage(argv[0]);
+            }
+            continue;
+        }
+        if (TmpArg == "-b")
+            target = &job.Binary;
+        else if (TmpArg == "-c")
+            target = &job.Deck;
+        else if (TmpArg == "-r")
+            target = &job.Boot;
+        else if (TmpArg == "-i")
+            target = &job.Input;
+        else if (TmpArg == "-p")
+            target = &punchname;
+        else if (TmpArg == "-d")
+            target = &job.Disk;
+        else if (TmpArg == "-o")
+            target = &printname;
+        else if (TmpArg == "-j")
+            target = &manifest;
+        else if (TmpArg == "-S")
+            target = &server;
+        else if (TmpArg == "--stats")
+            target = &statsname;
+        else if (TmpArg == "--profile")
+            target = &profname;
+        else if (TmpArg == "--map")
+            target = &mapname;
+        else if (TmpArg == "--callgraph")
+            target = &callname;
+        else if (TmpArg == "--folded")
+            target = &foldname;
+        else if (TmpArg == "--trace")
+            target = &tracename;
+        else if (TmpArg == "--timeline")
+            target = &timename;
+        else if (TmpArg == "--coverage")
+            target = &covername;
+        else if (TmpArg == "--hostperf")
+            target = &hostname;
+        if (target != nullptr) {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            *target = argv[i];
+            continue;
+        }
+        if ((TmpArg[0] == '-') || !job.Binary.empty())
+            return Usage(argv[0]);
+        job.Binary = TmpArg;
+    }
+
+    bool profiling = !profname.empty() || !callname.empty() || !foldname.empty();
+    bool tracing = !tracename.empty() || !timename.empty();
+    bool counting = !hostname.empty();
+    if (!manifest.empty() && (!statsname.empty() || profiling || tracing || counting)) {
+        std::cerr << "--stats, --trace, --timeline, --hostperf and the profiling options only apply to a single\n";
+        std::cerr << "job.\n";
+        return Usage(argv[0]);
+    }
+    if (lockstep && !covername.empty()) {
+        std::cerr << "Lockstep runs don't record coverage, so --coverage can't be used with -l.\n";
+        return Usage(argv[0]);
+    }
+    if (!manifest.empty())
+        return RunManifest(manifest, threads, lockstep, verify, covername);
+    if (lockstep || verify) {
+        std::cerr << "-l and --verify only apply to manifests.\n";
+        return Usage(argv[0]);
+    }
+
+    if (job.Binary.empty() + job.Deck.empty() + job.Boot.empty() != 2) {
+        std::cerr << "Exactly one of a binary, -c or -r is needed.\n";
+        return Usage(argv[0]);
+    }
+    if (!job.Boot.empty() && !job.Input.empty()) {
+        std::cerr << "The boot deck occupies the scanner, so -i can't be used with -r.\n";
+        return EXIT_ERROR;
+    }
+    if (!server.empty() && !job.Disk.empty()) {
+        std::cerr << "The disk file is on this host, so -d can't be used with -S.\n";
+        return EXIT_ERROR;
+    }
+    bool covering = !covername.empty();
+    if (!server.empty() && (!statsname.empty() || profiling || tracing || covering || counting)) {
+        std::cerr << "The server doesn't send back counters, so --stats, --trace, --timeline, --coverage,\n";
+        std::cerr << "--hostperf and profiling can't be used with -S.\n";
+        return EXIT_ERROR;
+    }
+#ifndef CT6K_TRACE
+    if (!tracename.empty()) {
+        std::cerr << "This build doesn't include tracing, so --trace can't be used.\n";
+        return EXIT_ERROR;
+    }
+#endif
+    if (counting && !profname.empty()) {
+        std::cerr << "The host counters would count the profiler too, so --hostperf can't be used with --profile.\n";
+        return EXIT_ERROR;
+    }
+    if (!counting && hostsample) {
+        std::cerr << "--hostperf-sample is only used with --hostperf.\n";
+        return Usage(argv[0]);
+    }
+    if (!profiling && !mapname.empty()) {
+        std::cerr << "--map is only used when profiling.\n";
+        return Usage(argv[0]);
+    }
+
+    std::ofstream punchfile, printfile;
+    std::ostream *printout = &std::cout;
+    if (!punchname.empty()) {
+        punchfile.open(punchname, std::ios::out | std::ios::trunc);
+        if (!punchfile.is_open()) {
+            std::cerr << "Error opening " << punchname << "\n";
+            return EXIT_ERROR;
+        }
+    }
+    if (!printname.empty()) {
+        printfile.open(printname, std::ios::out | std::ios::trunc);
+        if (!printfile.is_open()) {
+            std::cerr << "Error opening " << printname << "\n";
+            return EXIT_ERROR;
+        }
+        printout = &printfile;
+    }
+
+    std::ofstream proffile, callfile, foldfile, timefile, coverfile, hostfile;
+    ToolHooks *tools {nullptr};
+    if (profiling || tracing || covering || counting) {
+        if (OpenReport(profname, proffile) || OpenReport(callname, callfile) || OpenReport(foldname, foldfile) ||
+            OpenReport(timename, timefile) || OpenReport(covername, coverfile) || OpenReport(hostname, hostfile))
+            return EXIT_ERROR;
+        tools = new ToolHooks;
+        if (!mapname.empty()) {
+            std::ifstream mapfile(mapname);
+            std::string error;
+            if (!mapfile.is_open() || tools->Map.Load(mapfile, mapname, error)) {
+                std::cerr << (error.empty() ? "Error opening " + mapname : error) << "\n";
+                delete tools;
+                return EXIT_ERROR;
+            }
+        }
+        if (!profname.empty()) {
+            tools->Prof = new Profiler(interval);
+            tools->ProfOut = &proffile;
+        }
+        if (!callname.empty() || !foldname.empty()) {
+            tools->Calls = new CallTracker;
+            tools->CallOut = callname.empty() ? nullptr : &callfile;
+            tools->FoldOut = foldname.empty() ? nullptr : &foldfile;
+        }
+        if (!covername.empty()) {
+            tools->Cover = new Coverage;
+            tools->Cover->SetProgram(std::filesystem::path(ProgramFile(job)).filename().string());
+            tools->CoverOut = &coverfile;
+        }
+        if (!timename.empty()) {
+            tools->Timeline = new DeviceTimeline;
+            tools->TimelineOut = &timefile;
+        }
+        if (counting) {
+            std::string error;
+            tools->Host = new HostCounters(hostsample);
+            tools->HostOut = &hostfile;
+            if (tools->Host->Open(error)) {
+                std::cerr << error << "\n";
+                delete tools;
+                return EXIT_ERROR;
+            }
+        }
+        if (!tracename.empty()) {
+            std::string error;
+            tools->Trace = new TraceRecorder;
+            if (tools->Trace->Open(tracename, error)) {
+                std::cerr << error << "\n";
+                delete tools;
+                return EXIT_ERROR;
+            }
+        }
+    }
+
+    BatchResult result;
+    if (!server.empty())
+        SubmitJob(server, job, *printout, punchname.empty() ? nullptr : &punchfile, result);
+    else
+        RunJob(job, *printout, punchname.empty() ? nullptr : &punchfile, result, tools);
+    delete tools;
+    printout->flush();
+    if ((result.Status == EXIT_ERROR) && !result.Error.empty()) {
+        std::cerr << result.Error << "\n";
+        return result.Status;
+    }
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s at 0x%08x after %llu cycles, %.3f s, %.2f MIPS\n",
+             result.Error.empty() ? "halted" : result.Error.c_str(), result.Registers[REG_IP],
+             (unsigned long long)result.Cycles, result.Secs,
+             (result.Secs > 0) ? (result.Cycles / result.Secs / 1e6) : 0.0);
+    std::cerr << buf;
+    if (!quiet) {
+        snprintf(buf, sizeof(buf), "memory: %u pages written, %u never touched\n", result.Pages.Private,
+                 result.Pages.Zero);
+        std::cerr << buf;
+        DumpRegisters(result.Registers);
+    }
+    if (!statsname.empty()) {
+        std::ofstream statsfile(statsname, std::ios::out | std::ios::trunc);
+        if (!statsfile.is_open()) {
+            std::cerr << "Error opening " << statsname << "\n";
+            return EXIT_ERROR;
+        }
+        WriteStatsJSON(statsfile, result.Stats, result.Cycles);
+    }
+    return result.Status;
+}
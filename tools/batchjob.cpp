@@ -0,0 +1,275 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// batchjob.cpp - definitions for running jobs without a UI.
+
+#include <chrono>
+#include <filesystem>
+#include "batchjob.hpp"
+#include "loadprog.h"
+
+// Read and return a 32-bit word from an array of bytes, MSB first.
+static uint32_t FillWordFromMSB(uint8_t *Buf)
+{
+    uint32_t retval {0};
+    for (auto i = 24, j = 0; i >= 0; i -= 8, j++) // ugly magic numbers
+        retval |= (uint32_t)Buf[j] << i;
+    return retval;
+}
+
+// Load a program from a binary image at address 0. Name is only used in error messages.
+// Returns true on error, with the reason in Error.
+bool LoadBinary(std::istream &In, const std::string &Name, CPU *C, std::string &Error)
+{
+    uint8_t buffer[sizeof(uint32_t)];
+    uint32_t loc {0};
+
+    while (In.read((char *)buffer, sizeof(uint32_t)))
+        C->WriteMem(loc++, FillWordFromMSB(buffer));
+    if (In.gcount() != 0) {
+        Error = "error reading " + Name + ": length is not a whole number of words";
+        return true;
+    }
+    C->WriteReg(REG_IP, 0);
+    return false;
+}
+
+// Load a card deck straight into memory, doing the loader ROM's job on the host. Only code cards are
+// allowed. The first word of each card is its load address, and execution starts at the first card.
+// Name is only used in error messages.
+// Returns true on error, with the reason in Error.
+bool LoadDeck(std::istream &In, const std::string &Name, CPU *C, std::string &Error)
+{
+    bool first {true};
+    char open, type, close;
+    uint32_t len, addr, word;
+
+    while (In >> open) {
+        if (!(In >> type >> close >> std::dec >> len) || (open != '<') || (close != '>')) {
+            Error = Name + ": bad card header";
+            return true;
+        }
+        if (type != 'C') {
+            Error = Name + ": only code cards can be loaded directly, use -r to boot this deck";
+            return true;
+        }
+        if ((len == 0) || (len > MAX_CARD_LEN) || !(In >> std::hex >> addr)) {
+            Error = Name + ": bad card length";
+            return true;
+        }
+        if (first) {
+            C->WriteReg(REG_IP, addr);
+            first = false;
+        }
+        for (uint32_t i = 1; i < len; i++) {
+            if (!(In >> std::hex >> word)) {
+                Error = Name + ": card is short";
+                return true;
+            }
+            C->WriteMem(addr++, word);
+        }
+    }
+    if (first) {
+        Error = Name + ": no cards in deck";
+        return true;
+    }
+    return false;
+}
+
+// All the devices are in instant mode, so a job takes the same number of cycles however often the
+// host looks at it.
+JobMachine::JobMachine()
+{
+    Core.AddDevice(&Printer);
+    Core.AddDevice(&Punch);
+    Core.AddDevice(&Scanner);
+    Core.AddROM(ROMImage, ROM_START, sizeof(ROMImage) / sizeof(ROMImage[0]));
+    Printer.SetInstant(true);
+    Scanner.SetInstant(true);
+    Punch.SetInstant(true);
+}
+
+JobMachine::~JobMachine()
+{
+    DetachDisk();
+}
+
+// Connect a Stor-o-Tron using the named data file. A file that doesn't exist yet is created at full
+// size, reading as all zeros, like a freshly formatted drum.
+// Returns true on error, with the reason in Error.
+bool JobMachine::AttachDisk(const std::string &Name, std::string &Error)
+{
+    std::error_code ec;
+
+    if (!std::filesystem::exists(Name, ec)) {
+        std::ofstream create(Name, std::ios::out | std::ios::binary);
+        create.close();
+        std::filesystem::resize_file(Name, SOT_FILE_SIZE, ec);
+        if (ec) {
+            Error = "error creating " + Name;
+            return true;
+        }
+    }
+    DiskFile.open(Name, std::ios::in | std::ios::out | std::ios::binary);
+    if (!DiskFile.is_open()) {
+        Error = "error opening " + Name;
+        return true;
+    }
+    Disk = new StorOTron(&DiskFile);
+    Disk->SetInstant(true);
+    Disk->PowerOnReset();
+    Core.AddDevice(Disk);
+    return false;
+}
+
+void JobMachine::DetachDisk()
+{
+    if (Disk == nullptr)
+        return;
+    Core.RemoveDevice(Disk);
+    delete Disk;
+    Disk = nullptr;
+    DiskFile.close();
+    DiskFile.clear();
+}
+
+// Load the job's program and input. The punch is only loaded with cards if PunchOut is given.
+// If Template is given, it has already loaded the same program, and this machine shares its memory
+// instead of loading another copy.
+// Returns true on error, with the reason in Error.
+bool JobMachine::Load(const BatchJob &Job, std::ostream *PunchOut, std::string &Error, JobMachine *Template)
+{
+    std::string inname = Job.Input;
+    std::string progname = Job.Binary.empty() ? Job.Deck : Job.Binary;
+
+    if (Template != nullptr) {
+        Core.CloneMemory(Template->Core);
+        Core.WriteReg(REG_IP, Template->Core.ReadReg(REG_IP));
+    } else if (!progname.empty()) {
+        std::ifstream prog(progname, std::ios::in | std::ios::binary);
+        if (!prog.is_open()) {
+            Error = "error opening " + progname;
+            return true;
+        }
+        if (!Job.Binary.empty() ? LoadBinary(prog, progname, &Core, Error) : LoadDeck(prog, progname, &Core, Error))
+            return true;
+    }
+    if (!Job.Boot.empty())
+        inname = Job.Boot;
+    if (!inname.empty()) {
+        InFile.open(inname, std::ios::in);
+        if (!InFile.is_open()) {
+            Error = "error opening " + inname;
+            return true;
+        }
+        if (!Job.Boot.empty())
+            Boot(InFile);
+        else
+            Scanner.SetInFile(&InFile);
+    }
+    if (PunchOut != nullptr)
+        Punch.SetOutFile(PunchOut);
+    if (!Job.Disk.empty() && AttachDisk(Job.Disk, Error))
+        return true;
+    return false;
+}
+
+// Put a deck in the scanner and start at the loader ROM, which will read it in.
+void JobMachine::Boot(std::istream &Deck)
+{
+    Scanner.SetInFile(&Deck);
+    Core.WriteReg(REG_IP, ROM_START);
+}
+
+// Run up to BATCH_CHUNK_CYCLES more cycles, stopping at MaxCycles in all, then empty the printer.
+// BRK has no meaning without a debugger, so it just continues. Hooks, if given, does the running.
+// Returns true if there is more to run.
+bool JobMachine::RunChunk(uint64_t MaxCycles, std::ostream &PrintOut, JobHooks *Hooks)
+{
+    if (Core.IsHalted() || (Core.GetCycles() >= MaxCycles))
+        return false;
+    uint64_t left = MaxCycles - Core.GetCycles();
+    uint64_t chunk = (left < BATCH_CHUNK_CYCLES) ? left : BATCH_CHUNK_CYCLES;
+    if (Hooks != nullptr)
+        Hooks->Run(Core, chunk);
+    else
+        Core.Run(chunk);
+    DrainPrinter(PrintOut);
+    return !Core.IsHalted() && (Core.GetCycles() < MaxCycles);
+}
+
+void JobMachine::DrainPrinter(std::ostream &PrintOut)
+{
+    while (Printer.IsOutputReady())
+        PrintOut << Printer.GetOutputLine() << "\n";
+}
+
+// Fill in the result once the job has stopped, one way or another.
+void JobMachine::Finish(uint64_t Cycles, BatchResult &Result)
+{
+    if (!Core.IsHalted()) {
+        Result.Status = EXIT_CYCLE_LIMIT;
+        Result.Error = "cycle limit reached";
+    } else if (Core.IsFlagSet(FLG_FAULT)) {
+        Result.Status = EXIT_FAULT;
+        Result.Error = "halted in fault handler";
+    } else {
+        Result.Status = EXIT_HALTED;
+        Result.Error.clear();
+    }
+    Result.Cycles = Cycles;
+    for (int i = 0; i < NUMREGS; i++)
+        Result.Registers[i] = Core.ReadReg(i);
+    Result.Pages = Core.GetMemPageCounts();
+    Result.Stats = Core.GetStats();
+}
+
+// Put the machine back the way it was when it was built, ready for another job. Memory goes back to
+// all zero pages, so this is cheap.
+void JobMachine::Reset()
+{
+    Core.Reset();
+    Printer.PowerOnReset();
+    Scanner.PowerOnReset();
+    Punch.PowerOnReset();
+    if (InFile.is_open())
+        InFile.close();
+    InFile.clear();
+    DetachDisk();
+}
+
+// Run one job on a machine of its own. Safe to call from many threads at once.
+// Printer output goes to PrintOut. The punch is only loaded with cards if PunchOut is given.
+void RunJob(const BatchJob &Job, std::ostream &PrintOut, std::ostream *PunchOut, BatchResult &Result,
+            JobHooks *Hooks)
+{
+    JobMachine m;
+
+    Result.Status = EXIT_ERROR;
+    if (m.Load(Job, PunchOut, Result.Error))
+        return;
+    if (Hooks != nullptr)
+        Hooks->Start(m.Core);
+    auto start = std::chrono::steady_clock::now();
+    while (m.RunChunk(Job.MaxCycles, PrintOut, Hooks))
+        ;
+    auto stop = std::chrono::steady_clock::now();
+    m.Finish(m.Core.GetCycles(), Result);
+    if (Hooks != nullptr)
+        Hooks->Finish(m.Core);
+    Result.Secs = std::chrono::duration<double>(stop - start).count();
+}
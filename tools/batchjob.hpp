@@ -0,0 +1,107 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// batchjob.hpp - running one program to completion on a machine of its own, without a UI.
+// Shared by batch6k and serve6k.
+#ifndef __BATCHJOB_HPP__
+#define __BATCHJOB_HPP__
+
+#include <cstdint>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include "arch.h"
+#include "cpu.hpp"
+#include "printotron.hpp"
+#include "cardotron.hpp"
+#include "storotron.hpp"
+
+#define BATCH_CHUNK_CYCLES 1024 // cycles to run between emptying the printer
+#define DEFAULT_MAX_CYCLES 1000000000ULL
+
+// Exit codes, so scripts can tell what happened.
+#define EXIT_HALTED 0
+#define EXIT_ERROR 1
+#define EXIT_CYCLE_LIMIT 2
+#define EXIT_FAULT 3
+#define EXIT_JOBS_FAILED 4
+
+// One program run: what to load, what goes in the scanner, and how long it may take.
+struct BatchJob {
+    std::string Name;
+    std::string Binary;         // exactly one of these three
+    std::string Deck;
+    std::string Boot;
+    std::string Input;
+    std::string Disk;           // Stor-o-Tron data file, created if it doesn't exist
+    std::string ExpectPrint;    // manifest mode only
+    std::string ExpectPunch;
+    uint64_t ExpectCycles {0};  // manifest mode only, 0 if any cycle count will do
+    uint64_t MaxCycles {DEFAULT_MAX_CYCLES};
+};
+
+struct BatchResult {
+    int Status {EXIT_ERROR};
+    std::string Error;
+    uint64_t Cycles {0};
+    double Secs {0};
+    uint32_t Registers[NUMREGS] {0};
+    MemPageCounts Pages {0, 0, 0};
+    CPUStats Stats {};          // not filled in by lockstep runs or a server
+};
+
+// Optional instrumentation for a job, such as a profiler. Start() is called once the job is loaded,
+// Run() stands in for CPU::Run() for each chunk, and Finish() is called once the job has stopped, while
+// the machine is still intact.
+class JobHooks {
+public:
+    virtual ~JobHooks() {}
+    virtual void Start(CPU &C) { (void)C; }
+    virtual uint64_t Run(CPU &C, uint64_t MaxCycles) { return C.Run(MaxCycles); }
+    virtual void Finish(CPU &C) { (void)C; }
+};
+
+// A machine of its own for one job: a CPU, memory and set of devices, sharing nothing with any other
+// job except the read-only ROM image and opcode map. The input file comes first, so it outlives the
+// scanner that closes it on destruction. The Stor-o-Tron is only there for jobs that ask for a disk.
+struct JobMachine {
+    std::ifstream InFile;
+    std::fstream DiskFile;
+    CPU Core;
+    PrintOTron Printer;
+    CardOTronScan Scanner;
+    CardOTronPunch Punch;
+    StorOTron *Disk {nullptr};
+
+    JobMachine();
+    ~JobMachine();
+    bool AttachDisk(const std::string &Name, std::string &Error);
+    void DetachDisk();
+    bool Load(const BatchJob &Job, std::ostream *PunchOut, std::string &Error, JobMachine *Template = nullptr);
+    void Boot(std::istream &Deck);
+    bool RunChunk(uint64_t MaxCycles, std::ostream &PrintOut, JobHooks *Hooks = nullptr);
+    void DrainPrinter(std::ostream &PrintOut);
+    void Finish(uint64_t Cycles, BatchResult &Result);
+    void Reset();
+};
+
+bool LoadBinary(std::istream &In, const std::string &Name, CPU *C, std::string &Error);
+bool LoadDeck(std::istream &In, const std::string &Name, CPU *C, std::string &Error);
+void RunJob(const BatchJob &Job, std::ostream &PrintOut, std::ostream *PunchOut, BatchResult &Result,
+            JobHooks *Hooks = nullptr);
+
+#endif // __BATCHJOB_HPP__
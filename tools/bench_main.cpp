@@ -0,0 +1,468 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// bench_main.cpp - microbenchmarks for the Comp-o-Tron 6000 emulator core and tools.
+// Each benchmark runs a fixed piece of work enough times to take a measurable while, then reports
+// the median of several runs as nanoseconds and operations per second. Results go out as JSON, so
+// they can be saved and compared from one version to the next, and as a table on stderr for people.
+// Inputs are generated with fixed seeds, so every run measures the same work.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include "arch.h"
+#include "hw.h"
+#include "cpu.hpp"
+#include "memory.hpp"
+#include "instruction.hpp"
+#include "printotron.hpp"
+#include "cardotron.hpp"
+
+#define BENCH_MIN_SECS 0.05     // a single timed run should take at least this long
+#define BENCH_REPEATS 5         // timed runs per benchmark; the median is reported
+#define BENCH_SEED 6000
+#define BENCH_STEPS 1000        // CPU steps per call
+#define BENCH_MEM_OPS 4096      // memory accesses per call
+#define BENCH_PROG_BASE 0x100
+#define BENCH_PROG_COPIES 1024  // copies of the instruction under test
+#define BENCH_DATA 0x8000       // indirect operands point here
+#define BENCH_STACK 0x10000
+#define BENCH_PT_BASE 0x20000   // identity page table for the MMU benchmarks
+#define BENCH_ROM_BASE 0xFFC00000
+#define BENCH_ROM_LEN 4096
+#define BENCH_DEV0_BASE (BASE_IO_MEM + 0x10000) // where the CPU puts the first device added
+#define BENCH_CARDS 512
+#define BENCH_ASM_LINES 50000
+
+struct BenchResult {
+    std::string Name;
+    uint64_t Ops;           // operations in one timed run
+    double NsPerOp;
+    double OpsPerSec;
+};
+
+static std::vector<BenchResult> Results;
+static std::string Filter;
+static int Repeats {BENCH_REPEATS};
+static double MinSecs {BENCH_MIN_SECS};
+static volatile uint32_t Sink; // keeps the compiler from throwing away work whose result isn't used
+
+// Time Fn, which does OpsPerCall operations each time it is called. Calls are doubled until one run
+// takes at least MinSecs, then Repeats runs are timed and the median kept.
+template <typename F>
+static void Bench(const std::string &Name, uint64_t OpsPerCall, F Fn)
+{
+    if (!Filter.empty() && (Name.find(Filter) == std::string::npos))
+        return;
+    uint64_t calls {1};
+    double secs;
+    auto timeit = [&] {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < calls; i++)
+            Fn();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    while (((secs = timeit()) < MinSecs) && (calls < (1ULL << 40)))
+        calls *= 2;
+    std::vector<double> runs;
+    for (int i = 0; i < Repeats; i++)
+        runs.push_back(timeit());
+    std::sort(runs.begin(), runs.end());
+    secs = runs[runs.size() / 2];
+
+    BenchResult r;
+    r.Name = Name;
+    r.Ops = calls * OpsPerCall;
+    r.NsPerOp = secs * 1e9 / r.Ops;
+    r.OpsPerSec = r.Ops / secs;
+    Results.push_back(r);
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%-36s %12.2f ns/op %14.0f ops/s\n", Name.c_str(), r.NsPerOp, r.OpsPerSec);
+    std::cerr << buf;
+}
+
+// Assemble one line, with %NEXT replaced by the address of the following instruction.
+// Returns the number of words written.
+static uint32_t PutInstruction(CPU &C, uint32_t Addr, std::string Text)
+{
+    uint32_t extra;
+    bool present {false};
+
+    for (int pass = 0; pass < 2; pass++) {
+        std::string line = Text;
+        auto pos = line.find("%NEXT");
+        if (pos != std::string::npos)
+            line.replace(pos, 5, std::to_string(Addr + (present ? 2 : 1)));
+        uint32_t word = BuildInstruction(line, extra, present);
+        if ((pos == std::string::npos) || (pass == 1)) {
+            C.WriteMem(Addr, word);
+            if (present)
+                C.WriteMem(Addr + 1, extra);
+            return present ? 2 : 1;
+        }
+    }
+    return 0;
+}
+
+// Load a program made of the prologue, then many copies of the body, then a jump back to the first
+// copy, and run the prologue. Stepping the CPU from there executes almost nothing but the body.
+static void LoadRepeated(CPU &C, const std::vector<std::string> &Prologue, const std::vector<std::string> &Body)
+{
+    uint32_t addr = BENCH_PROG_BASE;
+
+    C.WriteReg(REG_R1, BENCH_DATA);
+    C.WriteReg(REG_R2, 5);
+    C.WriteReg(REG_R3, BENCH_DATA + 1);
+    C.WriteReg(REG_R5, 0xFFFFFFFF);
+    C.WriteReg(REG_R7, BENCH_PROG_BASE);
+    C.WriteReg(REG_SP, BENCH_STACK);
+    for (auto &line : Prologue)
+        addr += PutInstruction(C, addr, line);
+    uint32_t body = addr;
+    for (int i = 0; i < BENCH_PROG_COPIES; i++)
+        for (auto &line : Body)
+            addr += PutInstruction(C, addr, line);
+    PutInstruction(C, addr, "JMP " + std::to_string(body));
+    C.WriteReg(REG_IP, BENCH_PROG_BASE);
+    for (std::size_t i = 0; i < Prologue.size(); i++)
+        C.Step();
+}
+
+static void BenchStep(const std::string &Name, const std::vector<std::string> &Body,
+                      const std::vector<std::string> &Prologue = {})
+{
+    if (!Filter.empty() && (("step/" + Name).find(Filter) == std::string::npos))
+        return;
+    CPU c;
+    LoadRepeated(c, Prologue, Body);
+    Bench("step/" + Name, BENCH_STEPS, [&] {
+        for (int i = 0; i < BENCH_STEPS; i++)
+            c.Step();
+    });
+    if (c.IsHalted())
+        std::cerr << "step/" << Name << ": CPU halted, result is meaningless\n";
+}
+
+// A mix of valid instruction words, as a program would have.
+static std::vector<uint32_t> MakeInstructionMix()
+{
+    const char *lines[] = {"NOP", "MOVE R1, R2", "MOVE I1, R2", "MOVE 1234, R2", "ADD R1, R2, R3",
+                           "SUB I1, R2, I3", "INCR R4", "DECR I4", "CMP R1, R2", "JMP R7", "JZERO 100",
+                           "CALL R7", "RETURN", "PUSH R1", "POP R2", "LOOP R5, 100", "SHIFTL R1, R2, R3"};
+    std::vector<uint32_t> words;
+    std::mt19937 rng(BENCH_SEED);
+
+    for (int i = 0; i < 4096; i++) {
+        uint32_t extra;
+        bool present;
+        words.push_back(BuildInstruction(lines[rng() % (sizeof(lines) / sizeof(lines[0]))], extra, present));
+    }
+    return words;
+}
+
+static void BenchDecode()
+{
+    std::vector<uint32_t> words = MakeInstructionMix();
+
+    Bench("decode/instruction", words.size(), [&] {
+        uint32_t acc {0};
+        for (auto w : words) {
+            auto i = new Instruction(w); // as CPU::Step() does it
+            acc += i->GetOpcode() + i->GetType();
+            delete i;
+        }
+        Sink = acc;
+    });
+    Bench("decode/find_from_opcode", 256, [&] {
+        uint32_t acc {0};
+        for (int op = 0; op < 256; op++)
+            acc += FindFromOpcode(op)->Type;
+        Sink = acc;
+    });
+    Bench("disasm/format", words.size(), [&] {
+        uint32_t acc {0};
+        for (std::size_t i = 0; i + 1 < words.size(); i++)
+            acc += FormatDisasm(words[i], words[i + 1], nullptr).size();
+        Sink = acc;
+    });
+}
+
+static void BenchSteps()
+{
+    BenchStep("no_args/none", {"NOP"});
+    BenchStep("src_dest/register", {"MOVE R2, R4"});
+    BenchStep("src_dest/direct", {"MOVE 1234, R4"});
+    BenchStep("src_dest/load_indirect", {"MOVE I1, R4"});
+    BenchStep("src_dest/store_indirect", {"MOVE R2, I3"});
+    BenchStep("src_dest/compare", {"CMP R2, R4"});
+    BenchStep("dest_only/register", {"INCR R4"});
+    BenchStep("dest_only/indirect", {"INCR I1"});
+    BenchStep("2src_dest/register", {"ADD R2, R6, R4"});
+    BenchStep("2src_dest/indirect", {"ADD I1, R2, I3"});
+    BenchStep("control_flow/direct", {"JMP %NEXT"});
+    BenchStep("control_flow/register", {"JZERO R7"});
+    BenchStep("loop/direct", {"LOOP R5, %NEXT"});
+    BenchStep("stack/push_pop", {"PUSH R2", "POP R4"});
+
+    // The same loads and stores through the MMU, with an identity page table and a warm TLB.
+    std::vector<std::string> mmu {"MOVE " + std::to_string(BENCH_PT_BASE) + ", R8", "SETPTB R8",
+                                  "MOVE 1024, R8", "SETPTL R8", "MMUENA"};
+    for (auto body : {std::vector<std::string>{"MOVE I1, R4"}, std::vector<std::string>{"MOVE R2, I3"}}) {
+        std::string name = (body[0] == "MOVE I1, R4") ? "mmu/load_indirect" : "mmu/store_indirect";
+        if (!Filter.empty() && (("step/" + name).find(Filter) == std::string::npos))
+            continue;
+        CPU c;
+        for (uint32_t vpn = 0; vpn < 1024; vpn++)
+            c.WriteMem(BENCH_PT_BASE + vpn, (vpn << MMU_PAGE_SHIFT) | PTE_VALID | PTE_WRITE | PTE_EXEC);
+        LoadRepeated(c, mmu, body);
+        Bench("step/" + name, BENCH_STEPS, [&] {
+            for (int i = 0; i < BENCH_STEPS; i++)
+                c.Step();
+        });
+    }
+
+    // Run() with no breakpoints, then with breakpoints that are never reached, some of them on the
+    // pages the code is on. The difference is what debugging at full speed costs.
+    for (int breaks : {0, 48}) {
+        std::string name = "run/breakpoints_" + std::to_string(breaks);
+        if (!Filter.empty() && (name.find(Filter) == std::string::npos))
+            continue;
+        CPU c;
+        LoadRepeated(c, {}, {"ADD R2, R6, R4"});
+        for (int i = 0; i < breaks; i++)
+            c.AddBreakpoint((i % 2) ? BENCH_PROG_BASE + BENCH_PROG_COPIES + 0x80 + i : BENCH_DATA + i * 0x400);
+        Bench(name, BENCH_STEPS, [&] {
+            c.Run(BENCH_STEPS);
+        });
+        if (c.IsBroken())
+            std::cerr << name << ": CPU stopped at a breakpoint, result is meaningless\n";
+    }
+}
+
+static void BenchMem()
+{
+    CPU c;
+    PrintOTron printer;
+    static uint32_t rom[BENCH_ROM_LEN];
+    std::vector<uint32_t> addrs;
+    std::mt19937 rng(BENCH_SEED);
+
+    for (auto &w : rom)
+        w = rng();
+    c.AddROM(rom, BENCH_ROM_BASE, BENCH_ROM_LEN);
+    printer.SetInstant(true);
+    c.AddDevice(&printer);
+    for (int i = 0; i < BENCH_MEM_OPS; i++)
+        addrs.push_back(rng() % (MEM_DEFAULT_SIZE / 4)); // a 1MB working set, bigger than most L2s
+
+    Bench("mem/read_ram", BENCH_MEM_OPS, [&] {
+        uint32_t acc {0};
+        for (auto a : addrs)
+            acc += c.ReadMem(a);
+        Sink = acc;
+    });
+    Bench("mem/write_ram", BENCH_MEM_OPS, [&] {
+        for (auto a : addrs)
+            c.WriteMem(a, a);
+    });
+    Bench("mem/read_rom", BENCH_MEM_OPS, [&] {
+        uint32_t acc {0};
+        for (auto a : addrs)
+            acc += c.ReadMem(BENCH_ROM_BASE + (a % BENCH_ROM_LEN));
+        Sink = acc;
+    });
+    Bench("mem/read_io", BENCH_MEM_OPS, [&] {
+        uint32_t acc {0};
+        for (int i = 0; i < BENCH_MEM_OPS; i++)
+            acc += c.ReadMem(BENCH_DEV0_BASE + POT_REG_STATUS);
+        Sink = acc;
+    });
+    Bench("mem/write_io", BENCH_MEM_OPS, [&] {
+        for (int i = 0; i < BENCH_MEM_OPS; i++)
+            c.WriteMem(BENCH_DEV0_BASE + POT_REG_OUTPUT, 'A' + (i % 26));
+        while (printer.IsOutputReady())
+            printer.GetOutputLine();
+    });
+    c.RemoveDevice(&printer);
+
+    // Clearing memory that was never written is the best case; after a program has touched every
+    // page, every page has to be handed back.
+    Memory mem;
+    Bench("memory/clear_zero", 1, [&] {
+        mem.Clear();
+    });
+    Bench("memory/clear_after_writes", 1, [&] {
+        for (uint32_t a = 0; a < MEM_DEFAULT_SIZE; a += MEM_PAGE_WORDS)
+            mem.MemWrite(a, a);
+        mem.Clear();
+    });
+}
+
+static void BenchCards()
+{
+    std::ostringstream deck;
+    std::mt19937 rng(BENCH_SEED);
+
+    for (int i = 0; i < BENCH_CARDS; i++) {
+        deck << "<B> 32\n";
+        for (int w = 0; w < 32; w++)
+            deck << "0x" << std::hex << rng() << ((w % 8 == 7) ? "\n" : " ");
+    }
+    std::string text = deck.str();
+    CardOTronScan scanner;
+    scanner.SetInstant(true);
+
+    Bench("cards/scan", BENCH_CARDS, [&] {
+        std::istringstream in(text);
+        uint32_t acc {0};
+        scanner.PowerOnReset();
+        scanner.SetInFile(&in);
+        for (int i = 0; i < BENCH_CARDS; i++) {
+            scanner.WriteIOMem(COTS_REG_COMMAND, COTS_CMD_READ);
+            if (!(scanner.ReadIOMem(COTS_REG_STATUS) & COTS_STATUS_COMPLETE))
+                break;
+            acc += scanner.ReadIOMem(COTS_REG_READ_BUF);
+        }
+        scanner.SetInFile(nullptr); // the deck goes out of scope here
+        Sink = acc;
+    });
+}
+
+// Runs the real assembler on a generated source file with plenty of labels and forward references.
+// The time includes starting the process, which is small next to a file this size.
+static void BenchAsm(const std::string &AsmPath)
+{
+    if (AsmPath.empty() || (!Filter.empty() && (std::string("asm/assemble").find(Filter) == std::string::npos)))
+        return;
+    auto dir = std::filesystem::temp_directory_path();
+    std::string src = (dir / "bench6k.cta").string();
+    std::string out = (dir / "bench6k.bin").string();
+    std::ofstream f(src);
+    const char *ops[] = {"MOVE R1, R2", "ADD R1, R2, R3", "INCR I4", "CMP 0x1234, R5", "PUSH R6", "POP R6"};
+    uint64_t lines {0};
+    int label {0};
+
+    for (; lines < BENCH_ASM_LINES; label++) {
+        f << "$L" << label << "\n";
+        for (int j = 0; j < 6; j++, lines++)
+            f << "    " << ops[(label + j) % 6] << "\n";
+        f << "    JNZERO $L" << (label + 1) << "\n";
+        lines += 2;
+    }
+    f << "$L" << label << "\n    HALT\n";
+    f.close();
+
+    std::string cmd = "\"" + AsmPath + "\" -b -o \"" + out + "\" \"" + src + "\" >/dev/null 2>&1";
+    if (std::system(cmd.c_str()) != 0) {
+        std::cerr << "asm/assemble: " << AsmPath << " failed, skipped\n";
+    } else {
+        int saved = Repeats;
+        Repeats = std::min(Repeats, 3); // each run is a whole process
+        Bench("asm/assemble", lines, [&] {
+            Sink = std::system(cmd.c_str());
+        });
+        Repeats = saved;
+    }
+    std::filesystem::remove(src);
+    std::filesystem::remove(out);
+}
+
+static std::string JsonEscape(const std::string &S)
+{
+    std::string r;
+    for (char ch : S) {
+        if ((ch == '"') || (ch == '\\'))
+            r += '\\';
+        r += ch;
+    }
+    return r;
+}
+
+static void WriteJson(std::ostream &Out)
+{
+    Out << "{\n  \"suite\": \"bench6k\",\n  \"compiler\": \"" << JsonEscape(__VERSION__) << "\",\n";
+    Out << "  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < Results.size(); i++) {
+        auto &r = Results[i];
+        char buf[256];
+        snprintf(buf, sizeof(buf), "    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f}%s\n",
+                 JsonEscape(r.Name).c_str(), (unsigned long long)r.Ops, r.NsPerOp, r.OpsPerSec,
+                 (i + 1 < Results.size()) ? "," : "");
+        Out << buf;
+    }
+    Out << "  ]\n}\n";
+}
+
+static void Usage()
+{
+    std::cerr << "Usage: bench6k [-o results.json] [-f filter] [-r repeats] [-t min_secs] [--asm path/to/asm6k]\n";
+    std::cerr << "  Runs emulator microbenchmarks and writes the results as JSON (to stdout by default).\n";
+    std::cerr << "  -f runs only benchmarks whose name contains the filter, e.g. -f step/ or -f mem/read.\n";
+    std::cerr << "  --asm also times the assembler on a generated source file.\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string outname;
+    std::string asmpath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool more = (i + 1 < argc);
+        if ((arg == "-o") && more) {
+            outname = argv[++i];
+        } else if ((arg == "-f") && more) {
+            Filter = argv[++i];
+        } else if ((arg == "-r") && more) {
+            Repeats = std::max(1, std::atoi(argv[++i]));
+        } else if ((arg == "-t") && more) {
+            MinSecs = std::atof(argv[++i]);
+        } else if ((arg == "--asm") && more) {
+            asmpath = argv[++i];
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+
+    BenchDecode();
+    BenchSteps();
+    BenchMem();
+    BenchCards();
+    BenchAsm(asmpath);
+
+    if (outname.empty()) {
+        WriteJson(std::cout);
+    } else {
+        std::ofstream out(outname);
+        if (!out.is_open()) {
+            std::cerr << "Can't write " << outname << "\n";
+            return 1;
+        }
+        WriteJson(out);
+        std::cerr << "Results written to " << outname << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// calltrack.cpp - definitions for the CallTracker class
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include "calltrack.hpp"
+
+CallTracker::CallTracker()
+{
+    Current = &Root;
+}
+
+CallTracker::~CallTracker()
+{
+    DeleteChildren(&Root);
+}
+
+// Free everything below N. Guest call chains can be deep, so none of the tree walks recurse.
+void CallTracker::DeleteChildren(Node *N)
+{
+    std::vector<Node *> work(N->Children.begin(), N->Children.end());
+    N->Children.clear();
+    while (!work.empty()) {
+        Node *n = work.back();
+        work.pop_back();
+        work.insert(work.end(), n->Children.begin(), n->Children.end());
+        delete n;
+    }
+}
+
+// Charge the cycles since the last event to the path on top of the stack.
+void CallTracker::Charge(uint64_t Cycles)
+{
+    Current->Self += Cycles - LastCycles;
+    LastCycles = Cycles;
+}
+
+// Start a new frame for Func on top of the current path.
+void CallTracker::Push(uint32_t Func, uint32_t SP)
+{
+    Node *next {nullptr};
+    for (auto child : Current->Children) {
+        if (child->Func == Func) {
+            next = child;
+            break;
+        }
+    }
+    if (next == nullptr) {
+        next = new Node {Func, Current, {}, 0, 0};
+        Current->Children.push_back(next);
+    }
+    next->Calls++;
+    Stack.push_back({next, SP});
+    Current = next;
+}
+
+// Drop every frame whose return slot is at or above SP. The stack grows up, so those have been popped.
+void CallTracker::DropDead(uint32_t SP)
+{
+    while (!Stack.empty() && (Stack.back().SP > SP))
+        Stack.pop_back();
+    Current = Stack.empty() ? &Root : Stack.back().Path;
+}
+
+// CALL to Target. SP is after the return address was pushed. The CALL itself counts to the caller.
+void CallTracker::Call(uint32_t Target, uint32_t SP, uint64_t Cycles)
+{
+    Charge(Cycles);
+    DropDead(SP - 1);
+    Push(Target, SP);
+}
+
+// RETURN, with SP after the return address was popped. The RETURN itself counts to the callee.
+void CallTracker::Return(uint32_t SP, uint64_t Cycles)
+{
+    Charge(Cycles);
+    DropDead(SP);
+}
+
+// Fault or interrupt handler entry, with SP after the machine state was pushed.
+void CallTracker::EnterHandler(uint32_t Handler, uint32_t SP, uint64_t Cycles)
+{
+    Charge(Cycles);
+    Push(Handler, SP);
+}
+
+// IRET, with SP as restored from the saved state.
+void CallTracker::ExitHandler(uint32_t SP, uint64_t Cycles)
+{
+    Charge(Cycles);
+    DropDead(SP);
+}
+
+// Charge the cycles up to now, for when the run is over.
+void CallTracker::Finish(uint64_t Cycles)
+{
+    Charge(Cycles);
+}
+
+// Forget everything and start again with an empty stack. Cycles is the CPU's cycle count now.
+void CallTracker::Reset(uint64_t Cycles)
+{
+    DeleteChildren(&Root);
+    Root.Self = 0;
+    Stack.clear();
+    Current = &Root;
+    LastCycles = Cycles;
+}
+
+int CallTracker::GetDepth() const
+{
+    return Stack.size();
+}
+
+// Cycles spent in every path and everything it called, by node.
+void CallTracker::Totals(std::unordered_map<const Node *, uint64_t> &Out) const
+{
+    std::vector<const Node *> order {&Root};
+
+    for (size_t i = 0; i < order.size(); i++)   // parents always come before their children
+        order.insert(order.end(), order[i]->Children.begin(), order[i]->Children.end());
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Out[*it] += (*it)->Self;
+        if ((*it)->Parent != nullptr)
+            Out[(*it)->Parent] += Out[*it];
+    }
+}
+
+// Name a routine by its label. Calls into the middle of a label get an offset.
+std::string CallTracker::Name(const SymbolMap &Map, uint32_t Func) const
+{
+    char buf[64];
+
+    if (Func == CALL_ROOT_ADDR)
+        return "[root]";
+    const MapSymbol *sym = Map.FindSymbol(Func);
+    if (sym == nullptr) {
+        snprintf(buf, sizeof(buf), "0x%08x", Func);
+        return buf;
+    }
+    if (sym->Addr == Func)
+        return sym->Name;
+    snprintf(buf, sizeof(buf), "+0x%x", Func - sym->Addr);
+    return sym->Name + buf;
+}
+
+// Write one line per call path that used any cycles: the names along the path separated by semicolons,
+// then the cycles. This is the input format of flamegraph.pl and most other flame graph tools.
+void CallTracker::WriteFolded(std::ostream &Out, const SymbolMap &Map) const
+{
+    std::vector<std::pair<const Node *, std::string>> work {{&Root, Name(Map, Root.Func)}};
+
+    while (!work.empty()) {
+        auto item = work.back();
+        work.pop_back();
+        if (item.first->Self)
+            Out << item.second << " " << item.first->Self << "\n";
+        for (auto it = item.first->Children.rbegin(); it != item.first->Children.rend(); ++it)
+            work.push_back({*it, item.second + ";" + Name(Map, (*it)->Func)});
+    }
+}
+
+// Write the cycles for each routine: inclusive (itself and everything it called) and exclusive (itself
+// only), and how many times it was called, sorted by inclusive cycles. Under recursion, only the
+// outermost call of a routine counts towards its inclusive cycles.
+void CallTracker::WriteReport(std::ostream &Out, const SymbolMap &Map) const
+{
+    struct Sums {
+        uint64_t Incl {0};
+        uint64_t Excl {0};
+        uint64_t Calls {0};
+    };
+    std::map<std::string, Sums> byname;
+    std::map<std::string, int> active;  // how many times each name is on the path being walked
+    std::unordered_map<const Node *, uint64_t> totals;
+    char buf[160];
+
+    Totals(totals);
+    uint64_t total = totals[&Root];
+    // Walk the tree keeping count of the names on the current path
+    struct Step {
+        const Node *N;
+        std::string Name;
+        bool Leaving;
+    };
+    std::vector<Step> work {{&Root, Name(Map, Root.Func), false}};
+    while (!work.empty()) {
+        Step item = work.back();
+        work.pop_back();
+        if (item.Leaving) {
+            active[item.Name]--;
+            continue;
+        }
+        Sums &t = byname[item.Name];
+        t.Excl += item.N->Self;
+        t.Calls += item.N->Calls;
+        if (active[item.Name]++ == 0)
+            t.Incl += totals[item.N];
+        work.push_back({item.N, item.Name, true});
+        for (auto child : item.N->Children)
+            work.push_back({child, Name(Map, child->Func), false});
+    }
+
+    std::vector<std::pair<std::string, Sums>> rows(byname.begin(), byname.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto &a, const auto &b)
+                     { return a.second.Incl > b.second.Incl; });
+    Out << "Call graph: " << total << " cycles\n\n";
+    Out << "       inclusive            exclusive         calls  routine\n";
+    for (auto &row : rows) {
+        snprintf(buf, sizeof(buf), "%12llu %6.2f%%  %12llu %6.2f%%  %10llu  %s\n",
+                 (unsigned long long)row.second.Incl, total ? 100.0 * row.second.Incl / total : 0.0,
+                 (unsigned long long)row.second.Excl, total ? 100.0 * row.second.Excl / total : 0.0,
+                 (unsigned long long)row.second.Calls, row.first.c_str());
+        Out << buf;
+    }
+}
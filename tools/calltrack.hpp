@@ -0,0 +1,82 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// calltrack.hpp - declarations for the CallTracker class, a shadow call stack for guest code.
+// When a tracker is attached, the CPU reports every CALL, RETURN, IRET, fault and interrupt to it. The
+// tracker keeps its own copy of the call stack and a tree of every call path seen, and charges cycles
+// to the path that was running, so it can give exact inclusive and exclusive cycles per routine and
+// write folded stacks for flame graph tools.
+//
+// Guest code doesn't always play by the rules, so frames are matched by SP rather than by return address.
+// Each frame remembers SP just after its return address (or saved state) was pushed, and at every CALL,
+// RETURN and IRET any frame whose slot is no longer below SP is dropped. That covers a RETURN to
+// somewhere other than the pushed address, a stack reset by hand, and routines that never return; a
+// RETURN that pops something other than a return address leaves the frames alone. Code entered with a
+// JMP, like a program started by the loader ROM, runs in whatever frame the JMP was in.
+#ifndef __CALLTRACK_HPP__
+#define __CALLTRACK_HPP__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "symmap.hpp"
+
+#define CALL_ROOT_ADDR 0xFFFFFFFF  // stands for the code that was running when the tracker started
+
+class CallTracker {
+public:
+    CallTracker();
+    ~CallTracker();
+    void Call(uint32_t Target, uint32_t SP, uint64_t Cycles);
+    void Return(uint32_t SP, uint64_t Cycles);
+    void EnterHandler(uint32_t Handler, uint32_t SP, uint64_t Cycles);
+    void ExitHandler(uint32_t SP, uint64_t Cycles);
+    void Finish(uint64_t Cycles);
+    void Reset(uint64_t Cycles);
+    int GetDepth() const;
+    void WriteFolded(std::ostream &Out, const SymbolMap &Map) const;
+    void WriteReport(std::ostream &Out, const SymbolMap &Map) const;
+
+private:
+    // One node per distinct call path. Self is the cycles spent with this path on top of the stack.
+    struct Node {
+        uint32_t Func;
+        Node *Parent;
+        std::vector<Node *> Children;
+        uint64_t Self {0};
+        uint64_t Calls {0};
+    };
+    struct Frame {
+        Node *Path;
+        uint32_t SP;        // SP just after the return address or state was pushed
+    };
+    Node Root {CALL_ROOT_ADDR, nullptr, {}, 0, 0};
+    std::vector<Frame> Stack;
+    Node *Current;
+    uint64_t LastCycles {0};
+
+    void Charge(uint64_t Cycles);
+    void Push(uint32_t Func, uint32_t SP);
+    void DropDead(uint32_t SP);
+    static void DeleteChildren(Node *N);
+    void Totals(std::unordered_map<const Node *, uint64_t> &Out) const;
+    std::string Name(const SymbolMap &Map, uint32_t Func) const;
+};
+
+#endif // __CALLTRACK_HPP__
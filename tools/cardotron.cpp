@@ -31,8 +31,7 @@ CardOTronScan::CardOTronScan()
 //Destructor
 CardOTronScan::~CardOTronScan()
 {
-    if ((InFile != nullptr) && InFile->is_open())
-        InFile->close();
+    CloseInFile();
     delete[] ReadBuf;
 }
 
@@ -62,6 +61,7 @@ uint32_t CardOTronScan::ReadIOMem(uint32_t Offset)
     CheckReadTimer();
     switch (Offset) {
         case COTS_REG_STATUS:
+            NotePoll();
             return StatusReg;
             break;
         case COTS_REG_CARD_INFO:
@@ -113,23 +113,40 @@ void CardOTronScan::WriteIOMem(uint32_t Offset, uint32_t Value)
 // Reset the device as though a power cycle had happened.
 void CardOTronScan::PowerOnReset()
 {
-    if ((InFile != nullptr) && InFile->is_open())
-        InFile->close();
+    CloseInFile();
     Reading = false;
+    SpanEnd();
     StatusReg = COTS_STATUS_EMPTY;
 }
 
 // Get a ref to the input file. The must already be open for
-// reading and must be positioned at the start.
-void CardOTronScan::SetInFile(std::ifstream *File)
+// reading and must be positioned at the start. Any input stream will do; as with the punch, files
+// are closed when the hopper empties and other streams are just let go.
+void CardOTronScan::SetInFile(std::istream *File)
 {
-    if ((File != nullptr) && File->is_open())
+    if ((File != nullptr) && File->good())
         InFile = File;
     else
         InFile = nullptr;
     StatusReg = COTS_STATUS_READY;
 }
 
+void CardOTronScan::CloseInFile()
+{
+    if (InFile == nullptr)
+        return;
+    auto *file = dynamic_cast<std::ifstream *>(InFile);
+    if ((file != nullptr) && file->is_open())
+        file->close();
+    InFile = nullptr;
+}
+
+// Normally a card takes SCAN_MSEC to read, like the real thing. Headless runs don't want to wait.
+void CardOTronScan::SetInstant(bool Enable)
+{
+    Instant = Enable;
+}
+
 bool CardOTronScan::IsReading()
 {
     CheckReadTimer();
@@ -142,14 +159,17 @@ void CardOTronScan::ReadNextCard()
         return;
     ReadStart = std::chrono::steady_clock::now();
     Reading = true;
+    SpanBegin("scan", SCAN_MSEC);
     StatusReg = COTS_STATUS_READING;
     InFile->exceptions(std::ios::eofbit | std::ios::failbit | std::ios::badbit);
     try {
         InFile->ignore(std::numeric_limits<std::streamsize>::max(), '<');
-    } catch (std::ifstream::failure &e) {
-        InFile->close();
+    } catch (std::ios::failure &e) {
+        bool eof = InFile->eof();
+        CloseInFile();
         Reading = false;
-        if (InFile->eof()) {
+        SpanEnd();
+        if (eof) {
             // this is OK, we're out of cards
             StatusReg = COTS_STATUS_EMPTY;
             return;
@@ -192,9 +212,10 @@ void CardOTronScan::ReadNextCard()
         for (unsigned int i = 0 ; i < Len ; i++) {
             *InFile >> std::hex >> ReadBuf[i];
         }
-    } catch (std::ifstream::failure &e) {
-        InFile->close();
+    } catch (...) { // stream failure, or a bad card type or length from above
+        CloseInFile();
         Reading = false;
+        SpanEnd();
         StatusReg = COTS_STATUS_ERR_CSUM;
     }
 }
@@ -204,8 +225,9 @@ void CardOTronScan::CheckReadTimer()
     if (Reading) {
         auto ReadNow = std::chrono::steady_clock::now();
         auto Since = std::chrono::duration_cast<std::chrono::milliseconds>(ReadNow - ReadStart);
-        if (Since.count() > SCAN_MSEC) {
+        if (Instant || (Since.count() > SCAN_MSEC)) {
             Reading = false;
+            SpanEnd();
             StatusReg = COTS_STATUS_READY | COTS_STATUS_COMPLETE;
         }
     }
@@ -221,8 +243,7 @@ CardOTronPunch::CardOTronPunch()
 //Destructor
 CardOTronPunch::~CardOTronPunch()
 {
-    if ((OutFile != nullptr) && OutFile->is_open())
-        OutFile->close();
+    CloseOutFile();
     delete[] WriteBuf;
 }
 
@@ -277,24 +298,27 @@ void CardOTronPunch::WriteIOMem(uint32_t Offset, uint32_t Value)
 uint32_t CardOTronPunch::ReadIOMem(uint32_t Offset)
 {
     CheckWriteTimer();
-    if (Offset == COTP_REG_STATUS)
+    if (Offset == COTP_REG_STATUS) {
+        NotePoll();
         return StatusReg;
-    else
+    } else
         return 0xffffffff;
 }
 
 // Reset the device as though a power cycle had happened.
 void CardOTronPunch::PowerOnReset()
 {
-    if ((OutFile != nullptr) && (OutFile->is_open()))
-        OutFile->close();
+    CloseOutFile();
     Writing = false;
+    SpanEnd();
     StatusReg = COTP_STATUS_EMPTY;
 }
 
-void CardOTronPunch::SetOutFile(std::ofstream *File)
+// Any output stream will do. Files are closed when the hopper is emptied, other streams (like the
+// string streams the batch runner uses to check output) are just flushed.
+void CardOTronPunch::SetOutFile(std::ostream *File)
 {
-    if ((File != nullptr) && (File->is_open()))  {
+    if ((File != nullptr) && File->good())  {
         OutFile = File;
         StatusReg = COTP_STATUS_READY;
         *OutFile << std::showbase;
@@ -302,6 +326,26 @@ void CardOTronPunch::SetOutFile(std::ofstream *File)
         OutFile = nullptr;
 }
 
+// As for the scanner, skip the PUNCH_MSEC delay.
+void CardOTronPunch::SetInstant(bool Enable)
+{
+    Instant = Enable;
+}
+
+void CardOTronPunch::CloseOutFile()
+{
+    if (OutFile == nullptr)
+        return;
+    auto *file = dynamic_cast<std::ofstream *>(OutFile);
+    if (file != nullptr) {
+        if (file->is_open())
+            file->close();
+    } else {
+        OutFile->flush();
+    }
+    OutFile = nullptr;
+}
+
 bool CardOTronPunch::IsPunching()
 {
     CheckWriteTimer();
@@ -314,6 +358,7 @@ void CardOTronPunch::WriteCard()
         return;
     WriteStart = std::chrono::steady_clock::now();
     Writing = true;
+    SpanBegin("punch", PUNCH_MSEC);
     StatusReg = COTP_STATUS_BUSY;
     // Write type, surrounded by brackets
     *OutFile << '<';
@@ -354,8 +399,9 @@ void CardOTronPunch::CheckWriteTimer()
     if (Writing) {
         auto WriteNow = std::chrono::steady_clock::now();
         auto Since = std::chrono::duration_cast<std::chrono::milliseconds>(WriteNow - WriteStart);
-        if (Since.count() > PUNCH_MSEC) {
+        if (Instant || (Since.count() > PUNCH_MSEC)) {
             Writing = false;
+            SpanEnd();
             StatusReg = COTP_STATUS_READY;
         }
     }
@@ -38,7 +38,8 @@ public:
     DeviceClass GetDeviceClass();
     uint32_t GetDDN();
     void PowerOnReset();
-    void SetInFile(std::ifstream *File);  // load punched cards into hopper
+    void SetInFile(std::istream *File);   // load punched cards into hopper
+    void SetInstant(bool Enable);         // no scan delay, for batch runs
     // for UI to display blinking lights
     bool IsReading();
 
@@ -46,11 +47,13 @@ private:
     uint32_t StatusReg;
     uint32_t *ReadBuf;
     uint32_t CardInfoReg;
-    bool Reading;
+    bool Reading {false};
     std::chrono::time_point<std::chrono::steady_clock> ReadStart;
-    std::ifstream *InFile {nullptr};
+    std::istream *InFile {nullptr};
+    bool Instant {false};
     void ReadNextCard();
     void CheckReadTimer();
+    void CloseInFile();
 };
 
 class CardOTronPunch: public Periph {
@@ -63,7 +66,8 @@ public:
     DeviceClass GetDeviceClass();
     uint32_t GetDDN();
     void PowerOnReset();
-    void SetOutFile(std::ofstream *File); // load blank cards into hopper
+    void SetOutFile(std::ostream *File);  // load blank cards into hopper
+    void SetInstant(bool Enable);         // no punch delay, for batch runs
     // for UI to display blinking lights
     bool IsPunching();
 
@@ -71,11 +75,13 @@ private:
     uint32_t *WriteBuf;
     uint32_t StatusReg;
     uint32_t InfoReg;
-    bool Writing;
+    bool Writing {false};
     std::chrono::time_point<std::chrono::steady_clock> WriteStart;
-    std::ofstream *OutFile {nullptr}; // file should be open before calling SetOutFile
+    std::ostream *OutFile {nullptr}; // file should be open before calling SetOutFile
+    bool Instant {false};
     void WriteCard();
     void CheckWriteTimer();
+    void CloseOutFile();
 };
 
 
@@ -0,0 +1,372 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// condition.cpp - breakpoint conditions: a recursive descent parser that writes a postfix program, and
+// the little stack machine that runs it.
+
+#include <cctype>
+#include <cstring>
+#include "condition.hpp"
+#include "cpu.hpp"
+#include "symmap.hpp"
+
+enum _cond_op {
+    cond_const = 0,     // push Arg
+    cond_reg,           // push register Arg
+    cond_flag,          // push 1 if flag bit Arg is set
+    cond_hits,
+    cond_value,
+    cond_old,
+    cond_load,          // replace the top with the RAM word it addresses
+    cond_not,
+    cond_neg,
+    cond_inv,
+    cond_mul,           // binary operators from here on pop two and push one
+    cond_div,
+    cond_mod,
+    cond_add,
+    cond_sub,
+    cond_and,
+    cond_xor,
+    cond_or,
+    cond_lt,
+    cond_le,
+    cond_gt,
+    cond_ge,
+    cond_eq,
+    cond_ne,
+    cond_land,
+    cond_lor,
+};
+
+namespace {
+
+struct CondName {
+    const char *Name;
+    uint8_t Code;
+    uint32_t Arg;
+};
+
+const CondName Names[] = {
+    {"SP", cond_reg, REG_SP},
+    {"FLG", cond_reg, REG_FLG},
+    {"IP", cond_reg, REG_IP},
+    {"OVER", cond_flag, FLG_OVER},
+    {"UNDER", cond_flag, FLG_UNDER},
+    {"ZERO", cond_flag, FLG_ZERO},
+    {"IN_INT", cond_flag, FLG_IN_INT},
+    {"MMUENA", cond_flag, FLG_MMUENA},
+    {"SIGNED", cond_flag, FLG_SIGNED},
+    {"INTENA", cond_flag, FLG_INTENA},
+    {"FAULT", cond_flag, FLG_FAULT},
+    {"HITS", cond_hits, 0},
+    {"VALUE", cond_value, 0},
+    {"OLD", cond_old, 0},
+};
+
+// Binary operators by precedence, loosest first. Longer spellings come before their prefixes.
+struct CondOper {
+    const char *Text;
+    uint8_t Code;
+};
+
+const CondOper Levels[][4] = {
+    {{"||", cond_lor}},
+    {{"&&", cond_land}},
+    {{"|", cond_or}},
+    {{"^", cond_xor}},
+    {{"&", cond_and}},
+    {{"==", cond_eq}, {"!=", cond_ne}},
+    {{"<=", cond_le}, {">=", cond_ge}, {"<", cond_lt}, {">", cond_gt}},
+    {{"+", cond_add}, {"-", cond_sub}},
+    {{"*", cond_mul}, {"/", cond_div}, {"%", cond_mod}},
+};
+const int NumLevels = sizeof(Levels) / sizeof(Levels[0]);
+
+class CondParser {
+public:
+    CondParser(const std::string &Text, const SymbolMap *Map, std::vector<CondOp> &Code)
+        : Text(Text), Map(Map), Code(Code) {}
+
+    // Returns true on error, with a message.
+    bool Parse(std::string &Error)
+    {
+        Binary(0);
+        SkipSpace();
+        if (Err.empty() && (Pos < Text.size()))
+            Fail("unexpected '" + Text.substr(Pos, 1) + "'");
+        if (Err.empty() && (MaxDepth > COND_STACK_MAX))
+            Err = "condition is nested too deeply";
+        Error = Err;
+        return !Err.empty();
+    }
+
+private:
+    const std::string &Text;
+    const SymbolMap *Map;
+    std::vector<CondOp> &Code;
+    size_t Pos {0};
+    int Depth {0};
+    int MaxDepth {0};
+    std::string Err;
+
+    void Fail(const std::string &Msg)
+    {
+        if (Err.empty())
+            Err = Msg + " at column " + std::to_string(Pos + 1);
+    }
+
+    void Emit(uint8_t Code, uint32_t Arg = 0)
+    {
+        if (Code < cond_load) {
+            if (++Depth > MaxDepth)
+                MaxDepth = Depth;
+        } else if (Code >= cond_mul) {
+            Depth--;
+        }
+        this->Code.push_back({Code, Arg});
+    }
+
+    void SkipSpace()
+    {
+        while ((Pos < Text.size()) && isspace((unsigned char)Text[Pos]))
+            Pos++;
+    }
+
+    bool Accept(const char *Op)
+    {
+        SkipSpace();
+        size_t len = strlen(Op);
+        if (Text.compare(Pos, len, Op) != 0)
+            return false;
+        // don't take the first half of a longer operator
+        if ((len == 1) && (Pos + 1 < Text.size()) && (Text[Pos + 1] == Op[0]) && strchr("&|", Op[0]))
+            return false;
+        Pos += len;
+        return true;
+    }
+
+    std::string Word()
+    {
+        size_t start = Pos;
+        while ((Pos < Text.size()) && (isalnum((unsigned char)Text[Pos]) || (Text[Pos] == '_')))
+            Pos++;
+        return Text.substr(start, Pos - start);
+    }
+
+    void Binary(int Level)
+    {
+        if (Level == NumLevels) {
+            Unary();
+            return;
+        }
+        Binary(Level + 1);
+        while (Err.empty()) {
+            const CondOper *op = nullptr;
+            for (auto &o : Levels[Level])
+                if ((o.Text != nullptr) && Accept(o.Text)) {
+                    op = &o;
+                    break;
+                }
+            if (op == nullptr)
+                return;
+            Binary(Level + 1);
+            Emit(op->Code);
+        }
+    }
+
+    void Unary()
+    {
+        if (Accept("!")) {
+            Unary();
+            Emit(cond_not);
+        } else if (Accept("~")) {
+            Unary();
+            Emit(cond_inv);
+        } else if (Accept("-")) {
+            Unary();
+            Emit(cond_neg);
+        } else {
+            Primary();
+        }
+    }
+
+    void Primary()
+    {
+        SkipSpace();
+        if (Pos >= Text.size()) {
+            Fail("expression expected");
+        } else if (Accept("(")) {
+            Binary(0);
+            if (!Accept(")"))
+                Fail("')' expected");
+        } else if (Accept("[")) {
+            Binary(0);
+            if (!Accept("]"))
+                Fail("']' expected");
+            Emit(cond_load);
+        } else if (isdigit((unsigned char)Text[Pos])) {
+            size_t start = Pos;
+            std::string num = Word();
+            char *end;
+            unsigned long long val = strtoull(num.c_str(), &end, 0);
+            if ((*end != '\0') || (val > UINT32_MAX)) {
+                Pos = start;
+                Fail("bad number '" + num + "'");
+            }
+            Emit(cond_const, (uint32_t)val);
+        } else if (Text[Pos] == '$') {
+            Pos++;
+            size_t start = Pos;
+            std::string name = Word();
+            const MapSymbol *sym = nullptr;
+            if (Map != nullptr)
+                for (auto &s : Map->GetSymbols())
+                    if (s.Name == name) {
+                        sym = &s;
+                        break;
+                    }
+            Pos = start;
+            if (name.empty())
+                Fail("label expected");
+            else if (Map == nullptr)
+                Fail("no symbol map for label '" + name + "'");
+            else if (sym == nullptr)
+                Fail("unknown label '" + name + "'");
+            Pos = start + name.size();
+            Emit(cond_const, (sym != nullptr) ? sym->Addr : 0);
+        } else if (isalpha((unsigned char)Text[Pos]) || (Text[Pos] == '_')) {
+            size_t start = Pos;
+            std::string word = Word();
+            std::string name = word;
+            for (auto &c : name)
+                c = toupper((unsigned char)c);
+            if ((name.size() >= 2) && (name[0] == 'R') && isdigit((unsigned char)name[1])) {
+                unsigned long reg = strtoul(name.c_str() + 1, nullptr, 10);
+                if ((reg < NUMREGS) && (name == "R" + std::to_string(reg))) {
+                    Emit(cond_reg, reg);
+                    return;
+                }
+            }
+            for (auto &n : Names)
+                if (name == n.Name) {
+                    Emit(n.Code, n.Arg);
+                    return;
+                }
+            Pos = start;
+            Fail("unknown name '" + word + "'");
+        } else {
+            Fail("unexpected '" + Text.substr(Pos, 1) + "'");
+        }
+    }
+};
+
+} // namespace
+
+// Parse the condition. Labels are looked up in Map, which may be null if there isn't one.
+// Returns true on error, with a message saying what and where.
+bool BreakCondition::Compile(const std::string &Text, const SymbolMap *Map, std::string &Error)
+{
+    std::vector<CondOp> code;
+    CondParser parser(Text, Map, code);
+
+    if (parser.Parse(Error))
+        return true;
+    Code.swap(code);
+    this->Text = Text;
+    return false;
+}
+
+const std::string &BreakCondition::GetText() const
+{
+    return Text;
+}
+
+// Run the condition against the core, stopped at the breakpoint. Hit is what the instruction did, when
+// the breakpoint is a watchpoint. Returns true if the run should stop there.
+bool BreakCondition::Eval(CPU &C, uint64_t Hits, const WatchHit *Hit) const
+{
+    uint32_t stack[COND_STACK_MAX];
+    int sp = 0;
+
+    for (auto &op : Code) {
+        if (op.Code < cond_load) {
+            uint32_t v = 0;
+            switch (op.Code) {
+            case cond_const:
+                v = op.Arg;
+                break;
+            case cond_reg:
+                v = C.ReadReg(op.Arg);
+                break;
+            case cond_flag:
+                v = (C.ReadReg(REG_FLG) & op.Arg) != 0;
+                break;
+            case cond_hits:
+                v = (Hits > UINT32_MAX) ? UINT32_MAX : (uint32_t)Hits;
+                break;
+            case cond_value:
+                v = (Hit != nullptr) ? Hit->Value : 0;
+                break;
+            case cond_old:
+                v = (Hit != nullptr) ? Hit->Old : 0;
+                break;
+            }
+            stack[sp++] = v;
+            continue;
+        }
+        uint32_t &a = stack[sp - 1];
+        if (op.Code < cond_mul) {
+            switch (op.Code) {
+            case cond_load:
+                a = (a < BASE_IO_MEM) ? C.ReadMem(a) : 0;
+                break;
+            case cond_not:
+                a = !a;
+                break;
+            case cond_neg:
+                a = 0 - a;
+                break;
+            case cond_inv:
+                a = ~a;
+                break;
+            }
+            continue;
+        }
+        uint32_t b = stack[--sp];
+        uint32_t &l = stack[sp - 1];
+        switch (op.Code) {
+        case cond_mul: l = l * b; break;
+        case cond_div: l = (b != 0) ? l / b : 0; break;
+        case cond_mod: l = (b != 0) ? l % b : 0; break;
+        case cond_add: l = l + b; break;
+        case cond_sub: l = l - b; break;
+        case cond_and: l = l & b; break;
+        case cond_xor: l = l ^ b; break;
+        case cond_or: l = l | b; break;
+        case cond_lt: l = l < b; break;
+        case cond_le: l = l <= b; break;
+        case cond_gt: l = l > b; break;
+        case cond_ge: l = l >= b; break;
+        case cond_eq: l = l == b; break;
+        case cond_ne: l = l != b; break;
+        case cond_land: l = l && b; break;
+        case cond_lor: l = l || b; break;
+        }
+    }
+    return (sp == 0) || (stack[0] != 0);
+}
@@ -0,0 +1,63 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// condition.hpp - declarations for the BreakCondition class, a condition on a breakpoint or watchpoint.
+// The text is parsed once, when the condition is set, into a short postfix program that Eval() runs each
+// time the breakpoint is reached; the run only stops if the result is nonzero. Nothing is evaluated on
+// instructions that don't hit a breakpoint, so conditions cost nothing until then.
+//
+// A condition is a C-like expression on unsigned 32-bit words. Names are not case sensitive.
+//      R0 - R15, SP, FLG, IP       registers, as they are when the breakpoint is reached
+//      OVER UNDER ZERO IN_INT      flags, 1 if set
+//      MMUENA SIGNED INTENA FAULT
+//      HITS                        times this breakpoint has been reached, counting this one
+//      VALUE, OLD                  for watchpoints, the word read or written and the word before a write
+//      [expr]                      the RAM word at a physical address; I/O space reads as 0, so that
+//                                  checking a condition never disturbs a device
+//      123, 0x7B, $LABEL           numbers and labels from an asm6k symbol map
+//      ( ) ! ~ - * / % + - & ^ | < <= > >= == != && ||     with their C meanings and precedence
+// For example, IP == $LOOP && R6 < 3, or [0x1000] != 0 && HITS > 10.
+#ifndef __CONDITION_HPP__
+#define __CONDITION_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define COND_STACK_MAX 32   // deepest nesting a condition may have
+
+class CPU;
+class SymbolMap;
+struct WatchHit;
+
+struct CondOp {
+    uint8_t Code;
+    uint32_t Arg;
+};
+
+class BreakCondition {
+public:
+    bool Compile(const std::string &Text, const SymbolMap *Map, std::string &Error);
+    bool Eval(CPU &C, uint64_t Hits, const WatchHit *Hit) const;
+    const std::string &GetText() const;
+
+private:
+    std::string Text;
+    std::vector<CondOp> Code;   // postfix, run on a stack
+};
+
+#endif // __CONDITION_HPP__
@@ -0,0 +1,170 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// cov_main.cpp - cov6k, merges coverage files from batch6k --coverage and shows what they cover.
+// Given an asm6k -l listing, marks each word with whether it ran and each conditional branch with how
+// many times it went each way. Given a symbol map, lists each label with how much of it ran.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cctype>
+#include "coverage.hpp"
+#include "symmap.hpp"
+
+// Display usage. Caller passes in argv[0] so that we can display the name of the command.
+static int Usage(char *Cmd)
+{
+    std::cerr << "Usage: " << Cmd << " [options] covfile...\n";
+    std::cerr << "Options:\n";
+    std::cerr << "\t-o outfile      write the merged coverage to outfile\n";
+    std::cerr << "\t-l listing      annotate a listing from asm6k -l\n";
+    std::cerr << "\t-m mapfile      show coverage for each label in a map from asm6k -m\n";
+    std::cerr << "In a listing, + marks words that ran and # words that didn't. Data words are\n";
+    std::cerr << "marked # too, since the listing can't tell them from code.\n";
+    return 1;
+}
+
+// Copy the listing to Out with a marker in front of every line that has an address.
+static bool Annotate(const std::string &Name, const Coverage &Cover, std::ostream &Out)
+{
+    std::ifstream in(Name);
+    if (!in.is_open()) {
+        std::cerr << "Error opening " << Name << "\n";
+        return true;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(' ');
+        if ((start == std::string::npos) || (line.compare(start, 2, "0x") && !isdigit(line[start]))) {
+            Out << "    " << line << "\n";
+            continue;
+        }
+        uint32_t addr;
+        try {
+            addr = std::stoul(line.substr(start), nullptr, 0);
+        } catch (...) {
+            Out << "    " << line << "\n";
+            continue;
+        }
+        Out << (Cover.IsHit(addr) ? "  + " : "  # ") << line;
+        CoverBranch b;
+        if (Cover.GetBranch(addr, b)) {
+            Out << "    taken " << b.Taken << ", not taken " << b.NotTaken;
+            if (!b.Taken || !b.NotTaken)
+                Out << " (one way only)";
+        }
+        Out << "\n";
+    }
+    return false;
+}
+
+// One line per label: words that ran out of the words it covers.
+static void LabelSummary(const SymbolMap &Map, const Coverage &Cover, std::ostream &Out)
+{
+    char buf[160];
+    for (auto &sym : Map.GetSymbols()) {
+        uint32_t hit {0};
+        for (uint32_t a = sym.Addr; a < sym.End; a++)
+            hit += Cover.IsHit(a);
+        snprintf(buf, sizeof(buf), "%-24s 0x%08x %6u of %6u words%s\n", sym.Name.c_str(), sym.Addr, hit,
+                 sym.End - sym.Addr, hit ? "" : "  never reached");
+        Out << buf;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string outname, listname, mapname;
+    std::vector<std::string> inputs;
+
+    for (auto i = 1; i < argc; i++) {
+        std::string TmpArg = argv[i];
+        std::string *target {nullptr};
+
+        if (TmpArg == "-o")
+            target = &outname;
+        else if (TmpArg == "-l")
+            target = &listname;
+        else if (TmpArg == "-m")
+            target = &mapname;
+        if (target != nullptr) {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            *target = argv[i];
+            continue;
+        }
+        if (TmpArg[0] == '-')
+            return Usage(argv[0]);
+        inputs.push_back(TmpArg);
+    }
+    if (inputs.empty())
+        return Usage(argv[0]);
+
+    Coverage cover;
+    std::string error;
+    for (auto &name : inputs) {
+        std::ifstream in(name);
+        Coverage one;
+        if (!in.is_open() || one.Read(in, name, error)) {
+            std::cerr << (error.empty() ? "Error opening " + name : error) << "\n";
+            return 1;
+        }
+        if (!cover.GetProgram().empty() && !one.GetProgram().empty() && (cover.GetProgram() != one.GetProgram()))
+            std::cerr << "Warning: " << name << " is for " << one.GetProgram() << ", not " << cover.GetProgram()
+                      << "\n";
+        cover.Merge(one);
+    }
+
+    if (!outname.empty()) {
+        std::ofstream out(outname, std::ios::out | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Error opening " << outname << "\n";
+            return 1;
+        }
+        cover.Write(out);
+    }
+    if (!listname.empty() && Annotate(listname, cover, std::cout))
+        return 1;
+    if (!mapname.empty()) {
+        SymbolMap map;
+        std::ifstream mapfile(mapname);
+        if (!mapfile.is_open() || map.Load(mapfile, mapname, error)) {
+            std::cerr << (error.empty() ? "Error opening " + mapname : error) << "\n";
+            return 1;
+        }
+        LabelSummary(map, cover, std::cout);
+    }
+
+    std::vector<CoverBranch> branches;
+    cover.GetBranches(branches);
+    uint64_t both {0}, taken {0};
+    for (auto &b : branches) {
+        both += (b.Taken && b.NotTaken);
+        taken += (b.Taken && !b.NotTaken);
+    }
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%llu runs, %llu words executed, %zu branches: %llu both ways, %llu only taken, "
+             "%llu only not taken\n", (unsigned long long)cover.GetRuns(), (unsigned long long)cover.CountHit(),
+             branches.size(), (unsigned long long)both, (unsigned long long)taken,
+             (unsigned long long)(branches.size() - both - taken));
+    std::cerr << buf;
+    return 0;
+}
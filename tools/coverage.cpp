@@ -0,0 +1,239 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// coverage.cpp - execution coverage map, and reading and writing coverage files.
+
+#include <algorithm>
+#include <sstream>
+#include "coverage.hpp"
+
+Coverage::Coverage()
+{
+}
+
+Coverage::~Coverage()
+{
+    Clear();
+}
+
+// Slow path of GetPage(): find the page, making it if this is the first time it has run code.
+Coverage::Page *Coverage::FindPage(uint32_t Num)
+{
+    auto it = Pages.find(Num);
+    Page *p;
+    if (it == Pages.end()) {
+        p = new Page;
+        Pages[Num] = p;
+    } else {
+        p = it->second;
+    }
+    LastNum = Num;
+    LastPage = p;
+    return p;
+}
+
+const Coverage::Page *Coverage::LookupPage(uint32_t Addr) const
+{
+    auto it = Pages.find(Addr >> COVER_PAGE_SHIFT);
+    return (it == Pages.end()) ? nullptr : it->second;
+}
+
+void Coverage::Branch(uint32_t Addr, bool Taken)
+{
+    Page *p = GetPage(Addr);
+    if (p->Counts == nullptr)
+        p->Counts = new uint64_t[COVER_PAGE_WORDS][2]();
+    p->Counts[Addr & COVER_PAGE_MASK][Taken ? 0 : 1]++;
+}
+
+bool Coverage::IsHit(uint32_t Addr) const
+{
+    const Page *p = LookupPage(Addr);
+    return (p != nullptr) && (p->Bits[(Addr & COVER_PAGE_MASK) >> 6] & (1ULL << (Addr & 63)));
+}
+
+// Get the counts for the branch at Addr. Returns false if no branch ran there.
+bool Coverage::GetBranch(uint32_t Addr, CoverBranch &Out) const
+{
+    const Page *p = LookupPage(Addr);
+    if ((p == nullptr) || (p->Counts == nullptr))
+        return false;
+    Out.Addr = Addr;
+    Out.Taken = p->Counts[Addr & COVER_PAGE_MASK][0];
+    Out.NotTaken = p->Counts[Addr & COVER_PAGE_MASK][1];
+    return Out.Taken || Out.NotTaken;
+}
+
+// Every branch that ran, in address order.
+void Coverage::GetBranches(std::vector<CoverBranch> &Out) const
+{
+    Out.clear();
+    for (auto &pg : Pages) {
+        if (pg.second->Counts == nullptr)
+            continue;
+        for (uint32_t i = 0; i < COVER_PAGE_WORDS; i++) {
+            CoverBranch b {(pg.first << COVER_PAGE_SHIFT) + i, pg.second->Counts[i][0], pg.second->Counts[i][1]};
+            if (b.Taken || b.NotTaken)
+                Out.push_back(b);
+        }
+    }
+    std::sort(Out.begin(), Out.end(), [](const CoverBranch &a, const CoverBranch &b) { return a.Addr < b.Addr; });
+}
+
+// Number of words executed.
+uint64_t Coverage::CountHit() const
+{
+    uint64_t n {0};
+    for (auto &pg : Pages)
+        for (auto bits : pg.second->Bits)
+            for (; bits != 0; bits &= (bits - 1))
+                n++;
+    return n;
+}
+
+// Add another run's coverage to this one.
+void Coverage::Merge(const Coverage &Other)
+{
+    for (auto &pg : Other.Pages) {
+        Page *p = FindPage(pg.first);
+        for (int i = 0; i < COVER_PAGE_WORDS / 64; i++)
+            p->Bits[i] |= pg.second->Bits[i];
+        if (pg.second->Counts == nullptr)
+            continue;
+        if (p->Counts == nullptr)
+            p->Counts = new uint64_t[COVER_PAGE_WORDS][2]();
+        for (int i = 0; i < COVER_PAGE_WORDS; i++) {
+            p->Counts[i][0] += pg.second->Counts[i][0];
+            p->Counts[i][1] += pg.second->Counts[i][1];
+        }
+    }
+    if (Program.empty())
+        Program = Other.Program;
+    Runs += Other.Runs;
+}
+
+void Coverage::Clear()
+{
+    for (auto &pg : Pages) {
+        delete[] pg.second->Counts;
+        delete pg.second;
+    }
+    Pages.clear();
+    LastNum = COVER_NO_PAGE;
+    LastPage = nullptr;
+    Runs = 0;
+}
+
+void Coverage::SetProgram(const std::string &Name)
+{
+    Program = Name;
+}
+
+const std::string &Coverage::GetProgram() const
+{
+    return Program;
+}
+
+void Coverage::AddRuns(uint64_t Count)
+{
+    Runs += Count;
+}
+
+uint64_t Coverage::GetRuns() const
+{
+    return Runs;
+}
+
+// Write the coverage in the format described in coverage.hpp, in address order.
+void Coverage::Write(std::ostream &Out) const
+{
+    std::vector<uint32_t> nums;
+    for (auto &pg : Pages)
+        nums.push_back(pg.first);
+    std::sort(nums.begin(), nums.end());
+
+    Out << "* Comp-o-Tron 6000 coverage\n";
+    if (!Program.empty())
+        Out << "PROG " << Program << "\n";
+    Out << "RUNS " << Runs << "\n" << std::showbase;
+    for (auto num : nums) {
+        const Page *p = Pages.at(num);
+        uint32_t base = num << COVER_PAGE_SHIFT;
+        for (uint32_t i = 0; i < COVER_PAGE_WORDS; ) {
+            if (!(p->Bits[i >> 6] & (1ULL << (i & 63)))) {
+                i++;
+                continue;
+            }
+            uint32_t start = i;
+            while ((i < COVER_PAGE_WORDS) && (p->Bits[i >> 6] & (1ULL << (i & 63))))
+                i++;
+            Out << "EXEC " << std::hex << base + start << std::dec << " " << i - start << "\n";
+        }
+    }
+    std::vector<CoverBranch> branches;
+    GetBranches(branches);
+    for (auto &b : branches)
+        Out << "BRANCH " << std::hex << b.Addr << std::dec << " " << b.Taken << " " << b.NotTaken << "\n";
+    Out << std::noshowbase;
+}
+
+// Read a coverage file and merge it into this one. Returns true on error, with Error set.
+bool Coverage::Read(std::istream &In, const std::string &Name, std::string &Error)
+{
+    std::string line;
+    int linenum {0};
+
+    while (std::getline(In, line)) {
+        linenum++;
+        std::istringstream words(line);
+        std::string kind;
+        if (!(words >> kind) || (kind[0] == '*'))
+            continue;
+        bool bad {false};
+        try {
+            std::string a, b, c;
+            if (kind == "PROG") {
+                std::getline(words >> std::ws, a);
+                if (Program.empty())
+                    Program = a;
+            } else if ((kind == "RUNS") && (words >> a)) {
+                Runs += std::stoull(a, nullptr, 0);
+            } else if ((kind == "EXEC") && (words >> a >> b)) {
+                uint32_t addr = std::stoul(a, nullptr, 0);
+                uint64_t count = std::stoull(b, nullptr, 0);
+                for (uint64_t i = 0; i < count; i++)
+                    Hit(addr + i);
+            } else if ((kind == "BRANCH") && (words >> a >> b >> c)) {
+                uint32_t addr = std::stoul(a, nullptr, 0);
+                Page *p = GetPage(addr);
+                if (p->Counts == nullptr)
+                    p->Counts = new uint64_t[COVER_PAGE_WORDS][2]();
+                p->Counts[addr & COVER_PAGE_MASK][0] += std::stoull(b, nullptr, 0);
+                p->Counts[addr & COVER_PAGE_MASK][1] += std::stoull(c, nullptr, 0);
+            } else {
+                bad = true;
+            }
+        } catch (...) {
+            bad = true;
+        }
+        if (bad) {
+            Error = Name + ":" + std::to_string(linenum) + ": bad coverage record";
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,92 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// coverage.hpp - declarations for the Coverage class, a map of which guest code has run.
+// Once attached to a CPU, every instruction executed sets a bit for its address, and every conditional
+// branch (the J* family and LOOP) counts whether it was taken. Bitmaps are kept per page and only made
+// for pages that run code, and the page last used is remembered, so the cost per instruction is a
+// compare and an OR.
+//
+// Coverage files are text, one record per line, and merge by OR-ing the bits and adding the counts.
+// Lines starting with * are comments; addresses are hex.
+//      PROG name               the program that was run
+//      RUNS count              number of runs merged into the file
+//      EXEC addr count         count words starting at addr were executed
+//      BRANCH addr taken not   a conditional branch and how many times it went each way
+#ifndef __COVERAGE_HPP__
+#define __COVERAGE_HPP__
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define COVER_PAGE_SHIFT 10
+#define COVER_PAGE_WORDS (1 << COVER_PAGE_SHIFT)
+#define COVER_PAGE_MASK (COVER_PAGE_WORDS - 1)
+#define COVER_NO_PAGE 0xFFFFFFFF    // never a page number, they are only 22 bits
+
+struct CoverBranch {
+    uint32_t Addr;
+    uint64_t Taken;
+    uint64_t NotTaken;
+};
+
+class Coverage {
+public:
+    Coverage();
+    ~Coverage();
+    void Hit(uint32_t Addr)
+    {
+        GetPage(Addr)->Bits[(Addr & COVER_PAGE_MASK) >> 6] |= 1ULL << (Addr & 63);
+    }
+    void Branch(uint32_t Addr, bool Taken);
+    bool IsHit(uint32_t Addr) const;
+    bool GetBranch(uint32_t Addr, CoverBranch &Out) const;
+    void GetBranches(std::vector<CoverBranch> &Out) const;
+    uint64_t CountHit() const;
+    void Merge(const Coverage &Other);
+    void Clear();
+    void SetProgram(const std::string &Name);
+    const std::string &GetProgram() const;
+    void AddRuns(uint64_t Count);
+    uint64_t GetRuns() const;
+    void Write(std::ostream &Out) const;
+    bool Read(std::istream &In, const std::string &Name, std::string &Error);
+
+private:
+    struct Page {
+        uint64_t Bits[COVER_PAGE_WORDS / 64] {0};
+        uint64_t (*Counts)[2] {nullptr};    // taken and not taken for each word, made at the first branch
+    };
+    std::unordered_map<uint32_t, Page *> Pages;
+    uint32_t LastNum {COVER_NO_PAGE};
+    Page *LastPage {nullptr};
+    std::string Program;
+    uint64_t Runs {0};
+
+    Page *GetPage(uint32_t Addr)
+    {
+        return ((Addr >> COVER_PAGE_SHIFT) == LastNum) ? LastPage : FindPage(Addr >> COVER_PAGE_SHIFT);
+    }
+    Page *FindPage(uint32_t Num);
+    const Page *LookupPage(uint32_t Addr) const;
+};
+
+#endif // __COVERAGE_HPP__
@@ -20,24 +20,55 @@
 // First loop executed November 4, 2021
 
 #include <cstdint>
+#include <algorithm>
 #include <new>
 #include <cassert>
 #include <climits>
+#include <iomanip>
 #include "arch.h"
 #include "cpu.hpp"
 #include "periph.hpp"
+#include "calltrack.hpp"
+#include "trace.hpp"
+#include "coverage.hpp"
+#include "heatmap.hpp"
+#include "condition.hpp"
 
 
 // Constructor, takes no arguments. If needed, we could take one to set the memory size.
+// This creates the boot core (core 0) of a new machine.
 CPU::CPU()
 {
-    Mem = new Memory(); /* using DEFAULT_SIZE */
+    Bus = new SystemBus;
+    OwnsBus = true;
+    Bus->Mem = new Memory(); /* using DEFAULT_SIZE */
+    Bus->Cores[0] = this;
+    Bus->NumCores = 1;
+    FlushTLB();
 };
 
-// Destructor
+// Constructor for secondary cores. The new core shares memory, ROM and devices with the boot core
+// and gets the next free core number.
+CPU::CPU(CPU &Boot)
+{
+    Bus = Boot.Bus;
+    assert (Bus->NumCores < MAX_CORES);
+    CoreID = Bus->NumCores++;
+    Bus->Cores[CoreID] = this;
+    FlushTLB();
+};
+
+// Destructor. Secondary cores must be destroyed before the boot core.
 CPU::~CPU()
 {
-    delete Mem;
+    ClearBreakpoints();
+    ClearWatchpoints();
+    if (OwnsBus) {
+        delete Bus->Mem;
+        delete Bus;
+    } else {
+        Bus->Cores[CoreID] = nullptr;
+    }
 };
 
 // Returns value of register at given index. This is public to allow inspection.
@@ -47,15 +78,31 @@ uint32_t CPU::ReadReg(uint8_t Index)
     return Reg[Index];
 };
 
+// Reset this core. Resetting the boot core also clears memory, so it should be done while the other
+// cores are stopped.
 void CPU::Reset()
 {
-    delete Mem;
-    Mem = new Memory();
+    if (OwnsBus)
+        Bus->Mem->Clear();
     for (int i = 0; i < 16; i++)
         Reg[i] = 0;
     Running = true;
     FHAP_Addr = 0;
     IHAP_Addr = 0;
+    PT_Base = 0;
+    PT_Len = 0;
+    PendingFault = FAULT_NO_FAULT;
+    PendingInts = 0;
+    Cycles = 0;
+    BreakCycles = UINT64_MAX;
+    for (auto &b : BreakConds)
+        b.second.Hits = 0;
+    for (auto &w : Watches)
+        w.Hits = 0;
+    for (int i = 0; i < NUMREGS; i++)
+        RegHits[i] = 0;
+    FlushTLB();
+    ResetStats();
 }
 // Write register with given value at given index.
 void CPU::WriteReg(uint8_t Index, uint32_t Value)
@@ -79,16 +126,18 @@ CPUInternalState CPU::DumpInternalState()
     retval.Halted = !Running;
     retval.FHAP_Base = FHAP_Addr;
     retval.IHAP_Base = IHAP_Addr;
+    retval.Cycles = Cycles;
     return retval;
 }
 
-// Passthrough to memory read function
+// Passthrough to memory read function. Addresses are always physical; see LoadWord() for the
+// translated version used by executing code.
 uint32_t CPU::ReadMem(uint32_t Address)
 {
     if (Address < BASE_IO_MEM) {
-        if ((Address >= ROM_Base) && (Address < ROM_Base + ROM_Len))
-            return ROM_Content[Address - ROM_Base];
-        return Mem->MemRead(Address);
+        if ((Address >= Bus->ROM_Base) && (Address < Bus->ROM_Base + Bus->ROM_Len))
+            return Bus->ROM_Content[Address - Bus->ROM_Base];
+        return Bus->Mem->MemRead(Address);
     } else {
         return ReadIO(Address);
     }
@@ -98,7 +147,7 @@ uint32_t CPU::ReadMem(uint32_t Address)
 void CPU::WriteMem(uint32_t Address, uint32_t Value)
 {
     if (Address < BASE_IO_MEM) {
-        Mem->MemWrite(Address, Value);
+        Bus->Mem->MemWrite(Address, Value);
     } else {
         WriteIO(Address, Value);
     }
@@ -162,39 +211,238 @@ void CPU::Set_IHAP(uint32_t Addr)
 
 // This is where things actually happen! Simulates a single clock cycle of the processor.
 void CPU::Step()
+{
+    if (RegWatch != 0)
+        for (int i = 0; i < NUMREGS; i++)
+            RegLast[i] = Reg[i];
+    if ((Trace != nullptr) || (Cover != nullptr))
+        DoStep<true>();
+    else
+        DoStep<false>();
+    if (RegWatch != 0)
+        CheckRegWatch();
+}
+
+// Run until the CPU halts, hits a BRK or a breakpoint, or has executed MaxCycles instructions. A breakpoint
+// stops it before the instruction there runs; running again from the same place carries on past it.
+// Returns the number of instructions executed.
+uint64_t CPU::Run(uint64_t MaxCycles)
+{
+    if ((Trace != nullptr) || (Cover != nullptr) || (BreakCount != 0) || (RegWatch != 0))
+        return DoRun<true>(MaxCycles);
+    return DoRun<false>(MaxCycles);
+}
+
+// The body of Step(). There are two copies, so that the one used when no trace recorder or coverage
+// map is attached has no code for them at all. The hooked copy of DoRun() also checks breakpoints and
+// register watches.
+template <bool Hooked>
+void CPU::DoStep()
 {
     if (!Running)
         // we are halted; don't do anything
         return;
-    // TODO check for and deal with interrupts here (better have some I/O devices first!)
+    Cycles++;
+    Broken = false;
+    Watched = false;
+    if (Hooked && (Trace != nullptr))
+        Trace->Begin(Reg, Cycles);
+    if (PendingInts.load(std::memory_order_relaxed)) {
+        TakeInterrupt();
+        if (!Running) { // couldn't enter the handler, so nothing more runs
+            if (Hooked && (Trace != nullptr))
+                Trace->End(ReadReg(REG_IP), 0, false, FAULT_NO_FAULT, Reg);
+            return;
+        }
+    }
     uint32_t iaddr = ReadReg(REG_IP);
+    // With the MMU on, any access may page fault partway through an instruction. Keep a copy of the
+    // registers so the instruction can be backed out and restarted once the handler has fixed things.
+    if (Reg[REG_FLG] & FLG_MMUENA)
+        for (int i = 0; i < NUMREGS; i++)
+            SavedReg[i] = Reg[i];
+    InstAddr = iaddr;
     IncrIP();
-    CurrentInst = new Instruction(ReadMem(iaddr));
-    uint32_t ftype = Execute();
-    delete CurrentInst;
+    uint32_t iword = FetchWord(iaddr);
+    uint32_t ftype = PendingFault;
+    bool fetched = (ftype == FAULT_NO_FAULT);
+    if (fetched) {
+        CurrentInst = new Instruction(iword);
+        CPU_STAT(Stats.Opcodes[CurrentInst->GetOpcode()]++);
+        ftype = Execute();
+        if (Hooked && (Cover != nullptr)) {
+            Cover->Hit(iaddr);
+            if (CurrentInst->IsDirectValInstr())
+                Cover->Hit(iaddr + 1);
+            uint8_t op = CurrentInst->GetOpcode();
+            if ((ftype == FAULT_NO_FAULT) && !PendingFault &&
+                (((op >= OP_JZERO) && (op <= OP_JNUNDER)) || (op == OP_LOOP)))
+                Cover->Branch(iaddr, Reg[REG_IP] != iaddr + (CurrentInst->IsDirectValInstr() ? 2 : 1));
+        }
+        delete CurrentInst;
+    }
+    if (PendingFault) {
+        for (int i = 0; i < NUMREGS; i++)
+            Reg[i] = SavedReg[i];
+        ftype = PendingFault;
+        PendingFault = FAULT_NO_FAULT;
+    }
     if (ftype)
         Fault(ftype);
+    if (Hooked && (Trace != nullptr))
+        Trace->End(iaddr, iword, fetched, ftype, Reg);
 };
 
+// The check Run() makes before each instruction. Code mostly stays in one page for a while, so the page's
+// bitmap (or the lack of one) is kept from the last lookup.
+inline bool CPU::HitBreakpoint(uint32_t Addr)
+{
+    uint32_t page = Addr >> BREAK_PAGE_SHIFT;
+    if (page != BreakCachePage) {
+        auto it = BreakPages.find(page);
+        BreakCache = (it == BreakPages.end()) ? nullptr : it->second;
+        BreakCachePage = page;
+    }
+    if (BreakCache == nullptr)
+        return false;
+    uint32_t bit = Addr & (BREAK_PAGE_WORDS - 1);
+    return (BreakCache->Bits[bit / 64] >> (bit % 64)) & 1;
+}
+
+// Run() has reached a breakpoint. If it has a condition, count the hit and stop only if the condition holds.
+bool CPU::TakeBreakpoint(uint32_t Addr)
+{
+    auto it = BreakConds.find(Addr);
+    if (it == BreakConds.end())
+        return true;
+    it->second.Hits++;
+    return it->second.Cond->Eval(*this, it->second.Hits, nullptr);
+}
+
+// Compare the watched registers with what they were before the instruction. Only the first change that
+// passes its condition stops the run, but all of them are remembered for the next instruction.
+void CPU::CheckRegWatch()
+{
+    for (uint32_t i = 0; i < NUMREGS; i++) {
+        if (!((RegWatch >> i) & 1) || (Reg[i] == RegLast[i]))
+            continue;
+        WatchHit hit {InstAddr, i, WATCH_REG, RegLast[i], Reg[i]};
+        RegLast[i] = Reg[i];
+        if (Watched)
+            continue;
+        RegHits[i]++;
+        if ((RegConds[i] != nullptr) && !RegConds[i]->Eval(*this, RegHits[i], &hit))
+            continue;
+        LastWatch = hit;
+        Watched = true;
+        Broken = true;
+    }
+}
+
+template <bool Hooked>
+uint64_t CPU::DoRun(uint64_t MaxCycles)
+{
+    uint64_t start = Cycles;
+
+    if (Hooked)
+        for (int i = 0; i < NUMREGS; i++)
+            RegLast[i] = Reg[i];
+    while (Running && (Cycles - start < MaxCycles)) {
+        if (Hooked && (BreakCount != 0) && HitBreakpoint(Reg[REG_IP])) {
+            if (((Cycles != BreakCycles) || (Reg[REG_IP] != BreakAddr)) &&
+                (BreakConds.empty() || TakeBreakpoint(Reg[REG_IP]))) {
+                BreakCycles = Cycles;
+                BreakAddr = Reg[REG_IP];
+                Broken = true;
+                Watched = false;    // nothing ran, so a hit from the last instruction is old news
+                break;
+            }
+        }
+        DoStep<Hooked>();
+        if (Hooked && (RegWatch != 0))
+            CheckRegWatch();
+        if (Broken)
+            break;
+    }
+    return Cycles - start;
+}
+
+// Getter for the cycle counter. Every instruction takes one cycle, so this is also the instruction count.
+uint64_t CPU::GetCycles() const
+{
+    return Cycles;
+}
+
 // Fault processing. When a fault is found, save the CPU state and jump to the registered fault
 // handler in the FHAP. Note that there is no error checking, so if the FHAP isn't set up, the CPU
 // will immediately double-fault on the next clock.
+// For page faults, the faulting virtual address is pushed after the machine state. If saving the state
+// itself page faults, that is treated as a double fault.
 void CPU::Fault(uint32_t Type)
 {
     uint32_t newIP;
+    uint32_t vaddr = FaultAddr;
 
     if (IsFlagSet(FLG_FAULT)) {
         // already in a fault, this is a double-fault
+        CPU_STAT(Stats.Faults[0]++);
         Halt();
         return;
     }
-    Reg[REG_IP]--;  // IP is pointing to the next instruction, so roll back to the failing one.
+    CPU_STAT(Stats.Faults[Type < STAT_NUM_FAULTS ? Type : 0]++);
+    WriteReg(REG_IP, InstAddr);  // IP may be past a direct value, so roll back to the failing instruction.
     PushState();
+    if (Type == FAULT_PAGE)
+        PushWord(vaddr);
     SetFlag(FLG_FAULT);
-    newIP = ReadMem(FHAP_Addr + (Type - 1));
+    newIP = LoadWord(FHAP_Addr + (Type - 1));
+    if (PendingFault) {
+        PendingFault = FAULT_NO_FAULT;
+        Halt();
+        return;
+    }
     WriteReg(REG_IP, newIP);
+    if (Calls != nullptr)
+        Calls->EnterHandler(newIP, ReadReg(REG_SP), Cycles);
 };
 
+// Start the interrupt handler for the lowest numbered pending interrupt, if interrupts are allowed right now.
+// Called before each instruction when anything is pending. Saving state works just as for a fault.
+void CPU::TakeInterrupt()
+{
+    uint32_t flags = Reg[REG_FLG];
+
+    if (!(flags & FLG_INTENA) || (flags & (FLG_IN_INT | FLG_FAULT)))
+        return;
+    uint32_t pending = PendingInts.load(std::memory_order_acquire);
+    for (uint32_t line = 0; line < NUM_INTS; line++) {
+        uint32_t bit = 1 << line;
+        if ((pending & bit) && (flags & (FLG_INTEN0 << line))) {
+            PendingInts.fetch_and(~bit, std::memory_order_acq_rel);
+            CPU_STAT(Stats.Interrupts++);
+            PushState();
+            SetFlag(FLG_IN_INT);
+            uint32_t newIP = LoadWord(IHAP_Addr + line);
+            if (PendingFault) { // can't save state or find the handler, give up
+                PendingFault = FAULT_NO_FAULT;
+                Halt();
+                return;
+            }
+            WriteReg(REG_IP, newIP);
+            if (Calls != nullptr)
+                Calls->EnterHandler(newIP, ReadReg(REG_SP), Cycles);
+            return;
+        }
+    }
+}
+
+// Flag an interrupt as pending on this core. Safe to call from any thread; this is how IPI works.
+void CPU::RaiseInterrupt(uint32_t Line)
+{
+    if (Line < NUM_INTS)
+        PendingInts.fetch_or(1 << Line, std::memory_order_acq_rel);
+}
+
 // Save the CPU state to the stack, in preparation for calling a fault handler, an interrupt handler, or a subroutine.
 // Fault handlers can look at the stack to get the IP of the original fault location.
 // Returns fault status.
@@ -209,7 +457,7 @@ int CPU::PushState()
         return FAULT_STACK;
     }
     for (int i = 0; i < NUMREGS; i++)
-        WriteMem(mem_base + i, ReadReg(i));
+        StoreWord(mem_base + i, ReadReg(i));
     WriteReg(REG_SP, mem_base + NUMREGS);
     return FAULT_NO_FAULT;
 };
@@ -225,8 +473,64 @@ int CPU::PopState()
         return FAULT_STACK;
     }
     mem_base -= NUMREGS;
+    // Read everything before touching any register, so a restored FLG can't turn the MMU on or off
+    // halfway through.
+    uint32_t tmp[NUMREGS];
+    for (int i = 0; i < NUMREGS; i++)
+        tmp[i] = LoadWord(mem_base + i);
+    for (int i = 0; i < NUMREGS; i++)
+        WriteReg(i, tmp[i]);
+    return FAULT_NO_FAULT;
+};
+
+// Save only the registers selected by the mask to the stack, lowest register first. Used by SSTATEM.
+// The layout and fault checks match PushState(), just with fewer words.
+// Returns fault status.
+int CPU::PushStateMasked(uint32_t Mask)
+{
+    uint32_t mem_base = ReadReg(REG_SP);
+    uint32_t count {0};
+
+    Mask &= STATE_MASK_ALL;
+    for (uint32_t m = Mask; m != 0; m &= (m - 1))
+        count++;
+    if (mem_base > (MAX_ADDR - count)) { // no space for state
+        return FAULT_STACK;
+    }
+    uint32_t addr = mem_base;
+    for (int i = 0; i < NUMREGS; i++)
+        if (Mask & (1 << i))
+            StoreWord(addr++, ReadReg(i));
+    WriteReg(REG_SP, addr);
+    return FAULT_NO_FAULT;
+};
+
+// Restore the registers selected by the mask from the stack. Used by LSTATEM.
+// Like LSTATE, R0 and IP are left alone. SP is rolled back past the saved words rather than
+// restored from its slot.
+// Returns fault status.
+int CPU::PopStateMasked(uint32_t Mask)
+{
+    uint32_t mem_base = ReadReg(REG_SP);
+    uint32_t count {0};
+
+    Mask &= STATE_MASK_ALL;
+    for (uint32_t m = Mask; m != 0; m &= (m - 1))
+        count++;
+    if (mem_base < count) { // stack underflow
+        return FAULT_STACK;
+    }
+    mem_base -= count;
+    // As in PopState(), read everything first.
+    uint32_t tmp[NUMREGS];
+    uint32_t addr = mem_base;
     for (int i = 0; i < NUMREGS; i++)
-        WriteReg(i, ReadMem(mem_base + i));
+        if (Mask & (1 << i))
+            tmp[i] = LoadWord(addr++);
+    for (int i = 0; i < NUMREGS; i++)
+        if ((Mask & (1 << i)) && (i != REG_R0) && (i != REG_SP) && (i != REG_IP))
+            WriteReg(i, tmp[i]);
+    WriteReg(REG_SP, mem_base);
     return FAULT_NO_FAULT;
 };
 
@@ -238,7 +542,7 @@ int CPU::PushWord(uint32_t Word)
     if (mem_base == MAX_ADDR) { // overflow
         return FAULT_STACK;
     }
-    WriteMem(mem_base, Word);
+    StoreWord(mem_base, Word);
     mem_base++;
     WriteReg(REG_SP, mem_base);
     return FAULT_NO_FAULT;
@@ -255,7 +559,7 @@ int CPU::PopWord(uint32_t &Word)
     }
 
     mem_base--;
-    Word = ReadMem(mem_base);
+    Word = LoadWord(mem_base);
     WriteReg(REG_SP, mem_base);
     return FAULT_NO_FAULT;
 };
@@ -272,7 +576,6 @@ uint32_t CPU::Execute()
     // For ease of comprehension, this is all open-coded. It would be possible to
     // set up a bunch of classes and do some polymorphic magic and dynamic casts,
     // but that would get ugly and confusing very quickly.
-    Broken = false;
     switch (CurrentInst->GetType()) {
         case op_no_args:
             retval = ExecuteNoArgs();
@@ -292,6 +595,12 @@ uint32_t CPU::Execute()
         case op_2src_dest:
             retval = Execute2SrcDest();
             break;
+        case op_loop:
+            retval = ExecuteLoop();
+            break;
+        case op_direct_only:
+            retval = ExecuteDirectOnly();
+            break;
         default:
             retval = FAULT_BAD_INSTR;
             break;
@@ -304,18 +613,24 @@ uint32_t CPU::Execute()
 // Returns fault status.
 uint32_t CPU::PutToDest(uint32_t Value)
 {
-    auto dest = CurrentInst->GetDestReg();
+    return PutToReg(CurrentInst->GetDestReg(), Value);
+};
 
-    switch (dest.GetType())
+// Store the value to the location specified by the given register. This is the mirror image of GetFromReg(), and
+// is used directly by instructions (like LOOP) that write back to a source register.
+// Returns fault status.
+uint32_t CPU::PutToReg(RegisterArg DestReg, uint32_t Value)
+{
+    switch (DestReg.GetType())
     {
         case rt_indirect:
         {
-            uint32_t addr = ReadReg(dest.GetNum());
-            WriteMem(addr, Value);
+            uint32_t addr = ReadReg(DestReg.GetNum());
+            StoreWord(addr, Value);
             break;
         }
         case rt_value:
-            WriteReg(dest.GetNum(), Value);
+            WriteReg(DestReg.GetNum(), Value);
             break;
         default:
             return FAULT_BAD_INSTR;
@@ -335,7 +650,7 @@ uint32_t CPU::GetFromReg(RegisterArg SrcReg, uint32_t &Value)
         case rt_indirect:
         {
             uint32_t memaddr = ReadReg(SrcReg.GetNum());
-            Value = ReadMem(memaddr);
+            Value = LoadWord(memaddr);
             break;
         }
         case rt_value:
@@ -354,11 +669,127 @@ uint32_t CPU::RetrieveDirectValue()
 {
 
     uint32_t addr = ReadReg(REG_IP);
-    uint32_t retval = ReadMem(addr);
+    uint32_t retval = FetchWord(addr);
+    CPU_STAT(Stats.DirectFetches++);
+    CPU_TRACE(Direct(retval));
     IncrIP();
     return retval;
 };
 
+// Is the address on a page or I/O slot that has a watchpoint? Only called once there are some.
+inline bool CPU::IsWatched(uint32_t Addr) const
+{
+    if (Addr >= BASE_IO_MEM)
+        return (WatchIO >> ((Addr >> 16) & 0xF)) & 1;
+    uint32_t page = Addr >> MEM_PAGE_SHIFT;
+    return (page < WatchPages.size()) && WatchPages[page];
+}
+
+// Read a word on behalf of the running program. With the MMU off this is just ReadMem(). With it on, the
+// address is translated first; if that fails, the page fault is left pending for Step() to deliver and
+// the returned value is garbage.
+uint32_t CPU::LoadWord(uint32_t Address)
+{
+    if (Reg[REG_FLG] & FLG_MMUENA) {
+        uint32_t paddr;
+        if (Translate(Address, tlb_read, paddr))
+            return MEM_READ_INVALID;
+        Address = paddr;
+    }
+    CPU_STAT(Stats.Reads[AddrSpace(Address)]++);
+    CPU_STAT(if (Heat != nullptr) Heat->Read(Address, Cycles));
+    if (Watches.empty())
+        return ReadMem(Address);
+    uint32_t value = ReadMem(Address);
+    if (IsWatched(Address))
+        CheckWatch(Address, WATCH_READ, value, value);
+    return value;
+}
+
+// Write a word on behalf of the running program. Once a page fault is pending, further writes by the
+// same instruction are dropped so the instruction can be restarted cleanly.
+void CPU::StoreWord(uint32_t Address, uint32_t Value)
+{
+    uint32_t paddr = Address;
+
+    if (Reg[REG_FLG] & FLG_MMUENA) {
+        if (PendingFault || Translate(Address, tlb_write, paddr))
+            return;
+    }
+    CPU_TRACE(Write(Address, Value));
+    CPU_STAT(Stats.Writes[AddrSpace(paddr)]++);
+    CPU_STAT(if (Heat != nullptr) Heat->Write(paddr, Cycles));
+    if (!Watches.empty() && IsWatched(paddr))
+        CheckWatch(paddr, WATCH_WRITE, (paddr < BASE_IO_MEM) ? ReadMem(paddr) : Value, Value);
+    WriteMem(paddr, Value);
+}
+
+// Fetch an instruction word or direct value. Same as LoadWord() but needs execute permission.
+uint32_t CPU::FetchWord(uint32_t Address)
+{
+    if (Reg[REG_FLG] & FLG_MMUENA) {
+        uint32_t paddr;
+        if (Translate(Address, tlb_exec, paddr))
+            return MEM_READ_INVALID;
+        Address = paddr;
+    }
+    CPU_STAT(Stats.Fetches[AddrSpace(Address)]++);
+    CPU_STAT(if (Heat != nullptr) Heat->Fetch(Address, Cycles));
+    return ReadMem(Address);
+}
+
+// Translate a virtual address to a physical one. The fast path is a single tag compare in the TLB.
+// Returns true (and raises a pending page fault) if the access is not allowed.
+bool CPU::Translate(uint32_t VAddr, _tlb_access Access, uint32_t &PAddr)
+{
+    if (VAddr >= BASE_IO_MEM) { // I/O space is never mapped
+        PAddr = VAddr;
+        return false;
+    }
+    uint32_t vpn = VAddr >> MMU_PAGE_SHIFT;
+    TLBEntry &entry = TLB[vpn & (TLB_SIZE - 1)];
+    if (entry.Tag[Access] == vpn) {
+        PAddr = entry.Frame | (VAddr & MMU_OFFSET_MASK);
+        return false;
+    }
+    return TLBMiss(VAddr, Access, PAddr);
+}
+
+// Slow path for Translate(). Walk the page table, refill the TLB entry, then check permissions.
+// Returns true (and raises a pending page fault) if the access is not allowed.
+bool CPU::TLBMiss(uint32_t VAddr, _tlb_access Access, uint32_t &PAddr)
+{
+    uint32_t vpn = VAddr >> MMU_PAGE_SHIFT;
+    uint32_t pte {0};
+
+    if (vpn < PT_Len)
+        pte = ReadMem(PT_Base + vpn); // page table is always physical
+    if (pte & PTE_VALID) {
+        TLBEntry &entry = TLB[vpn & (TLB_SIZE - 1)];
+        entry.Frame = pte & PTE_FRAME_MASK;
+        entry.Tag[tlb_read] = vpn;
+        entry.Tag[tlb_write] = (pte & PTE_WRITE) ? vpn : TLB_NO_TAG;
+        entry.Tag[tlb_exec] = (pte & PTE_EXEC) ? vpn : TLB_NO_TAG;
+        if (entry.Tag[Access] == vpn) {
+            PAddr = entry.Frame | (VAddr & MMU_OFFSET_MASK);
+            return false;
+        }
+    }
+    if (PendingFault == FAULT_NO_FAULT) { // report the first failure only
+        PendingFault = FAULT_PAGE;
+        FaultAddr = VAddr;
+    }
+    return true;
+}
+
+// Discard all cached translations.
+void CPU::FlushTLB()
+{
+    for (int i = 0; i < TLB_SIZE; i++)
+        for (int j = 0; j < tlb_num_access; j++)
+            TLB[i].Tag[j] = TLB_NO_TAG;
+}
+
 // Stop the CPU, forever.
 void CPU::Halt()
 {
@@ -396,11 +827,15 @@ uint32_t CPU::ExecuteNoArgs()
             uint32_t newIP {0};
             faultval = PopWord(newIP);
             WriteReg(REG_IP, newIP);
+            if ((Calls != nullptr) && !faultval && !PendingFault)
+                Calls->Return(ReadReg(REG_SP), Cycles);
             break;
         }
         case OP_IRET:
             faultval = PopState(); // IP restored to previous position, fault flag cleared
             ClearFlag(FLG_IN_INT);
+            if ((Calls != nullptr) && !faultval && !PendingFault)
+                Calls->ExitHandler(ReadReg(REG_SP), Cycles);
             break;
         case OP_SIGNED:
             SetFlag(FLG_SIGNED);
@@ -414,6 +849,15 @@ uint32_t CPU::ExecuteNoArgs()
         case OP_INTDIS:
             ClearFlag(FLG_INTENA);
             break;
+        case OP_MMUENA:
+            SetFlag(FLG_MMUENA);
+            break;
+        case OP_MMUDIS:
+            ClearFlag(FLG_MMUENA);
+            break;
+        case OP_TLBFLUSH:
+            FlushTLB();
+            break;
         case OP_NOP:
             // do nothing
             break;
@@ -511,6 +955,21 @@ uint32_t CPU::ExecuteSrcOnly()
                 }
                 Set_IHAP(tmp);
                 break;
+            case OP_SETPTB:
+                PT_Base = tmp;
+                FlushTLB();
+                break;
+            case OP_SETPTL:
+                PT_Len = tmp;
+                FlushTLB();
+                break;
+            case OP_IPI:
+                if ((tmp >= MAX_CORES) || (Bus->Cores[tmp] == nullptr)) {
+                    faultval = FAULT_BAD_ADDR;
+                    break;
+                }
+                Bus->Cores[tmp]->RaiseInterrupt(INT_IPI);
+                break;
             default:
                 faultval = FAULT_BAD_INSTR;
                 break;
@@ -530,6 +989,8 @@ uint32_t CPU::ExecuteDestOnly()
         faultval = PopWord(tmp);
         if (faultval == FAULT_NO_FAULT)
             faultval = PutToDest(tmp);
+    } else if (opcode == OP_COREID) {
+        faultval = PutToDest(CoreID);
     } else {
         faultval = GetFromReg(CurrentInst->GetDestReg(), tmp);
         if (faultval == FAULT_NO_FAULT)
@@ -543,11 +1004,9 @@ uint32_t CPU::ExecuteDestOnly()
                 case OP_INCR:
                     ClearMathFlags();
                     if (IsFlagSet(FLG_SIGNED)) {
-                        int32_t stmp = tmp;
-                        stmp++;
-                        if (stmp == INT_MIN) // overflow
+                        tmp++; // in unsigned, as signed overflow is undefined in C++
+                        if (tmp == (uint32_t)INT_MIN) // overflow
                             SetFlag(FLG_OVER);
-                        tmp = stmp;
                     } else { // unsigned math
                         tmp++;
                         if (tmp == 0) // overflow
@@ -559,11 +1018,9 @@ uint32_t CPU::ExecuteDestOnly()
                 case OP_DECR:
                     ClearMathFlags();
                     if (IsFlagSet(FLG_SIGNED)) {
-                        int32_t stmp = tmp;
-                        stmp--;
-                        if (stmp == INT_MAX) // underflow
+                        tmp--;
+                        if (tmp == (uint32_t)INT_MAX) // underflow
                             SetFlag(FLG_UNDER);
-                        tmp = stmp;
                     } else { // unsigned math
                         tmp--;
                         if (tmp == 0xFFFFFFFF)
@@ -628,6 +1085,8 @@ uint32_t CPU::ExecuteControlFlow()
                 faultval = PushWord(ReadReg(REG_IP));
                 if (faultval == FAULT_NO_FAULT)
                     WriteReg(REG_IP, tmp);
+                if ((Calls != nullptr) && !faultval && !PendingFault)
+                    Calls->Call(tmp, ReadReg(REG_SP), Cycles);
                 break;
             default:
                 faultval = FAULT_BAD_INSTR;
@@ -637,6 +1096,53 @@ uint32_t CPU::ExecuteControlFlow()
     return faultval;
 }
 
+// Subfunction to execute the LOOP instruction. The counter comes from src1, the target from dest or the
+// direct value. No flags are touched; see arch.h.
+// Returns fault status. May change registers and memory.
+uint32_t CPU::ExecuteLoop()
+{
+    uint32_t faultval {FAULT_NO_FAULT};
+    uint32_t target {0};
+    uint32_t count;
+
+    if (CurrentInst->IsDirectValInstr())
+        target = RetrieveDirectValue(); // cannot fault
+    else
+        faultval = GetFromReg(CurrentInst->GetDestReg(), target);
+    if (faultval == FAULT_NO_FAULT)
+        faultval = GetFromReg(CurrentInst->GetSrc1Reg(), count);
+    if (faultval == FAULT_NO_FAULT) {
+        count--;
+        faultval = PutToReg(CurrentInst->GetSrc1Reg(), count);
+        if ((faultval == FAULT_NO_FAULT) && (count != 0))
+            WriteReg(REG_IP, target);
+    }
+    return faultval;
+}
+
+// Subfunction to execute instructions that take only a direct value.
+// Returns fault status. May change registers and memory.
+uint32_t CPU::ExecuteDirectOnly()
+{
+    uint32_t faultval {FAULT_NO_FAULT};
+
+    if (!CurrentInst->IsDirectValInstr())
+        return FAULT_BAD_INSTR;
+    uint32_t val = RetrieveDirectValue();
+    switch (CurrentInst->GetOpcode()) {
+        case OP_SSTATEM:
+            faultval = PushStateMasked(val);
+            break;
+        case OP_LSTATEM:
+            faultval = PopStateMasked(val);
+            break;
+        default:
+            faultval = FAULT_BAD_INSTR;
+            break;
+    }
+    return faultval;
+}
+
 // Subfunction to execute instructions with two source and one destination register specified.
 // Returns fault status. May change registers and memory.
 uint32_t CPU::Execute2SrcDest()
@@ -649,6 +1155,8 @@ uint32_t CPU::Execute2SrcDest()
     faultval = GetFromReg(CurrentInst->GetSrc1Reg(), src1val);
     if (faultval == FAULT_NO_FAULT)
         faultval = GetFromReg(CurrentInst->GetSrc2Reg(), src2val);
+    if ((faultval == FAULT_NO_FAULT) && (opcode == OP_CAS)) // doesn't fit the pattern below
+        return ExecuteCAS(src1val, src2val);
     if (faultval == FAULT_NO_FAULT) {
         ClearMathFlags();
         switch (opcode) {
@@ -656,7 +1164,7 @@ uint32_t CPU::Execute2SrcDest()
                 if (IsFlagSet(FLG_SIGNED)) {
                     int32_t s1 = src1val;
                     int32_t s2 = src2val;
-                    int32_t d = s1 + s2;
+                    int32_t d = (int32_t)(src1val + src2val); // wraps, where signed overflow wouldn't
                     if (d < s1 || d < s2)
                         SetFlag(FLG_OVER);
                     destval = d;
@@ -670,7 +1178,7 @@ uint32_t CPU::Execute2SrcDest()
                 if (IsFlagSet(FLG_SIGNED)) {
                     int32_t s1 = src1val;
                     int32_t s2 = src2val;
-                    int32_t d = s1 - s2;
+                    int32_t d = (int32_t)(src1val - src2val);
                     if (d > s1 || d > s2)
                         SetFlag(FLG_UNDER);
                     destval = d;
@@ -690,11 +1198,24 @@ uint32_t CPU::Execute2SrcDest()
                 destval = src1val ^ src2val;
                 break;
             case OP_SHIFTR:
+                // A shift of 32 or more is undefined in C++; everything shifts out.
+                if (src2val > 31) {
+                    destval = 0;
+                    if (src1val != 0)
+                        SetFlag(FLG_UNDER);
+                    break;
+                }
                 destval = src1val >> src2val;
                 if (destval << src2val != src1val)
                     SetFlag(FLG_UNDER);
                 break;
             case OP_SHIFTL:
+                if (src2val > 31) {
+                    destval = 0;
+                    if (src1val != 0)
+                        SetFlag(FLG_OVER);
+                    break;
+                }
                 destval = src1val << src2val;
                 if (destval >> src2val != src1val)
                     SetFlag(FLG_OVER);
@@ -711,6 +1232,45 @@ uint32_t CPU::Execute2SrcDest()
     return faultval;
 }
 
+// Subfunction to execute CAS, given the expected and new values. The dest register must be indirect.
+// Returns fault status. May change flags and memory.
+uint32_t CPU::ExecuteCAS(uint32_t Expected, uint32_t Desired)
+{
+    RegisterArg dest = CurrentInst->GetDestReg();
+
+    if (dest.GetType() != rt_indirect)
+        return FAULT_BAD_INSTR;
+    if (PendingFault) // reading the operands page faulted, so the instruction will be restarted
+        return FAULT_NO_FAULT;
+    uint32_t addr = ReadReg(dest.GetNum());
+    if (Reg[REG_FLG] & FLG_MMUENA) {
+        uint32_t paddr;
+        if (Translate(addr, tlb_write, paddr))
+            return FAULT_NO_FAULT; // page fault is pending
+        addr = paddr;
+    }
+    if (addr >= BASE_IO_MEM)
+        return FAULT_BAD_ADDR;
+    // The word is always read, but only written if it matched
+    CPU_STAT(Stats.Reads[AddrSpace(addr)]++);
+    CPU_STAT(if (Heat != nullptr) Heat->Read(addr, Cycles));
+    if (!Watches.empty() && IsWatched(addr)) {
+        uint32_t cur = ReadMem(addr);
+        CheckWatch(addr, WATCH_READ, cur, cur);
+    }
+    if (Bus->Mem->MemCompareExchange(addr, Expected, Desired)) {
+        CPU_STAT(Stats.Writes[AddrSpace(addr)]++);
+        CPU_STAT(if (Heat != nullptr) Heat->Write(addr, Cycles));
+        CPU_TRACE(Write(ReadReg(dest.GetNum()), Desired));
+        if (!Watches.empty() && IsWatched(addr))
+            CheckWatch(addr, WATCH_WRITE, Expected, Desired);
+        SetFlag(FLG_ZERO);
+    } else {
+        ClearFlag(FLG_ZERO);
+    }
+    return FAULT_NO_FAULT;
+}
+
 #define IOMEM_MAX 0xFFFF // 64k words
 #define IOMEM_DEV_BASE(_i) (BASE_IO_MEM + (((_i) + 1) << 16))
 #define IOMEM_INDEX(_a) ((((_a) & 0x000F0000) >> 16) - 1)
@@ -721,8 +1281,8 @@ uint32_t CPU::Execute2SrcDest()
 
 int CPU::FindPeriphTableEntry(Periph *Dev)
 {
-    for (int i = 0; i < PERIPH_MAP_SIZE; i++)
-        if (Devices[i].Owner == Dev)
+    for (int i = 0; i < PERIPH_MAP_ENTRIES; i++)
+        if (Bus->Devices[i].Owner == Dev)
             return i;
 
     // not found
@@ -733,85 +1293,403 @@ bool CPU::AddDevice(Periph *Dev)
 {
     uint32_t memsize = Dev->GetMemSize();
     int index;
+    std::lock_guard<std::mutex> lock(Bus->IOLock);
 
     if (FindPeriphTableEntry(Dev) >= 0)
         return false;
     if (memsize > IOMEM_MAX)
         return false;
-    for (index = 0; index < PERIPH_MAP_SIZE; index++) {
-        if (Devices[index].Owner == nullptr)
+    for (index = 0; index < PERIPH_MAP_ENTRIES; index++) {
+        if (Bus->Devices[index].Owner == nullptr)
             break;
     }
-    if (index == PERIPH_MAP_SIZE - 1)  // Max 15 devices
+    if (index >= PERIPH_MAP_ENTRIES - 1)  // Max 15 devices, the map itself has the first 64k
         return false;
 
-    Devices[index].Owner = Dev;
-    Devices[index].Entry.DDN = Dev->GetDDN();
-    Devices[index].Entry.Base_Addr = IOMEM_DEV_BASE(index);
-    Devices[index].Entry.IOMemLen = memsize;
+    Bus->Devices[index].Owner = Dev;
+    Bus->Devices[index].Entry.DDN = Dev->GetDDN();
+    Bus->Devices[index].Entry.Base_Addr = IOMEM_DEV_BASE(index);
+    Bus->Devices[index].Entry.IOMemLen = memsize;
     if (Dev->InterruptSupported())
-        Devices[index].Entry.Interrupt = index;
+        Bus->Devices[index].Entry.Interrupt = index;
     return true;
 }
 
 void CPU::RemoveDevice(Periph *Dev)
 {
+    std::lock_guard<std::mutex> lock(Bus->IOLock);
     int index = FindPeriphTableEntry(Dev);
     if (index == -1)
         return;
-    Devices[index].Owner = nullptr;
-    Devices[index].Entry.DDN = 0;
-    Devices[index].Entry.Base_Addr = 0;
-    Devices[index].Entry.IOMemLen = 0;
-    Devices[index].Entry.Interrupt = 0;
+    Bus->Devices[index].Owner = nullptr;
+    Bus->Devices[index].Entry.DDN = 0;
+    Bus->Devices[index].Entry.Base_Addr = 0;
+    Bus->Devices[index].Entry.IOMemLen = 0;
+    Bus->Devices[index].Entry.Interrupt = 0;
 }
 
-// Add a ROM image, provided by the caller
-bool CPU::AddROM(uint32_t *ROM, uint32_t Base, uint32_t Len)
+// The device in the given slot of the peripheral map, or nullptr if the slot is empty.
+Periph *CPU::GetDevice(int Index) const
 {
-    if (Base < Mem->GetMemSize())
+    if ((Index < 0) || (Index >= PERIPH_MAP_ENTRIES))
+        return nullptr;
+    return Bus->Devices[Index].Owner;
+}
+
+// Add a ROM image, provided by the caller. The image is only ever read, so one copy can be shared by
+// many CPUs.
+bool CPU::AddROM(const uint32_t *ROM, uint32_t Base, uint32_t Len)
+{
+    if (Base < Bus->Mem->GetMemSize())
         return true;
     if ((Base + Len) > BASE_IO_MEM)
         return true;
-    ROM_Base = Base;
-    ROM_Content = ROM;
-    ROM_Len = Len;
+    Bus->ROM_Base = Base;
+    Bus->ROM_Content = ROM;
+    Bus->ROM_Len = Len;
+    return false;
+}
+
+// Replace this machine's memory with a copy-on-write clone of another machine's, so machines running the
+// same program share every page neither of them has written. Only the boot core can do this, and neither
+// machine may be running. Returns true on error.
+bool CPU::CloneMemory(CPU &Source)
+{
+    if (!OwnsBus || (Source.Bus == Bus))
+        return true;
+    delete Bus->Mem;
+    Bus->Mem = Source.Bus->Mem->Clone();
     return false;
 }
 
+// Memory use of this machine, in pages.
+MemPageCounts CPU::GetMemPageCounts()
+{
+    return Bus->Mem->GetPageCounts();
+}
+
 bool CPU::IsBroken() const
 {
     return Broken;
 }
 
+// Set an execution breakpoint at the given (virtual) address. Only Run() stops for breakpoints; Step()
+// always runs the next instruction. Breakpoints belong to the core and survive Reset().
+// Returns true if there was already one there.
+bool CPU::AddBreakpoint(uint32_t Addr)
+{
+    uint32_t page = Addr >> BREAK_PAGE_SHIFT;
+    uint32_t bit = Addr & (BREAK_PAGE_WORDS - 1);
+    BreakPage *&bp = BreakPages[page];
+
+    if (bp == nullptr)
+        bp = new BreakPage {};
+    if (bp->Bits[bit / 64] & ((uint64_t)1 << (bit % 64)))
+        return true;
+    bp->Bits[bit / 64] |= (uint64_t)1 << (bit % 64);
+    bp->Count++;
+    BreakCount++;
+    BreakCachePage = BREAK_NO_PAGE;
+    return false;
+}
+
+// Returns true if there was no breakpoint at the given address.
+bool CPU::RemoveBreakpoint(uint32_t Addr)
+{
+    uint32_t page = Addr >> BREAK_PAGE_SHIFT;
+    uint32_t bit = Addr & (BREAK_PAGE_WORDS - 1);
+
+    if (!IsBreakpoint(Addr))
+        return true;
+    BreakPage *bp = BreakPages[page];
+    bp->Bits[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    SetBreakCondition(Addr, nullptr);
+    BreakCount--;
+    if (--bp->Count == 0) {
+        BreakPages.erase(page);
+        delete bp;
+    }
+    BreakCachePage = BREAK_NO_PAGE;
+    return false;
+}
+
+void CPU::ClearBreakpoints()
+{
+    for (auto &p : BreakPages)
+        delete p.second;
+    BreakPages.clear();
+    for (auto &b : BreakConds)
+        delete b.second.Cond;
+    BreakConds.clear();
+    BreakCount = 0;
+    BreakCachePage = BREAK_NO_PAGE;
+}
+
+// Give the breakpoint at Addr a condition, replacing any it had, or take it away if Cond is null. The CPU
+// owns the condition from then on. Returns true, and leaves Cond to the caller, if there is no breakpoint.
+bool CPU::SetBreakCondition(uint32_t Addr, BreakCondition *Cond)
+{
+    auto it = BreakConds.find(Addr);
+    if (it != BreakConds.end()) {
+        if (Cond == it->second.Cond)
+            return false;
+        delete it->second.Cond;
+        BreakConds.erase(it);
+    }
+    if (Cond == nullptr)
+        return false;
+    if (!IsBreakpoint(Addr))
+        return true;
+    BreakConds[Addr] = {Cond, 0};
+    return false;
+}
+
+// Null if the breakpoint has no condition.
+const BreakCondition *CPU::GetBreakCondition(uint32_t Addr) const
+{
+    auto it = BreakConds.find(Addr);
+    return (it == BreakConds.end()) ? nullptr : it->second.Cond;
+}
+
+bool CPU::IsBreakpoint(uint32_t Addr) const
+{
+    auto it = BreakPages.find(Addr >> BREAK_PAGE_SHIFT);
+    if (it == BreakPages.end())
+        return false;
+    uint32_t bit = Addr & (BREAK_PAGE_WORDS - 1);
+    return (it->second->Bits[bit / 64] >> (bit % 64)) & 1;
+}
+
+// Watch Len words from Addr for the given kinds of access, any of WATCH_READ, WATCH_WRITE and
+// WATCH_CHANGE. If Cond isn't null, a matching access only stops the run if it holds; the CPU owns it
+// from then on. Watchpoints belong to the core and survive Reset().
+// Returns true, and leaves Cond to the caller, if the range is empty, wraps around, or runs from RAM into
+// I/O space.
+bool CPU::AddWatchpoint(uint32_t Addr, uint32_t Len, uint32_t Kinds, BreakCondition *Cond)
+{
+    Kinds &= WATCH_READ | WATCH_WRITE | WATCH_CHANGE;
+    if ((Len == 0) || (Kinds == 0) || (Addr + Len - 1 < Addr))
+        return true;
+    if ((Addr < BASE_IO_MEM) && (Addr + Len - 1 >= BASE_IO_MEM))
+        return true;
+    Watches.push_back({Addr, Len, Kinds, Cond, 0});
+    MarkWatch(Watches.back());
+    return false;
+}
+
+// Mark the pages and I/O slots a watchpoint covers.
+void CPU::MarkWatch(const Watchpoint &W)
+{
+    for (uint64_t a = W.Addr; a < (uint64_t)W.Addr + W.Len; a = (a | 0xFFFF) + 1) {
+        if (a < BASE_IO_MEM)
+            break;
+        WatchIO |= 1 << ((a >> 16) & 0xF);
+    }
+    if (W.Addr < BASE_IO_MEM) {
+        uint32_t last = (W.Addr + W.Len - 1) >> MEM_PAGE_SHIFT;
+        if (WatchPages.size() <= last)
+            WatchPages.resize(last + 1, 0);
+        for (uint32_t page = W.Addr >> MEM_PAGE_SHIFT; page <= last; page++)
+            WatchPages[page] = 1;
+    }
+}
+
+// Remove the watchpoints that start at the given address.
+// Returns true if there weren't any.
+bool CPU::RemoveWatchpoint(uint32_t Addr)
+{
+    std::vector<Watchpoint> keep;
+
+    for (auto &w : Watches) {
+        if (w.Addr == Addr)
+            delete w.Cond;
+        else
+            keep.push_back(w);
+    }
+    if (keep.size() == Watches.size())
+        return true;
+    Watches.swap(keep);
+    WatchPages.clear();
+    WatchIO = 0;
+    for (auto &w : Watches)
+        MarkWatch(w);
+    return false;
+}
+
+// Remove one watchpoint with no condition on exactly this range and these kinds of access, leaving any
+// others alone, for a front end taking out only the ones it added itself.
+// Returns true if there isn't one.
+bool CPU::RemoveWatchpoint(uint32_t Addr, uint32_t Len, uint32_t Kinds)
+{
+    Kinds &= WATCH_READ | WATCH_WRITE | WATCH_CHANGE;
+    auto it = std::find_if(Watches.begin(), Watches.end(), [&](const Watchpoint &W) {
+        return (W.Addr == Addr) && (W.Len == Len) && (W.Kinds == Kinds) && (W.Cond == nullptr);
+    });
+    if (it == Watches.end())
+        return true;
+    Watches.erase(it);
+    WatchPages.clear();
+    WatchIO = 0;
+    for (auto &w : Watches)
+        MarkWatch(w);
+    return false;
+}
+
+// Clears the register watches too.
+void CPU::ClearWatchpoints()
+{
+    for (auto &w : Watches)
+        delete w.Cond;
+    Watches.clear();
+    WatchPages.clear();
+    WatchIO = 0;
+    for (uint8_t i = 0; i < NUMREGS; i++)
+        UnwatchRegister(i);
+}
+
+// Stop the run whenever an instruction changes the register, or if Cond isn't null, when it changes and
+// Cond holds; the CPU owns Cond from then on. Replaces any watch already on the register. IP changes on
+// every instruction, so it can't be watched. Returns true, and leaves Cond to the caller, if Index is
+// IP or out of range.
+bool CPU::WatchRegister(uint8_t Index, BreakCondition *Cond)
+{
+    if ((Index >= NUMREGS) || (Index == REG_IP))
+        return true;
+    if (RegConds[Index] != Cond)
+        delete RegConds[Index];
+    RegConds[Index] = Cond;
+    RegHits[Index] = 0;
+    RegLast[Index] = Reg[Index];
+    RegWatch |= 1 << Index;
+    return false;
+}
+
+// Returns true if the register wasn't being watched.
+bool CPU::UnwatchRegister(uint8_t Index)
+{
+    if ((Index >= NUMREGS) || !((RegWatch >> Index) & 1))
+        return true;
+    delete RegConds[Index];
+    RegConds[Index] = nullptr;
+    RegWatch &= ~(1 << Index);
+    return false;
+}
+
+// One bit per watched register.
+uint32_t CPU::GetRegisterWatches() const
+{
+    return RegWatch;
+}
+
+// Null if the register has no watch, or a watch with no condition.
+const BreakCondition *CPU::GetRegisterCondition(uint8_t Index) const
+{
+    return (Index < NUMREGS) ? RegConds[Index] : nullptr;
+}
+
+std::vector<Watchpoint> CPU::GetWatchpoints() const
+{
+    return Watches;
+}
+
+// Find out what the last instruction did to a watched address, if anything.
+// Returns true if it didn't touch one.
+bool CPU::GetWatchHit(WatchHit &Hit) const
+{
+    if (!Watched)
+        return true;
+    Hit = LastWatch;
+    return false;
+}
+
+// Slow path for an access to a watched page. Stops the CPU after this instruction if a watchpoint
+// covers the address, cares about this kind of access and has no condition, or one that holds. Only the
+// first hit of an instruction is kept. Conditions see the registers as the instruction has left them so far.
+void CPU::CheckWatch(uint32_t Addr, uint32_t Kind, uint32_t Old, uint32_t Value)
+{
+    if (Watched)
+        return;
+    for (auto &w : Watches) {
+        if (Addr - w.Addr >= w.Len)
+            continue;
+        bool hit = (w.Kinds & Kind);
+        if ((Kind == WATCH_WRITE) && (w.Kinds & WATCH_CHANGE))
+            hit = hit || (Addr >= BASE_IO_MEM) || (Old != Value);
+        if (hit) {
+            WatchHit h {InstAddr, Addr, Kind, Old, Value};
+            w.Hits++;
+            if ((w.Cond != nullptr) && !w.Cond->Eval(*this, w.Hits, &h))
+                continue;
+            LastWatch = h;
+            Watched = true;
+            Broken = true;
+            return;
+        }
+    }
+}
+
+// All of the breakpoints, lowest address first.
+std::vector<uint32_t> CPU::GetBreakpoints() const
+{
+    std::vector<uint32_t> addrs;
+
+    for (auto &p : BreakPages)
+        for (uint32_t bit = 0; bit < BREAK_PAGE_WORDS; bit++)
+            if ((p.second->Bits[bit / 64] >> (bit % 64)) & 1)
+                addrs.push_back((p.first << BREAK_PAGE_SHIFT) | bit);
+    std::sort(addrs.begin(), addrs.end());
+    return addrs;
+}
+
+uint32_t CPU::GetCoreID() const
+{
+    return CoreID;
+}
+
+int CPU::GetNumCores() const
+{
+    return Bus->NumCores;
+}
+
+// Find another core of the same machine by number. Returns nullptr if there is no such core.
+CPU *CPU::GetCore(int ID) const
+{
+    if ((ID < 0) || (ID >= MAX_CORES))
+        return nullptr;
+    return Bus->Cores[ID];
+}
+
 uint32_t CPU::ReadIO(uint32_t Address)
 {
     uint32_t offset = IOMEM_OFFSET(Address);
     uint32_t retval {0};
+    std::unique_lock<std::mutex> lock(Bus->IOLock, std::defer_lock);
+    if (Bus->NumCores > 1)
+        lock.lock();
     if (IOMEM_IS_TABLE(Address)) {
         // read table
         if (offset < (PERIPH_MAP_SIZE * PERIPH_MAP_ENTRIES)) {
-            unsigned int index = offset / PERIPH_MAP_ENTRIES;
+            unsigned int index = offset / PERIPH_MAP_SIZE;
 
             switch (offset & 3) { // low two bits selects which field
                 case 0:
-                    retval = Devices[index].Entry.DDN;
+                    retval = Bus->Devices[index].Entry.DDN;
                     break;
                 case 1:
-                    retval = Devices[index].Entry.Base_Addr;
+                    retval = Bus->Devices[index].Entry.Base_Addr;
                     break;
                 case 2:
-                    retval = Devices[index].Entry.IOMemLen;
+                    retval = Bus->Devices[index].Entry.IOMemLen;
                     break;
                 case 3:
-                    retval = Devices[index].Entry.Interrupt;
+                    retval = Bus->Devices[index].Entry.Interrupt;
                     break;
             }
         }
     } else {
         uint32_t index = IOMEM_INDEX(Address); // this cannot overflow as the macro returns 4 bits
-        if (Devices[index].Owner != nullptr) {
-            retval = Devices[index].Owner->ReadIOMem(offset);
+        if (Bus->Devices[index].Owner != nullptr) {
+            retval = Bus->Devices[index].Owner->ReadIOMem(offset);
         }
     }
     return retval;
@@ -821,11 +1699,145 @@ void CPU::WriteIO(uint32_t Address, uint32_t Value)
     if (IOMEM_IS_TABLE(Address)) {
         return;
     } else {
+        std::unique_lock<std::mutex> lock(Bus->IOLock, std::defer_lock);
+        if (Bus->NumCores > 1)
+            lock.lock();
         uint32_t offset = IOMEM_OFFSET(Address);
         uint32_t index = IOMEM_INDEX(Address);
-        if (Devices[index].Owner != nullptr) {
-            Devices[index].Owner->WriteIOMem(offset, Value);
+        if (Bus->Devices[index].Owner != nullptr) {
+            Bus->Devices[index].Owner->WriteIOMem(offset, Value);
         }
     }
 
 }
+
+// Which kind of memory a physical address falls in, for the access counters.
+_stat_space CPU::AddrSpace(uint32_t Address)
+{
+    if (Address >= BASE_IO_MEM)
+        return stat_io;
+    if (Address - Bus->ROM_Base < Bus->ROM_Len)
+        return stat_rom;
+    return stat_ram;
+}
+
+// Getter for the execution counters. All zero if the library was built without CT6K_STATS.
+const CPUStats &CPU::GetStats() const
+{
+    return Stats;
+}
+
+// Attach a shadow call stack, or detach it with nullptr. The tracker is told about every CALL, RETURN,
+// IRET and handler entry from now on, and is reset to start counting from here. The caller owns it.
+void CPU::SetCallTracker(CallTracker *Tracker)
+{
+    Calls = Tracker;
+    if (Calls != nullptr)
+        Calls->Reset(Cycles);
+}
+
+// Attach a trace recorder, or detach it with nullptr. The recorder must already be open, and is only used
+// by the thread running this core. Returns true if the library was built without tracing.
+bool CPU::SetTraceRecorder(TraceRecorder *Recorder)
+{
+#ifdef CT6K_TRACE
+    Trace = Recorder;
+    return false;
+#else
+    return Recorder != nullptr;
+#endif
+}
+
+// Attach a coverage map, or detach it with nullptr. Every instruction executed from now on is marked in
+// it, along with which way each conditional branch went. The caller owns it.
+void CPU::SetCoverage(Coverage *Map)
+{
+    Cover = Map;
+}
+
+// Attach a memory heatmap, or detach it with nullptr. Every fetch, read and write the program makes from
+// now on is counted in it; Reset() clears it along with the execution counters. The caller owns it.
+// Returns true if the library was built without execution counters, which the heatmap is part of.
+bool CPU::SetHeatmap(MemHeatmap *Map)
+{
+#ifdef CT6K_STATS
+    Heat = Map;
+    return false;
+#else
+    return Map != nullptr;
+#endif
+}
+
+// Clear the execution counters, and the heatmap if there is one. Reset() does this too.
+void CPU::ResetStats()
+{
+    Stats = CPUStats {};
+    if (Heat != nullptr)
+        Heat->Clear();
+}
+
+// Helper for WriteStatsJSON(), writes one set of per-space access counts.
+static void WriteSpaces(std::ostream &Out, const char *Name, const uint64_t *Counts, const char *End)
+{
+    Out << "  \"" << Name << "\": {\"ram\": " << Counts[stat_ram] << ", \"rom\": " << Counts[stat_rom]
+        << ", \"io\": " << Counts[stat_io] << "}" << End << "\n";
+}
+
+// Write a set of execution counters as a JSON object. Opcodes that never ran are left out; opcodes with
+// no mnemonic are named by their hex value.
+void WriteStatsJSON(std::ostream &Out, const CPUStats &Stats, uint64_t Cycles)
+{
+    static const char *fault_names[STAT_NUM_FAULTS] = {"double", "bad_instr", "bad_addr", "stack", "page"};
+    const char *sep = "";
+
+    Out << "{\n  \"cycles\": " << Cycles << ",\n  \"opcodes\": {";
+    for (int i = 0; i < STAT_NUM_OPCODES; i++) {
+        if (!Stats.Opcodes[i])
+            continue;
+        const OpMap *map = FindFromOpcode(i);
+        Out << sep << "\n    \"";
+        if (map->Opcode == i)
+            Out << map->Name;
+        else
+            Out << "0x" << std::hex << std::setw(2) << std::setfill('0') << i << std::dec << std::setfill(' ');
+        Out << "\": " << Stats.Opcodes[i];
+        sep = ",";
+    }
+    Out << "\n  },\n  \"faults\": {";
+    for (int i = 0; i < STAT_NUM_FAULTS; i++)
+        Out << (i ? ", " : "") << "\"" << fault_names[i] << "\": " << Stats.Faults[i];
+    Out << "},\n  \"interrupts\": " << Stats.Interrupts << ",\n";
+    Out << "  \"direct_fetches\": " << Stats.DirectFetches << ",\n";
+    WriteSpaces(Out, "fetches", Stats.Fetches, ",");
+    WriteSpaces(Out, "reads", Stats.Reads, ",");
+    WriteSpaces(Out, "writes", Stats.Writes, "");
+    Out << "}\n";
+}
+
+// Take a sample of the cycle counter and update the rolling rate if enough time has passed. Each new
+// figure counts for a quarter, so the rate settles within a second or two. Returns the current rate.
+double IPSMeter::Sample(uint64_t Cycles)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (!Started || Cycles < LastCycles) { // first sample, or the CPU was reset
+        Started = true;
+        LastTime = now;
+        LastCycles = Cycles;
+        return IPS;
+    }
+    double secs = std::chrono::duration<double>(now - LastTime).count();
+    if (secs < IPS_SAMPLE_SECS)
+        return IPS;
+    double rate = (Cycles - LastCycles) / secs;
+    IPS = (IPS == 0.0) ? rate : IPS + (rate - IPS) / 4;
+    LastTime = now;
+    LastCycles = Cycles;
+    return IPS;
+}
+
+// Forget the history, the next sample starts over.
+void IPSMeter::Reset()
+{
+    Started = false;
+    IPS = 0.0;
+}
@@ -20,6 +20,12 @@
 #define __CPU_HPP__
 
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
 #include "arch.h"
 #include "memory.hpp"
 #include "instruction.hpp"
@@ -32,6 +38,62 @@ struct CPUInternalState {
     bool Halted;
     uint32_t FHAP_Base; // coding style violation but FHAPBase looks bad
     uint32_t IHAP_Base;
+    uint64_t Cycles;
+};
+
+// Execution counters, one set per core. They are only kept when the library is built with CT6K_STATS
+// (the default); without it every CPU_STAT() compiles to nothing and GetStats() returns zeroes.
+#ifdef CT6K_STATS
+#define CPU_STAT(_x) do { _x; } while (0)
+#else
+#define CPU_STAT(_x) do { } while (0)
+#endif
+
+// Execution tracing, see trace.hpp. Built in with CT6K_TRACE (the default), and only does anything
+// once a TraceRecorder has been attached with SetTraceRecorder().
+#ifdef CT6K_TRACE
+#define CPU_TRACE(_x) do { if (Trace != nullptr) { Trace->_x; } } while (0)
+#else
+#define CPU_TRACE(_x) do { } while (0)
+#endif
+
+enum _stat_space {
+    stat_ram = 0,
+    stat_rom,
+    stat_io,
+    stat_num_spaces,
+};
+
+#define STAT_NUM_FAULTS 5   // indexed by fault type, double faults are counted in slot 0
+#define STAT_NUM_OPCODES 256
+
+struct CPUStats {
+    uint64_t Opcodes[STAT_NUM_OPCODES];
+    uint64_t Faults[STAT_NUM_FAULTS];
+    uint64_t Interrupts;
+    uint64_t DirectFetches;     // direct values read after an instruction word
+    uint64_t Fetches[stat_num_spaces];  // instruction words, including direct values
+    uint64_t Reads[stat_num_spaces];
+    uint64_t Writes[stat_num_spaces];
+};
+
+void WriteStatsJSON(std::ostream &Out, const CPUStats &Stats, uint64_t Cycles);
+
+// Rolling instructions-per-second figure for a front end. Feed it the cycle counter as often as is
+// convenient; the rate is only recalculated every IPS_SAMPLE_SECS, and is smoothed so it doesn't jitter.
+#define IPS_SAMPLE_SECS 0.25
+
+class IPSMeter {
+public:
+    double Sample(uint64_t Cycles);
+    double Get() const { return IPS; }
+    void Reset();
+
+private:
+    std::chrono::steady_clock::time_point LastTime;
+    uint64_t LastCycles {0};
+    double IPS {0.0};
+    bool Started {false};
 };
 
 struct IORegion {
@@ -39,12 +101,96 @@ struct IORegion {
     Periph *Owner;
 };
 
+class CPU;
+class CallTracker;
+class TraceRecorder;
+class Coverage;
+class MemHeatmap;
+class BreakCondition;
+
+// Everything the cores of one machine share: memory, ROM, the peripheral map and the list of cores.
+// The boot core creates and owns this; secondary cores are attached to it. All cores should be
+// created before any of them start running on their own threads.
+struct SystemBus {
+    Memory *Mem {nullptr};
+    uint32_t ROM_Base {0};
+    uint32_t ROM_Len {0};
+    const uint32_t *ROM_Content {nullptr};
+    IORegion Devices[PERIPH_MAP_ENTRIES] {{{0,}, nullptr,},};    // Allocate separately?
+    std::mutex IOLock;      // serializes device access, only taken with more than one core
+    CPU *Cores[MAX_CORES] {nullptr};
+    int NumCores {0};
+};
+
+// Software TLB for the MMU. Direct-mapped, indexed by the low bits of the virtual page number. Each entry
+// keeps a separate tag for each kind of access, set to the page number only if the PTE allows that access,
+// so a hit is a single compare no matter what is being checked.
+#define TLB_SIZE 64 // entries, must be a power of two
+#define TLB_NO_TAG 0xFFFFFFFF // never matches, page numbers are only 22 bits
+
+enum _tlb_access {
+    tlb_read = 0,
+    tlb_write,
+    tlb_exec,
+    tlb_num_access,
+};
+
+struct TLBEntry {
+    uint32_t Tag[tlb_num_access];
+    uint32_t Frame;
+};
+
+// Execution breakpoints, one bit per word. Only pages that have a breakpoint get a bitmap, so any number
+// of them costs a little memory and, in Run(), one page compare and one bit test per instruction.
+#define BREAK_PAGE_SHIFT 10
+#define BREAK_PAGE_WORDS (1 << BREAK_PAGE_SHIFT)
+#define BREAK_NO_PAGE 0xFFFFFFFF // never matches, page numbers are only 22 bits
+
+struct BreakPage {
+    uint64_t Bits[BREAK_PAGE_WORDS / 64];
+    uint32_t Count;
+};
+
+// Data watchpoints, on a range of physical addresses (the program's own when the MMU is off), RAM or I/O.
+// Each RAM page and each I/O slot with a watchpoint on it is marked, and only accesses to marked ones look
+// at the list. The instruction that hits one finishes, then the CPU stops as it does for BRK.
+#define WATCH_READ      0x1
+#define WATCH_WRITE     0x2
+#define WATCH_CHANGE    0x4     // a write of a different value; on I/O, where reading back isn't safe, any write
+#define WATCH_REG       0x8     // only in a WatchHit: a watched register changed
+
+struct Watchpoint {
+    uint32_t Addr;
+    uint32_t Len;
+    uint32_t Kinds;
+    BreakCondition *Cond;   // only stop if this holds, may be null; owned by the CPU
+    uint64_t Hits;          // accesses that matched, whether or not the condition held
+};
+
+// What the last instruction did to a watched address or register.
+struct WatchHit {
+    uint32_t IP;        // the instruction that did it
+    uint32_t Addr;      // for WATCH_REG, the register number
+    uint32_t Kind;      // WATCH_READ, WATCH_WRITE or WATCH_REG
+    uint32_t Old;       // the word before a write to RAM, or the register before it changed
+    uint32_t Value;     // the word read or written, or the register's new value
+};
+
+// A condition set on a breakpoint, and how many times the breakpoint has been reached since Reset().
+struct BreakCond {
+    BreakCondition *Cond;
+    uint64_t Hits;
+};
+
 // Core class that actually executes instructions.
 class CPU {
 public:
     CPU();
+    CPU(CPU &Boot);     // secondary core sharing the boot core's memory and devices
     ~CPU();
     void Step();
+    uint64_t Run(uint64_t MaxCycles);
+    uint64_t GetCycles() const;
     CPUInternalState DumpInternalState();
     uint32_t ReadReg(uint8_t);
     void WriteReg(uint8_t, uint32_t);
@@ -59,6 +205,8 @@ public:
     void Fault(uint32_t);
     int PushState();
     int PopState();
+    int PushStateMasked(uint32_t Mask);
+    int PopStateMasked(uint32_t Mask);
     int PushWord(uint32_t);
     int PopWord(uint32_t &);
     void Halt();
@@ -66,25 +214,98 @@ public:
     void Reset();
     bool AddDevice(Periph *Dev);
     void RemoveDevice(Periph *Dev);
-    bool AddROM(uint32_t *ROM, uint32_t Base, uint32_t Len);
+    Periph *GetDevice(int Index) const;
+    bool AddROM(const uint32_t *ROM, uint32_t Base, uint32_t Len);
+    bool CloneMemory(CPU &Source);
+    MemPageCounts GetMemPageCounts();
     bool IsBroken() const;
+    bool AddBreakpoint(uint32_t Addr);
+    bool RemoveBreakpoint(uint32_t Addr);
+    void ClearBreakpoints();
+    bool IsBreakpoint(uint32_t Addr) const;
+    std::vector<uint32_t> GetBreakpoints() const;
+    bool SetBreakCondition(uint32_t Addr, BreakCondition *Cond);
+    const BreakCondition *GetBreakCondition(uint32_t Addr) const;
+    bool AddWatchpoint(uint32_t Addr, uint32_t Len, uint32_t Kinds, BreakCondition *Cond = nullptr);
+    bool RemoveWatchpoint(uint32_t Addr);
+    bool RemoveWatchpoint(uint32_t Addr, uint32_t Len, uint32_t Kinds);
+    void ClearWatchpoints();
+    std::vector<Watchpoint> GetWatchpoints() const;
+    bool GetWatchHit(WatchHit &Hit) const;
+    bool WatchRegister(uint8_t Index, BreakCondition *Cond = nullptr);
+    bool UnwatchRegister(uint8_t Index);
+    uint32_t GetRegisterWatches() const;
+    const BreakCondition *GetRegisterCondition(uint8_t Index) const;
+    void FlushTLB();
+    uint32_t GetCoreID() const;
+    int GetNumCores() const;
+    CPU *GetCore(int ID) const;
+    void RaiseInterrupt(uint32_t Line);
+    const CPUStats &GetStats() const;
+    void ResetStats();
+    void SetCallTracker(CallTracker *Tracker);
+    bool SetTraceRecorder(TraceRecorder *Recorder);
+    void SetCoverage(Coverage *Map);
+    bool SetHeatmap(MemHeatmap *Map);
 
 private:
-    Memory *Mem;
+    SystemBus *Bus;
+    bool OwnsBus {false};
+    uint32_t CoreID {0};
+    std::atomic<uint32_t> PendingInts {0};  // one bit per interrupt line, may be set by other cores
     uint32_t Reg[NUMREGS] {0};
     bool Running {true};
     uint32_t FHAP_Addr {0}; // Fault Handler Pointer
     uint32_t IHAP_Addr {0}; // Interrupt Handler Pointer
-    uint32_t ROM_Base {0};
-    uint32_t ROM_Len {0};
-    uint32_t *ROM_Content {nullptr};
     Instruction *CurrentInst {nullptr};
-    IORegion Devices[PERIPH_MAP_SIZE] {{{0,}, nullptr,},};    // Allocate separately?
     bool Broken {false};
+    uint64_t Cycles {0};    // instructions executed since reset
+    uint32_t PT_Base {0};   // page table base, physical
+    uint32_t PT_Len {0};    // page table length, in entries
+    TLBEntry TLB[TLB_SIZE];
+    uint32_t InstAddr {0};  // address of the instruction being executed
+    uint32_t PendingFault {FAULT_NO_FAULT}; // page fault raised during the current instruction
+    uint32_t FaultAddr {0}; // virtual address that caused PendingFault
+    uint32_t SavedReg[NUMREGS] {0}; // registers at start of instruction, only kept while the MMU is on
+    CPUStats Stats {};
+    CallTracker *Calls {nullptr};   // shadow call stack, only when someone wants one
+    TraceRecorder *Trace {nullptr};
+    Coverage *Cover {nullptr};
+    MemHeatmap *Heat {nullptr};
+    std::unordered_map<uint32_t, BreakPage *> BreakPages;  // by page number
+    uint32_t BreakCount {0};
+    uint32_t BreakCachePage {BREAK_NO_PAGE};    // last page looked up in Run(), and its bitmap if it has one
+    const BreakPage *BreakCache {nullptr};
+    uint64_t BreakCycles {UINT64_MAX};  // where Run() last stopped for a breakpoint, so it can carry on from it
+    uint32_t BreakAddr {0};
+    std::unordered_map<uint32_t, BreakCond> BreakConds;    // only the breakpoints that have a condition
+    std::vector<Watchpoint> Watches;
+    std::vector<uint8_t> WatchPages;    // by RAM page, nonzero if a watchpoint covers some of it
+    uint32_t WatchIO {0};               // one bit per I/O slot, bit 0 for the peripheral map
+    bool Watched {false};               // the current instruction hit a watchpoint
+    WatchHit LastWatch {};
+    uint32_t RegWatch {0};              // one bit per watched register
+    uint32_t RegLast[NUMREGS] {0};      // the watched registers after the last instruction
+    BreakCondition *RegConds[NUMREGS] {nullptr};
+    uint64_t RegHits[NUMREGS] {0};
 
+    template <bool Hooked> void DoStep();
+    template <bool Hooked> uint64_t DoRun(uint64_t MaxCycles);
+    bool HitBreakpoint(uint32_t Addr);
+    bool TakeBreakpoint(uint32_t Addr);
+    void CheckRegWatch();
+    void MarkWatch(const Watchpoint &W);
+    bool IsWatched(uint32_t Addr) const;
+    void CheckWatch(uint32_t Addr, uint32_t Kind, uint32_t Old, uint32_t Value);
     uint32_t Execute(); // executes current instruction, returns fault value
     uint32_t RetrieveDirectValue();
+    uint32_t LoadWord(uint32_t);
+    void StoreWord(uint32_t, uint32_t);
+    uint32_t FetchWord(uint32_t);
+    bool Translate(uint32_t, _tlb_access, uint32_t &);
+    bool TLBMiss(uint32_t, _tlb_access, uint32_t &);
     uint32_t PutToDest(uint32_t);
+    uint32_t PutToReg(RegisterArg, uint32_t);
     uint32_t GetFromReg(RegisterArg, uint32_t &);
     uint32_t ExecuteNoArgs();
     uint32_t ExecuteSrcDest();
@@ -92,11 +313,16 @@ private:
     uint32_t ExecuteDestOnly();
     uint32_t ExecuteControlFlow();
     uint32_t Execute2SrcDest();
+    uint32_t ExecuteLoop();
+    uint32_t ExecuteDirectOnly();
+    uint32_t ExecuteCAS(uint32_t, uint32_t);
+    void TakeInterrupt();
     void IndicateZero(uint32_t);
     void IncrIP();
     uint32_t ReadIO(uint32_t);
     void WriteIO(uint32_t, uint32_t);
     int FindPeriphTableEntry(Periph *Dev);
+    _stat_space AddrSpace(uint32_t);
 };
 
 #endif // __CPU_HPP__
@@ -0,0 +1,417 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// diff_main.cpp - diff6k, runs the CPU in lockstep with RefCPU, the reference interpreter, and reports
+// the first instruction after which they disagree.
+// Programs come from ProgramGenerator, one per seed, or from a binary or card deck given on the command
+// line. Each engine has its own memory and its own probe device. After every instruction (or every N with
+// -e) the registers, halt state, FHAP and IHAP are compared, every word the reference wrote is read back
+// from the CPU's memory, and the two probe devices' access logs are compared. At the end of each program
+// all of RAM is compared as well, which catches stray writes by the CPU.
+//
+// Once something differs, the program is run again from the start, checking every instruction, and if
+// that doesn't find it (only the full RAM comparison saw it) the cycle is found by bisection. The report
+// shows the difference, the last instructions the reference ran, and both sets of registers.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "arch.h"
+#include "cpu.hpp"
+#include "memory.hpp"
+#include "instruction.hpp"
+#include "refcpu.hpp"
+#include "progen.hpp"
+#include "batchjob.hpp"
+
+#define DIFF_DEFAULT_PROGRAMS 100
+#define DIFF_DEFAULT_CYCLES 100000
+#define DIFF_CONTEXT 8  // instructions shown before a divergence
+
+static const char *RegNames[NUMREGS] = {
+    "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
+    "R8", "R9", "R10", "R11", "R12", "FLG", "SP", "IP",
+};
+
+// Display usage. Caller passes in argv[0] so that we can display the name of the command.
+static int Usage(char *Cmd)
+{
+    std::cerr << "Usage: " << Cmd << " [options]\n";
+    std::cerr << "Options:\n";
+    std::cerr << "\t-n count        check this many random programs (default " << DIFF_DEFAULT_PROGRAMS << ")\n";
+    std::cerr << "\t-s seed         seed of the first program (default 1), the rest count up from it\n";
+    std::cerr << "\t-l length       instructions in each random program (default " << GEN_DEFAULT_LENGTH
+              << ", at most " << GEN_MAX_LENGTH << ")\n";
+    std::cerr << "\t-t cycles       run each program for at most this many cycles (default "
+              << DIFF_DEFAULT_CYCLES << ")\n";
+    std::cerr << "\t-e every        compare every this many instructions (default 1)\n";
+    std::cerr << "\t-b binfile      check this binary instead of random programs\n";
+    std::cerr << "\t-c deck         check this card deck instead of random programs\n";
+    std::cerr << "\t-k              keep going after a divergence\n";
+    std::cerr << "\t-v              print a line for each program\n";
+    std::cerr << "Only the probe device is attached, at " << std::hex << PROBE_BASE << std::dec
+              << ", so programs that need real devices won't get far.\n";
+    return 1;
+}
+
+// One machine of each kind, each with its own probe.
+struct Engines {
+    CPU Real;
+    RefCPU Ref {MEM_DEFAULT_SIZE};
+    ProbeDevice RealProbe;
+    ProbeDevice RefProbe;
+    size_t Writes {0};      // reference writes and probe accesses already compared
+    size_t Accesses {0};
+
+    Engines()
+    {
+        Real.AddDevice(&RealProbe);
+        Ref.AddDevice(&RefProbe);
+    }
+    ~Engines()
+    {
+        Real.RemoveDevice(&RealProbe);
+    }
+};
+
+// What to run: a generated program, or a file.
+struct Program {
+    uint32_t Seed {0};
+    int Length {GEN_DEFAULT_LENGTH};
+    std::string File;
+    bool Deck {false};
+};
+
+enum _run_end {
+    run_limit,      // ran out of cycles
+    run_halted,
+    run_undefined,  // the program did something arch.h leaves undefined
+    run_diverged,
+};
+
+static std::string Hex(uint32_t Val)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%08x", Val);
+    return buf;
+}
+
+// Reset both engines and load the program into both. Returns true on error.
+static bool Load(Engines &E, const Program &Prog, std::string &Error)
+{
+    E.Real.Reset();
+    E.Ref.Reset();
+    E.RealProbe.PowerOnReset();
+    E.RefProbe.PowerOnReset();
+    E.Writes = 0;
+    E.Accesses = 0;
+    if (Prog.File.empty()) {
+        ProgramGenerator gen(Prog.Seed, Prog.Length);
+        const std::vector<uint32_t> &image = gen.GetImage();
+        for (uint32_t addr = 0; addr < image.size(); addr++) {
+            E.Real.WriteMem(addr, image[addr]);
+            E.Ref.Poke(addr, image[addr]);
+        }
+        return false;
+    }
+    std::ifstream in(Prog.File, Prog.Deck ? std::ios::in : std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        Error = "Error opening " + Prog.File;
+        return true;
+    }
+    if (Prog.Deck ? LoadDeck(in, Prog.File, &E.Real, Error) : LoadBinary(in, Prog.File, &E.Real, Error))
+        return true;
+    for (uint32_t addr = 0; addr < MEM_DEFAULT_SIZE; addr++)
+        E.Ref.Poke(addr, E.Real.ReadMem(addr));
+    for (int i = 0; i < NUMREGS; i++)
+        E.Ref.SetReg(i, E.Real.ReadReg(i));
+    return false;
+}
+
+// Compare what can be compared cheaply: registers and other state, the words the reference has written
+// since the last call, and the probe accesses since the last call. Returns true, with a description in
+// What, if anything differs.
+static bool Compare(Engines &E, std::string &What)
+{
+    CPUInternalState st = E.Real.DumpInternalState();
+
+    for (int i = 0; i < NUMREGS; i++)
+        if (st.Registers[i] != E.Ref.GetReg(i))
+            What += std::string(What.empty() ? "" : ", ") + RegNames[i];
+    if (!What.empty()) {
+        What += " differ" + std::string(What.find(',') == std::string::npos ? "s" : "");
+        return true;
+    }
+    if (st.Halted != E.Ref.IsHalted()) {
+        What = st.Halted ? "the CPU halted and the reference didn't" : "the reference halted and the CPU didn't";
+        return true;
+    }
+    if ((st.FHAP_Base != E.Ref.GetFHAP()) || (st.IHAP_Base != E.Ref.GetIHAP())) {
+        What = "FHAP or IHAP differs: CPU " + Hex(st.FHAP_Base) + "/" + Hex(st.IHAP_Base) + ", reference " +
+            Hex(E.Ref.GetFHAP()) + "/" + Hex(E.Ref.GetIHAP());
+        return true;
+    }
+    const std::vector<RefWrite> &writes = E.Ref.GetWrites();
+    for (; E.Writes < writes.size(); E.Writes++) {
+        const RefWrite &w = writes[E.Writes];
+        uint32_t real = E.Real.ReadMem(w.Addr);
+        uint32_t ref = E.Ref.Peek(w.Addr);
+        if (real != ref) {
+            What = "memory at " + Hex(w.Addr) + " differs: CPU " + Hex(real) + ", reference " + Hex(ref) +
+                " (reference wrote it at cycle " + std::to_string(w.Cycle) + ")";
+            return true;
+        }
+    }
+    E.Ref.ClearWrites();
+    E.Writes = 0;
+    const std::vector<ProbeAccess> &real = E.RealProbe.GetLog();
+    const std::vector<ProbeAccess> &ref = E.RefProbe.GetLog();
+    for (; (E.Accesses < real.size()) || (E.Accesses < ref.size()); E.Accesses++) {
+        if ((E.Accesses >= real.size()) || (E.Accesses >= ref.size())) {
+            What = "only the " + std::string(E.Accesses < real.size() ? "CPU" : "reference") + " made probe access " +
+                std::to_string(E.Accesses);
+            return true;
+        }
+        const ProbeAccess &a = real[E.Accesses];
+        const ProbeAccess &b = ref[E.Accesses];
+        if ((a.Write != b.Write) || (a.Offset != b.Offset) || (a.Value != b.Value)) {
+            What = "probe access " + std::to_string(E.Accesses) + " differs: CPU " + (a.Write ? "wrote " : "read ") +
+                Hex(a.Value) + " at " + Hex(a.Offset) + ", reference " + (b.Write ? "wrote " : "read ") +
+                Hex(b.Value) + " at " + Hex(b.Offset);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compare all of RAM. Returns true, with a description in What, if any word differs.
+static bool CompareRAM(Engines &E, std::string &What)
+{
+    for (uint32_t addr = 0; addr < MEM_DEFAULT_SIZE; addr++) {
+        uint32_t real = E.Real.ReadMem(addr);
+        uint32_t ref = E.Ref.Peek(addr);
+        if (real != ref) {
+            What = "memory at " + Hex(addr) + " differs: CPU " + Hex(real) + ", reference " + Hex(ref);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Step both engines up to MaxCycles times, comparing every Every instructions and at the end.
+// Every of zero means never compare. Steps is set to the number of steps taken, and Good to the last
+// step after which a comparison passed.
+static _run_end Run(Engines &E, uint64_t MaxCycles, uint64_t Every, bool FullCheck, uint64_t &Steps,
+                    uint64_t &Good, std::string &What)
+{
+    _run_end end {run_limit};
+
+    Good = 0;
+    for (Steps = 0; Steps < MaxCycles; ) {
+        E.Real.Step();
+        E.Ref.Step();
+        Steps++;
+        if (!E.Ref.GetUndefined().empty()) {
+            What = E.Ref.GetUndefined();
+            return run_undefined;
+        }
+        bool halted = E.Real.IsHalted() || E.Ref.IsHalted();
+        if (Every && ((Steps % Every == 0) || halted)) {
+            if (Compare(E, What))
+                return run_diverged;
+            Good = Steps;
+        }
+        if (halted) {
+            end = run_halted;
+            break;
+        }
+    }
+    if (FullCheck && (Compare(E, What) || CompareRAM(E, What)))
+        return run_diverged;
+    return end;
+}
+
+// Having seen a difference somewhere in the first Bad steps, find the first step after which the engines
+// differ. Returns that step, with the difference in What.
+static uint64_t Pinpoint(Engines &E, const Program &Prog, uint64_t Good, uint64_t Bad, std::string &What)
+{
+    std::string error;
+    uint64_t steps, good;
+
+    // Catch up without looking, then look at every instruction.
+    Load(E, Prog, error);
+    Run(E, Good, 0, false, steps, good, What);
+    Compare(E, What);   // passed the first time, but moves past the writes and accesses made so far
+    What.clear();
+    if (Run(E, Bad - Good, 1, false, steps, good, What) == run_diverged)
+        return Good + steps;
+
+    // Only the full memory comparison sees it. Bisect, comparing all of RAM each time.
+    uint64_t lo = 0, hi = Bad;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        Load(E, Prog, error);
+        What.clear();
+        if (Run(E, mid, 0, true, steps, good, What) == run_diverged)
+            hi = mid;
+        else
+            lo = mid;
+    }
+    Load(E, Prog, error);
+    What.clear();
+    Run(E, hi, 0, true, steps, good, What);
+    return hi;
+}
+
+// Describe a divergence after step Step: what differs, where the reference had got to, and both sets
+// of registers. The engines must be in the state just after that step.
+static void Report(std::ostream &Out, Engines &E, const Program &Prog, uint64_t Step, const std::string &What)
+{
+    if (Prog.File.empty())
+        Out << "seed " << Prog.Seed;
+    else
+        Out << Prog.File;
+    Out << ": diverged at cycle " << Step << ": " << What << "\n";
+
+    RefHistory hist[DIFF_CONTEXT];
+    int n = E.Ref.GetHistory(hist, DIFF_CONTEXT);
+    Out << "Last instructions run by the reference:\n";
+    for (int i = 0; i < n; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s %10llu  %08x  %08x  ", (i == n - 1) ? ">" : " ",
+                 (unsigned long long)hist[i].Cycle, hist[i].Addr, hist[i].Word);
+        Out << buf << FormatDisasm(hist[i].Word, hist[i].Next, nullptr) << "\n";
+    }
+    if (n && (hist[n - 1].Cycle != Step))
+        Out << "  (cycle " << Step << " didn't run an instruction: it was an interrupt, a fetch fault or a halt)\n";
+
+    CPUInternalState st = E.Real.DumpInternalState();
+    Out << "         CPU         reference\n";
+    for (int i = 0; i < NUMREGS; i++) {
+        Out << "  " << RegNames[i] << std::string(5 - strlen(RegNames[i]), ' ') << Hex(st.Registers[i]) << "  "
+            << Hex(E.Ref.GetReg(i)) << (st.Registers[i] != E.Ref.GetReg(i) ? "  <--" : "") << "\n";
+    }
+    Out << "  halted " << (st.Halted ? "yes" : "no ") << "         " << (E.Ref.IsHalted() ? "yes" : "no") << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    Program prog;
+    uint64_t count {DIFF_DEFAULT_PROGRAMS};
+    uint64_t seed {1};
+    uint64_t length {GEN_DEFAULT_LENGTH};
+    uint64_t cycles {DIFF_DEFAULT_CYCLES};
+    uint64_t every {1};
+    bool keep_going {false};
+    bool verbose {false};
+
+    for (auto i = 1; i < argc; i++) {
+        std::string TmpArg = argv[i];
+
+        if ((TmpArg == "-n") || (TmpArg == "-s") || (TmpArg == "-l") || (TmpArg == "-t") || (TmpArg == "-e")) {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            uint64_t val;
+            try {
+                val = std::stoull(argv[i], nullptr, 0);
+            } catch (...) {
+                return Usage(argv[0]);
+            }
+            if (TmpArg == "-n")
+                count = val;
+            else if (TmpArg == "-s")
+                seed = val;
+            else if (TmpArg == "-l")
+                length = val;
+            else if (TmpArg == "-t")
+                cycles = val;
+            else
+                every = val;
+            continue;
+        }
+        if ((TmpArg == "-b") || (TmpArg == "-c")) {
+            if ((++i >= argc) || !prog.File.empty())
+                return Usage(argv[0]);
+            prog.File = argv[i];
+            prog.Deck = (TmpArg == "-c");
+            continue;
+        }
+        if (TmpArg == "-k") {
+            keep_going = true;
+            continue;
+        }
+        if (TmpArg == "-v") {
+            verbose = true;
+            continue;
+        }
+        return Usage(argv[0]);
+    }
+    if ((length == 0) || (length > GEN_MAX_LENGTH) || (every == 0) || (cycles == 0))
+        return Usage(argv[0]);
+    if (!prog.File.empty())
+        count = 1;
+    prog.Length = length;
+
+    Engines *e = new Engines();
+    uint64_t total {0};
+    uint64_t checked {0}, halted {0}, undefined {0}, diverged {0};
+    std::string error;
+    for (uint64_t n = 0; n < count; n++) {
+        prog.Seed = seed + n;
+        if (Load(*e, prog, error)) {
+            std::cerr << error << "\n";
+            delete e;
+            return 1;
+        }
+        uint64_t steps, good;
+        std::string what;
+        _run_end end = Run(*e, cycles, every, true, steps, good, what);
+        total += steps;
+        checked++;
+        if (end == run_diverged) {
+            diverged++;
+            uint64_t step = Pinpoint(*e, prog, good, steps, what);
+            Report(std::cout, *e, prog, step, what);
+            if (!keep_going)
+                break;
+            continue;
+        }
+        if (end == run_halted)
+            halted++;
+        else if (end == run_undefined)
+            undefined++;
+        if (verbose) {
+            if (prog.File.empty())
+                std::cout << "seed " << prog.Seed;
+            else
+                std::cout << prog.File;
+            if (end == run_halted)
+                std::cout << ": halted after " << steps << " cycles\n";
+            else if (end == run_undefined)
+                std::cout << ": stopped after " << steps << " cycles, " << what << "\n";
+            else
+                std::cout << ": ran " << steps << " cycles\n";
+        }
+    }
+    delete e;
+    std::cout << total << " cycles checked in " << checked << " programs: " << halted << " halted, "
+              << undefined << " stopped early on undefined behavior, " << diverged << " diverged\n";
+    return diverged ? 1 : 0;
+}
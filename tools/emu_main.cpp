@@ -23,6 +23,7 @@
 #include <cstdint>
 #include <cstring>
 #include <vector>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include "unistd.h"
@@ -31,22 +32,18 @@
 #include "cpu.hpp"
 #include "ui.hpp"
 #include "printotron.hpp"
+#include "heatmap.hpp"
+#include "condition.hpp"
+#include "symmap.hpp"
+#include "gdbstub.hpp"
 
 #define SLOW_SLEEP 400000 // 400msec
 #define QUICK_SLEEP 100000 // 100msec
-
-// Print the instruction based upon the value(s) given. If Count is specified, update the count of
-// words used for the instruction.
-std::string FormatDisasm(uint32_t Val, uint32_t Val2, uint32_t *Count)
-{
-    std::string outstr;
-    auto i = new Instruction(Val, Val2);
-    i->Print(outstr);
-    if (Count != nullptr)
-        *Count = i->SizeInMemory();
-    delete i;
-    return outstr;
-}
+#define FULL_RUN_CYCLES 10000 // instructions run between checks for a key in a full-speed run
+#define BREAK_LIST_MAX 24 // breakpoints the list window has room for, four to a line
+#define WATCH_LIST_MAX 6 // and watchpoints, one to a line
+#define HEAT_BAR_WIDTH 10
+#define HEAT_SPARK_WIDTH 46
 
 
 // Read and return a 32-bit word from an array of bytes, MSB first.
@@ -100,8 +97,14 @@ void LoadProgram(char* File, CPU *C)
 int Usage(char *cmd)
 {
     std::cout << "USAGE:\n\t";
-    std::cout << cmd << " [binfile]\n";
-    std::cout << "No other options are currently supported\n\n";
+    std::cout << cmd << " [-s statsfile] [-H heatfile] [-R base:len] [-m mapfile] [-g port|path]\n\t\t[binfile]\n";
+    std::cout << "\t-s statsfile    write the CPU's execution counters to statsfile as JSON on exit\n";
+    std::cout << "\t-H heatfile     write the memory heatmap to heatfile on exit, as JSON if the name ends\n";
+    std::cout << "\t                in .json and CSV otherwise\n";
+    std::cout << "\t-R base:len     count accesses to each word from base to base + len - 1 (hex) as well\n";
+    std::cout << "\t-m mapfile      asm6k symbol map, so breakpoint conditions can use $LABEL\n";
+    std::cout << "\t-g port|path    wait for a debugger speaking the GDB remote protocol on this TCP port of\n";
+    std::cout << "\t                127.0.0.1, or Unix socket; it has the machine while it is connected\n\n";
     return 0;
 }
 
@@ -111,6 +114,7 @@ enum RunState {
     RS_Quick,
     RS_Full,
     RS_Halted,
+    RS_Remote,      // a debugger is connected and has the machine
 };
 
 // compare internal CPU states and only display what has changed
@@ -129,6 +133,160 @@ void UpdateScreen(CPUInternalState Current, CPUInternalState Previous, UI *Scree
 
 }
 
+// Say what the last instruction did to a watched address.
+void ShowWatchHit(const WatchHit &Hit, UI *Screen)
+{
+    char buf[80];
+
+    if (Hit.Kind == WATCH_REG)
+        snprintf(buf, sizeof(buf), "    %08X changed R%u to %08X, was %08X", Hit.IP, Hit.Addr, Hit.Value, Hit.Old);
+    else if (Hit.Kind == WATCH_READ)
+        snprintf(buf, sizeof(buf), "    %08X read %08X from %08X", Hit.IP, Hit.Value, Hit.Addr);
+    else if (Hit.Addr >= BASE_IO_MEM)
+        snprintf(buf, sizeof(buf), "    %08X wrote %08X to %08X", Hit.IP, Hit.Value, Hit.Addr);
+    else
+        snprintf(buf, sizeof(buf), "    %08X wrote %08X to %08X, was %08X", Hit.IP, Hit.Value, Hit.Addr, Hit.Old);
+    Screen->DrawMessage(buf);
+}
+
+// Ask for the condition on a new breakpoint or watch, and compile it.
+// Returns null if none was entered, or if it doesn't compile, in which case the message says why.
+BreakCondition *InputCondition(UI *Screen, const SymbolMap *Map)
+{
+    std::string text, error;
+
+    if (!Screen->InputCondition(text))
+        return nullptr;
+    BreakCondition *cond = new BreakCondition;
+    if (cond->Compile(text, Map, error)) {
+        Screen->DrawMessage("    Stopping every time, condition has " + error);
+        delete cond;
+        return nullptr;
+    }
+    return cond;
+}
+
+// Format the execution counters for the counts window: the busiest opcodes, then faults and memory traffic.
+std::vector<std::string> FormatStats(const CPUStats &Stats, uint64_t Cycles)
+{
+    std::vector<std::string> lines;
+    std::vector<int> ops;
+    char buf[80];
+
+    for (int i = 0; i < STAT_NUM_OPCODES; i++)
+        if (Stats.Opcodes[i])
+            ops.push_back(i);
+    std::sort(ops.begin(), ops.end(), [&Stats](int a, int b) { return Stats.Opcodes[a] > Stats.Opcodes[b]; });
+    snprintf(buf, sizeof(buf), "EXECUTION COUNTS AFTER %llu CYCLES", (unsigned long long)Cycles);
+    lines.push_back(buf);
+    lines.push_back("");
+    // two columns of the most frequent opcodes, leaving room for the summary below
+    for (size_t row = 0; row < 6; row++) {
+        std::string line;
+        for (size_t col = row; col < ops.size() && col < 12; col += 6) {
+            const OpMap *map = FindFromOpcode(ops[col]);
+            snprintf(buf, sizeof(buf), "%-8s %12llu %5.1f%%      ", (map->Opcode == ops[col]) ? map->Name : "???",
+                     (unsigned long long)Stats.Opcodes[ops[col]],
+                     Cycles ? 100.0 * Stats.Opcodes[ops[col]] / Cycles : 0.0);
+            line += buf;
+        }
+        lines.push_back(line);
+    }
+    lines.push_back("");
+    snprintf(buf, sizeof(buf), "Faults: instr %llu  addr %llu  stack %llu  page %llu  double %llu",
+             (unsigned long long)Stats.Faults[FAULT_BAD_INSTR], (unsigned long long)Stats.Faults[FAULT_BAD_ADDR],
+             (unsigned long long)Stats.Faults[FAULT_STACK], (unsigned long long)Stats.Faults[FAULT_PAGE],
+             (unsigned long long)Stats.Faults[0]);
+    lines.push_back(buf);
+    snprintf(buf, sizeof(buf), "Interrupts: %llu  Direct values: %llu", (unsigned long long)Stats.Interrupts,
+             (unsigned long long)Stats.DirectFetches);
+    lines.push_back(buf);
+    lines.push_back("");
+    lines.push_back("                    RAM            ROM             IO");
+    const char *names[] = {"Fetches", "Reads", "Writes"};
+    const uint64_t *counts[] = {Stats.Fetches, Stats.Reads, Stats.Writes};
+    for (int i = 0; i < 3; i++) {
+        snprintf(buf, sizeof(buf), "%-8s %14llu %14llu %14llu", names[i], (unsigned long long)counts[i][stat_ram],
+                 (unsigned long long)counts[i][stat_rom], (unsigned long long)counts[i][stat_io]);
+        lines.push_back(buf);
+    }
+    return lines;
+}
+
+// Format the heatmap for the counts window: the busiest pages, the working set over time as a row of
+// characters from light to heavy, and the busiest words of the region if there is one.
+std::vector<std::string> FormatHeatmap(const MemHeatmap &Heat, uint64_t Cycles)
+{
+    static const char shades[] = " .:-=+*#%@";
+    std::vector<std::string> lines;
+    std::vector<HeatPage> pages;
+    std::vector<HeatSample> samples;
+    char buf[80];
+
+    Heat.GetPages(pages);
+    Heat.GetSamples(samples);
+    snprintf(buf, sizeof(buf), "MEMORY HEATMAP AFTER %llu CYCLES", (unsigned long long)Cycles);
+    lines.push_back(buf);
+    lines.push_back("");
+    lines.push_back("PAGE              READS       WRITES      FETCHES");
+    auto total = [](const HeatPage &p) { return p.Reads + p.Writes + p.Fetches; };
+    std::sort(pages.begin(), pages.end(),
+              [&total](const HeatPage &a, const HeatPage &b) { return total(a) > total(b); });
+    for (size_t i = 0; (i < pages.size()) && (i < 8); i++) {
+        int bar = (int)((total(pages[i]) * HEAT_BAR_WIDTH + total(pages[0]) - 1) / total(pages[0]));
+        snprintf(buf, sizeof(buf), "%08X %12llu %12llu %12llu  %s", pages[i].Addr, (unsigned long long)pages[i].Reads,
+                 (unsigned long long)pages[i].Writes, (unsigned long long)pages[i].Fetches,
+                 std::string(bar, '#').c_str());
+        lines.push_back(buf);
+    }
+    lines.push_back("");
+
+    uint32_t peak {0};
+    for (auto &s : samples)
+        peak = std::max(peak, s.Pages);
+    snprintf(buf, sizeof(buf), "Working set: %u pages now, %u at peak, %u touched in all",
+             samples.empty() ? 0 : samples.back().Pages, peak, Heat.GetPageCount());
+    lines.push_back(buf);
+    std::string spark;
+    size_t first = (samples.size() > HEAT_SPARK_WIDTH) ? samples.size() - HEAT_SPARK_WIDTH : 0;
+    for (size_t i = first; i < samples.size(); i++)
+        spark += shades[peak ? (samples[i].Pages * 9 + peak - 1) / peak : 0];
+    snprintf(buf, sizeof(buf), "[%-*s] per %llu cycles", HEAT_SPARK_WIDTH, spark.c_str(),
+             (unsigned long long)Heat.GetWindow());
+    lines.push_back(buf);
+
+    uint32_t base, len;
+    if (Heat.GetRegion(base, len)) {
+        std::vector<uint32_t> words;
+        for (uint32_t i = 0; i < len; i++) {
+            uint64_t r, w;
+            Heat.GetWord(base + i, r, w);
+            if (r || w)
+                words.push_back(base + i);
+        }
+        auto busy = [&Heat](uint32_t a) { uint64_t r, w; Heat.GetWord(a, r, w); return r + w; };
+        std::sort(words.begin(), words.end(), [&busy](uint32_t a, uint32_t b) { return busy(a) > busy(b); });
+        lines.push_back("");
+        snprintf(buf, sizeof(buf), "Region %08X-%08X, busiest words:", base, base + len - 1);
+        lines.push_back(buf);
+        std::string line;
+        for (size_t i = 0; (i < words.size()) && (i < 6); i++) {
+            uint64_t r, w;
+            Heat.GetWord(words[i], r, w);
+            snprintf(buf, sizeof(buf), "%08X r%-9llu w%-9llu ", words[i], (unsigned long long)r,
+                     (unsigned long long)w);
+            line += buf;
+            if ((i % 2) == 1) {
+                lines.push_back(line);
+                line.clear();
+            }
+        }
+        if (!line.empty())
+            lines.push_back(line);
+    }
+    return lines;
+}
+
 // The main loop. Create a CPU, read a binary file into memory, and step through until it halts.
 int main(int argc, char *argv[])
 {
@@ -136,20 +294,83 @@ int main(int argc, char *argv[])
     UI *foil = new UI();  // [n]curses, foiled again!
     PrintOTron *POT = new PrintOTron();
     CPUInternalState curr_state, prev_state;
+    IPSMeter meter;
+    std::string statsname;
+    std::string heatname;
+    MemHeatmap *heat = new MemHeatmap();
+    SymbolMap *syms {nullptr};
+    GdbStub *gdb {nullptr};
+    char *binfile {nullptr};
     RunState RS {RS_Step};
     int quitting {false};
-    bool bp_active {false};
-    uint32_t breakpoint {0};
 
     // Connect printer to system so programs can write to it.
     ct6k->AddDevice(POT);
 
     // Loading a program is optional, users can hand-assemble a bootstrap loader if they want.
-    if (argc > 2)
-        return Usage(argv[0]);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            statsname = argv[i];
+        } else if (strcmp(argv[i], "-H") == 0) {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            heatname = argv[i];
+        } else if (strcmp(argv[i], "-R") == 0) {
+            uint32_t base, len;
+            size_t colon;
+            if (++i >= argc)
+                return Usage(argv[0]);
+            try {
+                base = std::stoul(argv[i], &colon, 16);
+                if (argv[i][colon] != ':')
+                    return Usage(argv[0]);
+                len = std::stoul(argv[i] + colon + 1, nullptr, 16);
+            } catch (...) {
+                return Usage(argv[0]);
+            }
+            if (heat->SetRegion(base, len)) {
+                std::cout << "Region is too big, the most is " << HEAT_MAX_REGION << " words\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            std::string error;
+            if (++i >= argc)
+                return Usage(argv[0]);
+            std::ifstream mapfile(argv[i]);
+            syms = new SymbolMap();
+            if (!mapfile.is_open() || syms->Load(mapfile, argv[i], error)) {
+                std::cout << "Can't load symbol map " << argv[i] << (error.empty() ? "" : ": ") << error << "\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-g") == 0) {
+            std::string error;
+            if (++i >= argc)
+                return Usage(argv[0]);
+            gdb = new GdbStub(*ct6k);
+            if (gdb->Listen(argv[i], error)) {
+                std::cout << "Can't wait for a debugger on " << argv[i] << ": " << error << "\n";
+                return 1;
+            }
+        } else if ((argv[i][0] == '-') || (binfile != nullptr)) {
+            return Usage(argv[0]);
+        } else {
+            binfile = argv[i];
+        }
+    }
 
-    if (argc == 2)
-        LoadProgram(argv[1], ct6k);
+    if (ct6k->SetHeatmap(heat)) {
+        delete heat;
+        heat = nullptr;
+        if (!heatname.empty()) {
+            std::cout << "This build has no execution counters, so no heatmap\n";
+            return 1;
+        }
+    }
+
+    if (binfile != nullptr)
+        LoadProgram(binfile, ct6k);
     curr_state = ct6k->DumpInternalState(); // Just to prep
 
     if (foil->InitGui() == -1)
@@ -165,20 +386,13 @@ int main(int argc, char *argv[])
         prev_state = curr_state;
         curr_state = ct6k->DumpInternalState();
         UpdateScreen(curr_state, prev_state, foil);
-        if (POT->IsOutputReady()) {
+        foil->DrawIPS(meter.Sample(ct6k->GetCycles()));
+        while (POT->IsOutputReady()) {
             std::string tmpline = POT->GetOutputLine();
             foil->AddPrinterOutput(tmpline);
         }
 
 
-        if (bp_active && (curr_state.Registers[REG_IP] == breakpoint))
-        {
-            nodelay(stdscr, false);
-            foil->DrawMessage("    Reached breakpoint! Press any key.");
-            RS = RS_Step;
-            foil->DrawRunState("STEPPING");
-        }
-
         if (RS != RS_Full) {
             tmp = FormatDisasm(ct6k->ReadMem(curr_state.Registers[REG_IP]),
                                              ct6k->ReadMem(curr_state.Registers[REG_IP]+1),
@@ -186,13 +400,22 @@ int main(int argc, char *argv[])
             foil->DrawNextInstr(tmp);
         }
 
-        if (curr_state.Halted == true) {
+        // Hand the machine over as soon as a debugger connects, whatever it was doing.
+        if ((gdb != nullptr) && (RS != RS_Remote)) {
+            gdb->Poll(0);
+            if (gdb->IsConnected()) {
+                RS = RS_Remote;
+                foil->DrawRunState("DEBUGGER");
+                nodelay(stdscr, true);
+            }
+        }
+
+        if ((curr_state.Halted == true) && (RS != RS_Remote)) {
             RS = RS_Halted;
             foil->DrawRunState("HALTED");
             nodelay(stdscr, false);
         }
 
-        // TODO check for breakpoint
         switch (RS) {
             case RS_Slow:
                 std::this_thread::sleep_for(std::chrono::microseconds(SLOW_SLEEP));
@@ -204,7 +427,20 @@ int main(int argc, char *argv[])
                 // we are in nodelay mode, just check for any key and keep rolling
                 c = getch(); // ignore return value - any key stops run mode
                 if (c == ERR) {
-                    ct6k->Step();
+                    // Run() rather than Step(), so it stops before an instruction with a breakpoint on it
+                    ct6k->Run((RS == RS_Full) ? FULL_RUN_CYCLES : 1);
+                    if (ct6k->IsBroken()) {
+                        WatchHit hit;
+                        if (!ct6k->GetWatchHit(hit))
+                            ShowWatchHit(hit, foil);
+                        else if (ct6k->IsBreakpoint(ct6k->ReadReg(REG_IP)))
+                            foil->DrawMessage("    Reached breakpoint! Press any key.");
+                        else
+                            foil->DrawMessage("    Reached BRK! Press any key.");
+                        RS = RS_Step;
+                        foil->DrawRunState("STEPPING");
+                        nodelay(stdscr, false);
+                    }
                     continue; // just keep cranking through
                 } else {
                     RS = RS_Step;
@@ -213,18 +449,43 @@ int main(int argc, char *argv[])
                     continue;
                 }
                 break;
+            case RS_Remote:
+                // The debugger runs the machine, a slice at a time; only exit works from here.
+                gdb->Poll(GDB_POLL_MS);
+                if (!gdb->IsConnected()) {
+                    RS = RS_Step;
+                    foil->DrawRunState("STEPPING");
+                    nodelay(stdscr, false);
+                } else if (getch() == CT6K_KEY_EXIT) {
+                    nodelay(stdscr, false);
+                    quitting = foil->ConfirmExit();
+                    nodelay(stdscr, true);
+                }
+                continue;
             default:
+                // Don't wait on the keyboard for long if a debugger might connect.
+                if (gdb != nullptr)
+                    timeout(GDB_POLL_MS);
                 c = getch();
+                if (gdb != nullptr) {
+                    timeout(-1);
+                    if (c == ERR)
+                        continue;
+                }
                 break;
         }
 
         c = toupper(c);
         switch (c) {
             case CT6K_KEY_STEP:
-            case ' ':
+            case ' ': {
                 // Single-step - no effect if halted
+                WatchHit hit;
                 ct6k->Step();
+                if (!ct6k->GetWatchHit(hit))
+                    ShowWatchHit(hit, foil);
                 break;
+            }
             case CT6K_KEY_FULL:
                 // Full-speed run
                 if (RS != RS_Halted) {
@@ -250,10 +511,85 @@ int main(int argc, char *argv[])
                     foil->DrawRunState("RUNNING 10Hz");
                 }
                 break;
-            case CT6K_KEY_MODBRK:
-                bp_active = foil->InputBreakpoint(breakpoint);
+            case CT6K_KEY_MODBRK: {
+            // set or clear a breakpoint
+                uint32_t addr;
+                if (!foil->InputBreakpoint(addr))
+                    break;
+                if (ct6k->AddBreakpoint(addr)) {
+                    ct6k->RemoveBreakpoint(addr);
+                    break;
+                }
+                BreakCondition *cond = InputCondition(foil, syms);
+                if (cond != nullptr)
+                    ct6k->SetBreakCondition(addr, cond);
                 break;
-            // set breakpoint
+            }
+            case CT6K_KEY_MODWATCH: {
+            // set or clear a watchpoint
+                uint32_t addr, len, kinds;
+                if (!foil->InputWatchpoint(addr) || !ct6k->RemoveWatchpoint(addr) ||
+                    !foil->InputWatchRange(len, kinds))
+                    break;
+                BreakCondition *cond = InputCondition(foil, syms);
+                if (ct6k->AddWatchpoint(addr, len, kinds, cond)) {
+                    delete cond;
+                    foil->DrawMessage("    That range runs off the end of RAM or I/O space.");
+                }
+                break;
+            }
+            case CT6K_KEY_MODREGWATCH: {
+            // watch a register for changes, or stop watching it
+                uint8_t reg;
+                if (!foil->InputRegWatch(reg) || !ct6k->UnwatchRegister(reg))
+                    break;
+                if (reg == REG_IP) {
+                    foil->DrawMessage("    IP changes on every instruction, so it can't be watched.");
+                    break;
+                }
+                ct6k->WatchRegister(reg, InputCondition(foil, syms));
+                break;
+            }
+            case CT6K_KEY_VIEWBRK: {
+                std::vector<uint32_t> addrs = ct6k->GetBreakpoints();
+                std::vector<Watchpoint> watches = ct6k->GetWatchpoints();
+                std::vector<std::string> lines;
+                char buf[80];
+                snprintf(buf, sizeof(buf), "%zu BREAKPOINTS (? HAS A CONDITION)", addrs.size());
+                lines.push_back(buf);
+                for (size_t i = 0; (i < addrs.size()) && (i < BREAK_LIST_MAX); i += 4) {
+                    std::string line;
+                    for (size_t j = i; (j < i + 4) && (j < addrs.size()); j++) {
+                        snprintf(buf, sizeof(buf), "%08X%c   ", addrs[j],
+                                 (ct6k->GetBreakCondition(addrs[j]) != nullptr) ? '?' : ' ');
+                        line += buf;
+                    }
+                    lines.push_back(line);
+                }
+                if (addrs.size() > BREAK_LIST_MAX)
+                    lines.push_back("...");
+                lines.push_back("");
+                snprintf(buf, sizeof(buf), "%zu WATCHPOINTS", watches.size());
+                lines.push_back(buf);
+                for (size_t i = 0; (i < watches.size()) && (i < WATCH_LIST_MAX); i++) {
+                    Watchpoint &w = watches[i];
+                    std::string kinds = std::string((w.Kinds & WATCH_READ) ? "R" : "") +
+                                        ((w.Kinds & WATCH_WRITE) ? "W" : "") + ((w.Kinds & WATCH_CHANGE) ? "C" : "");
+                    snprintf(buf, sizeof(buf), "%08X-%08X  %-3s %s%s", w.Addr, w.Addr + w.Len - 1, kinds.c_str(),
+                             (w.Cond != nullptr) ? "if " : "", (w.Cond != nullptr) ? w.Cond->GetText().c_str() : "");
+                    lines.push_back(buf);
+                }
+                if (watches.size() > WATCH_LIST_MAX)
+                    lines.push_back("...");
+                lines.push_back("");
+                std::string regs = "REGISTER WATCHES:";
+                for (uint8_t r = 0; r < NUMREGS; r++)
+                    if ((ct6k->GetRegisterWatches() >> r) & 1)
+                        regs += " R" + std::to_string(r) + ((ct6k->GetRegisterCondition(r) != nullptr) ? "?" : "");
+                lines.push_back(regs);
+                foil->ShowStatsWindow(lines);
+                break;
+            }
             case CT6K_KEY_MODE:
                 foil->ChangeDisplayState();
                 break;
@@ -317,7 +653,6 @@ int main(int argc, char *argv[])
             // reset
                 if (foil->ConfirmReset()) {
                     ct6k->Reset();
-                    bp_active = false;
                     RS = RS_Step;
                     foil->DrawRunState("STEPPING");
                     nodelay(stdscr, false);
@@ -331,6 +666,15 @@ int main(int argc, char *argv[])
             case CT6K_KEY_HELP:
                 foil->ShowHelpWindow();
                 break;
+            case CT6K_KEY_VIEWSTATS:
+                foil->ShowStatsWindow(FormatStats(ct6k->GetStats(), ct6k->GetCycles()));
+                break;
+            case CT6K_KEY_VIEWHEAT:
+                if (heat != nullptr)
+                    foil->ShowStatsWindow(FormatHeatmap(*heat, ct6k->GetCycles()));
+                else
+                    foil->ShowStatsWindow({"This build has no execution counters, so no heatmap."});
+                break;
             default:
             // break from run, already handled
                 break;
@@ -339,6 +683,27 @@ int main(int argc, char *argv[])
     ct6k->RemoveDevice(POT);
     delete(POT);
     delete(foil); // will call endwin();
+    if (!statsname.empty()) {
+        std::ofstream statsfile(statsname, std::ios::out | std::ios::trunc);
+        if (statsfile.is_open())
+            WriteStatsJSON(statsfile, ct6k->GetStats(), ct6k->GetCycles());
+        else
+            std::cout << "Error opening " << statsname << "\n";
+    }
+    if (!heatname.empty()) {
+        std::ofstream heatfile(heatname, std::ios::out | std::ios::trunc);
+        bool json = (heatname.size() > 5) && (heatname.compare(heatname.size() - 5, 5, ".json") == 0);
+        if (!heatfile.is_open())
+            std::cout << "Error opening " << heatname << "\n";
+        else if (json)
+            heat->WriteJSON(heatfile);
+        else
+            heat->WriteCSV(heatfile);
+    }
+    ct6k->SetHeatmap(nullptr);
+    delete heat;
+    delete syms;
+    delete gdb;
     delete(ct6k);
     return 0;
 }
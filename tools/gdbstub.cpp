@@ -0,0 +1,629 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// gdbstub.cpp - the GDB remote serial protocol: packet framing, the commands we answer, and the sockets.
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+#include "gdbstub.hpp"
+#include "cpu.hpp"
+
+// GDB's own signal numbers, which aren't necessarily the host's
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+#define GDB_SIGTERM 15
+
+#define GDB_INTERRUPT 0x03      // ^C from the debugger, sent outside of any packet
+
+static const char *RegNames[NUMREGS] = {
+    "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "r11", "r12", "flg", "sp", "ip",
+};
+
+// ip and sp hold word addresses, which GDB gets as byte addresses like every other address. Those don't
+// fit in 32 bits, as ROM and I/O space are at the top, so these two are 64 bits wide.
+static int RegDigits(int Index)
+{
+    return ((Index == REG_IP) || (Index == REG_SP)) ? 16 : 8;
+}
+
+// The target description GDB asks for, built once.
+static std::string TargetXML()
+{
+    std::string xml = "<?xml version=\"1.0\"?>\n<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+                      "<target version=\"1.0\">\n<feature name=\"org.ct6k.core\">\n";
+    for (int i = 0; i < NUMREGS; i++) {
+        const char *type = (i == REG_IP) ? "code_ptr" : (i == REG_SP) ? "data_ptr" : "uint32";
+        xml += std::string("<reg name=\"") + RegNames[i] + "\" bitsize=\"" + std::to_string(RegDigits(i) * 4) +
+               "\" regnum=\"" + std::to_string(i) + "\" type=\"" + type + "\"/>\n";
+    }
+    xml += "</feature>\n</target>\n";
+    return xml;
+}
+
+static std::string Hex8(uint32_t Value)
+{
+    char buf[9];
+    snprintf(buf, sizeof(buf), "%08x", Value);
+    return buf;
+}
+
+static int HexDigit(char C)
+{
+    if ((C >= '0') && (C <= '9'))
+        return C - '0';
+    if ((C >= 'a') && (C <= 'f'))
+        return C - 'a' + 10;
+    if ((C >= 'A') && (C <= 'F'))
+        return C - 'A' + 10;
+    return -1;
+}
+
+// Parse a hex number starting at Pos, leaving Pos just past it.
+// Returns false if there are no digits there, or too many.
+static bool ParseHex(const std::string &S, size_t &Pos, uint64_t &Value)
+{
+    size_t start = Pos;
+
+    Value = 0;
+    while ((Pos < S.size()) && (HexDigit(S[Pos]) >= 0) && (Pos - start < 16))
+        Value = (Value << 4) | HexDigit(S[Pos++]);
+    return (Pos > start) && ((Pos == S.size()) || (HexDigit(S[Pos]) < 0));
+}
+
+// A register's value as GDB sees it, in hex.
+static std::string RegToHex(int Index, uint32_t Value)
+{
+    char buf[17];
+
+    if (RegDigits(Index) == 16)
+        snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)Value * 4);
+    else
+        snprintf(buf, sizeof(buf), "%08x", Value);
+    return buf;
+}
+
+// Parse a register's value from GDB: exactly RegDigits(Index) hex digits at Pos. ip and sp must be the
+// byte address of a word. Returns false if the value is malformed.
+static bool RegFromHex(const std::string &S, size_t Pos, int Index, uint32_t &Value)
+{
+    uint64_t v {0};
+    int digits = RegDigits(Index);
+
+    if (S.size() < Pos + digits)
+        return false;
+    for (size_t i = Pos; i < Pos + digits; i++) {
+        int d = HexDigit(S[i]);
+        if (d < 0)
+            return false;
+        v = (v << 4) | d;
+    }
+    if (digits == 16) {
+        if (((v % 4) != 0) || (v / 4 > UINT32_MAX))
+            return false;
+        v /= 4;
+    }
+    Value = (uint32_t)v;
+    return true;
+}
+
+GdbStub::GdbStub(CPU &Core)
+    : Core(Core), LastStop("S05")
+{
+}
+
+GdbStub::~GdbStub()
+{
+    Disconnect();
+#ifndef _WIN32
+    if (ListenFd >= 0) {
+        close(ListenFd);
+        if (!SocketPath.empty())
+            unlink(SocketPath.c_str());
+    }
+#endif
+}
+
+// Start listening for a debugger. Where is a TCP port number, which is only open to the local host, or
+// the path of a Unix socket, replacing any stale one. Returns true on error, with a message.
+bool GdbStub::Listen(const std::string &Where, std::string &Error)
+{
+#ifndef _WIN32
+    bool tcp = !Where.empty() && (Where.find_first_not_of("0123456789") == std::string::npos);
+    int fd;
+
+    if (ListenFd >= 0) {
+        Error = "Already listening for a debugger";
+        return true;
+    }
+    if (tcp) {
+        sockaddr_in addr;
+        unsigned long port = strtoul(Where.c_str(), nullptr, 10);
+        int on = 1;
+        if ((port == 0) || (port > 65535)) {
+            Error = "Bad port number " + Where;
+            return true;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if ((bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, 1) < 0)) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    } else {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (Where.empty() || (Where.size() >= sizeof(addr.sun_path))) {
+            Error = "Bad socket path " + Where;
+            return true;
+        }
+        strncpy(addr.sun_path, Where.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(Where.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((fd >= 0) && ((bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, 1) < 0))) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd >= 0)
+            SocketPath = Where;
+    }
+    if (fd < 0) {
+        Error = "Can't listen on " + Where + ": " + strerror(errno);
+        return true;
+    }
+    ListenFd = fd;
+    return false;
+#else
+    Error = "The debugger stub needs POSIX sockets, which this build doesn't have";
+    return true;
+#endif
+}
+
+bool GdbStub::IsConnected() const
+{
+    return Fd >= 0;
+}
+
+// True while the debugger has let the core run. Poll() is running it.
+bool GdbStub::IsRunning() const
+{
+    return Running;
+}
+
+// Do whatever needs doing: take a new connection, handle what the debugger has sent, and if it has let
+// the core go, run it for a while. Waits up to TimeoutMs for something to happen, but only when the core
+// isn't running.
+void GdbStub::Poll(int TimeoutMs)
+{
+    if (Fd < 0) {
+        Accept(TimeoutMs);
+        return;
+    }
+    if (!Receive(Running ? 0 : TimeoutMs)) {
+        Disconnect();
+        return;
+    }
+    HandleInput();
+    if (!Running)
+        return;
+    Core.Run(GDB_RUN_CYCLES);
+    if (Core.IsHalted())
+        Stopped(GDB_SIGTERM);
+    else if (Core.IsBroken())
+        Stopped(GDB_SIGTRAP);
+}
+
+// Take a connection if one is waiting. The core is left as it is, stopped, for the debugger to look at.
+// Returns true if there is a debugger now.
+bool GdbStub::Accept(int TimeoutMs)
+{
+#ifndef _WIN32
+    pollfd p {ListenFd, POLLIN, 0};
+
+    if ((ListenFd < 0) || (poll(&p, 1, TimeoutMs) <= 0))
+        return false;
+    Fd = accept(ListenFd, nullptr, nullptr);
+    if (Fd < 0)
+        return false;
+    if (SocketPath.empty()) {
+        int on = 1;
+        setsockopt(Fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    In.clear();
+    LastSent.clear();
+    NoAck = false;
+    Running = false;
+    LastStop = "S05";
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Drop the debugger, taking out its breakpoints and watchpoints. The core stays where it is.
+void GdbStub::Disconnect()
+{
+    for (auto addr : Breaks)
+        Core.RemoveBreakpoint(addr);
+    Breaks.clear();
+    for (auto &w : Watches)
+        Core.RemoveWatchpoint(w.Addr, w.Len, w.Kinds);
+    Watches.clear();
+#ifndef _WIN32
+    if (Fd >= 0)
+        close(Fd);
+#endif
+    Fd = -1;
+    In.clear();
+    Running = false;
+}
+
+// Read whatever the debugger has sent, waiting up to TimeoutMs for it.
+// Returns false if the connection has closed.
+bool GdbStub::Receive(int TimeoutMs)
+{
+#ifndef _WIN32
+    pollfd p {Fd, POLLIN, 0};
+    char buf[GDB_PACKET_MAX];
+
+    if (poll(&p, 1, TimeoutMs) <= 0)
+        return true;
+    ssize_t len = read(Fd, buf, sizeof(buf));
+    if (len < 0)
+        return (errno == EINTR) || (errno == EAGAIN);
+    if (len == 0)
+        return false;
+    In.append(buf, len);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Handle each complete packet received, acknowledging it, and any ^C, acks and nacks between them.
+void GdbStub::HandleInput()
+{
+    while (!In.empty() && (Fd >= 0)) {
+        char c = In[0];
+        if (c != '$') {
+            In.erase(0, 1);
+            if ((c == GDB_INTERRUPT) && Running)
+                Stopped(GDB_SIGINT);
+            else if ((c == '-') && !LastSent.empty())
+                SendRaw(LastSent);
+            continue;
+        }
+        size_t hash = In.find('#');
+        if ((hash == std::string::npos) || (In.size() < hash + 3)) {
+            if (In.size() > 2 * GDB_PACKET_MAX)
+                In.clear(); // garbage, or a packet bigger than we said we'd take
+            return;
+        }
+        std::string body = In.substr(1, hash - 1);
+        int sum = (HexDigit(In[hash + 1]) << 4) | HexDigit(In[hash + 2]);
+        In.erase(0, hash + 3);
+        uint8_t check {0};
+        for (auto b : body)
+            check += (uint8_t)b;
+        if (!NoAck)
+            SendRaw((check == sum) ? "+" : "-");
+        if (check == sum)
+            HandlePacket(body);
+    }
+}
+
+// Carry out one command. Anything we don't know gets an empty reply, which tells the debugger so.
+void GdbStub::HandlePacket(const std::string &Packet)
+{
+    static const std::string Supported = "PacketSize=" + Hex8(GDB_PACKET_MAX) +
+                                         ";qXfer:features:read+;QStartNoAckMode+";
+    size_t pos {1};
+    uint64_t addr, len;
+    uint32_t value;
+
+    switch (Packet.empty() ? 0 : Packet[0]) {
+    case '?':
+        Send(LastStop);
+        break;
+    case 'g':
+        Send(ReadRegisters());
+        break;
+    case 'G': {
+        // Check every register before writing any, so a bad packet changes nothing
+        uint32_t regs[NUMREGS];
+        size_t at {1};
+        bool bad {false};
+        for (int i = 0; !bad && (i < NUMREGS); i++) {
+            bad = !RegFromHex(Packet, at, i, regs[i]);
+            at += RegDigits(i);
+        }
+        bad = bad || (Packet.size() != at);
+        if (bad) {
+            Send("E01");
+            break;
+        }
+        for (int i = 0; i < NUMREGS; i++)
+            Core.WriteReg(i, regs[i]);
+        Send("OK");
+        break;
+    }
+    case 'p':
+        if (!ParseHex(Packet, pos, addr) || (addr >= NUMREGS))
+            Send("E01");
+        else
+            Send(RegToHex(addr, Core.ReadReg(addr)));
+        break;
+    case 'P':
+        if (!ParseHex(Packet, pos, addr) || (addr >= NUMREGS) || (Packet[pos] != '=') ||
+            (Packet.size() != pos + 1 + RegDigits(addr)) || !RegFromHex(Packet, pos + 1, addr, value)) {
+            Send("E01");
+            break;
+        }
+        Core.WriteReg(addr, value);
+        Send("OK");
+        break;
+    case 'm':
+        if (!ParseHex(Packet, pos, addr) || (Packet[pos++] != ',') || !ParseHex(Packet, pos, len))
+            Send("E01");
+        else
+            Send(ReadMemory(addr, len));
+        break;
+    case 'M':
+        if (!ParseHex(Packet, pos, addr) || (Packet[pos++] != ',') || !ParseHex(Packet, pos, len) ||
+            (Packet[pos++] != ':') || (Packet.size() - pos != 2 * len) || WriteMemory(addr, Packet.substr(pos)))
+            Send("E01");
+        else
+            Send("OK");
+        break;
+    case 'c':
+    case 's':
+        // an address to resume from is optional
+        if (ParseHex(Packet, pos, addr))
+            Core.WriteReg(REG_IP, addr / 4);
+        if (Packet[0] == 'c') {
+            Running = true;
+            break;
+        }
+        Core.Step();
+        Stopped(Core.IsHalted() ? GDB_SIGTERM : GDB_SIGTRAP);
+        break;
+    case 'Z':
+    case 'z':
+        pos = 3;
+        if ((Packet.size() < 3) || (Packet[2] != ',') || !ParseHex(Packet, pos, addr) ||
+            (Packet[pos++] != ',') || !ParseHex(Packet, pos, len))
+            Send("E01");
+        else
+            Send(SetPoint(Packet[1], addr, len, Packet[0] == 'Z'));
+        break;
+    case 'H':
+    case 'T':
+        Send("OK"); // there is only one thread
+        break;
+    case 'k':
+        Disconnect();
+        break;
+    case 'D':
+        Send("OK");
+        Disconnect();
+        break;
+    case 'q':
+        if (Packet.compare(0, 10, "qSupported") == 0)
+            Send(Supported);
+        else if (Packet == "qAttached")
+            Send("1");
+        else if (Packet == "qC")
+            Send("QC1");
+        else if (Packet == "qfThreadInfo")
+            Send("m1");
+        else if (Packet == "qsThreadInfo")
+            Send("l");
+        else if (Packet.compare(0, 20, "qXfer:features:read:") == 0)
+            Send(ReadFeatures(Packet.substr(20)));
+        else
+            Send("");
+        break;
+    case 'Q':
+        if (Packet == "QStartNoAckMode") {
+            Send("OK");
+            NoAck = true;
+        } else {
+            Send("");
+        }
+        break;
+    default:
+        Send("");
+        break;
+    }
+}
+
+// Frame a packet and send it.
+void GdbStub::Send(const std::string &Packet)
+{
+    uint8_t sum {0};
+    char tail[4];
+
+    for (auto c : Packet)
+        sum += (uint8_t)c;
+    snprintf(tail, sizeof(tail), "#%02x", sum);
+    LastSent = "$" + Packet + tail;
+    SendRaw(LastSent);
+}
+
+// Send bytes as they are. Drops the connection if the debugger has gone.
+void GdbStub::SendRaw(const std::string &Data)
+{
+#ifndef _WIN32
+    size_t done {0};
+#ifdef MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+
+    while ((Fd >= 0) && (done < Data.size())) {
+        ssize_t len = send(Fd, Data.data() + done, Data.size() - done, flags);
+        if ((len < 0) && (errno == EINTR))
+            continue;
+        if (len <= 0) {
+            Disconnect();
+            return;
+        }
+        done += len;
+    }
+#endif
+}
+
+// The core has stopped; tell the debugger why. A watchpoint hit says which address, so the debugger can
+// tell which of its watchpoints it was.
+void GdbStub::Stopped(int Signal)
+{
+    WatchHit hit;
+    char buf[64];
+
+    Running = false;
+    if ((Signal == GDB_SIGTRAP) && !Core.GetWatchHit(hit) && (hit.Kind != WATCH_REG))
+        snprintf(buf, sizeof(buf), "T%02x%s:%llx;", Signal, (hit.Kind == WATCH_READ) ? "rwatch" : "watch",
+                 (unsigned long long)hit.Addr * 4);
+    else
+        snprintf(buf, sizeof(buf), "S%02x", Signal);
+    LastStop = buf;
+    Send(LastStop);
+}
+
+std::string GdbStub::ReadRegisters()
+{
+    std::string out;
+
+    for (int i = 0; i < NUMREGS; i++)
+        out += RegToHex(i, Core.ReadReg(i));
+    return out;
+}
+
+// Read Len bytes from GDB address Addr. Stops short at I/O space, or with an error if it starts there.
+std::string GdbStub::ReadMemory(uint64_t Addr, uint64_t Len)
+{
+    std::string out;
+    char buf[3];
+
+    if (Len > GDB_PACKET_MAX / 2 - 8)
+        Len = GDB_PACKET_MAX / 2 - 8;
+    for (uint64_t a = Addr; a < Addr + Len; a++) {
+        if (a / 4 >= BASE_IO_MEM)
+            break;
+        uint32_t word = Core.ReadMem(a / 4);
+        snprintf(buf, sizeof(buf), "%02x", (word >> (24 - 8 * (a % 4))) & 0xFF);
+        out += buf;
+    }
+    return (out.empty() && (Len != 0)) ? "E01" : out;
+}
+
+// Write the bytes given in hex at GDB address Addr, a word at a time. Returns true if any of them would
+// land in I/O space, or the hex is bad, in which case nothing is written.
+bool GdbStub::WriteMemory(uint64_t Addr, const std::string &Hex)
+{
+    uint64_t len = Hex.size() / 2;
+
+    if ((len != 0) && ((Addr + len - 1) / 4 >= BASE_IO_MEM))
+        return true;
+    for (auto c : Hex)
+        if (HexDigit(c) < 0)
+            return true;
+    for (uint64_t i = 0; i < len; i++) {
+        uint64_t a = Addr + i;
+        int shift = 24 - 8 * (a % 4);
+        uint32_t byte = (HexDigit(Hex[2 * i]) << 4) | HexDigit(Hex[2 * i + 1]);
+        uint32_t word = Core.ReadMem(a / 4);
+        Core.WriteMem(a / 4, (word & ~(0xFFu << shift)) | (byte << shift));
+    }
+    return false;
+}
+
+// Insert or remove a breakpoint (types 0 and 1, software and hardware are the same here) or a watchpoint
+// on writes, reads or both (types 2, 3 and 4). Len is the watched length in bytes. Breakpoints and
+// watchpoints set by the user are left alone.
+std::string GdbStub::SetPoint(char Type, uint64_t Addr, uint64_t Len, bool Insert)
+{
+    uint32_t word = Addr / 4;
+
+    if (Addr / 4 > UINT32_MAX)
+        return "E01";
+    if ((Type == '0') || (Type == '1')) {
+        auto it = std::find(Breaks.begin(), Breaks.end(), word);
+        if (Insert && (it == Breaks.end()) && !Core.AddBreakpoint(word))
+            Breaks.push_back(word);
+        if (!Insert && (it != Breaks.end())) {
+            Core.RemoveBreakpoint(word);
+            Breaks.erase(it);
+        }
+        return "OK";
+    }
+    if ((Type < '2') || (Type > '4'))
+        return "";
+    uint32_t kinds = (Type == '2') ? WATCH_WRITE : (Type == '3') ? WATCH_READ : (WATCH_READ | WATCH_WRITE);
+    uint32_t words = (Len == 0) ? 1 : (uint32_t)((Addr + Len + 3) / 4 - word);
+    if (Insert) {
+        if (Core.AddWatchpoint(word, words, kinds))
+            return "E01";
+        Watches.push_back({word, words, kinds});
+        return "OK";
+    }
+    for (auto it = Watches.begin(); it != Watches.end(); it++) {
+        if ((it->Addr == word) && (it->Len == words) && (it->Kinds == kinds)) {
+            Watches.erase(it);
+            Core.RemoveWatchpoint(word, words, kinds);
+            break;
+        }
+    }
+    return "OK";
+}
+
+// A piece of the target description: "target.xml:offset,length".
+std::string GdbStub::ReadFeatures(const std::string &Args)
+{
+    static const std::string xml = TargetXML();
+    size_t colon = Args.find(':');
+    size_t pos;
+    uint64_t off, len;
+
+    if ((colon == std::string::npos) || (Args.substr(0, colon) != "target.xml"))
+        return "E00";
+    pos = colon + 1;
+    if (!ParseHex(Args, pos, off) || (Args[pos++] != ',') || !ParseHex(Args, pos, len))
+        return "E01";
+    if (off >= xml.size())
+        return "l";
+    return ((off + len >= xml.size()) ? "l" : "m") + xml.substr(off, len);
+}
@@ -0,0 +1,94 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// gdbstub.hpp - declarations for the GdbStub class, a GDB remote serial protocol server for one core.
+// GDB (or anything else that speaks the protocol) connects over TCP on the local host, or over a Unix
+// socket, and can then read and write registers and memory, step, continue, interrupt a run with ^C, and
+// set breakpoints and watchpoints. Those go straight into the core's own lists, so a continued run goes at
+// full speed until one of them, a BRK or a HALT stops it; the debugger's are taken out again when it goes.
+//
+// The front end owns the core and calls Poll() regularly, from the thread that runs the core. While the
+// debugger has let the core go, each Poll() runs up to GDB_RUN_CYCLES instructions, so the front end can
+// keep its display up to date in between.
+//
+// GDB thinks in bytes, so word N of memory is at GDB address 4 * N, most significant byte first, and
+// breakpoint and watchpoint addresses are scaled the same way. Registers are sent big endian. ip and sp
+// are pointers, so they are sent as byte addresses too, 4 * the word address, and are 64 bits wide so
+// that ROM and I/O addresses fit; writing one that isn't a multiple of 4 is an error. The other registers
+// are 32 bits, as they are. The target description lists r0 - r12, flg, sp and ip, in that order.
+// Memory goes through the core's debug access (physical addresses); I/O space can't be read or written,
+// so the debugger can't disturb a device by looking at it.
+//
+// A stop is reported as SIGTRAP for a breakpoint, watchpoint, BRK or step, SIGINT for ^C, and SIGTERM for
+// a HALT, so that a script can tell them apart. Only one debugger is served at a time.
+#ifndef __GDBSTUB_HPP__
+#define __GDBSTUB_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define GDB_DEFAULT_PORT 6100
+#define GDB_RUN_CYCLES 10000    // instructions run by each Poll() while the debugger has the core running
+#define GDB_POLL_MS 20          // a good Poll() timeout for a front end that also has a display to update
+#define GDB_PACKET_MAX 4096     // longest packet we take, and tell the debugger about
+
+class CPU;
+
+class GdbStub {
+public:
+    GdbStub(CPU &Core);
+    ~GdbStub();
+    bool Listen(const std::string &Where, std::string &Error);
+    void Poll(int TimeoutMs);
+    bool IsConnected() const;
+    bool IsRunning() const;
+
+private:
+    struct GdbWatch {
+        uint32_t Addr;      // in words
+        uint32_t Len;
+        uint32_t Kinds;
+    };
+    CPU &Core;
+    int ListenFd {-1};
+    int Fd {-1};
+    std::string SocketPath;         // removed again when we stop listening, if it's a Unix socket
+    std::string In;                 // received and not yet handled
+    std::string LastSent;           // for a resend when the debugger asks for one
+    bool NoAck {false};
+    bool Running {false};
+    std::string LastStop;
+    std::vector<uint32_t> Breaks;   // breakpoints the debugger added, in words
+    std::vector<GdbWatch> Watches;
+
+    bool Accept(int TimeoutMs);
+    void Disconnect();
+    bool Receive(int TimeoutMs);
+    void HandleInput();
+    void HandlePacket(const std::string &Packet);
+    void Send(const std::string &Packet);
+    void SendRaw(const std::string &Data);
+    void Stopped(int Signal);
+    std::string ReadRegisters();
+    std::string ReadMemory(uint64_t Addr, uint64_t Len);
+    bool WriteMemory(uint64_t Addr, const std::string &Hex);
+    std::string SetPoint(char Type, uint64_t Addr, uint64_t Len, bool Insert);
+    std::string ReadFeatures(const std::string &Args);
+};
+
+#endif // __GDBSTUB_HPP__
@@ -0,0 +1,209 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// heatmap.cpp - memory access counts by page and by word, and working set samples.
+
+#include <iomanip>
+#include "heatmap.hpp"
+
+MemHeatmap::MemHeatmap(uint64_t Window)
+    : Window((Window > 0) ? Window : 1), WindowEnd(0)
+{
+}
+
+MemHeatmap::~MemHeatmap()
+{
+    Clear();
+    delete[] Region;
+}
+
+// Slow path of Touch(): make the page, and its leaf of the table if need be.
+MemHeatmap::Page *MemHeatmap::NewPage(uint32_t Addr)
+{
+    Page **&leaf = Top[Addr >> HEAT_TOP_SHIFT];
+    if (leaf == nullptr)
+        leaf = new Page *[HEAT_LEAF_SIZE]();
+    Page *p = new Page;
+    leaf[(Addr >> HEAT_PAGE_SHIFT) & (HEAT_LEAF_SIZE - 1)] = p;
+    PageCount++;
+    return p;
+}
+
+// Close the window that just ended, with a sample for it and for any windows after it that touched
+// nothing, and start the window that Cycles falls in. The first access starts the first window, so a map
+// attached part way through a run doesn't begin with a string of empty samples.
+void MemHeatmap::Roll(uint64_t Cycles)
+{
+    uint64_t start = Cycles - (Cycles % Window);
+
+    if (WindowEnd != 0) {
+        Samples.push_back({WindowStart, WindowPages, PageCount});
+        for (uint64_t w = WindowEnd; w < start; w += Window)
+            Samples.push_back({w, 0, PageCount});
+    }
+    WindowStart = start;
+    WindowEnd = start + Window;
+    WindowNum++;
+    WindowPages = 0;
+}
+
+// Count each word from Base to Base + Len - 1 as well, or stop with Len 0. Any old word counts are lost.
+// Returns true if the region is too big or runs off the end of memory.
+bool MemHeatmap::SetRegion(uint32_t Base, uint32_t Len)
+{
+    if ((Len > HEAT_MAX_REGION) || (Base + Len < Base))
+        return true;
+    delete[] Region;
+    Region = (Len > 0) ? new uint64_t[Len][2]() : nullptr;
+    RegionBase = Base;
+    RegionLen = Len;
+    return false;
+}
+
+// Returns true if a region is being counted word by word.
+bool MemHeatmap::GetRegion(uint32_t &Base, uint32_t &Len) const
+{
+    Base = RegionBase;
+    Len = RegionLen;
+    return RegionLen > 0;
+}
+
+// Counts for one word of the region. Words outside it read as zero.
+void MemHeatmap::GetWord(uint32_t Addr, uint64_t &Reads, uint64_t &Writes) const
+{
+    if (Addr - RegionBase < RegionLen) {
+        Reads = Region[Addr - RegionBase][0];
+        Writes = Region[Addr - RegionBase][1];
+    } else {
+        Reads = Writes = 0;
+    }
+}
+
+// Every page touched so far, lowest address first.
+void MemHeatmap::GetPages(std::vector<HeatPage> &Out) const
+{
+    Out.clear();
+    for (uint32_t i = 0; i < HEAT_TOP_SIZE; i++) {
+        if (Top[i] == nullptr)
+            continue;
+        for (uint32_t j = 0; j < HEAT_LEAF_SIZE; j++) {
+            const Page *p = Top[i][j];
+            if (p != nullptr)
+                Out.push_back({(i << HEAT_TOP_SHIFT) | (j << HEAT_PAGE_SHIFT), p->Reads, p->Writes, p->Fetches});
+        }
+    }
+}
+
+// Working set samples so far, oldest first. The window still open is included if anything has been
+// touched in it.
+void MemHeatmap::GetSamples(std::vector<HeatSample> &Out) const
+{
+    Out = Samples;
+    if (WindowPages > 0)
+        Out.push_back({WindowStart, WindowPages, PageCount});
+}
+
+uint64_t MemHeatmap::GetWindow() const
+{
+    return Window;
+}
+
+uint32_t MemHeatmap::GetPageCount() const
+{
+    return PageCount;
+}
+
+// Forget all counts and samples. The region stays, with its counts zeroed.
+void MemHeatmap::Clear()
+{
+    for (uint32_t i = 0; i < HEAT_TOP_SIZE; i++) {
+        if (Top[i] == nullptr)
+            continue;
+        for (uint32_t j = 0; j < HEAT_LEAF_SIZE; j++)
+            delete Top[i][j];
+        delete[] Top[i];
+        Top[i] = nullptr;
+    }
+    PageCount = 0;
+    for (uint32_t i = 0; i < RegionLen; i++)
+        Region[i][0] = Region[i][1] = 0;
+    Samples.clear();
+    WindowNum++;
+    WindowStart = WindowEnd = 0;
+    WindowPages = 0;
+}
+
+// Write everything as one CSV table. The kind column says what each row is: a page, a word of the region
+// (only words that were used), or a working set sample; columns that don't apply to it are left empty.
+void MemHeatmap::WriteCSV(std::ostream &Out) const
+{
+    std::vector<HeatPage> pages;
+    std::vector<HeatSample> samples;
+    GetPages(pages);
+    GetSamples(samples);
+
+    Out << "kind,address,reads,writes,fetches,cycle,pages,total\n" << std::hex << std::setfill('0');
+    for (auto &p : pages)
+        Out << "page,0x" << std::setw(8) << p.Addr << std::dec << "," << p.Reads << "," << p.Writes << ","
+            << p.Fetches << ",,,\n" << std::hex;
+    for (uint32_t i = 0; i < RegionLen; i++) {
+        if (Region[i][0] || Region[i][1])
+            Out << "word,0x" << std::setw(8) << RegionBase + i << std::dec << "," << Region[i][0] << ","
+                << Region[i][1] << ",,,,\n" << std::hex;
+    }
+    Out << std::dec << std::setfill(' ');
+    for (auto &s : samples)
+        Out << "ws,,,,," << s.Cycle << "," << s.Pages << "," << s.Total << "\n";
+}
+
+// Write everything as a JSON object. Addresses are plain numbers, as JSON has no hex.
+void MemHeatmap::WriteJSON(std::ostream &Out) const
+{
+    std::vector<HeatPage> pages;
+    std::vector<HeatSample> samples;
+    const char *sep = "";
+    GetPages(pages);
+    GetSamples(samples);
+
+    Out << "{\n  \"page_words\": " << HEAT_PAGE_WORDS << ",\n  \"window\": " << Window << ",\n  \"pages\": [";
+    for (auto &p : pages) {
+        Out << sep << "\n    {\"address\": " << p.Addr << ", \"reads\": " << p.Reads << ", \"writes\": "
+            << p.Writes << ", \"fetches\": " << p.Fetches << "}";
+        sep = ",";
+    }
+    Out << "\n  ],\n";
+    if (RegionLen > 0) {
+        Out << "  \"region\": {\"base\": " << RegionBase << ", \"length\": " << RegionLen << ", \"words\": [";
+        sep = "";
+        for (uint32_t i = 0; i < RegionLen; i++) {
+            if (!Region[i][0] && !Region[i][1])
+                continue;
+            Out << sep << "\n    {\"address\": " << RegionBase + i << ", \"reads\": " << Region[i][0]
+                << ", \"writes\": " << Region[i][1] << "}";
+            sep = ",";
+        }
+        Out << "\n  ]},\n";
+    }
+    Out << "  \"working_set\": [";
+    sep = "";
+    for (auto &s : samples) {
+        Out << sep << "\n    {\"cycle\": " << s.Cycle << ", \"pages\": " << s.Pages << ", \"total\": " << s.Total
+            << "}";
+        sep = ",";
+    }
+    Out << "\n  ]\n}\n";
+}
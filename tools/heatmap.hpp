@@ -0,0 +1,124 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// heatmap.hpp - declarations for the MemHeatmap class, counts of guest memory accesses by page.
+// Once attached to a CPU, every instruction fetch, read and write made by the running program is counted
+// against the 1K-word page it touched (physical address, after the MMU), so the busy parts of memory
+// stand out. Words in one chosen region can also be counted one by one, to see which fields of a buffer
+// or table get the traffic. Pages are found through a two-level table rather than a hash, since fetches
+// and data accesses alternate between pages on nearly every instruction.
+//
+// The working set is sampled as the program runs: time is cut into windows of a fixed number of cycles,
+// and each sample gives the number of distinct pages touched in that window and the number touched since
+// the map was started.
+#ifndef __HEATMAP_HPP__
+#define __HEATMAP_HPP__
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#define HEAT_PAGE_SHIFT 10
+#define HEAT_PAGE_WORDS (1 << HEAT_PAGE_SHIFT)
+#define HEAT_TOP_SHIFT 20       // page table is indexed by the top 12 bits, then the next 10
+#define HEAT_TOP_SIZE (1 << (32 - HEAT_TOP_SHIFT))
+#define HEAT_LEAF_SIZE (1 << (HEAT_TOP_SHIFT - HEAT_PAGE_SHIFT))
+#define HEAT_DEFAULT_WINDOW 100000  // cycles per working set sample
+#define HEAT_MAX_REGION (1 << 20)   // largest region counted word by word
+
+struct HeatPage {
+    uint32_t Addr;          // first word of the page
+    uint64_t Reads;
+    uint64_t Writes;
+    uint64_t Fetches;
+};
+
+struct HeatSample {
+    uint64_t Cycle;         // start of the window
+    uint32_t Pages;         // distinct pages touched in the window
+    uint32_t Total;         // distinct pages touched since the start
+};
+
+class MemHeatmap {
+public:
+    MemHeatmap(uint64_t Window = HEAT_DEFAULT_WINDOW);
+    ~MemHeatmap();
+    void Read(uint32_t Addr, uint64_t Cycles)
+    {
+        Touch(Addr, Cycles)->Reads++;
+        if (Addr - RegionBase < RegionLen)
+            Region[Addr - RegionBase][0]++;
+    }
+    void Write(uint32_t Addr, uint64_t Cycles)
+    {
+        Touch(Addr, Cycles)->Writes++;
+        if (Addr - RegionBase < RegionLen)
+            Region[Addr - RegionBase][1]++;
+    }
+    void Fetch(uint32_t Addr, uint64_t Cycles)
+    {
+        Touch(Addr, Cycles)->Fetches++;
+    }
+    bool SetRegion(uint32_t Base, uint32_t Len);
+    bool GetRegion(uint32_t &Base, uint32_t &Len) const;
+    void GetWord(uint32_t Addr, uint64_t &Reads, uint64_t &Writes) const;
+    void GetPages(std::vector<HeatPage> &Out) const;
+    void GetSamples(std::vector<HeatSample> &Out) const;
+    uint64_t GetWindow() const;
+    uint32_t GetPageCount() const;
+    void Clear();
+    void WriteCSV(std::ostream &Out) const;
+    void WriteJSON(std::ostream &Out) const;
+
+private:
+    struct Page {
+        uint64_t Reads {0};
+        uint64_t Writes {0};
+        uint64_t Fetches {0};
+        uint64_t Window {0};    // last window the page was touched in
+    };
+    Page **Top[HEAT_TOP_SIZE] {};
+    uint32_t PageCount {0};
+    uint32_t RegionBase {0};
+    uint32_t RegionLen {0};
+    uint64_t (*Region)[2] {nullptr};    // reads and writes for each word of the region
+    uint64_t Window;
+    uint64_t WindowNum {1};
+    uint64_t WindowStart {0};
+    uint64_t WindowEnd;
+    uint32_t WindowPages {0};
+    std::vector<HeatSample> Samples;
+
+    Page *Touch(uint32_t Addr, uint64_t Cycles)
+    {
+        if (Cycles >= WindowEnd)
+            Roll(Cycles);
+        Page **leaf = Top[Addr >> HEAT_TOP_SHIFT];
+        Page *p = (leaf != nullptr) ? leaf[(Addr >> HEAT_PAGE_SHIFT) & (HEAT_LEAF_SIZE - 1)] : nullptr;
+        if (p == nullptr)
+            p = NewPage(Addr);
+        if (p->Window != WindowNum) {
+            p->Window = WindowNum;
+            WindowPages++;
+        }
+        return p;
+    }
+    Page *NewPage(uint32_t Addr);
+    void Roll(uint64_t Cycles);
+};
+
+#endif // __HEATMAP_HPP__
@@ -0,0 +1,274 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// hostperf.cpp - host performance counters around batches of guest instructions.
+
+#include <algorithm>
+#include <cstdio>
+#include "hostperf.hpp"
+#include "instruction.hpp"
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define HOSTPERF_CALIBRATE 64   // pairs of reads to find the overhead of one
+
+static const char *EventNames[hp_num_events] = {"cycles", "instructions", "branch misses", "cache misses"};
+static const char *ClassNames[HOSTPERF_NUM_CLASSES] = {"invalid", "no_args", "src_only", "dest_only",
+    "control_flow", "src_dest", "2src_dest", "loop", "direct_only", "mapped"};
+
+HostCounters::HostCounters(uint64_t SampleEvery)
+    : SampleEvery(SampleEvery), Countdown(SampleEvery)
+{
+    for (auto &fd : Fds)
+        fd = -1;
+}
+
+HostCounters::~HostCounters()
+{
+    Close();
+}
+
+// Open the counters as one group, so they all count over exactly the same stretch, and measure what a
+// pair of reads costs. The counters only count the thread that opens them, so a front end that runs the
+// CPU on a thread of its own must open them there, and close them before that thread goes. Counts carry
+// on across a Close() and Open(). Returns true (with the reason in Error) if the host won't give us the
+// counters.
+bool HostCounters::Open(std::string &Error)
+{
+#ifdef __linux__
+    Close();
+    static const uint64_t configs[hp_num_events] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                    PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+    for (int i = 0; i < hp_num_events; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = (i == 0);   // the group starts when the leader is enabled
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        Fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, (i == 0) ? -1 : Fds[0], 0);
+        if (Fds[i] < 0) {
+            Error = std::string("Can't open the host's ") + EventNames[i] + " counter: " + strerror(errno);
+            if ((errno == EACCES) || (errno == EPERM))
+                Error += " (see /proc/sys/kernel/perf_event_paranoid)";
+            else if (errno == ENOENT)
+                Error += " (no hardware counters, as in most virtual machines)";
+            Close();
+            return true;
+        }
+    }
+    ioctl(Fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    // The cheapest pair of reads is the best guess at what the reads themselves cost.
+    uint64_t before[hp_num_events], after[hp_num_events];
+    for (int i = 0; i < hp_num_events; i++)
+        Overhead[i] = UINT64_MAX;
+    for (int n = 0; n < HOSTPERF_CALIBRATE; n++) {
+        if (Read(before) || Read(after)) {
+            Error = "Can't read the host's counters";
+            Close();
+            return true;
+        }
+        for (int i = 0; i < hp_num_events; i++)
+            Overhead[i] = std::min(Overhead[i], after[i] - before[i]);
+    }
+    return false;
+#else
+    Error = "Host counters need perf_event_open(), which only Linux has";
+    return true;
+#endif
+}
+
+void HostCounters::Close()
+{
+#ifdef __linux__
+    for (auto &fd : Fds) {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+bool HostCounters::IsOpen() const
+{
+    return Fds[0] >= 0;
+}
+
+// Read every counter in the group at once. Returns true on failure.
+bool HostCounters::Read(uint64_t *Values) const
+{
+#ifdef __linux__
+    uint64_t buf[1 + hp_num_events];    // count of events, then the values in the order opened
+    if ((read(Fds[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf)) || (buf[0] != hp_num_events))
+        return true;
+    for (int i = 0; i < hp_num_events; i++)
+        Values[i] = buf[1 + i];
+    return false;
+#else
+    (void)Values;
+    return true;
+#endif
+}
+
+// Add the counts between two reads, less what the reads themselves cost.
+void HostCounters::Add(HostPerfCounts &To, const uint64_t *Before, const uint64_t *After, uint64_t Guest) const
+{
+    for (int i = 0; i < hp_num_events; i++) {
+        uint64_t n = After[i] - Before[i];
+        To.Events[i] += (n > Overhead[i]) ? n - Overhead[i] : 0;
+    }
+    To.Guest += Guest;
+}
+
+// The kind of the instruction at IP, found before it runs. With the MMU on IP would have to be translated,
+// so those just go in a class of their own. Reading I/O space would read a device register, so code there
+// counts as invalid, which the fetch will make it anyway.
+int HostCounters::Classify(CPU &C) const
+{
+    if (C.IsFlagSet(FLG_MMUENA))
+        return HOSTPERF_MAPPED_CLASS;
+    uint32_t ip = C.ReadReg(REG_IP);
+    if (ip >= BASE_IO_MEM)
+        return op_invalid;
+    uint8_t op = GET_OP(C.ReadMem(ip));
+    const OpMap *map = FindFromOpcode(op);
+    return (map->Opcode == op) ? map->Type : op_invalid;
+}
+
+// Run the CPU for up to MaxCycles, counting on the host as it goes. Without sampling the whole batch is
+// one stretch between two reads; with it, the batch is broken up so every Nth instruction can be counted
+// on its own. If the counters aren't open this is just CPU::Run(). A stretch is left out of the counts if
+// either read fails. Like CPU::Run(), it stops early on a halt, BRK, breakpoint or watchpoint, so the
+// caller can check IsBroken(). Returns the cycles run.
+uint64_t HostCounters::Run(CPU &C, uint64_t MaxCycles)
+{
+    uint64_t before[hp_num_events], after[hp_num_events];
+    uint64_t done {0};
+
+    if (!IsOpen())
+        return C.Run(MaxCycles);
+    Batches++;
+    while (done < MaxCycles) {
+        if (SampleEvery && (Countdown == 1)) {
+            int cls = Classify(C);
+            bool failed = Read(before);
+            uint64_t ran = C.Run(1);
+            failed = Read(after) || failed;
+            if (ran == 0)
+                break;
+            if (!failed) {
+                Add(Classes[cls], before, after, 1);
+                Add(Totals, before, after, 1);
+            }
+            done++;
+            Countdown = SampleEvery;
+            if (C.IsBroken() || C.IsHalted())
+                break;
+            continue;
+        }
+        uint64_t slice = SampleEvery ? std::min(Countdown - 1, MaxCycles - done) : MaxCycles - done;
+        bool failed = Read(before);
+        uint64_t ran = C.Run(slice);
+        failed = Read(after) || failed;
+        if (!failed)
+            Add(Totals, before, after, ran);
+        done += ran;
+        Countdown -= ran;
+        // Stop on a BRK, breakpoint or watchpoint too, even on the last instruction of the slice, as the
+        // next Run() would clear it
+        if ((ran < slice) || C.IsBroken() || C.IsHalted())
+            break;
+    }
+    return done;
+}
+
+void HostCounters::Clear()
+{
+    Totals = HostPerfCounts {};
+    for (auto &c : Classes)
+        c = HostPerfCounts {};
+    Batches = 0;
+    Countdown = SampleEvery;
+}
+
+const HostPerfCounts &HostCounters::GetTotals() const
+{
+    return Totals;
+}
+
+const HostPerfCounts &HostCounters::GetClass(int Class) const
+{
+    return Classes[(Class < HOSTPERF_NUM_CLASSES) ? Class : op_invalid];
+}
+
+uint64_t HostCounters::GetBatches() const
+{
+    return Batches;
+}
+
+// Write the totals and the figures per guest instruction, then the same for each kind of instruction if
+// sampling was on.
+void HostCounters::WriteReport(std::ostream &Out) const
+{
+    char buf[160];
+
+    snprintf(buf, sizeof(buf), "%llu guest instructions in %llu batches\n\n", (unsigned long long)Totals.Guest,
+             (unsigned long long)Batches);
+    Out << buf;
+    snprintf(buf, sizeof(buf), "%-16s %16s %16s\n", "host event", "total", "per guest instr");
+    Out << buf;
+    for (int i = 0; i < hp_num_events; i++) {
+        snprintf(buf, sizeof(buf), "%-16s %16llu %16.3f\n", EventNames[i], (unsigned long long)Totals.Events[i],
+                 Totals.Guest ? (double)Totals.Events[i] / Totals.Guest : 0.0);
+        Out << buf;
+    }
+    if (Totals.Events[hp_instructions] > 0) {
+        snprintf(buf, sizeof(buf), "%-16s %16s %16.3f\n", "IPC", "",
+                 (double)Totals.Events[hp_instructions] / std::max<uint64_t>(Totals.Events[hp_cycles], 1));
+        Out << buf;
+    }
+    if (!SampleEvery)
+        return;
+
+    snprintf(buf, sizeof(buf), "\nSampled 1 in %llu. Reading the counters costs %llu cycles and %llu "
+             "instructions,\nwhich is taken off every stretch counted.\n", (unsigned long long)SampleEvery,
+             (unsigned long long)Overhead[hp_cycles], (unsigned long long)Overhead[hp_instructions]);
+    Out << buf;
+    snprintf(buf, sizeof(buf), "%-14s %10s %12s %12s %12s %12s\n", "kind", "samples", "cycles", "instructions",
+             "br misses", "cache misses");
+    Out << buf;
+    for (int c = 0; c < HOSTPERF_NUM_CLASSES; c++) {
+        const HostPerfCounts &k = Classes[c];
+        if (k.Guest == 0)
+            continue;
+        snprintf(buf, sizeof(buf), "%-14s %10llu %12.1f %12.1f %12.3f %12.3f\n", ClassNames[c],
+                 (unsigned long long)k.Guest, (double)k.Events[hp_cycles] / k.Guest,
+                 (double)k.Events[hp_instructions] / k.Guest, (double)k.Events[hp_branch_misses] / k.Guest,
+                 (double)k.Events[hp_cache_misses] / k.Guest);
+        Out << buf;
+    }
+}
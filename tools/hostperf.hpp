@@ -0,0 +1,82 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// hostperf.hpp - declarations for the HostCounters class, host CPU performance counters around the emulator.
+// Stands in for CPU::Run() like the profiler does, reading the host's hardware counters (cycles,
+// instructions, branch misses and cache misses, in user mode only) before and after each batch of guest
+// instructions, so a change to the CPU classes can be judged in host cycles per guest instruction without
+// attaching an outside profiler. Uses perf_event_open(), so it only works on Linux, and only where the
+// kernel allows a process to count itself (perf_event_paranoid of 2 or less).
+//
+// With sampling on, one guest instruction in every N is stepped on its own between two counter reads and
+// charged to its kind of instruction (the operand layouts in instruction.hpp), giving the cost of each
+// kind. Each read costs a system call, so the cost of a pair of back-to-back reads is measured when the
+// counters are opened and taken off every stretch counted.
+#ifndef __HOSTPERF_HPP__
+#define __HOSTPERF_HPP__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "cpu.hpp"
+
+enum _hostperf_event {
+    hp_cycles = 0,
+    hp_instructions,
+    hp_branch_misses,
+    hp_cache_misses,
+    hp_num_events,
+};
+
+#define HOSTPERF_NUM_CLASSES (op_direct_only + 2)   // each _op_type, then instructions run with the MMU on
+#define HOSTPERF_MAPPED_CLASS (op_direct_only + 1)  // can't look ahead at these without translating IP
+#define HOSTPERF_DEFAULT_SAMPLE 997 // for front ends that always sample; prime, like the profiler's
+
+struct HostPerfCounts {
+    uint64_t Events[hp_num_events] {0};
+    uint64_t Guest {0};     // guest instructions run while counting
+};
+
+class HostCounters {
+public:
+    HostCounters(uint64_t SampleEvery = 0);
+    ~HostCounters();
+    bool Open(std::string &Error);
+    void Close();
+    bool IsOpen() const;
+    uint64_t Run(CPU &C, uint64_t MaxCycles);
+    void Clear();
+    const HostPerfCounts &GetTotals() const;
+    const HostPerfCounts &GetClass(int Class) const;
+    uint64_t GetBatches() const;
+    void WriteReport(std::ostream &Out) const;
+
+private:
+    int Fds[hp_num_events];
+    uint64_t SampleEvery;
+    uint64_t Countdown;     // guest instructions left until the next sample
+    uint64_t Batches {0};
+    uint64_t Overhead[hp_num_events] {0};  // counted by a pair of reads with nothing in between
+    HostPerfCounts Totals;
+    HostPerfCounts Classes[HOSTPERF_NUM_CLASSES];
+
+    bool Read(uint64_t *Values) const;
+    void Add(HostPerfCounts &To, const uint64_t *Before, const uint64_t *After, uint64_t Guest) const;
+    int Classify(CPU &C) const;
+};
+
+#endif // __HOSTPERF_HPP__
@@ -98,8 +98,9 @@ void RegisterArg::Print(std::string &Out)
 // to search on two different keys: uint8 if executing and string if assembling or debugging.
 // Because of this, and because it's a short, static list, we will open-code the search functions
 // and just use fixed-length C strings.
+// The map is const so any number of CPUs, in any number of threads, can share it.
 
-OpMap opcode_map[] = {
+const OpMap opcode_map[] = {
 {"MOVE", OP_MOVE, op_src_dest},
 {"CMP", OP_CMP, op_src_dest},
 {"ADD", OP_ADD, op_2src_dest},
@@ -110,12 +111,16 @@ OpMap opcode_map[] = {
 {"XOR", OP_XOR, op_2src_dest},
 {"SHIFTR", OP_SHIFTR, op_2src_dest},
 {"SHIFTL", OP_SHIFTL, op_2src_dest},
+{"CAS", OP_CAS, op_2src_dest},
 {"PUSH", OP_PUSH, op_src_only},
 {"POP", OP_POP, op_dest_only},
 {"INCR", OP_INCR, op_dest_only},
 {"DECR", OP_DECR, op_dest_only},
+{"COREID", OP_COREID, op_dest_only},
 {"SSTATE", OP_SSTATE, op_no_args},
 {"LSTATE", OP_LSTATE, op_no_args},
+{"SSTATEM", OP_SSTATEM, op_direct_only},
+{"LSTATEM", OP_LSTATEM, op_direct_only},
 {"JZERO", OP_JZERO, op_control_flow},
 {"JNZERO", OP_JNZERO, op_control_flow},
 {"JOVER", OP_JOVER, op_control_flow},
@@ -124,6 +129,7 @@ OpMap opcode_map[] = {
 {"JNUNDER", OP_JNUNDER, op_control_flow},
 {"JMP", OP_JMP, op_control_flow},
 {"CALL", OP_CALL, op_control_flow},
+{"LOOP", OP_LOOP, op_loop},
 {"RETURN", OP_RETURN, op_no_args},
 {"IRET", OP_IRET, op_no_args},
 {"SIGNED", OP_SIGNED, op_no_args},
@@ -135,12 +141,18 @@ OpMap opcode_map[] = {
 {"NOP", OP_NOP, op_no_args},
 {"SETFHAP", OP_SETFHAP, op_src_only},
 {"SETIHAP", OP_SETIHAP, op_src_only},
+{"SETPTB", OP_SETPTB, op_src_only},
+{"SETPTL", OP_SETPTL, op_src_only},
+{"MMUENA", OP_MMUENA, op_no_args},
+{"MMUDIS", OP_MMUDIS, op_no_args},
+{"TLBFLUSH", OP_TLBFLUSH, op_no_args},
+{"IPI", OP_IPI, op_src_only},
 {"", OP_INVALID, op_invalid},
 };
 
 // Given an opcode, find the map. This lets us print the name and tells us the type so we can
 // execute the opcode.
-OpMap *FindFromOpcode(uint8_t Op)
+const OpMap *FindFromOpcode(uint8_t Op)
 {
     int i = 0;
 
@@ -153,7 +165,7 @@ OpMap *FindFromOpcode(uint8_t Op)
 };
 
 // Given a name, find the map. This is used for assembly.
-OpMap *FindFromString(std::string Instr)
+const OpMap *FindFromString(std::string Instr)
 {
     int i = 0;
     std::string tmpstr;
@@ -188,7 +200,8 @@ Instruction::Instruction(uint32_t Inst)
     if ((Opcode == OP_MOVE) || (Opcode == OP_CMP))
         DirectValInUse = (Src1->GetType() == rt_null) && (Src2->GetType() == rt_null);
     else
-        DirectValInUse = (Map->Type == op_control_flow) && (Dest->GetType() == rt_null);
+        DirectValInUse = ((Map->Type == op_control_flow) || (Map->Type == op_loop) ||
+                          (Map->Type == op_direct_only)) && (Dest->GetType() == rt_null);
 
 };
 
@@ -207,7 +220,8 @@ Instruction::Instruction(uint32_t Inst, uint32_t Prefetch)
     if ((Opcode == OP_MOVE) || (Opcode == OP_CMP))
         DirectValInUse = (Src1->GetType() == rt_null) && (Src2->GetType() == rt_null);
     else
-        DirectValInUse = (Map->Type == op_control_flow) && (Dest->GetType() == rt_null);
+        DirectValInUse = ((Map->Type == op_control_flow) || (Map->Type == op_loop) ||
+                          (Map->Type == op_direct_only)) && (Dest->GetType() == rt_null);
 
     DirectVal = Prefetch;
     DirectValProvided = true;
@@ -248,6 +262,12 @@ bool Instruction::IsValidInstruction()
         case op_2src_dest:
             retval = Src1->IsValid() && Src2->IsValid() && Dest->IsValid();
             break;
+        case op_loop:
+            retval = Src1->IsValid() && (Dest->IsValid() || DirectValInUse);
+            break;
+        case op_direct_only:
+            retval = DirectValInUse;
+            break;
         default:
             break; // retval is false by default
         }
@@ -319,6 +339,23 @@ void Instruction::Print(std::string &Out)
             Out += ", ";
             Dest->Print(Out);
             break;
+        case op_loop:
+            Src1->Print(Out);
+            Out += ", ";
+            if (DirectValInUse)
+                if (DirectValProvided)
+                    AddHexValue(Out, DirectVal);
+                else
+                    Out += "<direct data>";
+            else
+                Dest->Print(Out);
+            break;
+        case op_direct_only:
+            if (DirectValProvided)
+                AddHexValue(Out, DirectVal);
+            else
+                Out += "<direct data>";
+            break;
         default:
             // should never get here
             break;
@@ -449,7 +486,7 @@ void GetNextToken(std::string &In, std::string &Out)
 uint32_t BuildInstruction(std::string In, uint32_t &ExtraWord, bool &ExtraWordPresent)
 {
     uint32_t retval {0};
-    OpMap *map;
+    const OpMap *map;
     std::string tmp;
 
     ExtraWordPresent = false;
@@ -503,6 +540,25 @@ uint32_t BuildInstruction(std::string In, uint32_t &ExtraWord, bool &ExtraWordPr
                 GetNextToken(In, tmp);
                 retval |= DEST_LOAD(BuildReg(tmp));
                 break;
+            case op_loop:
+                GetNextToken(In, tmp);
+                retval |= S1_LOAD(BuildReg(tmp));
+                GetNextToken(In, tmp);
+                if (isdigit(tmp[0])) {
+                    retval |= DEST_LOAD(REG_NULL);
+                    ExtraWord = std::stoul(tmp,nullptr,0);
+                    ExtraWordPresent = true;
+                } else
+                    retval |= DEST_LOAD(BuildReg(tmp));
+                break;
+            case op_direct_only:
+                GetNextToken(In, tmp);
+                if (!isdigit(tmp[0]))
+                    throw("Invalid argument");
+                retval |= DEST_LOAD(REG_NULL);
+                ExtraWord = std::stoul(tmp,nullptr,0);
+                ExtraWordPresent = true;
+                break;
             default:
                 throw("Invalid instruction");
                 break;
@@ -520,3 +576,16 @@ uint32_t BuildInstruction(std::string In, uint32_t &ExtraWord, bool &ExtraWordPr
     }
     return retval;
 };
+
+// Print the instruction based upon the value(s) given. If Count is specified, update the count of
+// words used for the instruction.
+std::string FormatDisasm(uint32_t Val, uint32_t Val2, uint32_t *Count)
+{
+    std::string outstr;
+    auto i = new Instruction(Val, Val2);
+    i->Print(outstr);
+    if (Count != nullptr)
+        *Count = i->SizeInMemory();
+    delete i;
+    return outstr;
+}
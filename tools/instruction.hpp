@@ -40,6 +40,8 @@ enum _op_type {
     op_control_flow, // uses destination register only, but also can use direct data
     op_src_dest,     // allows direct data as well
     op_2src_dest,
+    op_loop,         // uses src1 as counter, dest or direct data as target
+    op_direct_only,  // takes only direct data, e.g. a register mask
 };
 
 // This is the class that handles the actual register argument bytes in each instruction word
@@ -87,7 +89,7 @@ private:
     uint32_t Raw;   // used for data
     bool IsRaw {false};
     uint8_t Opcode;
-    struct OpMap *Map;
+    const struct OpMap *Map;
     RegisterArg *Src1;
     RegisterArg *Src2;
     RegisterArg *Dest;
@@ -106,4 +108,14 @@ private:
 // function. Could it go back in the class? Sure, if it needs to.
 uint32_t BuildInstruction(std::string In, uint32_t& ExtraWord, bool& ExtraWordPresent);
 
+// The opcode map itself, for anything that wants to go through every instruction. The last entry has
+// the opcode OP_INVALID and an empty name.
+extern const OpMap opcode_map[];
+
+// More helpers. Opcode map lookups, and disassembly of a word (plus the following word, in case the
+// instruction takes a direct value) for the assembler listing and the debuggers.
+const OpMap *FindFromOpcode(uint8_t Op);
+const OpMap *FindFromString(std::string Instr);
+std::string FormatDisasm(uint32_t Val, uint32_t Val2, uint32_t *Count);
+
 #endif // __INSTRUCTION_HPP__
@@ -0,0 +1,178 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// jobsocket.cpp - socket plumbing for serve6k and its clients.
+
+#include <cstring>
+#include <cerrno>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "jobsocket.hpp"
+
+#define JOBSOCKET_READ_SIZE 65536
+
+JobSocket::JobSocket(int Fd): Fd(Fd)
+{
+}
+
+JobSocket::~JobSocket()
+{
+    if (Fd >= 0)
+        close(Fd);
+}
+
+// Read more from the socket onto the end of the buffer, first dropping whatever has been consumed.
+// Returns false at end of file or on error.
+bool JobSocket::Fill()
+{
+    char chunk[JOBSOCKET_READ_SIZE];
+    ssize_t len;
+
+    Buf.erase(0, Pos);
+    Pos = 0;
+    do {
+        len = read(Fd, chunk, sizeof(chunk));
+    } while ((len < 0) && (errno == EINTR));
+    if (len <= 0)
+        return false;
+    Buf.append(chunk, len);
+    return true;
+}
+
+// Read one line, without its newline. Returns false if the connection closes first.
+bool JobSocket::ReadLine(std::string &Line)
+{
+    std::size_t nl;
+
+    while ((nl = Buf.find('\n', Pos)) == std::string::npos)
+        if (!Fill())
+            return false;
+    Line = Buf.substr(Pos, nl - Pos);
+    Pos = nl + 1;
+    return true;
+}
+
+// Read exactly Len bytes. Returns false if the connection closes first.
+bool JobSocket::ReadBytes(std::size_t Len, std::string &Data)
+{
+    while (Buf.size() - Pos < Len)
+        if (!Fill())
+            return false;
+    Data = Buf.substr(Pos, Len);
+    Pos += Len;
+    return true;
+}
+
+// Write all of Data. Returns false if the other end has gone away.
+bool JobSocket::Write(const std::string &Data)
+{
+    std::size_t done {0};
+
+    while (done < Data.size()) {
+        ssize_t len = send(Fd, Data.data() + done, Data.size() - done, MSG_NOSIGNAL);
+        if ((len < 0) && (errno == EINTR))
+            continue;
+        if (len <= 0)
+            return false;
+        done += len;
+    }
+    return true;
+}
+
+// Fill in a socket address for the given path. Returns false if the path is too long.
+static bool MakeAddress(const std::string &Path, sockaddr_un &Addr)
+{
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    if (Path.size() >= sizeof(Addr.sun_path))
+        return false;
+    strncpy(Addr.sun_path, Path.c_str(), sizeof(Addr.sun_path) - 1);
+    return true;
+}
+
+// Create a listening socket at Path, replacing any stale one. Returns the descriptor, or -1 on error.
+int ListenJobSocket(const std::string &Path)
+{
+    sockaddr_un addr;
+
+    if (!MakeAddress(Path, addr))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    unlink(Path.c_str());
+    if ((bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, SOMAXCONN) < 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Connect to a server listening at Path. Returns the descriptor, or -1 on error.
+int ConnectJobSocket(const std::string &Path)
+{
+    sockaddr_un addr;
+
+    if (!MakeAddress(Path, addr))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static volatile sig_atomic_t GotStopSignal {0};
+
+static void StopSignalHandler(int)
+{
+    GotStopSignal = 1;
+}
+
+// Block or unblock the stop signals for the calling thread. Threads started while they are blocked
+// inherit that, and never see them.
+void BlockStopSignals(bool Block)
+{
+    sigset_t sigs;
+
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(Block ? SIG_BLOCK : SIG_UNBLOCK, &sigs, nullptr);
+}
+
+// Note stop signals for StopRequested(). Without SA_RESTART, a blocking accept() or read() in the
+// thread that takes the signal returns EINTR, so it can check.
+void CatchStopSignals()
+{
+    struct sigaction sa {};
+
+    sa.sa_handler = StopSignalHandler;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+}
+
+bool StopRequested()
+{
+    return GotStopSignal != 0;
+}
@@ -0,0 +1,75 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// jobsocket.hpp - the wire protocol between serve6k and its clients.
+//
+// A client connects to the server's Unix domain socket and sends requests, one per line. Files are sent
+// as a line giving their length in bytes, followed by exactly that many bytes:
+//
+//      bin N       raw binary to load at address 0 and start at (followed by N bytes)
+//      deck N      code card deck to load directly into memory (followed by N bytes)
+//      boot N      card deck to boot through the loader ROM (followed by N bytes)
+//      in N        card deck to put in the scanner (followed by N bytes)
+//      cycles N    cycle budget for the job; the server may impose a lower one
+//      punch       load the punch with blank cards and send back what gets punched
+//      run         run the job described so far
+//
+// For each run the server answers with lines of its own, printer and punch output streamed as the job
+// makes it:
+//
+//      print TEXT          one line from the Print-o-Tron
+//      punch TEXT          one line of punched card output
+//      regs R0 ... R15     final registers, in hex
+//      pages P S Z         private, shared and zero memory pages
+//      done STATUS CYCLES [MESSAGE]
+//
+// STATUS is one of batch6k's exit codes. After "done" the machine is reset and the connection can be
+// used for another job. A malformed request gets "done 1 0 MESSAGE" and the connection is closed.
+#ifndef __JOBSOCKET_HPP__
+#define __JOBSOCKET_HPP__
+
+#include <cstddef>
+#include <string>
+
+#define JOBSOCKET_DEFAULT_PATH "/tmp/ct6k.sock"
+#define JOBSOCKET_MAX_FILE (64 * 1024 * 1024) // largest file a client may send, in bytes
+
+// Buffered line and block I/O on a connected socket. Owns the descriptor and closes it when done.
+class JobSocket {
+public:
+    JobSocket(int Fd);
+    ~JobSocket();
+    bool ReadLine(std::string &Line);
+    bool ReadBytes(std::size_t Len, std::string &Data);
+    bool Write(const std::string &Data);
+private:
+    int Fd;
+    std::string Buf;
+    std::size_t Pos {0};
+    bool Fill();
+};
+
+int ListenJobSocket(const std::string &Path);
+int ConnectJobSocket(const std::string &Path);
+
+// Shutdown on SIGINT and SIGTERM. These live here, away from arch.h, because the system's signal
+// headers define register names of their own.
+void BlockStopSignals(bool Block);
+void CatchStopSignals();
+bool StopRequested();
+
+#endif // __JOBSOCKET_HPP__
@@ -0,0 +1,439 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// lockstep.cpp - definitions for the Lockstep execution engine
+//
+// Scheduling is simple: each step, the lanes sitting at the lowest IP run that instruction together.
+// Lanes that branch differently drift apart, and the lowest-IP rule lets the ones that fell behind
+// catch up so the group comes back together where the paths meet (the end of an if, the top of a loop).
+//
+// Only instructions that work on registers, direct values and plain memory are done here. Anything
+// else - I/O, the stack, faults, the MMU, interrupts - goes to the lane's own CPU, one lane at a time,
+// so the semantics stay exactly those of CPU::Step(). The lane loops below must match cpu.cpp, flag
+// for flag; batch6k --verify runs both engines and compares them.
+
+#include <climits>
+#include "lockstep.hpp"
+
+#define MATH_FLAGS (FLG_OVER | FLG_UNDER | FLG_ZERO)
+#define LANE_ON 0xFFFFFFFF
+
+// Merge a new value into a register for the lanes in the mask only.
+#define LANE_PUT(_reg, _l, _val, _mask) \
+    (Reg[(_reg)][(_l)] = ((_val) & (_mask)[(_l)]) | (Reg[(_reg)][(_l)] & ~(_mask)[(_l)]))
+
+// Constructor. The lanes must already have their programs loaded and devices attached. Lanes past
+// LOCKSTEP_MAX_LANES are ignored.
+Lockstep::Lockstep(const std::vector<CPU *> &Lanes, uint64_t CycleLimit)
+{
+    NumLanes = (Lanes.size() < LOCKSTEP_MAX_LANES) ? Lanes.size() : LOCKSTEP_MAX_LANES;
+    Limit = CycleLimit;
+    for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) {
+        Lane[l] = (l < NumLanes) ? Lanes[l] : nullptr;
+        Cycles[l] = 0;
+        for (int r = 0; r < NUMREGS; r++)
+            Reg[r][l] = (l < NumLanes) ? Lane[l]->ReadReg(r) : 0;
+    }
+}
+
+// A lane drops out when its CPU halts or it uses up its cycles.
+bool Lockstep::IsActive(int L) const
+{
+    return !Lane[L]->IsHalted() && (Cycles[L] < Limit);
+}
+
+bool Lockstep::IsDone() const
+{
+    for (int l = 0; l < NumLanes; l++)
+        if (IsActive(l))
+            return false;
+    return true;
+}
+
+uint64_t Lockstep::GetCycles(int Lane) const
+{
+    return Cycles[Lane];
+}
+
+uint64_t Lockstep::GetVectorInstructions() const
+{
+    return VectorInstructions;
+}
+
+uint64_t Lockstep::GetScalarInstructions() const
+{
+    return ScalarInstructions;
+}
+
+// Copy the registers back into the CPUs, so the caller can look at them the usual way.
+void Lockstep::Sync()
+{
+    for (int l = 0; l < NumLanes; l++)
+        for (int r = 0; r < NUMREGS; r++)
+            Lane[l]->WriteReg(r, Reg[r][l]);
+}
+
+// Run one instruction on a single lane using its own CPU.
+void Lockstep::ScalarStep(int L)
+{
+    for (int r = 0; r < NUMREGS; r++)
+        Lane[L]->WriteReg(r, Reg[r][L]);
+    Lane[L]->Step();
+    for (int r = 0; r < NUMREGS; r++)
+        Reg[r][L] = Lane[L]->ReadReg(r);
+    Cycles[L]++;
+    ScalarInstructions++;
+}
+
+void Lockstep::ScalarStepAll(const uint32_t *Mask)
+{
+    for (int l = 0; l < NumLanes; l++)
+        if (Mask[l])
+            ScalarStep(l);
+}
+
+// Execute up to MaxSteps instructions (counting a group of lanes running together as one).
+// Returns the number of steps taken, which is less than MaxSteps only if every lane is done.
+uint64_t Lockstep::Run(uint64_t MaxSteps)
+{
+    uint64_t steps;
+
+    for (steps = 0; steps < MaxSteps; steps++) {
+        uint32_t mask[LOCKSTEP_MAX_LANES] {0};
+        uint32_t ip {MAX_ADDR};
+        bool any {false};
+        int first {-1};
+
+        for (int l = 0; l < NumLanes; l++)
+            if (IsActive(l) && (Reg[REG_IP][l] <= ip)) {
+                ip = Reg[REG_IP][l];
+                any = true;
+            }
+        if (!any)
+            break;
+        for (int l = 0; l < NumLanes; l++) {
+            if (!IsActive(l) || (Reg[REG_IP][l] != ip))
+                continue;
+            // Translation and interrupts are CPU::Step()'s business.
+            if (Reg[REG_FLG][l] & (FLG_MMUENA | FLG_INTENA)) {
+                ScalarStep(l);
+                continue;
+            }
+            mask[l] = LANE_ON;
+            if (first < 0)
+                first = l;
+        }
+        if (first < 0)
+            continue;
+        if (ip >= BASE_IO_MEM) {
+            ScalarStepAll(mask);
+            continue;
+        }
+
+        // Every lane has to be looking at the same instruction, or it isn't the same program any more.
+        uint32_t word = Lane[first]->ReadMem(ip);
+        bool same {true};
+        for (int l = first + 1; l < NumLanes; l++)
+            if (mask[l] && (Lane[l]->ReadMem(ip) != word))
+                same = false;
+        Instruction inst(word);
+        uint32_t next = ip + 1;
+        uint32_t direct {0};
+        if (same && inst.IsDirectValInstr()) {
+            if (next >= BASE_IO_MEM) {
+                same = false;
+            } else {
+                direct = Lane[first]->ReadMem(next);
+                for (int l = first + 1; l < NumLanes; l++)
+                    if (mask[l] && (Lane[l]->ReadMem(next) != direct))
+                        same = false;
+                next++;
+            }
+        }
+        if (!same || !VectorStep(inst, mask, ip, next, direct))
+            ScalarStepAll(mask);
+    }
+    return steps;
+}
+
+// Execute the decoded instruction at IP across the lanes in the mask. As in CPU::Step(), IP already
+// points past the instruction (and its direct value) by the time it runs, so reading IP as an operand
+// gives the same answer here as there. Lanes that turn out to need the CPU (an I/O address, say) are
+// taken out of the mask and stepped individually.
+// Returns false, having done nothing, if the instruction isn't one this engine handles.
+bool Lockstep::VectorStep(Instruction &Inst, uint32_t *Mask, uint32_t IP, uint32_t Next, uint32_t Direct)
+{
+    uint8_t opcode = Inst.GetOpcode();
+    bool done {false};
+
+    if (opcode == OP_INVALID)
+        return false;
+    for (int l = 0; l < NumLanes; l++)
+        LANE_PUT(REG_IP, l, Next, Mask);
+    switch (Inst.GetType()) {
+        case op_no_args:
+            done = (opcode == OP_NOP);
+            break;
+        case op_2src_dest:
+            done = Vector2SrcDest(opcode, Inst.GetSrc1Reg(), Inst.GetSrc2Reg(), Inst.GetDestReg(), Mask);
+            break;
+        case op_src_dest:
+            done = VectorSrcDest(Inst, Mask, IP, Direct);
+            break;
+        case op_dest_only:
+            done = VectorDestOnly(opcode, Inst.GetDestReg(), Mask);
+            break;
+        case op_control_flow:
+        case op_loop:
+            done = VectorControlFlow(Inst, Mask, Direct);
+            break;
+        default:
+            break;
+    }
+    if (!done) {
+        for (int l = 0; l < NumLanes; l++)
+            LANE_PUT(REG_IP, l, IP, Mask);
+        return false;
+    }
+    for (int l = 0; l < NumLanes; l++)
+        if (Mask[l]) {
+            Cycles[l]++;
+            VectorInstructions++;
+        }
+    return true;
+}
+
+// ADD, SUB, AND, OR, XOR, SHIFTR, SHIFTL with all three operands in registers.
+// As in CPU::Execute2SrcDest(), the sources are read first, then the flags are set, then the
+// destination is written (so a destination of FLG wins).
+bool Lockstep::Vector2SrcDest(uint8_t Opcode, RegisterArg Src1, RegisterArg Src2, RegisterArg Dest,
+                              const uint32_t *Mask)
+{
+    if ((Src1.GetType() != rt_value) || (Src2.GetType() != rt_value) || (Dest.GetType() != rt_value))
+        return false;
+    int s1 = Src1.GetNum();
+    int s2 = Src2.GetNum();
+    int d = Dest.GetNum();
+
+    switch (Opcode) {
+        case OP_ADD:
+            for (int l = 0; l < NumLanes; l++) {
+                uint32_t a = Reg[s1][l], b = Reg[s2][l];
+                uint32_t f = Reg[REG_FLG][l] & ~MATH_FLAGS;
+                uint32_t r = a + b;
+                bool over = (f & FLG_SIGNED) ?
+                    (((int32_t)r < (int32_t)a) || ((int32_t)r < (int32_t)b)) : ((r < a) || (r < b));
+                f |= (over ? FLG_OVER : 0) | ((r == 0) ? FLG_ZERO : 0);
+                LANE_PUT(REG_FLG, l, f, Mask);
+                LANE_PUT(d, l, r, Mask);
+            }
+            break;
+        case OP_SUB:
+            for (int l = 0; l < NumLanes; l++) {
+                uint32_t a = Reg[s1][l], b = Reg[s2][l];
+                uint32_t f = Reg[REG_FLG][l] & ~MATH_FLAGS;
+                uint32_t r = a - b;
+                bool under = (f & FLG_SIGNED) ?
+                    (((int32_t)r > (int32_t)a) || ((int32_t)r > (int32_t)b)) : ((r > a) || (r > b));
+                f |= (under ? FLG_UNDER : 0) | ((r == 0) ? FLG_ZERO : 0);
+                LANE_PUT(REG_FLG, l, f, Mask);
+                LANE_PUT(d, l, r, Mask);
+            }
+            break;
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+            for (int l = 0; l < NumLanes; l++) {
+                uint32_t a = Reg[s1][l], b = Reg[s2][l];
+                uint32_t f = Reg[REG_FLG][l] & ~MATH_FLAGS;
+                uint32_t r = (Opcode == OP_AND) ? (a & b) : ((Opcode == OP_OR) ? (a | b) : (a ^ b));
+                f |= (r == 0) ? FLG_ZERO : 0;
+                LANE_PUT(REG_FLG, l, f, Mask);
+                LANE_PUT(d, l, r, Mask);
+            }
+            break;
+        case OP_SHIFTR:
+        case OP_SHIFTL:
+            // Shifts of 32 or more shift everything out, as in the CPU.
+            for (int l = 0; l < NumLanes; l++) {
+                uint32_t a = Reg[s1][l], b = Reg[s2][l];
+                uint32_t f = Reg[REG_FLG][l] & ~MATH_FLAGS;
+                uint32_t r;
+                if (b > 31) {
+                    r = 0;
+                    f |= a ? ((Opcode == OP_SHIFTR) ? FLG_UNDER : FLG_OVER) : 0;
+                } else if (Opcode == OP_SHIFTR) {
+                    r = a >> b;
+                    f |= ((r << b) != a) ? FLG_UNDER : 0;
+                } else {
+                    r = a << b;
+                    f |= ((r >> b) != a) ? FLG_OVER : 0;
+                }
+                f |= (r == 0) ? FLG_ZERO : 0;
+                LANE_PUT(REG_FLG, l, f, Mask);
+                LANE_PUT(d, l, r, Mask);
+            }
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+// MOVE and CMP. MOVE may use memory on either side; each lane has its own memory, so those are done
+// a lane at a time, and lanes that hit I/O space are handed to the CPU.
+bool Lockstep::VectorSrcDest(Instruction &Inst, uint32_t *Mask, uint32_t IP, uint32_t Direct)
+{
+    RegisterArg src = Inst.GetSrc1Reg();
+    RegisterArg dest = Inst.GetDestReg();
+    bool direct = Inst.IsDirectValInstr();
+    int s = src.GetNum();
+    int d = dest.GetNum();
+
+    if (!direct && (src.GetType() != rt_value) && (src.GetType() != rt_indirect))
+        return false;
+    if ((dest.GetType() != rt_value) && (dest.GetType() != rt_indirect))
+        return false;
+
+    if (Inst.GetOpcode() == OP_MOVE) {
+        bool simple = (direct || (src.GetType() == rt_value)) && (dest.GetType() == rt_value);
+        if (simple) {
+            for (int l = 0; l < NumLanes; l++) {
+                uint32_t v = direct ? Direct : Reg[s][l];
+                LANE_PUT(d, l, v, Mask);
+            }
+        } else {
+            for (int l = 0; l < NumLanes; l++) {
+                if (!Mask[l])
+                    continue;
+                uint32_t from = (!direct && (src.GetType() == rt_indirect)) ? Reg[s][l] : 0;
+                uint32_t to = (dest.GetType() == rt_indirect) ? Reg[d][l] : 0;
+                if ((from >= BASE_IO_MEM) || (to >= BASE_IO_MEM)) {
+                    Mask[l] = 0;
+                    Reg[REG_IP][l] = IP;
+                    ScalarStep(l);
+                    continue;
+                }
+                uint32_t v = direct ? Direct : ((src.GetType() == rt_indirect) ? Lane[l]->ReadMem(from) : Reg[s][l]);
+                if (dest.GetType() == rt_indirect)
+                    Lane[l]->WriteMem(to, v);
+                else
+                    Reg[d][l] = v;
+            }
+        }
+    } else if (Inst.GetOpcode() == OP_CMP) {
+        // CMP clears the math flags before it reads its operands, so FLG as an operand sees them clear.
+        if ((!direct && (src.GetType() != rt_value)) || (dest.GetType() != rt_value))
+            return false;
+        for (int l = 0; l < NumLanes; l++) {
+            uint32_t f = Reg[REG_FLG][l] & ~MATH_FLAGS;
+            uint32_t a = direct ? Direct : ((s == REG_FLG) ? f : Reg[s][l]);
+            uint32_t b = (d == REG_FLG) ? f : Reg[d][l];
+            if (f & FLG_SIGNED)
+                f |= (a == b) ? FLG_ZERO : (((int32_t)a < (int32_t)b) ? FLG_UNDER : FLG_OVER);
+            else
+                f |= (a == b) ? FLG_ZERO : ((a < b) ? FLG_UNDER : FLG_OVER);
+            LANE_PUT(REG_FLG, l, f, Mask);
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// NOT, INCR and DECR on a register. Order follows CPU::ExecuteDestOnly(): read, clear math flags,
+// set OVER/UNDER, write the result, then set ZERO.
+bool Lockstep::VectorDestOnly(uint8_t Opcode, RegisterArg Dest, const uint32_t *Mask)
+{
+    if (Dest.GetType() != rt_value)
+        return false;
+    if ((Opcode != OP_NOT) && (Opcode != OP_INCR) && (Opcode != OP_DECR))
+        return false;
+    int d = Dest.GetNum();
+
+    for (int l = 0; l < NumLanes; l++) {
+        uint32_t v = Reg[d][l];
+        uint32_t f = Reg[REG_FLG][l] & ~MATH_FLAGS;
+        uint32_t r;
+        bool sgn = f & FLG_SIGNED;
+        if (Opcode == OP_NOT) {
+            r = ~v;
+        } else if (Opcode == OP_INCR) {
+            r = v + 1;
+            f |= (sgn ? ((int32_t)r == INT_MIN) : (r == 0)) ? FLG_OVER : 0;
+        } else {
+            r = v - 1;
+            f |= (sgn ? ((int32_t)r == INT_MAX) : (r == 0xFFFFFFFF)) ? FLG_UNDER : 0;
+        }
+        LANE_PUT(REG_FLG, l, f, Mask);
+        LANE_PUT(d, l, r, Mask);
+        f = (Reg[REG_FLG][l] & ~FLG_ZERO) | ((r == 0) ? FLG_ZERO : 0);
+        LANE_PUT(REG_FLG, l, f, Mask);
+    }
+    return true;
+}
+
+// Conditional jumps, JMP and LOOP, with the target in a register or a direct value. CALL needs the
+// stack, so it goes to the CPU. This is where lanes split up.
+bool Lockstep::VectorControlFlow(Instruction &Inst, const uint32_t *Mask, uint32_t Direct)
+{
+    uint8_t opcode = Inst.GetOpcode();
+    RegisterArg dest = Inst.GetDestReg();
+    bool direct = Inst.IsDirectValInstr();
+    uint32_t flag {0};
+    bool want {true};
+
+    if (!direct && (dest.GetType() != rt_value))
+        return false;
+    int d = dest.GetNum();
+    switch (opcode) {
+        case OP_JZERO:   flag = FLG_ZERO;  want = true;  break;
+        case OP_JNZERO:  flag = FLG_ZERO;  want = false; break;
+        case OP_JOVER:   flag = FLG_OVER;  want = true;  break;
+        case OP_JNOVER:  flag = FLG_OVER;  want = false; break;
+        case OP_JUNDER:  flag = FLG_UNDER; want = true;  break;
+        case OP_JNUNDER: flag = FLG_UNDER; want = false; break;
+        case OP_JMP:
+        case OP_LOOP:
+            break;
+        default:
+            return false;
+    }
+
+    if (opcode == OP_LOOP) {
+        RegisterArg counter = Inst.GetSrc1Reg();
+        if (counter.GetType() != rt_value)
+            return false;
+        int c = counter.GetNum();
+        for (int l = 0; l < NumLanes; l++) {
+            if (!Mask[l])
+                continue;
+            uint32_t target = direct ? Direct : Reg[d][l];
+            uint32_t count = Reg[c][l] - 1;
+            Reg[c][l] = count;
+            if (count != 0)
+                Reg[REG_IP][l] = target;
+        }
+        return true;
+    }
+    for (int l = 0; l < NumLanes; l++) {
+        uint32_t target = direct ? Direct : Reg[d][l];
+        bool taken = (flag == 0) || (!!(Reg[REG_FLG][l] & flag) == want);
+        LANE_PUT(REG_IP, l, taken ? target : Reg[REG_IP][l], Mask);
+    }
+    return true;
+}
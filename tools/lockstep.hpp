@@ -0,0 +1,63 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// lockstep.hpp - declarations for the Lockstep execution engine.
+// Runs several copies of the same program, each on its own CPU with its own memory and devices,
+// and executes each instruction once for every lane that has reached it. The registers of all the
+// lanes are kept together, one array per register, so the simple instructions become short loops
+// across the lanes that the compiler can turn into vector code.
+#ifndef __LOCKSTEP_HPP__
+#define __LOCKSTEP_HPP__
+
+#include <cstdint>
+#include <vector>
+#include "arch.h"
+#include "cpu.hpp"
+#include "instruction.hpp"
+
+#define LOCKSTEP_MAX_LANES 16
+
+class Lockstep {
+public:
+    Lockstep(const std::vector<CPU *> &Lanes, uint64_t CycleLimit);
+    uint64_t Run(uint64_t MaxSteps);
+    bool IsDone() const;
+    uint64_t GetCycles(int Lane) const;
+    uint64_t GetVectorInstructions() const;
+    uint64_t GetScalarInstructions() const;
+    void Sync();
+
+private:
+    int NumLanes;
+    CPU *Lane[LOCKSTEP_MAX_LANES];
+    alignas(64) uint32_t Reg[NUMREGS][LOCKSTEP_MAX_LANES];
+    uint64_t Cycles[LOCKSTEP_MAX_LANES];
+    uint64_t Limit;
+    uint64_t VectorInstructions {0};
+    uint64_t ScalarInstructions {0};
+
+    bool IsActive(int L) const;
+    void ScalarStep(int L);
+    void ScalarStepAll(const uint32_t *Mask);
+    bool VectorStep(Instruction &Inst, uint32_t *Mask, uint32_t IP, uint32_t Next, uint32_t Direct);
+    bool Vector2SrcDest(uint8_t Opcode, RegisterArg Src1, RegisterArg Src2, RegisterArg Dest, const uint32_t *Mask);
+    bool VectorSrcDest(Instruction &Inst, uint32_t *Mask, uint32_t IP, uint32_t Direct);
+    bool VectorDestOnly(uint8_t Opcode, RegisterArg Dest, const uint32_t *Mask);
+    bool VectorControlFlow(Instruction &Inst, const uint32_t *Mask, uint32_t Direct);
+};
+
+#endif // __LOCKSTEP_HPP__
@@ -19,47 +19,164 @@
 #include "memory.hpp"
 #include <new>
 
+// Every page starts out as this one. It is never written and never freed.
+static MemPage ZeroPage;
+
 // Constructor with size specified by caller
 Memory::Memory(uint32_t Size)
 {
-    Blob = new uint32_t[Size]{0};
-    Limit = Size;
+    Init(Size);
 };
 
 // Constructor with default size
 Memory::Memory()
 {
-    Blob = new uint32_t[MEM_DEFAULT_SIZE]{0};
-    Limit = MEM_DEFAULT_SIZE;
+    Init(MEM_DEFAULT_SIZE);
+}
+
+// Set up the page table with every page pointing at the zero page. No page memory is allocated until
+// something is written.
+void Memory::Init(uint32_t Size)
+{
+    Limit = Size;
+    NumPages = (Size + MEM_PAGE_MASK) >> MEM_PAGE_SHIFT;
+    Pages = new std::atomic<MemPage *>[NumPages];
+    Private = new std::atomic<bool>[NumPages];
+    for (uint32_t i = 0; i < NumPages; i++) {
+        Pages[i].store(&ZeroPage, std::memory_order_relaxed);
+        Private[i].store(false, std::memory_order_relaxed);
+    }
 }
 
 // Destructor
 Memory::~Memory()
 {
-    delete[] Blob;
+    Clear();
+    delete[] Pages;
+    delete[] Private;
 };
 
+// Drop a reference to a page, freeing it if nobody else has it.
+void Memory::Release(MemPage *Page)
+{
+    if (Page == &ZeroPage)
+        return;
+    if (Page->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete Page;
+}
+
 // Read a word from the specified memory location. No errors returned from this function.
 uint32_t Memory::MemRead(uint32_t Address)
 {
-    if (Address <= Limit)
-        return Blob[Address];
+    if (Address < Limit)
+        return Pages[Address >> MEM_PAGE_SHIFT].load(std::memory_order_acquire)->Words[Address & MEM_PAGE_MASK]
+            .load(std::memory_order_acquire);
     else
         // No memory present at this address, the data lines
         // float to 1.
         return 0xFFFFFFFF;
 };
 
+// Return the page at the given index, ready to be written. The first write to a page that is shared,
+// or still the zero page, makes a private copy of it.
+MemPage *Memory::GetWritablePage(uint32_t Index)
+{
+    if (Private[Index].load(std::memory_order_acquire))
+        return Pages[Index].load(std::memory_order_acquire);
+
+    std::lock_guard<std::mutex> lock(CopyLock);
+    MemPage *old = Pages[Index].load(std::memory_order_acquire);
+    if (Private[Index].load(std::memory_order_acquire))
+        return old; // another core got here first
+    // If everyone else has let go of the page since it was shared, it's ours already.
+    if ((old != &ZeroPage) && (old->RefCount.load(std::memory_order_acquire) == 1)) {
+        Private[Index].store(true, std::memory_order_release);
+        return old;
+    }
+    MemPage *copy = new MemPage;
+    for (int i = 0; i < MEM_PAGE_WORDS; i++)
+        copy->Words[i].store(old->Words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    copy->RefCount.store(1, std::memory_order_relaxed);
+    Pages[Index].store(copy, std::memory_order_release);
+    Private[Index].store(true, std::memory_order_release);
+    // Other cores of this machine may still be reading the old page, so it can't be freed just yet even
+    // if this was the last reference.
+    if ((old != &ZeroPage) && (old->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1))
+        Retired.push_back(old);
+    return copy;
+}
+
 // Write a word to the specified memory location. As above, no errors are reported by this function.
 void Memory::MemWrite(uint32_t Address, uint32_t Value)
 {
-    if (Address <= Limit)
-        Blob[Address] = Value;
+    if (Address < Limit)
+        GetWritablePage(Address >> MEM_PAGE_SHIFT)->Words[Address & MEM_PAGE_MASK]
+            .store(Value, std::memory_order_release);
     // No error if address is out of range, value just disappears
     // like in a a real (vintage) CPU.
 }
 
+// Atomically replace the word at the specified location with Desired, but only if it currently holds
+// Expected. Returns true if the swap happened. Out of range addresses never match.
+// This is a full barrier, see arch.h.
+bool Memory::MemCompareExchange(uint32_t Address, uint32_t Expected, uint32_t Desired)
+{
+    if (Address < Limit)
+        return GetWritablePage(Address >> MEM_PAGE_SHIFT)->Words[Address & MEM_PAGE_MASK]
+            .compare_exchange_strong(Expected, Desired, std::memory_order_seq_cst);
+    return false;
+}
+
+// Zero all of memory, as at power-on. Used on reset so cores sharing this memory keep their pointer.
+// No core may be running.
+void Memory::Clear()
+{
+    for (uint32_t i = 0; i < NumPages; i++) {
+        Release(Pages[i].load(std::memory_order_relaxed));
+        Pages[i].store(&ZeroPage, std::memory_order_relaxed);
+        Private[i].store(false, std::memory_order_relaxed);
+    }
+    for (auto page : Retired)
+        delete page;
+    Retired.clear();
+}
+
 uint32_t Memory::GetMemSize()
 {
     return Limit;
 };
+
+// Make a new Memory with the same contents as this one, sharing all of its pages. From here on, a write by
+// either one to a shared page copies it first. No core using this memory may be running.
+// Caller owns the returned object.
+Memory *Memory::Clone()
+{
+    Memory *retval = new Memory(Limit);
+
+    std::lock_guard<std::mutex> lock(CopyLock);
+    for (uint32_t i = 0; i < NumPages; i++) {
+        MemPage *page = Pages[i].load(std::memory_order_relaxed);
+        if (page != &ZeroPage)
+            page->RefCount.fetch_add(1, std::memory_order_relaxed);
+        retval->Pages[i].store(page, std::memory_order_relaxed);
+        Private[i].store(false, std::memory_order_relaxed);
+    }
+    return retval;
+}
+
+// Count this instance's pages by how they are held.
+MemPageCounts Memory::GetPageCounts()
+{
+    MemPageCounts retval {0, 0, 0};
+
+    for (uint32_t i = 0; i < NumPages; i++) {
+        MemPage *page = Pages[i].load(std::memory_order_acquire);
+        if (page == &ZeroPage)
+            retval.Zero++;
+        else if (page->RefCount.load(std::memory_order_relaxed) > 1)
+            retval.Shared++;
+        else
+            retval.Private++;
+    }
+    return retval;
+}
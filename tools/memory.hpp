@@ -20,16 +20,45 @@
 #define __MEMORY_HPP__
 
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 #define MEM_DEFAULT_SIZE 1024*1024
 // That's 1M words or 4MB.
 
+#define MEM_PAGE_SHIFT 10
+#define MEM_PAGE_WORDS (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK (MEM_PAGE_WORDS - 1)
+
+// One page of memory. A page may be shared by several Memory objects (or many slots of one, for the zero
+// page), in which case nobody writes it; whoever wants to write gets a private copy first.
+struct MemPage {
+    std::atomic<uint32_t> Words[MEM_PAGE_WORDS];
+    std::atomic<uint32_t> RefCount;
+};
+
+// How an instance's pages are held: written by this instance only, shared with other instances, or still
+// the shared all-zero page that has never been written.
+struct MemPageCounts {
+    uint32_t Private;
+    uint32_t Shared;
+    uint32_t Zero;
+};
 
 // The simplest class - this really could be done with something out of STL, but that's really too heavyweight here.
-// This block of memory is allocated once and released once. It never grows or shrinks, and it doesn't need to be
-// accessed with an iterator. So we can use a boring old c-style array and add a few methods to access it.
+// This block of memory never grows or shrinks, and it doesn't need to be accessed with an iterator. So we can use
+// a boring old c-style array and add a few methods to access it.
 // When Uncle Bob says "program to an interface, not an implementation" this is what he means.
 //
+// Behind the interface, memory is a table of pages. Every page starts out as the one shared zero page, and
+// Clone() makes a new Memory that shares all of this one's pages. A page is copied the first time it is
+// written, so many machines running the same program only pay for the pages each of them changes.
+//
+// Words are atomic so several CPU cores can share one Memory. Reads are acquires and writes are releases,
+// which costs nothing extra on x86 and gives the ordering described in arch.h. Copying a page is done under
+// a lock, so cores of one machine can write the same shared page at once.
+//
 class Memory {
 public:
     Memory(uint32_t Size);
@@ -37,10 +66,21 @@ public:
     ~Memory();
     uint32_t MemRead(uint32_t Address);
     void MemWrite(uint32_t Address, uint32_t Value);
+    bool MemCompareExchange(uint32_t Address, uint32_t Expected, uint32_t Desired);
+    void Clear();
     uint32_t GetMemSize();
+    Memory *Clone();
+    MemPageCounts GetPageCounts();
 private:
     uint32_t Limit;
-    uint32_t *Blob;
+    uint32_t NumPages;
+    std::atomic<MemPage *> *Pages;
+    std::atomic<bool> *Private;     // page is this instance's own and may be written in place
+    std::mutex CopyLock;
+    std::vector<MemPage *> Retired; // replaced pages a core may still be reading, freed on Clear()
+    void Init(uint32_t Size);
+    MemPage *GetWritablePage(uint32_t Index);
+    void Release(MemPage *Page);
 };
 
 #endif // __MEMORY_HPP__
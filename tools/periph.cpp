@@ -18,6 +18,7 @@
 // periph.cpp
 #include "periph.hpp"
 #include "hw.h"
+#include "timeline.hpp"
 
 // function definitions for the abstract class Periph - these do nothing but make the compiler happy
 void Periph::DoBackground()
@@ -39,3 +40,38 @@ void Periph::PowerOnReset()
 {
     return;
 }
+
+// Report activity to the given timeline, on the given track, or stop reporting with nullptr.
+void Periph::SetTimeline(DeviceTimeline *NewTimeline, int Track)
+{
+    Timeline = NewTimeline;
+    TimelineTrack = Track;
+}
+
+// The device has started something that keeps it busy, normally for NominalMsec.
+void Periph::SpanBegin(const char *What, uint32_t NominalMsec)
+{
+    if (Timeline != nullptr)
+        Timeline->Begin(TimelineTrack, What, NominalMsec);
+}
+
+// Whatever the device was busy with has finished.
+void Periph::SpanEnd()
+{
+    if (Timeline != nullptr)
+        Timeline->End(TimelineTrack);
+}
+
+// Something that happens at an instant, like a line being printed.
+void Periph::SpanMark(const char *What)
+{
+    if (Timeline != nullptr)
+        Timeline->Mark(TimelineTrack, What);
+}
+
+// The program read the device's status register.
+void Periph::NotePoll()
+{
+    if (Timeline != nullptr)
+        Timeline->Poll(TimelineTrack);
+}
@@ -27,6 +27,9 @@
 #include <cstdint>
 #ifndef __PERIPH_HPP__
 #define __PERIPH_HPP__
+
+class DeviceTimeline;
+
 enum DeviceClass {
     DC_PRINTER,     // Print-o-Tron XL full-width matrix imager
     DC_TAPE,        // Tape-o-Tron 1200
@@ -52,9 +55,19 @@ public:
     virtual bool InterruptActive(); // Level triggered, will drop once interrupt has been serviced.
     virtual void DoBackground();
     virtual void PowerOnReset();
+    void SetTimeline(DeviceTimeline *NewTimeline, int Track);
 
     // Interface on UI side varies based on device, so the derived classes will add those functions.
+protected:
+    // Activity reports for a DeviceTimeline. These do nothing unless one is attached.
+    void SpanBegin(const char *What, uint32_t NominalMsec);
+    void SpanEnd();
+    void SpanMark(const char *What);
+    void NotePoll();
+
 private:
+    DeviceTimeline *Timeline {nullptr};
+    int TimelineTrack {0};
 };
 
 
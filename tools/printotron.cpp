@@ -58,12 +58,20 @@ void PrintOTron::WriteIOMem(uint32_t Offset, uint32_t Value)
             break;
         case POT_REG_CONTROL:
             if (Value & POT_CONTROL_LINE_RELEASE) {
-                Status = POT_STATUS_BUSY;
+                SpanMark("line");
+                if (!Instant) {
+                    Status = POT_STATUS_BUSY;
+                    SpanBegin("busy", 0);
+                }
                 OutputBuffer.push_back(CurrentLine);
                 CurrentLine.clear();
             }
             if (Value & POT_CONTROL_PAGE_RELEASE) {
-                Status = POT_STATUS_BUSY;
+                SpanMark("page");
+                if (!Instant) {
+                    Status = POT_STATUS_BUSY;
+                    SpanBegin("busy", 0);
+                }
                 CurrentLine.clear();
                 OutputBuffer.push_back("\f");
             }
@@ -77,8 +85,9 @@ void PrintOTron::WriteIOMem(uint32_t Offset, uint32_t Value)
 // Defines how the device responds to memory reads by applications.
 uint32_t PrintOTron::ReadIOMem(uint32_t Offset)
 {
-    if (Offset != 0)
+    if (Offset != POT_REG_STATUS)
         return 0xFFFFFFFF;
+    NotePoll();
     return Status;
 }
 
@@ -104,6 +113,7 @@ std::string PrintOTron::GetOutputLine()
 
     retval = OutputBuffer[0];
     Status = POT_STATUS_OK;
+    SpanEnd();
     OutputBuffer.erase(OutputBuffer.begin());
     return retval;
 }
@@ -113,5 +123,15 @@ void PrintOTron::PowerOnReset()
 {
     OutputBuffer.clear();
     CurrentLine.clear();
-    Status = POT_STATUS_NO_PAPER; // Will change to ready when UI initializes.
+    SpanEnd();
+    Status = Instant ? POT_STATUS_OK : POT_STATUS_NO_PAPER; // Will change to ready when UI initializes.
+}
+
+// In instant mode the printer never waits for the host to collect a line, so a program's timing doesn't
+// depend on how often the host drains the output buffer.
+void PrintOTron::SetInstant(bool Enable)
+{
+    Instant = Enable;
+    if (Instant)
+        Status = POT_STATUS_OK;
 }
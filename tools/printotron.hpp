@@ -36,10 +36,12 @@ public:
     bool IsOutputReady();
     std::string GetOutputLine();
     void PowerOnReset();
+    void SetInstant(bool Enable);         // paper loaded and never busy, for batch runs
 private:
     std::vector<std::string> OutputBuffer;
     std::string CurrentLine;
     uint32_t Status;
+    bool Instant {false};
 };
 
 
@@ -0,0 +1,195 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// profiler.cpp - definitions for the Profiler class
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "profiler.hpp"
+#include "instruction.hpp"
+
+Profiler::Profiler(uint64_t Interval)
+    : Interval(Interval ? Interval : 1), Countdown(this->Interval)
+{
+}
+
+// Run the CPU for up to MaxCycles, taking a sample every Interval cycles. Sampling carries on across
+// calls, so this can be called in chunks. Stops early if the CPU halts or hits a BRK, like CPU::Run().
+// Returns the number of cycles executed.
+uint64_t Profiler::Run(CPU &C, uint64_t MaxCycles)
+{
+    uint64_t done {0};
+
+    while (done < MaxCycles) {
+        uint64_t slice = std::min(Countdown, MaxCycles - done);
+        uint64_t ran = C.Run(slice);
+        done += ran;
+        Countdown -= ran;
+        if (Countdown == 0) {
+            Sample(C.ReadReg(REG_IP));
+            Countdown = Interval;
+        }
+        if (ran < slice)
+            break;
+    }
+    return done;
+}
+
+// Record one sample at the given address. For front ends that drive the CPU themselves.
+void Profiler::Sample(uint32_t Addr)
+{
+    Hits[Addr]++;
+    Total++;
+}
+
+void Profiler::Reset()
+{
+    Hits.clear();
+    Total = 0;
+    Countdown = Interval;
+}
+
+uint64_t Profiler::GetSamples() const
+{
+    return Total;
+}
+
+// Helper for the reports, formats a location as file:line, or nothing if it isn't in the map.
+static std::string Location(const SymbolMap &Map, uint32_t Addr)
+{
+    const MapLine *line = Map.FindLine(Addr);
+    if (line == nullptr)
+        return "";
+    std::string file = Map.GetFileName(line->File);
+    file.erase(0, file.find_last_of("/\\") + 1);
+    return file + ":" + std::to_string(line->Line);
+}
+
+// Same, for the line a label is declared on.
+static std::string Location(const SymbolMap &Map, const MapSymbol *Sym)
+{
+    if (Sym->Line == 0) // made up for the start of a segment
+        return Location(Map, Sym->Addr);
+    std::string file = Map.GetFileName(Sym->File);
+    file.erase(0, file.find_last_of("/\\") + 1);
+    return file + ":" + std::to_string(Sym->Line);
+}
+
+// Write a flat profile: samples charged to each label, busiest first. Addresses outside the map are
+// listed one by one, so without a map this is a profile by address.
+void Profiler::WriteFlat(std::ostream &Out, const SymbolMap &Map) const
+{
+    std::map<std::string, std::pair<uint64_t, std::string>> bysym; // name -> samples, location
+    char buf[160];
+
+    for (auto &hit : Hits) {
+        const MapSymbol *sym = Map.FindSymbol(hit.first);
+        std::string name;
+        if (sym != nullptr) {
+            name = sym->Name;
+        } else {
+            snprintf(buf, sizeof(buf), "[0x%08x]", hit.first);
+            name = buf;
+        }
+        auto &entry = bysym[name];
+        if (entry.first == 0)
+            entry.second = (sym != nullptr) ? Location(Map, sym) : Location(Map, hit.first);
+        entry.first += hit.second;
+    }
+    std::vector<std::pair<std::string, std::pair<uint64_t, std::string>>> rows(bysym.begin(), bysym.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto &a, const auto &b)
+                     { return a.second.first > b.second.first; });
+
+    Out << "Flat profile: " << Total << " samples, one every " << Interval << " cycles\n\n";
+    Out << "  samples   self%    cum%  symbol                    location\n";
+    uint64_t cum {0};
+    for (auto &row : rows) {
+        cum += row.second.first;
+        snprintf(buf, sizeof(buf), "%9llu %7.2f %7.2f  %-24s  %s\n", (unsigned long long)row.second.first,
+                 Total ? 100.0 * row.second.first / Total : 0.0, Total ? 100.0 * cum / Total : 0.0,
+                 row.first.c_str(), row.second.second.c_str());
+        Out << buf;
+    }
+}
+
+// Write an annotated listing of every label that got samples, in address order: the samples at each
+// instruction, its address, the words, the disassembly and the source line it came from. The code is
+// read from the CPU's memory, so call this before the machine is reset.
+void Profiler::WriteListing(std::ostream &Out, SymbolMap &Map, CPU &C) const
+{
+    std::vector<const MapSymbol *> hot;
+    std::unordered_map<const MapSymbol *, uint64_t> symtotal;
+    char buf[160];
+
+    for (auto &hit : Hits) {
+        const MapSymbol *sym = Map.FindSymbol(hit.first);
+        if (sym == nullptr)
+            continue;
+        if (symtotal[sym] == 0)
+            hot.push_back(sym);
+        symtotal[sym] += hit.second;
+    }
+    if (hot.empty()) {
+        Out << "No samples fell in the symbol map, so there is no listing.\n";
+        return;
+    }
+    std::sort(hot.begin(), hot.end(), [](const MapSymbol *a, const MapSymbol *b) { return a->Addr < b->Addr; });
+
+    for (auto sym : hot) {
+        snprintf(buf, sizeof(buf), "$%s  (%s)  %llu samples, %.2f%%\n\n", sym->Name.c_str(),
+                 Location(Map, sym).c_str(), (unsigned long long)symtotal[sym],
+                 Total ? 100.0 * symtotal[sym] / Total : 0.0);
+        Out << buf;
+        uint32_t addr = sym->Addr;
+        while (addr < sym->End) {
+            uint32_t word1 = C.ReadMem(addr);
+            uint32_t word2 = C.ReadMem(addr + 1);
+            uint32_t used {0};
+            std::string instr = FormatDisasm(word1, word2, &used);
+            if ((used < 1) || (addr + used > sym->End))
+                used = 1;
+            // a sample can only land on the first word, but count both in case code jumped into the middle
+            uint64_t count {0};
+            for (uint32_t i = 0; i < used; i++) {
+                auto it = Hits.find(addr + i);
+                if (it != Hits.end())
+                    count += it->second;
+            }
+            if (count)
+                snprintf(buf, sizeof(buf), "%9llu  ", (unsigned long long)count);
+            else
+                snprintf(buf, sizeof(buf), "%9s  ", "");
+            Out << buf;
+            snprintf(buf, sizeof(buf), "0x%08x 0x%08x ", addr, word1);
+            Out << buf;
+            if (used == 2)
+                snprintf(buf, sizeof(buf), "0x%08x ", word2);
+            else
+                snprintf(buf, sizeof(buf), "%11s", "");
+            Out << buf;
+            snprintf(buf, sizeof(buf), "%-24s", instr.c_str());
+            Out << buf;
+            const MapLine *line = Map.FindLine(addr);
+            if (line != nullptr)
+                Out << " " << std::to_string(line->Line) << ": " << Map.GetSourceText(line->File, line->Line);
+            Out << "\n";
+            addr += used;
+        }
+        Out << "\n";
+    }
+}
@@ -0,0 +1,49 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// profiler.hpp - declarations for the Profiler class, a sampling profiler for guest code.
+// The profiler runs the CPU in slices of a fixed number of cycles and records where IP is at the end
+// of each one. With a symbol map from asm6k -m, the samples are charged to labels and source lines.
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include "cpu.hpp"
+#include "symmap.hpp"
+
+#define PROFILE_DEFAULT_INTERVAL 997    // prime, so a loop is unlikely to always be sampled at one spot
+
+class Profiler {
+public:
+    Profiler(uint64_t Interval = PROFILE_DEFAULT_INTERVAL);
+    uint64_t Run(CPU &C, uint64_t MaxCycles);
+    void Sample(uint32_t Addr);
+    void Reset();
+    uint64_t GetSamples() const;
+    void WriteFlat(std::ostream &Out, const SymbolMap &Map) const;
+    void WriteListing(std::ostream &Out, SymbolMap &Map, CPU &C) const;
+
+private:
+    uint64_t Interval;
+    uint64_t Countdown;     // cycles left until the next sample
+    uint64_t Total {0};
+    std::unordered_map<uint32_t, uint64_t> Hits;    // samples by address
+};
+
+#endif // __PROFILER_HPP__
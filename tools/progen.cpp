@@ -0,0 +1,254 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// progen.cpp - definitions for ProgramGenerator and ProbeDevice, used by diff6k.
+
+#include "arch.h"
+#include "hw.h"
+#include "instruction.hpp"
+#include "progen.hpp"
+
+static uint32_t Encode(uint8_t Op, uint8_t Src1, uint8_t Src2, uint8_t Dest)
+{
+    return OP_LOAD(Op) | S1_LOAD(Src1) | S2_LOAD(Src2) | DEST_LOAD(Dest);
+}
+
+// A MOVE of a direct value to a register takes two words.
+static uint32_t MoveDirect(uint8_t Reg)
+{
+    return Encode(OP_MOVE, REG_NULL, REG_NULL, REG_VAL | Reg);
+}
+
+ProgramGenerator::ProgramGenerator(uint32_t Seed, int Length) : Rng(Seed), Image(GEN_IMAGE_SIZE, 0),
+    Length(Length)
+{
+    while (opcode_map[NumOps].Opcode != OP_INVALID)
+        NumOps++;
+    MMU = Chance(30);
+    uint32_t addr {0};
+
+    // Prologue: stack, handler tables, MMU, then random registers and flags.
+    Emit(addr, MoveDirect(REG_SP));
+    Emit(addr, GEN_STACK_BASE);
+    Emit(addr, MoveDirect(REG_R0));
+    Emit(addr, GEN_FHAP);
+    Emit(addr, Encode(OP_SETFHAP, REG_VAL | REG_R0, REG_UNUSED, REG_UNUSED));
+    Emit(addr, MoveDirect(REG_R0));
+    Emit(addr, GEN_IHAP);
+    Emit(addr, Encode(OP_SETIHAP, REG_VAL | REG_R0, REG_UNUSED, REG_UNUSED));
+    if (MMU) {
+        Emit(addr, MoveDirect(REG_R0));
+        Emit(addr, GEN_PT_BASE);
+        Emit(addr, Encode(OP_SETPTB, REG_VAL | REG_R0, REG_UNUSED, REG_UNUSED));
+        Emit(addr, MoveDirect(REG_R0));
+        Emit(addr, GEN_PT_LEN);
+        Emit(addr, Encode(OP_SETPTL, REG_VAL | REG_R0, REG_UNUSED, REG_UNUSED));
+    }
+    for (uint8_t r = REG_R0; r <= REG_R12; r++) {
+        Emit(addr, MoveDirect(r));
+        Emit(addr, Value());
+    }
+    uint32_t flags = Random(16) & (FLG_OVER | FLG_UNDER | FLG_ZERO);
+    if (Chance(50))
+        flags |= FLG_SIGNED;
+    if (Chance(50))
+        flags |= FLG_INTENA | (Random(16) * FLG_INTEN0) | FLG_INTEN3;
+    Emit(addr, MoveDirect(REG_FLG));
+    Emit(addr, flags);
+    if (MMU)
+        Emit(addr, Encode(OP_MMUENA, REG_UNUSED, REG_UNUSED, REG_UNUSED));
+    Emit(addr, Encode(OP_JMP, REG_NULL, REG_NULL, REG_NULL));
+    Emit(addr, GEN_CODE_BASE);
+
+    // Handlers. Faults skip the faulting word; a page fault first drops the address pushed for it.
+    addr = GEN_HANDLERS;
+    Emit(addr, Encode(OP_POP, REG_UNUSED, REG_UNUSED, REG_VAL | REG_R12));
+    Emit(addr, Encode(OP_INCR, REG_UNUSED, REG_UNUSED, REG_VAL | REG_R12));
+    Emit(addr, Encode(OP_PUSH, REG_VAL | REG_R12, REG_UNUSED, REG_UNUSED));
+    Emit(addr, Encode(OP_IRET, REG_UNUSED, REG_UNUSED, REG_UNUSED));
+    uint32_t page_handler = addr;
+    Emit(addr, Encode(OP_POP, REG_UNUSED, REG_UNUSED, REG_VAL | REG_R12));
+    Emit(addr, Encode(OP_JMP, REG_NULL, REG_NULL, REG_NULL));
+    Emit(addr, GEN_HANDLERS);
+    uint32_t int_handler = addr;
+    Emit(addr, Encode(OP_IRET, REG_UNUSED, REG_UNUSED, REG_UNUSED));
+    for (uint32_t i = 0; i < FHAP_SIZE; i++)
+        Image[GEN_FHAP + i] = (i == FAULT_PAGE - 1) ? page_handler : GEN_HANDLERS;
+    for (uint32_t i = 0; i < NUM_INTS; i++)
+        Image[GEN_IHAP + i] = int_handler;
+
+    // The body, which loops forever unless it halts or breaks.
+    addr = GEN_CODE_BASE;
+    for (int i = 0; (i < Length) && (addr < GEN_CODE_END - 4); i++) {
+        uint32_t direct;
+        bool has_direct;
+        Emit(addr, RandomInstruction(direct, has_direct));
+        if (has_direct)
+            Emit(addr, direct);
+    }
+    Emit(addr, Encode(OP_JMP, REG_NULL, REG_NULL, REG_NULL));
+    Emit(addr, GEN_CODE_BASE);
+
+    for (addr = GEN_DATA_BASE; addr < GEN_DATA_END; addr++)
+        Image[addr] = Value();
+
+    // Page table: identity, but with two data pages swapped and random permissions on the data.
+    for (uint32_t page = 0; page < GEN_PT_LEN; page++) {
+        uint32_t frame = page;
+        uint32_t perms = PTE_VALID | PTE_WRITE;
+        if (page == 4)
+            frame = 5;
+        else if (page == 5)
+            frame = 4;
+        if (page == 0) {
+            perms |= PTE_EXEC;
+        } else if (page < (GEN_DATA_BASE >> MMU_PAGE_SHIFT)) {
+            perms = PTE_VALID | PTE_EXEC | (Chance(30) ? PTE_WRITE : 0);
+        } else if (page < (GEN_STACK_BASE >> MMU_PAGE_SHIFT)) {
+            static const uint32_t data_perms[] = {0, PTE_VALID, PTE_VALID | PTE_WRITE, PTE_VALID | PTE_WRITE,
+                                                  PTE_VALID | PTE_WRITE, PTE_VALID | PTE_WRITE | PTE_EXEC};
+            perms = data_perms[Random(sizeof(data_perms) / sizeof(data_perms[0]))];
+        } else if (page == (GEN_PT_BASE >> MMU_PAGE_SHIFT)) {
+            perms = PTE_VALID;
+        }
+        Image[GEN_PT_BASE + page] = (frame << MMU_PAGE_SHIFT) | perms;
+    }
+}
+
+void ProgramGenerator::Emit(uint32_t &Addr, uint32_t Word)
+{
+    Image[Addr++] = Word;
+}
+
+// A register argument, mostly general purpose registers, sometimes FLG, SP or IP.
+uint8_t ProgramGenerator::Arg()
+{
+    uint8_t reg = Chance(90) ? Random(REG_R13) : REG_R13 + Random(3);
+    return (Chance(75) ? REG_VAL : REG_IND) | reg;
+}
+
+// A value worth putting in a register: often an address in one of the program's areas or a device,
+// often a number at the edge of something.
+uint32_t ProgramGenerator::Value()
+{
+    static const uint32_t edges[] = {0, 1, 2, 31, 32, 33, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFE, 0xFFFFFFFF};
+    uint32_t pick = Random(100);
+
+    if (pick < 30)
+        return GEN_DATA_BASE + Random(GEN_DATA_END - GEN_DATA_BASE);
+    if (pick < 40)
+        return Random(41);
+    if (pick < 50)
+        return edges[Random(sizeof(edges) / sizeof(edges[0]))];
+    if (pick < 60)
+        return CodeAddr();
+    if (pick < 65)
+        return GEN_STACK_BASE + Random(MMU_PAGE_SIZE);
+    if (pick < 70)
+        return Chance(80) ? PROBE_BASE + Random(PROBE_WORDS) : PERIPH_MAP_BASE + Random(PERIPH_MAP_SIZE * 2);
+    return Rng();
+}
+
+// Somewhere in the body, usually on an instruction.
+uint32_t ProgramGenerator::CodeAddr()
+{
+    return GEN_CODE_BASE + Random(Length);
+}
+
+// One instruction of any kind from the opcode map, with arguments that suit it and junk in the bytes
+// it doesn't use. Now and then, a completely random word.
+uint32_t ProgramGenerator::RandomInstruction(uint32_t &Direct, bool &HasDirect)
+{
+    HasDirect = false;
+    if (Chance(3))
+        return Rng();
+
+    const OpMap *op;
+    do {
+        op = &opcode_map[Random(NumOps)];
+    } while ((op->Opcode == OP_HALT) && !Chance(10));
+    uint8_t src1 = Rng();
+    uint8_t src2 = Rng();
+    uint8_t dest = Rng();
+    switch (op->Type) {
+        case op_src_only:
+            src1 = Arg();
+            break;
+        case op_dest_only:
+            dest = Arg();
+            break;
+        case op_src_dest:
+            dest = Arg();
+            if (Chance(40)) {
+                src1 = src2 = REG_NULL;
+                HasDirect = true;
+                Direct = Value();
+            } else {
+                src1 = Arg();
+            }
+            break;
+        case op_2src_dest:
+            src1 = Arg();
+            src2 = Arg();
+            dest = Arg();
+            if ((op->Opcode == OP_CAS) && Chance(80))
+                dest = REG_IND | (dest & REGNUM_MASK);
+            break;
+        case op_loop:
+        case op_control_flow:
+            if (op->Type == op_loop)
+                src1 = Arg();
+            if (Chance(70)) {
+                dest = REG_NULL;
+                HasDirect = true;
+                Direct = Chance(90) ? CodeAddr() : Value();
+            } else {
+                dest = Arg();
+            }
+            break;
+        case op_direct_only:
+            if (Chance(95))
+                dest = REG_NULL;
+            HasDirect = (dest == REG_NULL);
+            Direct = Chance(50) ? Random(0x10000) : Rng();
+            break;
+        default:
+            break;
+    }
+    return Encode(op->Opcode, src1, src2, dest);
+}
+
+void ProbeDevice::WriteIOMem(uint32_t Offset, uint32_t Value)
+{
+    Regs[Offset % PROBE_WORDS] = Value;
+    Log.push_back({true, Offset, Value});
+}
+
+uint32_t ProbeDevice::ReadIOMem(uint32_t Offset)
+{
+    uint32_t val = Regs[Offset % PROBE_WORDS] + Reads++;
+    Log.push_back({false, Offset, val});
+    return val;
+}
+
+void ProbeDevice::PowerOnReset()
+{
+    for (int i = 0; i < PROBE_WORDS; i++)
+        Regs[i] = 0;
+    Reads = 0;
+    Log.clear();
+}
@@ -0,0 +1,108 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// progen.hpp - random test programs for diff6k, and the probe device they talk to.
+// ProgramGenerator builds a program image from a seed: a prologue that sets up a stack, fault and
+// interrupt handlers, random registers and flags and (sometimes) the MMU, then a body of random
+// instructions picked from opcode_map. The same seed always gives the same program.
+//
+// Memory layout, in 1K-word pages:
+//      page 0      prologue, then the handlers and the FHAP and IHAP tables
+//      pages 1-3   the random body, ending in a jump back to its start
+//      pages 4-7   data, filled with random words
+//      page 8      stack
+//      page 9      page table, only used if the MMU is turned on
+// With the MMU on, pages 0-9 are mapped to themselves except that data pages 4 and 5 are swapped, the
+// data pages get random permissions and the page table can't be written. Nothing past page 9 is mapped.
+//
+// Every fault handler steps over the word that faulted and returns, so a program keeps going until it
+// wrecks its own stack or handlers badly enough to double fault.
+#ifndef __PROGEN_HPP__
+#define __PROGEN_HPP__
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "periph.hpp"
+
+#define GEN_CODE_BASE 0x0400
+#define GEN_CODE_END 0x1000
+#define GEN_DATA_BASE 0x1000
+#define GEN_DATA_END 0x2000
+#define GEN_STACK_BASE 0x2000
+#define GEN_PT_BASE 0x2400
+#define GEN_PT_LEN 10
+#define GEN_IMAGE_SIZE (GEN_PT_BASE + GEN_PT_LEN)
+#define GEN_HANDLERS 0x0300
+#define GEN_FHAP 0x03E0
+#define GEN_IHAP 0x03F0
+#define GEN_DEFAULT_LENGTH 256  // instructions in the body
+#define GEN_MAX_LENGTH 1500
+
+class ProgramGenerator {
+public:
+    ProgramGenerator(uint32_t Seed, int Length);
+    const std::vector<uint32_t> &GetImage() const { return Image; }
+    bool UsesMMU() const { return MMU; }
+
+private:
+    std::mt19937 Rng;
+    std::vector<uint32_t> Image;
+    bool MMU {false};
+    int Length;
+    int NumOps {0};
+
+    uint32_t Random(uint32_t Range) { return Rng() % Range; }
+    bool Chance(int Percent) { return Random(100) < (uint32_t)Percent; }
+    uint8_t Arg();
+    uint32_t Value();
+    uint32_t CodeAddr();
+    uint32_t RandomInstruction(uint32_t &Direct, bool &HasDirect);
+    void Emit(uint32_t &Addr, uint32_t Word);
+};
+
+// A device for random programs to poke at. Eight registers: writes store into them, and each read
+// returns the register plus the number of reads so far, so both the order and the number of accesses
+// show. Every access is logged, so the logs of two copies can be compared.
+#define PROBE_DDN 0x50524F42    // "PROB"
+#define PROBE_WORDS 8
+#define PROBE_BASE 0xFFF10000   // where it lands as the only device
+
+struct ProbeAccess {
+    bool Write;
+    uint32_t Offset;
+    uint32_t Value;
+};
+
+class ProbeDevice : public Periph {
+public:
+    uint32_t GetMemSize() override { return PROBE_WORDS; }
+    void WriteIOMem(uint32_t Offset, uint32_t Value) override;
+    uint32_t ReadIOMem(uint32_t Offset) override;
+    DeviceClass GetDeviceClass() override { return DC_TELE; }   // no class fits, and nothing looks
+    uint32_t GetDDN() override { return PROBE_DDN; }
+    void PowerOnReset() override;
+    const std::vector<ProbeAccess> &GetLog() const { return Log; }
+    void ClearLog() { Log.clear(); }
+
+private:
+    uint32_t Regs[PROBE_WORDS] {0};
+    uint32_t Reads {0};
+    std::vector<ProbeAccess> Log;
+};
+
+#endif // __PROGEN_HPP__
@@ -0,0 +1,731 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// refcpu.cpp - definitions for RefCPU, the reference interpreter used by diff6k.
+// Everything here is open-coded from arch.h, one opcode per case, with no attempt at speed.
+//
+// Choices made where arch.h is silent or out of date, to match the machine as programs know it:
+//  - Faults and interrupts don't put a code in R0, and a double fault simply halts.
+//  - ADD sets OVER if the result is below either operand, and SUB sets UNDER if it is above either,
+//    compared as signed numbers when SIGNED is set. (So a signed ADD of two negative numbers sets OVER.)
+//  - SHIFTL and SHIFTR by more than 31 give zero, with OVER or UNDER set if any bits were lost.
+//  - NOT, INCR and DECR set ZERO after writing the result, so ZERO wins if the destination is FLG. The
+//    other ALU instructions write the result last.
+//  - An argument that can't be used raises an invalid instruction fault when the instruction gets to
+//    it, and whatever the instruction did before then stands: a POP with a bad destination still moves
+//    SP, an ALU instruction still sets the flags. Sources are used before destinations, except that CMP
+//    clears OVER, UNDER and ZERO before it reads either, and jumps and LOOP read the target first.
+//  - Only page faults are precise. A store made before the access that faulted stays in memory, and
+//    later stores (and CAS) made by the same instruction are dropped.
+//  - IRET clears the in-interrupt flag even if it stack faults.
+//  - When a fault is delivered with no room on the stack for the state, the handler is entered anyway
+//    with SP unchanged. A page fault while delivering a fault or an interrupt halts the machine.
+//  - BRK is a no-op, since there is no debugger to stop for, and there is only ever one core.
+
+#include <algorithm>
+#include <cstring>
+#include "refcpu.hpp"
+
+// Argument bytes, decoded straight from the bits.
+static bool IsValue(uint8_t Byte)
+{
+    return (Byte & REGTYPE_MASK) == REG_VAL;
+}
+
+static bool IsIndirect(uint8_t Byte)
+{
+    return (Byte & REGTYPE_MASK) == REG_IND;
+}
+
+static bool IsUsable(uint8_t Byte)
+{
+    return IsValue(Byte) || IsIndirect(Byte);
+}
+
+RefCPU::RefCPU(uint32_t MemSize) : Mem(MemSize, 0)
+{
+}
+
+// Back to power-on state. Memory is cleared; devices stay attached.
+void RefCPU::Reset()
+{
+    std::fill(Mem.begin(), Mem.end(), 0);
+    for (int i = 0; i < NUMREGS; i++)
+        Reg[i] = 0;
+    FHAP = 0;
+    IHAP = 0;
+    PTB = 0;
+    PTL = 0;
+    Pending = 0;
+    Halted = false;
+    Cycles = 0;
+    PageFault = false;
+    Writes.clear();
+    Flush();
+    Undefined.clear();
+    HistoryCount = 0;
+}
+
+// Put a device in the first free slot of the peripheral map, as CPU::AddDevice() does.
+// Returns true if it was added.
+bool RefCPU::AddDevice(Periph *Dev)
+{
+    if (Dev->GetMemSize() > 0xFFFF)
+        return false;
+    for (int i = 0; i < PERIPH_MAP_ENTRIES - 1; i++) {
+        if (Devices[i] == Dev)
+            return false;
+        if (Devices[i] == nullptr) {
+            Devices[i] = Dev;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Memory as the program would see it with the MMU off, without touching any device.
+uint32_t RefCPU::Peek(uint32_t Addr) const
+{
+    if (Addr < Mem.size())
+        return Mem[Addr];
+    return MEM_READ_INVALID;
+}
+
+void RefCPU::Poke(uint32_t Addr, uint32_t Value)
+{
+    if (Addr < Mem.size())
+        Mem[Addr] = Value;
+}
+
+// Copy out the last instructions started, oldest first. Returns how many there were.
+int RefCPU::GetHistory(RefHistory *Out, int Max) const
+{
+    uint64_t n = (HistoryCount < REF_HISTORY) ? HistoryCount : REF_HISTORY;
+    if (n > (uint64_t)Max)
+        n = Max;
+    for (uint64_t i = 0; i < n; i++)
+        Out[i] = History[(HistoryCount - n + i) % REF_HISTORY];
+    return (int)n;
+}
+
+// Run one instruction, taking an interrupt first if one is due.
+void RefCPU::Step()
+{
+    if (Halted)
+        return;
+    Cycles++;
+    if (Pending) {
+        Interrupt();
+        if (Halted)
+            return;
+    }
+
+    uint32_t saved[NUMREGS];
+    memcpy(saved, Reg, sizeof(Reg));
+    PageFault = false;
+    Start = Reg[REG_IP];
+    Reg[REG_IP]++;
+    Word = Fetch(Start);
+    uint32_t fault {FAULT_NO_FAULT};
+    if (!PageFault) {
+        RefHistory &h = History[HistoryCount++ % REF_HISTORY];
+        h.Cycle = Cycles;
+        h.Addr = Start;
+        h.Word = Word;
+        h.Next = 0;
+        fault = Execute();
+    }
+    if (PageFault) {
+        memcpy(Reg, saved, sizeof(Reg));
+        fault = FAULT_PAGE;
+    }
+    if (fault != FAULT_NO_FAULT)
+        Deliver(fault);
+}
+
+// Enter the fault handler, or halt if already in one.
+void RefCPU::Deliver(uint32_t Type)
+{
+    if (Reg[REG_FLG] & FLG_FAULT) {
+        Halted = true;
+        return;
+    }
+    PageFault = false;
+    Reg[REG_IP] = Start;
+    SaveAll();
+    if (Type == FAULT_PAGE)
+        Push(FaultVAddr);
+    Reg[REG_FLG] |= FLG_FAULT;
+    uint32_t handler = Load(FHAP + Type - 1);
+    if (PageFault) {
+        Halted = true;
+        return;
+    }
+    Reg[REG_IP] = handler;
+}
+
+// Enter the handler for the lowest pending interrupt line that is enabled, if interrupts are allowed.
+void RefCPU::Interrupt()
+{
+    uint32_t flags = Reg[REG_FLG];
+
+    if (!(flags & FLG_INTENA) || (flags & (FLG_IN_INT | FLG_FAULT)))
+        return;
+    for (uint32_t line = 0; line < NUM_INTS; line++) {
+        if (!(Pending & (1 << line)) || !(flags & (FLG_INTEN0 << line)))
+            continue;
+        Pending &= ~(1 << line);
+        PageFault = false;
+        SaveAll();
+        Reg[REG_FLG] |= FLG_IN_INT;
+        uint32_t handler = Load(IHAP + line);
+        if (PageFault) {
+            Halted = true;
+            return;
+        }
+        Reg[REG_IP] = handler;
+        return;
+    }
+}
+
+// Physical memory and I/O space.
+uint32_t RefCPU::ReadPhys(uint32_t Addr)
+{
+    if (Addr < BASE_IO_MEM)
+        return Peek(Addr);
+    uint32_t offset = Addr & 0xFFFF;
+    if ((Addr & 0xFFFF0000) == PERIPH_MAP_BASE) {
+        if (offset >= PERIPH_MAP_SIZE * PERIPH_MAP_ENTRIES)
+            return 0;
+        int slot = offset / PERIPH_MAP_SIZE;
+        Periph *dev = Devices[slot];
+        if (dev == nullptr)
+            return 0;
+        switch (offset % PERIPH_MAP_SIZE) {
+            case 0:
+                return dev->GetDDN();
+            case 1:
+                return BASE_IO_MEM + ((slot + 1) << 16);
+            case 2:
+                return dev->GetMemSize();
+            default:
+                return dev->InterruptSupported() ? slot : 0;
+        }
+    }
+    Periph *dev = Devices[((Addr >> 16) & 0xF) - 1];
+    return (dev != nullptr) ? dev->ReadIOMem(offset) : 0;
+}
+
+void RefCPU::WritePhys(uint32_t Addr, uint32_t Value)
+{
+    if (Addr >= BASE_IO_MEM) {
+        if ((Addr & 0xFFFF0000) == PERIPH_MAP_BASE)
+            return;
+        Periph *dev = Devices[((Addr >> 16) & 0xF) - 1];
+        if (dev != nullptr)
+            dev->WriteIOMem(Addr & 0xFFFF, Value);
+        return;
+    }
+    Writes.push_back({Cycles, Addr, Value});
+    Poke(Addr, Value);
+    uint32_t page = Addr - PTB;
+    if ((page < PTL) && Walked.count(page))
+        Stale.insert(page);
+}
+
+// Translate an address for an access needing the given PTE bits (none for a read). With the MMU off this
+// does nothing. Returns true, and raises a page fault, if the access isn't allowed.
+bool RefCPU::Map(uint32_t VAddr, uint32_t Need, uint32_t &PAddr)
+{
+    PAddr = VAddr;
+    if (!(Reg[REG_FLG] & FLG_MMUENA) || (VAddr >= BASE_IO_MEM))
+        return false;
+    uint32_t page = VAddr >> MMU_PAGE_SHIFT;
+    uint32_t pte {0};
+    if (page < PTL) {
+        if (PTB + page >= BASE_IO_MEM)
+            Undefined = "page table in I/O space";
+        pte = ReadPhys(PTB + page);
+    }
+    if (Stale.count(page))
+        Undefined = "page table entry changed without TLBFLUSH";
+    if (pte & PTE_VALID)
+        Walked.insert(page);
+    if ((pte & (PTE_VALID | Need)) == (PTE_VALID | Need)) {
+        PAddr = (pte & PTE_FRAME_MASK) | (VAddr & MMU_OFFSET_MASK);
+        return false;
+    }
+    if (!PageFault) {
+        PageFault = true;
+        FaultVAddr = VAddr;
+    }
+    return true;
+}
+
+// Forget which pages have been translated, as TLBFLUSH does for the real TLB.
+void RefCPU::Flush()
+{
+    Walked.clear();
+    Stale.clear();
+}
+
+// Accesses made by the program, through the MMU.
+uint32_t RefCPU::Load(uint32_t Addr)
+{
+    uint32_t paddr;
+    if (Map(Addr, 0, paddr))
+        return MEM_READ_INVALID;
+    return ReadPhys(paddr);
+}
+
+void RefCPU::Store(uint32_t Addr, uint32_t Value)
+{
+    uint32_t paddr;
+    if (PageFault || Map(Addr, PTE_WRITE, paddr))
+        return;
+    WritePhys(paddr, Value);
+}
+
+uint32_t RefCPU::Fetch(uint32_t Addr)
+{
+    uint32_t paddr;
+    if (Map(Addr, PTE_EXEC, paddr))
+        return MEM_READ_INVALID;
+    return ReadPhys(paddr);
+}
+
+// The direct value following the instruction.
+uint32_t RefCPU::Direct()
+{
+    uint32_t val = Fetch(Reg[REG_IP]++);
+    History[(HistoryCount - 1) % REF_HISTORY].Next = val;
+    return val;
+}
+
+// Read or write an argument. Returns an invalid instruction fault if the byte isn't a register or
+// indirect argument.
+uint32_t RefCPU::Get(uint8_t Byte, uint32_t &Value)
+{
+    if (!IsUsable(Byte))
+        return FAULT_BAD_INSTR;
+    Value = Reg[Byte & REGNUM_MASK];
+    if (IsIndirect(Byte))
+        Value = Load(Value);
+    return FAULT_NO_FAULT;
+}
+
+uint32_t RefCPU::Put(uint8_t Byte, uint32_t Value)
+{
+    if (!IsUsable(Byte))
+        return FAULT_BAD_INSTR;
+    if (IsIndirect(Byte))
+        Store(Reg[Byte & REGNUM_MASK], Value);
+    else
+        Reg[Byte & REGNUM_MASK] = Value;
+    return FAULT_NO_FAULT;
+}
+
+// The stack grows up from SP.
+uint32_t RefCPU::Push(uint32_t Value)
+{
+    if (Reg[REG_SP] == MAX_ADDR)
+        return FAULT_STACK;
+    Store(Reg[REG_SP]++, Value);
+    return FAULT_NO_FAULT;
+}
+
+uint32_t RefCPU::Pop(uint32_t &Value)
+{
+    if (Reg[REG_SP] == 0)
+        return FAULT_STACK;
+    Value = Load(--Reg[REG_SP]);
+    return FAULT_NO_FAULT;
+}
+
+// All sixteen registers, R0 first, SP as it was before the push.
+uint32_t RefCPU::SaveAll()
+{
+    uint32_t sp = Reg[REG_SP];
+    if (sp > MAX_STATE_PUSH)
+        return FAULT_STACK;
+    for (int i = 0; i < NUMREGS; i++)
+        Store(sp + i, Reg[i]);
+    Reg[REG_SP] = sp + NUMREGS;
+    return FAULT_NO_FAULT;
+}
+
+uint32_t RefCPU::LoadAll()
+{
+    if (Reg[REG_SP] < MIN_STATE_POP)
+        return FAULT_STACK;
+    uint32_t base = Reg[REG_SP] - NUMREGS;
+    uint32_t tmp[NUMREGS];
+    for (int i = 0; i < NUMREGS; i++)
+        tmp[i] = Load(base + i);
+    memcpy(Reg, tmp, sizeof(Reg));
+    return FAULT_NO_FAULT;
+}
+
+// The registers selected by a mask, lowest first. Loading skips R0, SP and IP but uses up their slots.
+uint32_t RefCPU::SaveMasked(uint32_t Mask)
+{
+    uint32_t count {0};
+    for (int i = 0; i < NUMREGS; i++)
+        if (Mask & (1 << i))
+            count++;
+    uint32_t sp = Reg[REG_SP];
+    if (sp > MAX_ADDR - count)
+        return FAULT_STACK;
+    for (int i = 0; i < NUMREGS; i++)
+        if (Mask & (1 << i))
+            Store(sp++, Reg[i]);
+    Reg[REG_SP] = sp;
+    return FAULT_NO_FAULT;
+}
+
+uint32_t RefCPU::LoadMasked(uint32_t Mask)
+{
+    uint32_t count {0};
+    for (int i = 0; i < NUMREGS; i++)
+        if (Mask & (1 << i))
+            count++;
+    if (Reg[REG_SP] < count)
+        return FAULT_STACK;
+    uint32_t base = Reg[REG_SP] - count;
+    uint32_t tmp[NUMREGS];
+    uint32_t addr = base;
+    for (int i = 0; i < NUMREGS; i++)
+        if (Mask & (1 << i))
+            tmp[i] = Load(addr++);
+    for (int i = 0; i < NUMREGS; i++)
+        if ((Mask & (1 << i)) && (i != REG_R0) && (i != REG_SP) && (i != REG_IP))
+            Reg[i] = tmp[i];
+    Reg[REG_SP] = base;
+    return FAULT_NO_FAULT;
+}
+
+// Clear OVER, UNDER and ZERO, then set the given ones.
+void RefCPU::MathFlags(uint32_t Set)
+{
+    Reg[REG_FLG] = (Reg[REG_FLG] & ~(FLG_OVER | FLG_UNDER | FLG_ZERO)) | Set;
+}
+
+void RefCPU::ZeroFlag(uint32_t Value)
+{
+    if (Value == 0)
+        Reg[REG_FLG] |= FLG_ZERO;
+    else
+        Reg[REG_FLG] &= ~FLG_ZERO;
+}
+
+// Carry out the instruction in Word, with IP already past it. Returns the fault it raised, if any;
+// page faults are left in PageFault instead. Get() and Put() only ever fail with an invalid instruction.
+uint32_t RefCPU::Execute()
+{
+    uint8_t op = GET_OP(Word);
+    uint8_t src1 = GET_SRC1(Word);
+    uint8_t src2 = GET_SRC2(Word);
+    uint8_t dest = GET_DEST(Word);
+    bool sign = Reg[REG_FLG] & FLG_SIGNED;
+    bool direct = (dest == REG_NULL);
+    uint32_t a, b, r;
+    uint32_t set {0};
+
+    switch (op) {
+        case OP_MOVE:
+            if ((src1 == REG_NULL) && (src2 == REG_NULL))
+                a = Direct();
+            else if (Get(src1, a))
+                return FAULT_BAD_INSTR;
+            return Put(dest, a);
+        case OP_CMP:
+            MathFlags(0);
+            if ((src1 == REG_NULL) && (src2 == REG_NULL))
+                a = Direct();
+            else if (Get(src1, a))
+                return FAULT_BAD_INSTR;
+            if (Get(dest, b))
+                return FAULT_BAD_INSTR;
+            if (a == b)
+                set = FLG_ZERO;
+            else if (sign ? ((int32_t)a < (int32_t)b) : (a < b))
+                set = FLG_UNDER;
+            else
+                set = FLG_OVER;
+            MathFlags(set);
+            break;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+        case OP_SHIFTR:
+        case OP_SHIFTL:
+        case OP_CAS:
+            if (Get(src1, a) || Get(src2, b))
+                return FAULT_BAD_INSTR;
+            switch (op) {
+                case OP_ADD:
+                    r = a + b;
+                    if (sign ? (((int32_t)r < (int32_t)a) || ((int32_t)r < (int32_t)b)) : ((r < a) || (r < b)))
+                        set = FLG_OVER;
+                    break;
+                case OP_SUB:
+                    r = a - b;
+                    if (sign ? (((int32_t)r > (int32_t)a) || ((int32_t)r > (int32_t)b)) : ((r > a) || (r > b)))
+                        set = FLG_UNDER;
+                    break;
+                case OP_AND:
+                    r = a & b;
+                    break;
+                case OP_OR:
+                    r = a | b;
+                    break;
+                case OP_XOR:
+                    r = a ^ b;
+                    break;
+                case OP_SHIFTR:
+                    r = (b > 31) ? 0 : (a >> b);
+                    if (((b > 31) && a) || ((b <= 31) && ((r << b) != a)))
+                        set = FLG_UNDER;
+                    break;
+                case OP_SHIFTL:
+                    r = (b > 31) ? 0 : (a << b);
+                    if (((b > 31) && a) || ((b <= 31) && ((r >> b) != a)))
+                        set = FLG_OVER;
+                    break;
+                default: // CAS
+                {
+                    uint32_t paddr;
+                    if (!IsIndirect(dest))
+                        return FAULT_BAD_INSTR;
+                    if (PageFault || Map(Reg[dest & REGNUM_MASK], PTE_WRITE, paddr))
+                        return FAULT_NO_FAULT;
+                    if (paddr >= BASE_IO_MEM)
+                        return FAULT_BAD_ADDR;
+                    if ((paddr < Mem.size()) && (Mem[paddr] == a)) {
+                        WritePhys(paddr, b);
+                        Reg[REG_FLG] |= FLG_ZERO;
+                    } else {
+                        Reg[REG_FLG] &= ~FLG_ZERO;
+                    }
+                    return FAULT_NO_FAULT;
+                }
+            }
+            MathFlags(set);
+            ZeroFlag(r);
+            return Put(dest, r);
+
+        case OP_PUSH:
+        case OP_SETFHAP:
+        case OP_SETIHAP:
+        case OP_SETPTB:
+        case OP_SETPTL:
+        case OP_IPI:
+            if (Get(src1, a))
+                return FAULT_BAD_INSTR;
+            switch (op) {
+                case OP_PUSH:
+                    return Push(a);
+                case OP_SETFHAP:
+                    if (a > MAX_FHAP)
+                        return FAULT_BAD_ADDR;
+                    FHAP = a;
+                    break;
+                case OP_SETIHAP:
+                    if (a > MAX_IHAP)
+                        return FAULT_BAD_ADDR;
+                    IHAP = a;
+                    break;
+                case OP_SETPTB:
+                    PTB = a;
+                    Flush();
+                    break;
+                case OP_SETPTL:
+                    PTL = a;
+                    Flush();
+                    break;
+                default: // IPI, and this is core 0 of 1
+                    if (a != 0)
+                        return FAULT_BAD_ADDR;
+                    Pending |= 1 << INT_IPI;
+                    break;
+            }
+            break;
+
+        case OP_POP:
+        {
+            uint32_t fault = Pop(a);
+            if (fault != FAULT_NO_FAULT)
+                return fault;
+            return Put(dest, a);
+        }
+        case OP_COREID:
+            return Put(dest, 0);
+        case OP_NOT:
+        case OP_INCR:
+        case OP_DECR:
+            if (Get(dest, a))
+                return FAULT_BAD_INSTR;
+            if (op == OP_NOT) {
+                r = ~a;
+            } else if (op == OP_INCR) {
+                r = a + 1;
+                if (r == (sign ? 0x80000000 : 0))
+                    set = FLG_OVER;
+            } else {
+                r = a - 1;
+                if (r == (sign ? 0x7FFFFFFF : 0xFFFFFFFF))
+                    set = FLG_UNDER;
+            }
+            MathFlags(set);
+            if (Put(dest, r))
+                return FAULT_BAD_INSTR;
+            ZeroFlag(r);
+            break;
+
+        case OP_JZERO:
+        case OP_JNZERO:
+        case OP_JOVER:
+        case OP_JNOVER:
+        case OP_JUNDER:
+        case OP_JNUNDER:
+        case OP_JMP:
+        case OP_CALL:
+        {
+            uint32_t target;
+            if (direct)
+                target = Direct();
+            else if (Get(dest, target))
+                return FAULT_BAD_INSTR;
+            uint32_t flags = Reg[REG_FLG];
+            bool go;
+            switch (op) {
+                case OP_JZERO:
+                    go = flags & FLG_ZERO;
+                    break;
+                case OP_JNZERO:
+                    go = !(flags & FLG_ZERO);
+                    break;
+                case OP_JOVER:
+                    go = flags & FLG_OVER;
+                    break;
+                case OP_JNOVER:
+                    go = !(flags & FLG_OVER);
+                    break;
+                case OP_JUNDER:
+                    go = flags & FLG_UNDER;
+                    break;
+                case OP_JNUNDER:
+                    go = !(flags & FLG_UNDER);
+                    break;
+                case OP_JMP:
+                    go = true;
+                    break;
+                default: // CALL
+                {
+                    uint32_t fault = Push(Reg[REG_IP]);
+                    if (fault != FAULT_NO_FAULT)
+                        return fault;
+                    go = true;
+                    break;
+                }
+            }
+            if (go)
+                Reg[REG_IP] = target;
+            break;
+        }
+
+        case OP_LOOP:
+        {
+            uint32_t target, count;
+            if (direct)
+                target = Direct();
+            else if (Get(dest, target))
+                return FAULT_BAD_INSTR;
+            if (Get(src1, count) || Put(src1, --count))
+                return FAULT_BAD_INSTR;
+            if (count != 0)
+                Reg[REG_IP] = target;
+            break;
+        }
+
+        case OP_SSTATE:
+            return SaveAll();
+        case OP_LSTATE:
+        {
+            uint32_t ip = Reg[REG_IP];
+            uint32_t r0 = Reg[REG_R0];
+            uint32_t fault = LoadAll();
+            Reg[REG_IP] = ip;
+            Reg[REG_R0] = r0;
+            return fault;
+        }
+        case OP_RETURN:
+        {
+            uint32_t fault = Pop(a);
+            if (fault == FAULT_NO_FAULT)
+                Reg[REG_IP] = a;
+            return fault;
+        }
+        case OP_IRET:
+        {
+            uint32_t fault = LoadAll();
+            Reg[REG_FLG] &= ~FLG_IN_INT;
+            return fault;
+        }
+        case OP_SIGNED:
+            Reg[REG_FLG] |= FLG_SIGNED;
+            break;
+        case OP_UNSIGNED:
+            Reg[REG_FLG] &= ~FLG_SIGNED;
+            break;
+        case OP_INTENA:
+            Reg[REG_FLG] |= FLG_INTENA;
+            break;
+        case OP_INTDIS:
+            Reg[REG_FLG] &= ~FLG_INTENA;
+            break;
+        case OP_MMUENA:
+            Reg[REG_FLG] |= FLG_MMUENA;
+            break;
+        case OP_MMUDIS:
+            Reg[REG_FLG] &= ~FLG_MMUENA;
+            break;
+        case OP_TLBFLUSH:
+            Flush();
+            break;
+        case OP_NOP:
+        case OP_BRK:
+            break;
+        case OP_HALT:
+            Halted = true;
+            break;
+
+        case OP_SSTATEM:
+        case OP_LSTATEM:
+            if (!direct)
+                return FAULT_BAD_INSTR;
+            a = Direct() & STATE_MASK_ALL;
+            return (op == OP_SSTATEM) ? SaveMasked(a) : LoadMasked(a);
+
+        default:
+            return FAULT_BAD_INSTR;
+    }
+    return FAULT_NO_FAULT;
+}
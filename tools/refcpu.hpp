@@ -0,0 +1,123 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// refcpu.hpp - declarations for RefCPU, a deliberately plain second implementation of the machine.
+// RefCPU is written from the descriptions in arch.h and shares no code with CPU: it decodes instruction
+// words with the arch.h macros rather than the Instruction class, keeps memory in one flat array, and
+// walks the page table on every access instead of caching translations. It is slow, and is meant only
+// for checking the real CPU against, one instruction at a time (see diff6k).
+//
+// Where arch.h says nothing, or says something the machine has never done, RefCPU does what the machine
+// has always done, so that programs which work today still count as correct. Those choices are listed
+// at the top of refcpu.cpp.
+//
+// A few things a program can do are left undefined by arch.h, and the two implementations may then
+// legitimately disagree. RefCPU notices them and sets a reason (see GetUndefined()) rather than guessing:
+// changing a page table entry that is in use without TLBFLUSH, and keeping the page table in I/O space.
+#ifndef __REFCPU_HPP__
+#define __REFCPU_HPP__
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "arch.h"
+#include "hw.h"
+#include "periph.hpp"
+
+// A word written to memory, physical address. Writes to I/O space are logged by the devices instead.
+struct RefWrite {
+    uint64_t Cycle;
+    uint32_t Addr;
+    uint32_t Value;
+};
+
+// The last instructions started, for showing where things went wrong.
+#define REF_HISTORY 16
+
+struct RefHistory {
+    uint64_t Cycle;
+    uint32_t Addr;
+    uint32_t Word;
+    uint32_t Next;  // the word after, in case it is a direct value
+};
+
+class RefCPU {
+public:
+    RefCPU(uint32_t MemSize);
+    void Reset();
+    void Step();
+    bool AddDevice(Periph *Dev);
+    uint32_t GetReg(int Index) const { return Reg[Index]; }
+    void SetReg(int Index, uint32_t Value) { Reg[Index] = Value; }
+    uint32_t GetFHAP() const { return FHAP; }
+    uint32_t GetIHAP() const { return IHAP; }
+    uint64_t GetCycles() const { return Cycles; }
+    bool IsHalted() const { return Halted; }
+    uint32_t Peek(uint32_t Addr) const;
+    void Poke(uint32_t Addr, uint32_t Value);
+    const std::vector<RefWrite> &GetWrites() const { return Writes; }
+    void ClearWrites() { Writes.clear(); }
+    const std::string &GetUndefined() const { return Undefined; }
+    int GetHistory(RefHistory *Out, int Max) const;
+
+private:
+    std::vector<uint32_t> Mem;
+    Periph *Devices[PERIPH_MAP_ENTRIES] {nullptr};
+    uint32_t Reg[NUMREGS] {0};
+    uint32_t FHAP {0};
+    uint32_t IHAP {0};
+    uint32_t PTB {0};
+    uint32_t PTL {0};
+    uint32_t Pending {0};       // interrupt lines waiting to be taken
+    bool Halted {false};
+    uint64_t Cycles {0};
+    uint32_t Start {0};         // address of the instruction being executed
+    uint32_t Word {0};          // and its first word
+    bool PageFault {false};     // raised by this instruction; later writes are dropped
+    uint32_t FaultVAddr {0};
+    std::vector<RefWrite> Writes;
+    std::unordered_set<uint32_t> Walked;    // pages translated since the last flush
+    std::unordered_set<uint32_t> Stale;     // and of those, the ones whose PTE has since been written
+    std::string Undefined;
+    RefHistory History[REF_HISTORY];
+    uint64_t HistoryCount {0};
+
+    uint32_t Execute();
+    uint32_t ReadPhys(uint32_t Addr);
+    void WritePhys(uint32_t Addr, uint32_t Value);
+    bool Map(uint32_t VAddr, uint32_t Need, uint32_t &PAddr);
+    uint32_t Load(uint32_t Addr);
+    void Store(uint32_t Addr, uint32_t Value);
+    uint32_t Fetch(uint32_t Addr);
+    uint32_t Direct();
+    uint32_t Get(uint8_t Byte, uint32_t &Value);
+    uint32_t Put(uint8_t Byte, uint32_t Value);
+    uint32_t Push(uint32_t Value);
+    uint32_t Pop(uint32_t &Value);
+    uint32_t SaveAll();
+    uint32_t LoadAll();
+    void Flush();
+    void MathFlags(uint32_t Set);
+    void ZeroFlag(uint32_t Value);
+    uint32_t SaveMasked(uint32_t Mask);
+    uint32_t LoadMasked(uint32_t Mask);
+    void Deliver(uint32_t Type);
+    void Interrupt();
+};
+
+#endif // __REFCPU_HPP__
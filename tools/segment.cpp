@@ -29,9 +29,10 @@ void CodeSegment::SetBase(uint32_t Base)
     BaseAddr = Base;
 }
 
-void CodeSegment::AddWord(uint32_t NewWord)
+void CodeSegment::AddWord(uint32_t NewWord, uint32_t SrcLine)
 {
     Binary.push_back(NewWord);
+    SrcLines.push_back(SrcLine);
 }
 
 uint32_t CodeSegment::ReadWord(uint32_t Offset)
@@ -42,6 +43,14 @@ uint32_t CodeSegment::ReadWord(uint32_t Offset)
         return Binary[Offset];
 }
 
+uint32_t CodeSegment::GetSrcLine(uint32_t Offset)
+{
+    if (Offset >= SrcLines.size())
+        return 0;
+    else
+        return SrcLines[Offset];
+}
+
 void CodeSegment::ModifyWord(uint32_t Offset, uint32_t NewValue)
 {
     if (Offset < Binary.size())
@@ -27,8 +27,9 @@
 class CodeSegment {
 public:
     void SetBase(uint32_t Base);
-    void AddWord(uint32_t NewWord);
+    void AddWord(uint32_t NewWord, uint32_t SrcLine);
     uint32_t ReadWord(uint32_t Offset);
+    uint32_t GetSrcLine(uint32_t Offset);
     void ModifyWord(uint32_t Offset, uint32_t NewValue);
     uint32_t GetBase();
     std::size_t GetLen();
@@ -38,6 +39,7 @@ public:
 private:
     uint32_t BaseAddr;
     std::vector<uint32_t> Binary;
+    std::vector<uint32_t> SrcLines;     // source line of each word, for the symbol map
     std::string Filename;
 };
 
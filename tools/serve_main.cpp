@@ -0,0 +1,296 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// serve_main.cpp - job server for the Comp-o-Tron 6000.
+// Keeps a pool of machines built and ready, with the ROM loaded and devices attached, and runs jobs sent
+// to it over a Unix domain socket. A client pays for running its program and nothing else: the process,
+// the machines and their devices are set up once, and after each job a machine is reset in place,
+// which with page-based memory is just dropping its pages. Each connection gets a thread of its own,
+// which only takes a machine from the pool while one of its jobs runs, so idle clients don't hold any.
+// The protocol is described in jobsocket.hpp.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "arch.h"
+#include "cpu.hpp"
+#include "batchjob.hpp"
+#include "jobsocket.hpp"
+
+// Machines not running a job, and the connections being served. Clients is only for shutting them
+// down when we stop; Live counts their threads, which are detached, until each has closed its socket.
+static std::vector<JobMachine *> Idle;
+static std::vector<int> Clients;
+static unsigned Live {0};
+static std::mutex PoolLock;
+static std::condition_variable PoolCond;
+
+// Display usage. Caller passes in argv[0] so that we can display the name of the command.
+int Usage(char *Cmd)
+{
+    std::cerr << "Usage: " << Cmd << " [-s socket] [-t machines] [-m max-cycles]\n";
+    std::cerr << "\t-s socket       listen here (default " << JOBSOCKET_DEFAULT_PATH << ")\n";
+    std::cerr << "\t-t machines     machines in the pool, and so jobs run at once (default one\n";
+    std::cerr << "\t                per host core)\n";
+    std::cerr << "\t-m, --max-cycles N\n";
+    std::cerr << "\t                most cycles any job may have (default " << DEFAULT_MAX_CYCLES << ")\n";
+    std::cerr << "\nSubmit jobs with batch6k -S socket. Stop with SIGINT or SIGTERM; jobs already\n";
+    std::cerr << "running are finished first.\n";
+    return EXIT_ERROR;
+}
+
+// Send whole lines accumulated in Out to the client, each with the given prefix, keeping any partial
+// line for next time. Returns false if the client has gone away.
+static bool SendLines(JobSocket &Sock, const char *Prefix, std::ostringstream &Out)
+{
+    std::string text = Out.str();
+    std::string msg;
+    std::size_t start {0}, nl;
+
+    while ((nl = text.find('\n', start)) != std::string::npos) {
+        msg += Prefix;
+        msg += text.substr(start, nl + 1 - start);
+        start = nl + 1;
+    }
+    Out.str(text.substr(start));
+    Out.seekp(0, std::ios::end);
+    return msg.empty() || Sock.Write(msg);
+}
+
+// What a client has asked for so far.
+struct ServeJob {
+    std::string Kind;       // bin, deck or boot
+    std::string Program;
+    std::string Input;
+    bool HasInput {false};
+    bool Punch {false};
+    uint64_t MaxCycles {DEFAULT_MAX_CYCLES};
+};
+
+// Run one job on the given machine, streaming its output back, then reset the machine.
+// Returns false if the client has gone away.
+static bool RunServeJob(JobSocket &Sock, JobMachine &M, const ServeJob &Job, uint64_t CycleCap)
+{
+    std::istringstream prog(Job.Program), input(Job.Input);
+    std::ostringstream printed, punched;
+    BatchResult result;
+    bool ok {true};
+    char buf[256];
+
+    uint64_t cycles = (Job.MaxCycles < CycleCap) ? Job.MaxCycles : CycleCap;
+    if (Job.Kind.empty())
+        result.Error = "no program";
+    else if ((Job.Kind == "boot") && Job.HasInput)
+        result.Error = "the boot deck occupies the scanner";
+    else if (Job.Kind == "bin")
+        LoadBinary(prog, "binary", &M.Core, result.Error);
+    else if (Job.Kind == "deck")
+        LoadDeck(prog, "deck", &M.Core, result.Error);
+    if (result.Error.empty()) {
+        if (Job.Kind == "boot")
+            M.Boot(prog);
+        else if (Job.HasInput)
+            M.Scanner.SetInFile(&input);
+        if (Job.Punch)
+            M.Punch.SetOutFile(&punched);
+        bool more {true};
+        while (more && ok) {
+            more = M.RunChunk(cycles, printed);
+            ok = SendLines(Sock, "print ", printed) && SendLines(Sock, "punch ", punched);
+        }
+        M.Finish(M.Core.GetCycles(), result);
+        std::string regs = "regs";
+        for (int i = 0; i < NUMREGS; i++) {
+            snprintf(buf, sizeof(buf), " %08x", result.Registers[i]);
+            regs += buf;
+        }
+        snprintf(buf, sizeof(buf), "\npages %u %u %u\n", result.Pages.Private, result.Pages.Shared,
+                 result.Pages.Zero);
+        ok = ok && Sock.Write(regs + buf);
+    }
+    M.Reset();
+    snprintf(buf, sizeof(buf), "done %d %llu", result.Status, (unsigned long long)result.Cycles);
+    std::string done = buf;
+    if (!result.Error.empty())
+        done += " " + result.Error;
+    return ok && Sock.Write(done + "\n");
+}
+
+// Wait for a machine to be free and take it out of the pool.
+static JobMachine *TakeMachine()
+{
+    std::unique_lock<std::mutex> lock(PoolLock);
+    PoolCond.wait(lock, [] { return !Idle.empty(); });
+    JobMachine *m = Idle.back();
+    Idle.pop_back();
+    return m;
+}
+
+// Put a machine, already reset, back in the pool.
+static void GiveMachine(JobMachine *M)
+{
+    std::lock_guard<std::mutex> lock(PoolLock);
+    Idle.push_back(M);
+    PoolCond.notify_all();
+}
+
+// Take requests from one client until it hangs up, sends something we don't understand, or we stop.
+static void ServeConnection(JobSocket &sock, uint64_t CycleCap)
+{
+    ServeJob job;
+    std::string line;
+
+    while (sock.ReadLine(line)) {
+        std::istringstream words(line);
+        std::string cmd;
+        unsigned long long n {0};
+        std::string error;
+
+        words >> cmd;
+        if (cmd.empty())
+            continue;
+        if (cmd == "run") {
+            JobMachine *m = TakeMachine();
+            bool ok = RunServeJob(sock, *m, job, CycleCap);
+            GiveMachine(m);
+            if (!ok)
+                return;
+            job = ServeJob();
+            continue;
+        }
+        if (cmd == "punch") {
+            job.Punch = true;
+            continue;
+        }
+        if ((cmd != "bin") && (cmd != "deck") && (cmd != "boot") && (cmd != "in") && (cmd != "cycles"))
+            error = "unknown request " + cmd;
+        else if (!(words >> n))
+            error = "missing number after " + cmd;
+        else if (cmd == "cycles")
+            job.MaxCycles = n;
+        else if (n > JOBSOCKET_MAX_FILE)
+            error = "file too big";
+        else if (!sock.ReadBytes(n, (cmd == "in") ? job.Input : job.Program))
+            return;
+        else if (cmd == "in")
+            job.HasInput = true;
+        else
+            job.Kind = cmd;
+        if (!error.empty()) {
+            sock.Write("done " + std::to_string(EXIT_ERROR) + " 0 " + error + "\n");
+            return;
+        }
+    }
+}
+
+// The thread for one connection. Main has already counted it in Clients and Live. It comes out of
+// Clients before the socket is closed, so that main never shuts down a descriptor that has been reused.
+static void Client(int Fd, uint64_t CycleCap)
+{
+    {
+        JobSocket sock(Fd);
+        ServeConnection(sock, CycleCap);
+        std::lock_guard<std::mutex> lock(PoolLock);
+        Clients.erase(std::find(Clients.begin(), Clients.end(), Fd));
+    }
+    std::lock_guard<std::mutex> lock(PoolLock);
+    Live--;
+    PoolCond.notify_all();
+}
+
+int main(int argc, char *argv[])
+{
+    std::string path = JOBSOCKET_DEFAULT_PATH;
+    unsigned threads {0};
+    uint64_t maxcycles {DEFAULT_MAX_CYCLES};
+
+    for (auto i = 1; i < argc; i++) {
+        std::string TmpArg = argv[i];
+
+        if (++i >= argc)
+            return Usage(argv[0]);
+        try {
+            if (TmpArg == "-s")
+                path = argv[i];
+            else if (TmpArg == "-t")
+                threads = std::stoul(argv[i], nullptr, 0);
+            else if ((TmpArg == "-m") || (TmpArg == "--max-cycles"))
+                maxcycles = std::stoull(argv[i], nullptr, 0);
+            else
+                return Usage(argv[0]);
+        } catch (...) {
+            return Usage(argv[0]);
+        }
+    }
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    int listenfd = ListenJobSocket(path);
+    if (listenfd < 0) {
+        std::cerr << "Error listening on " << path << ": " << strerror(errno) << "\n";
+        return EXIT_ERROR;
+    }
+
+    for (unsigned i = 0; i < threads; i++)
+        Idle.push_back(new JobMachine());
+    CatchStopSignals();
+
+    std::cerr << "serving on " << path << " with " << threads << " machines\n";
+    while (!StopRequested()) {
+        int fd = accept(listenfd, nullptr, nullptr);
+        if (fd < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+                continue;
+            std::cerr << "accept: " << strerror(errno) << "\n";
+            break;
+        }
+        std::lock_guard<std::mutex> lock(PoolLock);
+        Clients.push_back(fd);
+        Live++;
+        // Signals go to this thread only, so they can break it out of accept().
+        BlockStopSignals(true);
+        std::thread(Client, fd, maxcycles).detach();
+        BlockStopSignals(false);
+    }
+
+    close(listenfd);
+    unlink(path.c_str());
+    // Stop taking requests. A client's next read sees the end of the connection, so jobs already
+    // running are finished and reported, and then each thread goes.
+    {
+        std::unique_lock<std::mutex> lock(PoolLock);
+        for (int fd : Clients)
+            shutdown(fd, SHUT_RD);
+        PoolCond.wait(lock, [] { return Live == 0; });
+    }
+    for (JobMachine *m : Idle)
+        delete m;
+    return EXIT_HALTED;
+}
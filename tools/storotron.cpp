@@ -15,7 +15,7 @@
 	51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
-// storotron.cpp - definitions for the Card-o-Tron 3CS emulator
+// storotron.cpp - definitions for the Stor-o-Tron emulator
 #include "storotron.hpp"
 #include <cstring>
 #include <iostream>
@@ -68,6 +68,7 @@ uint32_t StorOTron::ReadIOMem(uint32_t Offset)
 	CheckTimer();
 	switch (Offset) {
 		case SOT_REG_STATUS:
+			NotePoll();
 			return SOT_STATUS_BASE | (uint32_t)State;
 			break;
 		case SOT_REG_COMMAND:
@@ -103,19 +104,22 @@ void StorOTron::WriteIOMem(uint32_t Offset, uint32_t Value)
 				switch (Value) {
 					case SOT_COMMAND_SEEK:
 						StartTimer(SEEK_MSEC);
+						SpanBegin("seek", SEEK_MSEC);
 						break;
 					case SOT_COMMAND_READ:
 						StartTimer(READ_MSEC);
+						SpanBegin("read", READ_MSEC);
 						ReadFromFile();
 						break;
 					case SOT_COMMAND_WRITE:
 						StartTimer(WRITE_MSEC);
+						SpanBegin("write", WRITE_MSEC);
 						WriteToFile();
 						break;
 					case SOT_COMMAND_RESET:
 						PowerOnReset();
 						break;
-					defaut:
+					default:
 						// invalid command, ignored
 						break;
 				}
@@ -145,6 +149,7 @@ void StorOTron::WriteIOMem(uint32_t Offset, uint32_t Value)
 // Reset the device as though a power cycle had happened.
 void StorOTron::PowerOnReset()
 {
+	SpanEnd();
 	if (DataFile != nullptr) {
 		State = SOT_STATE_IDLE;
 		CurrentHead = 0;
@@ -156,6 +161,12 @@ void StorOTron::PowerOnReset()
 	}
 }
 
+// Normally seeks and transfers take as long as the real thing. Headless runs don't want to wait.
+void StorOTron::SetInstant(bool Enable)
+{
+	Instant = Enable;
+}
+
 void StorOTron::StartTimer(uint32_t NumMsec)
 {
 	Start = std::chrono::steady_clock::now();
@@ -165,20 +176,28 @@ void StorOTron::StartTimer(uint32_t NumMsec)
 
 void StorOTron::CheckTimer()
 {
+	if (State != SOT_STATE_BUSY)
+		return;
 	auto Now = std::chrono::steady_clock::now();
 	auto Since = std::chrono::duration_cast<std::chrono::milliseconds>(Now - Start);
-	if (Since.count() > MsecDelay)
+	if (Instant || (Since.count() > MsecDelay)) {
 		State = SOT_STATE_IDLE;
+		SpanEnd();
+	}
 }
 
+// Sectors are laid out in the file head by head, each head's positions in order.
+// A failed transfer (a short file, say) leaves the stream failed; clear it so the next one can try.
 void StorOTron::ReadFromFile()
 {
-    DataFile->seekg(CurrentHead * CurrentPos * SOT_SECTOR_BYTES);
+    DataFile->clear();
+    DataFile->seekg(((std::streamoff)CurrentHead * SOT_NUM_POS + CurrentPos) * SOT_SECTOR_BYTES);
     DataFile->read((char *)(Buffer), SOT_SECTOR_BYTES);
 }
 
 void StorOTron::WriteToFile()
 {
-    DataFile->seekp(CurrentHead * CurrentPos * SOT_SECTOR_BYTES);
+    DataFile->clear();
+    DataFile->seekp(((std::streamoff)CurrentHead * SOT_NUM_POS + CurrentPos) * SOT_SECTOR_BYTES);
     DataFile->write((char *)(Buffer), SOT_SECTOR_BYTES);
 }
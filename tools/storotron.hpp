@@ -48,20 +48,22 @@ public:
 	DeviceClass GetDeviceClass();
 	uint32_t GetDDN();
 	void PowerOnReset();
+	void SetInstant(bool Enable);	// no seek or transfer delay, for batch runs
 	// for UI to display blinking lights
 //    bool IsWorking();
 
 private:
 	StorOTronState State;
 uint32_t *Buffer;
-	uint32_t CurrentPos;
-	uint32_t NextPos;
-	uint32_t CurrentHead;
-	uint32_t NextHead;
+	uint32_t CurrentPos {0};
+	uint32_t NextPos {0};
+	uint32_t CurrentHead {0};
+	uint32_t NextHead {0};
 	// No current or next sector since it's always 0
 	std::chrono::time_point<std::chrono::steady_clock> Start;
-	uint32_t MsecDelay;
+	uint32_t MsecDelay {0};
 	std::fstream *DataFile {nullptr};
+	bool Instant {false};
 	void StartTimer(uint32_t NumMsec);
 	void CheckTimer();
 	void ReadFromFile();
@@ -0,0 +1,185 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// symmap.cpp - definitions for the SymbolMap class
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "symmap.hpp"
+
+// Read a map written by asm6k -m. Name is only used in error messages.
+// Returns true on error, with the reason in Error.
+bool SymbolMap::Load(std::istream &In, const std::string &Name, std::string &Error)
+{
+    std::string line;
+    int linenum {0};
+
+    while (std::getline(In, line)) {
+        linenum++;
+        if (line.empty() || (line[0] == '*'))
+            continue;
+        std::istringstream fields(line);
+        std::string type, text;
+        uint32_t addr {0}, len {0}, srcline {0};
+        int file {-1};
+        bool bad {false};
+        fields >> type;
+        try {
+            if (type == "FILE") {
+                fields >> text;
+                file = std::stoi(text, nullptr, 0);
+                std::getline(fields >> std::ws, text);
+                bad = (file != (int)Files.size()) || text.empty();
+                Files.push_back(text);
+            } else if (type == "SEG") {
+                fields >> text;
+                addr = std::stoul(text, nullptr, 0);
+                fields >> text;
+                len = std::stoul(text, nullptr, 0);
+                fields >> text;
+                file = std::stoi(text, nullptr, 0);
+                Segments.push_back({addr, len, file});
+            } else if (type == "LINE") {
+                fields >> text;
+                addr = std::stoul(text, nullptr, 0);
+                fields >> text;
+                file = std::stoi(text, nullptr, 0);
+                fields >> text;
+                srcline = std::stoul(text, nullptr, 0);
+                Lines.push_back({addr, file, srcline});
+            } else if (type == "SYM") {
+                std::string name;
+                fields >> text >> name;
+                addr = std::stoul(text, nullptr, 0);
+                fields >> text;
+                file = std::stoi(text, nullptr, 0);
+                fields >> text;
+                srcline = std::stoul(text, nullptr, 0);
+                bad = name.empty();
+                Symbols.push_back({name, addr, addr, file, srcline});
+            } else {
+                bad = true;
+            }
+        } catch (...) {
+            bad = true;
+        }
+        if (bad || (file < 0) || (file >= (int)Files.size())) {
+            Error = Name + ": bad record on line " + std::to_string(linenum);
+            return true;
+        }
+    }
+
+    auto byaddr = [](const auto &a, const auto &b) { return a.Addr < b.Addr; };
+    std::sort(Segments.begin(), Segments.end(), [](const MapSegment &a, const MapSegment &b)
+              { return a.Base < b.Base; });
+    std::stable_sort(Lines.begin(), Lines.end(), byaddr);
+    // Code at the start of a segment often has no label; name it after its file so that it still
+    // shows up as something.
+    for (auto &seg : Segments) {
+        auto it = std::find_if(Symbols.begin(), Symbols.end(), [&seg](const MapSymbol &s)
+                               { return s.Addr == seg.Base; });
+        if ((it == Symbols.end()) && seg.Len) {
+            std::string base = Files[seg.File];
+            base.erase(0, base.find_last_of("/\\") + 1);
+            Symbols.push_back({base, seg.Base, seg.Base, seg.File, 0});
+        }
+    }
+    std::stable_sort(Symbols.begin(), Symbols.end(), byaddr);
+    for (size_t i = 0; i < Symbols.size(); i++) {
+        const MapSegment *seg = FindSegment(Symbols[i].Addr);
+        uint32_t end = seg ? seg->Base + seg->Len : Symbols[i].Addr;
+        for (size_t j = i + 1; j < Symbols.size(); j++) {
+            if (Symbols[j].Addr > Symbols[i].Addr) {
+                end = std::min(end, Symbols[j].Addr);
+                break;
+            }
+        }
+        Symbols[i].End = end;
+    }
+    Source.resize(Files.size());
+    SourceRead.resize(Files.size(), false);
+    return false;
+}
+
+bool SymbolMap::IsEmpty() const
+{
+    return Symbols.empty();
+}
+
+// Find the segment holding the given address, or nullptr if it's not in any of them.
+const MapSegment *SymbolMap::FindSegment(uint32_t Addr) const
+{
+    auto it = std::upper_bound(Segments.begin(), Segments.end(), Addr, [](uint32_t a, const MapSegment &s)
+                               { return a < s.Base; });
+    if (it == Segments.begin())
+        return nullptr;
+    --it;
+    return (Addr - it->Base < it->Len) ? &*it : nullptr;
+}
+
+// Find the label the given address falls under, or nullptr if it's outside the program. Where several
+// labels share an address, the last one in the map wins.
+const MapSymbol *SymbolMap::FindSymbol(uint32_t Addr) const
+{
+    auto it = std::upper_bound(Symbols.begin(), Symbols.end(), Addr, [](uint32_t a, const MapSymbol &s)
+                               { return a < s.Addr; });
+    if (it == Symbols.begin())
+        return nullptr;
+    --it;
+    return (Addr < it->End) ? &*it : nullptr;
+}
+
+// Find the source line the word at the given address came from, or nullptr if it's outside the program.
+const MapLine *SymbolMap::FindLine(uint32_t Addr) const
+{
+    if (FindSegment(Addr) == nullptr)
+        return nullptr;
+    auto it = std::upper_bound(Lines.begin(), Lines.end(), Addr, [](uint32_t a, const MapLine &l)
+                               { return a < l.Addr; });
+    if (it == Lines.begin())
+        return nullptr;
+    return &*(--it);
+}
+
+const std::vector<MapSymbol> &SymbolMap::GetSymbols() const
+{
+    return Symbols;
+}
+
+const std::string &SymbolMap::GetFileName(int File) const
+{
+    return Files[File];
+}
+
+// Get the text of a source line, or an empty string if the file can't be read. Paths in the map are as
+// the assembler was given them, so this only works from the same directory or with absolute paths.
+std::string SymbolMap::GetSourceText(int File, uint32_t Line)
+{
+    if ((File < 0) || (File >= (int)Files.size()))
+        return "";
+    if (!SourceRead[File]) {
+        std::ifstream in(Files[File]);
+        std::string text;
+        while (std::getline(in, text))
+            Source[File].push_back(text);
+        SourceRead[File] = true;
+    }
+    if ((Line == 0) || (Line > Source[File].size()))
+        return "";
+    return Source[File][Line - 1];
+}
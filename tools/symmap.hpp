@@ -0,0 +1,77 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// symmap.hpp - declarations for the SymbolMap class, which reads the symbol map written by asm6k -m.
+// The map lets the debugging tools turn a guest address back into a label and a source line.
+//
+// The map is a text file, one record per line. Lines starting with * are comments. Numbers may be
+// decimal or 0x hex.
+//      FILE index path             a source file, as named on the assembler command line
+//      SEG base length file        a code segment and the file it came from
+//      LINE addr file line         the word at addr, and those after it up to the next LINE,
+//                                  came from this source line
+//      SYM addr name file line     a label
+#ifndef __SYMMAP_HPP__
+#define __SYMMAP_HPP__
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+struct MapSymbol {
+    std::string Name;
+    uint32_t Addr;
+    uint32_t End;       // first address past the symbol: the next symbol or the end of its segment
+    int File;
+    uint32_t Line;
+};
+
+struct MapSegment {
+    uint32_t Base;
+    uint32_t Len;
+    int File;
+};
+
+struct MapLine {
+    uint32_t Addr;
+    int File;
+    uint32_t Line;
+};
+
+class SymbolMap {
+public:
+    bool Load(std::istream &In, const std::string &Name, std::string &Error);
+    bool IsEmpty() const;
+    const MapSymbol *FindSymbol(uint32_t Addr) const;
+    const MapLine *FindLine(uint32_t Addr) const;
+    const std::vector<MapSymbol> &GetSymbols() const;
+    const std::string &GetFileName(int File) const;
+    std::string GetSourceText(int File, uint32_t Line);
+
+private:
+    std::vector<std::string> Files;
+    std::vector<MapSegment> Segments;   // these three are kept sorted by address
+    std::vector<MapLine> Lines;
+    std::vector<MapSymbol> Symbols;
+    std::vector<std::vector<std::string>> Source; // source text, read when first asked for
+    std::vector<bool> SourceRead;
+
+    const MapSegment *FindSegment(uint32_t Addr) const;
+};
+
+#endif // __SYMMAP_HPP__
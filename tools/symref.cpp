@@ -134,3 +134,17 @@ bool SymbolTable::AddDef(std::string NewName, uint32_t Location, uint32_t LineNu
     return false;
 
 }
+
+// Get every symbol that names an address, as opposed to a .VALUE, sorted by address. Only valid once
+// the table is complete and the segment bases are final. Used to write the symbol map.
+std::vector<const SymbolHead *> SymbolTable::GetLabels() const
+{
+    std::vector<const SymbolHead *> retval;
+
+    for (auto& Sym : HeadList)
+        if (Sym.Known && !Sym.IsValue)
+            retval.push_back(&Sym);
+    std::sort(retval.begin(), retval.end(), [](const SymbolHead *a, const SymbolHead *b)
+              {return (a->Seg->GetBase() + a->Offset) < (b->Seg->GetBase() + b->Offset);});
+    return retval;
+}
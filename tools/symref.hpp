@@ -55,6 +55,7 @@ public:
     bool AddRef(std::string NewName, uint32_t Location, uint32_t LineNum, CodeSegment *Seg);
     bool IsTableCorrect();
     bool UpdateSegment(CodeSegment *Segment);
+    std::vector<const SymbolHead *> GetLabels() const;
 private:
     std::forward_list<SymbolHead> HeadList;
     bool AddDef(std::string NewName, uint32_t Location, uint32_t LineNum, CodeSegment *Seg, bool IsValue);
@@ -0,0 +1,190 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// timeline.cpp - device activity timeline, and its export as Chrome trace events.
+
+#include <iomanip>
+#include "timeline.hpp"
+#include "periph.hpp"
+
+// Track names for the devices we know about.
+static std::string DeviceName(Periph *Dev)
+{
+    switch (Dev->GetDeviceClass()) {
+        case DC_PRINTER:
+            return "Print-o-Tron";
+        case DC_TAPE:
+            return "Tape-o-Tron";
+        case DC_CARD_READER:
+            return "Card-o-Tron scanner";
+        case DC_CARD_PUNCH:
+            return "Card-o-Tron punch";
+        case DC_RAS:
+            return "Stor-o-Tron";
+        case DC_TELE:
+            return "Type-o-Tron";
+        case DC_DISP:
+            return "Scope-o-Tron";
+        default:
+            return "device";
+    }
+}
+
+// Start recording: the clocks start now, and every device on the CPU gets a track.
+void DeviceTimeline::Attach(CPU &C)
+{
+    Core = &C;
+    Epoch = std::chrono::steady_clock::now();
+    Tracks.clear();
+    Events.clear();
+    AddTrack("CPU");
+    Begin(TIMELINE_CPU_TRACK, "run", 0);
+    for (int i = 0; i < PERIPH_MAP_ENTRIES; i++) {
+        Periph *dev = C.GetDevice(i);
+        if (dev != nullptr)
+            dev->SetTimeline(this, AddTrack(DeviceName(dev)));
+    }
+}
+
+// Stop recording. Anything still going on is cut off here. The CPU must still be around.
+void DeviceTimeline::Detach()
+{
+    if (Core == nullptr)
+        return;
+    for (int i = 0; i < PERIPH_MAP_ENTRIES; i++) {
+        Periph *dev = Core->GetDevice(i);
+        if (dev != nullptr)
+            dev->SetTimeline(nullptr, 0);
+    }
+    for (size_t i = 0; i < Tracks.size(); i++)
+        End(i);
+    Core = nullptr;
+}
+
+int DeviceTimeline::AddTrack(const std::string &Name)
+{
+    Tracks.push_back({Name, -1, 0, 0});
+    return Tracks.size() - 1;
+}
+
+double DeviceTimeline::Now() const
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - Epoch).count();
+}
+
+// A device has gone busy. If it somehow already was, the old span ends here.
+void DeviceTimeline::Begin(int Track, const char *What, uint32_t NominalMsec)
+{
+    End(Track);
+    double now = Now();
+    uint64_t cycles = Core->GetCycles();
+    Events.push_back({What, Track, cycles, cycles, now, now, NominalMsec, 0, false});
+    Tracks[Track].Open = Events.size() - 1;
+}
+
+void DeviceTimeline::End(int Track)
+{
+    int open = Tracks[Track].Open;
+    if (open < 0)
+        return;
+    Events[open].EndCycle = Core->GetCycles();
+    Events[open].EndUsec = Now();
+    Tracks[Track].Open = -1;
+}
+
+void DeviceTimeline::Mark(int Track, const char *What)
+{
+    double now = Now();
+    uint64_t cycles = Core->GetCycles();
+    Events.push_back({What, Track, cycles, cycles, now, now, 0, 0, true});
+}
+
+void DeviceTimeline::Poll(int Track)
+{
+    Tracks[Track].Polls++;
+    if (Tracks[Track].Open >= 0) {
+        Tracks[Track].BusyPolls++;
+        Events[Tracks[Track].Open].Polls++;
+    }
+}
+
+// Write the timeline as Chrome trace events. There are two processes with the same tracks: one timed
+// by the host clock in microseconds, and one timed in emulated cycles, shown one cycle per microsecond.
+// Totals for each device go in otherData.
+void DeviceTimeline::WriteJSON(std::ostream &Out) const
+{
+    static const char *clocks[2] = {"host time", "emulated cycles (1 us = 1 cycle)"};
+    bool first {true};
+
+    auto sep = [&]() {
+        Out << (first ? "\n" : ",\n");
+        first = false;
+    };
+    Out << std::fixed << std::setprecision(3);
+    Out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (int pid = 1; pid <= 2; pid++) {
+        sep();
+        Out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\""
+            << clocks[pid - 1] << "\"}}";
+        for (size_t t = 0; t < Tracks.size(); t++) {
+            sep();
+            Out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << t
+                << ",\"args\":{\"name\":\"" << Tracks[t].Name << "\"}}";
+        }
+    }
+    for (auto &e : Events) {
+        for (int pid = 1; pid <= 2; pid++) {
+            sep();
+            Out << "{\"name\":\"" << e.Name << "\",\"pid\":" << pid << ",\"tid\":" << e.Track << ",\"ts\":";
+            if (pid == 1)
+                Out << e.StartUsec;
+            else
+                Out << e.StartCycle;
+            if (e.Instant) {
+                Out << ",\"ph\":\"i\",\"s\":\"t\"";
+            } else {
+                Out << ",\"ph\":\"X\",\"dur\":";
+                if (pid == 1)
+                    Out << e.EndUsec - e.StartUsec;
+                else
+                    Out << e.EndCycle - e.StartCycle;
+            }
+            Out << ",\"args\":{\"cycle\":" << e.StartCycle;
+            if (!e.Instant)
+                Out << ",\"cycles\":" << e.EndCycle - e.StartCycle << ",\"host_us\":" << e.EndUsec - e.StartUsec
+                    << ",\"nominal_ms\":" << e.NominalMsec << ",\"polls\":" << e.Polls;
+            Out << "}}";
+        }
+    }
+    Out << "\n],\"otherData\":{";
+    for (size_t t = 0; t < Tracks.size(); t++) {
+        uint64_t spans {0}, cycles {0}, nominal {0};
+        double usec {0};
+        for (auto &e : Events)
+            if ((e.Track == (int)t) && !e.Instant) {
+                spans++;
+                cycles += e.EndCycle - e.StartCycle;
+                usec += e.EndUsec - e.StartUsec;
+                nominal += e.NominalMsec;
+            }
+        Out << (t ? ",\n" : "\n") << "\"" << Tracks[t].Name << " (track " << t << ")\":{\"spans\":" << spans
+            << ",\"busy_cycles\":" << cycles << ",\"busy_host_ms\":" << usec / 1000
+            << ",\"nominal_ms\":" << nominal << ",\"polls\":" << Tracks[t].Polls
+            << ",\"busy_polls\":" << Tracks[t].BusyPolls << "}";
+    }
+    Out << "\n}}\n";
+}
@@ -0,0 +1,79 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// timeline.hpp - declarations for the DeviceTimeline class, a record of what the devices were doing.
+// Once attached to a CPU, the timeline gets a track for each device, and the devices report when they
+// go busy (a card scan, a seek) and when they come back, along with each time the program reads their
+// status register. Every span is timed both in emulated cycles and in host time, and the lot can be
+// written out in the Chrome trace event format for chrome://tracing or ui.perfetto.dev.
+//
+// A device only notices that it's done when something looks at it, so a span ends at the first access
+// after its delay has run out. Batch runs use instant devices, which are done as soon as they're looked
+// at; each span also carries the delay the real device would have taken.
+//
+// The devices report from whichever thread touches them, so a timeline should only be attached where
+// one thread does all of that, as in batch6k.
+#ifndef __TIMELINE_HPP__
+#define __TIMELINE_HPP__
+
+#include <cstdint>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cpu.hpp"
+
+#define TIMELINE_CPU_TRACK 0    // the whole run, so device activity can be seen against it
+
+class DeviceTimeline {
+public:
+    void Attach(CPU &C);
+    void Detach();
+    int AddTrack(const std::string &Name);
+    void Begin(int Track, const char *What, uint32_t NominalMsec);
+    void End(int Track);
+    void Mark(int Track, const char *What);
+    void Poll(int Track);
+    void WriteJSON(std::ostream &Out) const;
+
+private:
+    struct Event {
+        const char *Name;
+        int Track;
+        uint64_t StartCycle;
+        uint64_t EndCycle;
+        double StartUsec;       // host time since Attach()
+        double EndUsec;
+        uint32_t NominalMsec;   // how long the real device would take
+        uint64_t Polls;         // status reads while this was going on
+        bool Instant;
+    };
+    struct Track {
+        std::string Name;
+        int Open;               // index in Events of the span in progress, or -1
+        uint64_t Polls;
+        uint64_t BusyPolls;     // the ones made while the device was busy
+    };
+    CPU *Core {nullptr};
+    std::chrono::steady_clock::time_point Epoch;
+    std::vector<Track> Tracks;
+    std::vector<Event> Events;
+
+    double Now() const;
+};
+
+#endif // __TIMELINE_HPP__
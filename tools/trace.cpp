@@ -0,0 +1,395 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// trace.cpp - execution trace recorder and reader. See trace.hpp for the file format.
+
+#include <cstring>
+#include "trace.hpp"
+
+// Varints and zigzag encoding, so small deltas either way take a byte or two.
+static inline uint8_t *PutVarint(uint8_t *Out, uint64_t Val)
+{
+    while (Val >= 0x80) {
+        *Out++ = (uint8_t)(Val | 0x80);
+        Val >>= 7;
+    }
+    *Out++ = (uint8_t)Val;
+    return Out;
+}
+
+static inline uint32_t ZigZag(uint32_t Delta)
+{
+    return (Delta << 1) ^ (uint32_t)((int32_t)Delta >> 31);
+}
+
+static inline uint32_t UnZigZag(uint32_t Val)
+{
+    return (Val >> 1) ^ (0 - (Val & 1));
+}
+
+// Start of a block: the registers are known, nothing is in the word cache.
+void TraceState::Start(const uint32_t *StartRegs)
+{
+    for (int i = 0; i < NUMREGS; i++)
+        Regs[i] = StartRegs[i];
+    NextIP = Regs[REG_IP];
+    LastWrite = 0;
+    for (int i = 0; i < TRACE_WORD_CACHE; i++) {
+        CacheAddr[i] = 0xFFFFFFFF;
+        CacheWord[i] = 0;
+    }
+}
+
+TraceRecorder::TraceRecorder()
+{
+    Writes.reserve(2 * NUMREGS + 2);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    if (Writer.joinable())
+        Close();
+    for (auto b : Spare)
+        delete b;
+}
+
+// Create the trace file and start the writer thread. Returns true on error.
+bool TraceRecorder::Open(const std::string &FileName, std::string &Error)
+{
+    File.open(FileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!File.is_open()) {
+        Error = "Error opening " + FileName;
+        return true;
+    }
+    File.write(TRACE_MAGIC, TRACE_MAGIC_LEN);
+    Stopping = false;
+    Failed = false;
+    Records = 0;
+    Writer = std::thread(&TraceRecorder::WriteBlocks, this);
+    return false;
+}
+
+// Write out whatever is left and stop the writer thread. The CPU must not be using the recorder any more.
+// Returns true if anything couldn't be written.
+bool TraceRecorder::Close()
+{
+    if (!Writer.joinable())
+        return Failed;
+    Flush(true);
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        Stopping = true;
+    }
+    Ready.notify_one();
+    Writer.join();
+    File.close();
+    return Failed;
+}
+
+uint64_t TraceRecorder::GetRecords() const
+{
+    return Records;
+}
+
+// Encode one instruction. Everything is relative to the state left by the previous record, which
+// the reader keeps in step.
+void TraceRecorder::End(uint32_t Addr, uint32_t Word, bool Fetched, uint32_t Fault, const uint32_t *Regs)
+{
+    size_t need = Cur->Len + TRACE_RECORD_MAX + Writes.size() * 10;
+    if (need > Cur->Data.size())
+        Cur->Data.resize(need);
+    uint8_t *head = Cur->Data.data() + Cur->Len;
+    uint8_t *p = head + 1;
+
+    *head = 0;
+    if (Addr != State.NextIP) {
+        *head |= TR_JUMP;
+        p = PutVarint(p, ZigZag(Addr - State.NextIP));
+    }
+    if (!Fetched) {
+        *head |= TR_NOINST;
+    } else {
+        uint32_t slot = Addr & (TRACE_WORD_CACHE - 1);
+        if ((State.CacheAddr[slot] != Addr) || (State.CacheWord[slot] != Word)) {
+            *head |= TR_WORD;
+            for (int i = 0; i < 4; i++)
+                *p++ = (uint8_t)(Word >> (8 * i));
+            State.CacheAddr[slot] = Addr;
+            State.CacheWord[slot] = Word;
+        }
+    }
+    if (HasDirect) {
+        *head |= TR_DIRECT;
+        p = PutVarint(p, DirectVal);
+    }
+    uint32_t mask {0};
+    for (int i = 0; i < NUMREGS; i++)
+        if ((Regs[i] != State.Regs[i]) && (i != REG_IP) && (i != REG_FLG))
+            mask |= 1 << i;
+    if (mask) {
+        *head |= TR_REGS;
+        p = PutVarint(p, mask);
+        for (int i = 0; i < NUMREGS; i++)
+            if (mask & (1 << i)) {
+                p = PutVarint(p, ZigZag(Regs[i] - State.Regs[i]));
+                State.Regs[i] = Regs[i];
+            }
+    }
+    if (Regs[REG_FLG] != State.Regs[REG_FLG]) {
+        *head |= TR_FLAGS;
+        p = PutVarint(p, Regs[REG_FLG] ^ State.Regs[REG_FLG]);
+        State.Regs[REG_FLG] = Regs[REG_FLG];
+    }
+    if (!Writes.empty()) {
+        *head |= TR_MEM;
+        p = PutVarint(p, Writes.size());
+        for (auto &w : Writes) {
+            p = PutVarint(p, ZigZag(w.first - State.LastWrite));
+            p = PutVarint(p, w.second);
+            State.LastWrite = w.first;
+        }
+        Writes.clear();
+    }
+    if (Fault) {
+        *head |= TR_FAULT;
+        p = PutVarint(p, Fault);
+    }
+    State.NextIP = Addr + (HasDirect ? 2 : 1);
+    HasDirect = false;
+    Cur->Len = p - Cur->Data.data();
+    BlockRecords++;
+    Records++;
+}
+
+// The current block is full, or this is the first record. Pass the block to the writer and start a new
+// one with a fresh copy of the registers.
+void TraceRecorder::StartBlock(const uint32_t *Regs, uint64_t Cycle)
+{
+    Flush(false);
+    uint8_t *p = PutVarint(Cur->Data.data(), Cycle);
+    for (int i = 0; i < NUMREGS; i++)
+        p = PutVarint(p, Regs[i]);
+    Cur->Len = p - Cur->Data.data();
+    State.Start(Regs);
+}
+
+// Queue the current block for writing, then, unless this is the last one, get an empty block to fill.
+// This is where the core waits if the writer has fallen behind.
+void TraceRecorder::Flush(bool Last)
+{
+    std::unique_lock<std::mutex> lock(Lock);
+    if (Cur != nullptr) {
+        if (BlockRecords)
+            Full.push_back(Cur);
+        else
+            Spare.push_back(Cur);
+        Cur = nullptr;
+        Ready.notify_one();
+    }
+    if (Last)
+        return;
+    Drained.wait(lock, [this] { return !Spare.empty() || (Allocated < TRACE_BLOCKS); });
+    if (!Spare.empty()) {
+        Cur = Spare.back();
+        Spare.pop_back();
+    } else {
+        Cur = new Block;
+        Cur->Data.resize(TRACE_BLOCK_SIZE + TRACE_RECORD_MAX);
+        Allocated++;
+    }
+    Cur->Len = 0;
+    BlockRecords = 0;
+}
+
+// Writer thread. Writes blocks in the order they were queued until told to stop and there are none left.
+void TraceRecorder::WriteBlocks()
+{
+    std::unique_lock<std::mutex> lock(Lock);
+    for (;;) {
+        Ready.wait(lock, [this] { return !Full.empty() || Stopping; });
+        if (Full.empty())
+            return;
+        Block *b = Full.front();
+        Full.pop_front();
+        lock.unlock();
+        char len[4];
+        for (int i = 0; i < 4; i++)
+            len[i] = (char)(b->Len >> (8 * i));
+        File.write(len, sizeof(len));
+        File.write((const char *)b->Data.data(), b->Len);
+        bool bad = !File.good();
+        lock.lock();
+        Failed |= bad;
+        Spare.push_back(b);
+        Drained.notify_one();
+    }
+}
+
+// Open a trace file and check that it is one. Returns true on error.
+bool TraceReader::Open(const std::string &FileName, std::string &Error)
+{
+    File.open(FileName, std::ios::in | std::ios::binary);
+    if (!File.is_open()) {
+        Error = "Error opening " + FileName;
+        return true;
+    }
+    char magic[TRACE_MAGIC_LEN];
+    if (!File.read(magic, TRACE_MAGIC_LEN) || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN)) {
+        Error = FileName + " is not a trace file";
+        return true;
+    }
+    Block.clear();
+    Pos = 0;
+    return false;
+}
+
+// Read a varint from the current block. Returns true if the block ends first.
+static bool GetVarint(const std::vector<uint8_t> &Block, size_t &Pos, uint64_t &Val)
+{
+    Val = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (Pos >= Block.size())
+            return true;
+        uint8_t b = Block[Pos++];
+        Val |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return false;
+    }
+    return true;
+}
+
+// Read the next block and its starting state. Returns true at the end of the file, with Error set if
+// the file didn't end cleanly.
+bool TraceReader::ReadBlock(std::string &Error)
+{
+    unsigned char len[4];
+    File.read((char *)len, sizeof(len));
+    if (File.gcount() == 0)
+        return true;
+    if (File.gcount() != sizeof(len)) {
+        Error = "trace file is truncated";
+        return true;
+    }
+    size_t n = len[0] | (len[1] << 8) | (len[2] << 16) | ((size_t)len[3] << 24);
+    Block.resize(n);
+    if (!File.read((char *)Block.data(), n)) {
+        Error = "trace file is truncated";
+        return true;
+    }
+    Pos = 0;
+    uint64_t val;
+    uint32_t regs[NUMREGS];
+    if (GetVarint(Block, Pos, Cycle)) {
+        Error = "bad block header in trace file";
+        return true;
+    }
+    for (int i = 0; i < NUMREGS; i++) {
+        if (GetVarint(Block, Pos, val)) {
+            Error = "bad block header in trace file";
+            return true;
+        }
+        regs[i] = (uint32_t)val;
+    }
+    State.Start(regs);
+    return false;
+}
+
+// Decode the next record. Returns true if there isn't one, with Error set if that's because the file
+// is damaged rather than finished.
+bool TraceReader::Next(TraceRecord &Rec, std::string &Error)
+{
+    while (Pos >= Block.size())
+        if (ReadBlock(Error))
+            return true;
+
+    uint8_t head = Block[Pos++];
+    uint64_t val {0};
+    bool bad {false};
+
+    Rec.Cycle = Cycle++;
+    Rec.Addr = State.NextIP;
+    Rec.Fetched = !(head & TR_NOINST);
+    Rec.Word = 0;
+    Rec.HasDirect = false;
+    Rec.Direct = 0;
+    Rec.Fault = 0;
+    Rec.Changed = 0;
+    Rec.Writes.clear();
+    if (head & TR_JUMP) {
+        bad |= GetVarint(Block, Pos, val);
+        Rec.Addr += UnZigZag((uint32_t)val);
+    }
+    if (Rec.Fetched) {
+        uint32_t slot = Rec.Addr & (TRACE_WORD_CACHE - 1);
+        if (head & TR_WORD) {
+            if (Pos + 4 > Block.size()) {
+                bad = true;
+            } else {
+                State.CacheAddr[slot] = Rec.Addr;
+                State.CacheWord[slot] = Block[Pos] | (Block[Pos + 1] << 8) | (Block[Pos + 2] << 16) |
+                                        ((uint32_t)Block[Pos + 3] << 24);
+                Pos += 4;
+            }
+        } else if (State.CacheAddr[slot] != Rec.Addr) {
+            bad = true;
+        }
+        Rec.Word = State.CacheWord[slot];
+    }
+    if (head & TR_DIRECT) {
+        bad |= GetVarint(Block, Pos, val);
+        Rec.HasDirect = true;
+        Rec.Direct = (uint32_t)val;
+    }
+    if (head & TR_REGS) {
+        bad |= GetVarint(Block, Pos, val);
+        Rec.Changed = (uint32_t)val & ~((1 << REG_IP) | (1 << REG_FLG));
+        for (int i = 0; i < NUMREGS; i++)
+            if (Rec.Changed & (1 << i)) {
+                bad |= GetVarint(Block, Pos, val);
+                State.Regs[i] += UnZigZag((uint32_t)val);
+            }
+    }
+    if (head & TR_FLAGS) {
+        bad |= GetVarint(Block, Pos, val);
+        State.Regs[REG_FLG] ^= (uint32_t)val;
+        Rec.Changed |= 1 << REG_FLG;
+    }
+    if (head & TR_MEM) {
+        uint64_t count {0};
+        bad |= GetVarint(Block, Pos, count);
+        for (uint64_t i = 0; (i < count) && !bad; i++) {
+            bad |= GetVarint(Block, Pos, val);
+            uint32_t addr = State.LastWrite + UnZigZag((uint32_t)val);
+            bad |= GetVarint(Block, Pos, val);
+            Rec.Writes.emplace_back(addr, (uint32_t)val);
+            State.LastWrite = addr;
+        }
+    }
+    if (head & TR_FAULT) {
+        bad |= GetVarint(Block, Pos, val);
+        Rec.Fault = (uint32_t)val;
+    }
+    if (bad) {
+        Error = "bad record in trace file";
+        return true;
+    }
+    State.NextIP = Rec.Addr + (Rec.HasDirect ? 2 : 1);
+    for (int i = 0; i < NUMREGS; i++)
+        Rec.Regs[i] = State.Regs[i];
+    Rec.Regs[REG_IP] = Rec.Addr;
+    return false;
+}
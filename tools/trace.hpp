@@ -0,0 +1,162 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// trace.hpp - declarations for the execution trace recorder and reader.
+// A TraceRecorder attached to a CPU gets one record for every instruction the CPU executes: where it
+// was, the instruction word and any direct value, the registers and flags it changed, the memory it
+// wrote, and the fault it raised, if any. Records are packed into blocks in memory and a background
+// thread writes full blocks out, so the running core only waits on the disk when it gets more than
+// TRACE_BLOCKS blocks ahead. Each core needs its own recorder.
+//
+// Tracing is only available when the library is built with CT6K_TRACE (the default). The CPU checks for
+// a recorder once per Run() rather than once per instruction, so having it built in costs a pointer test
+// on memory writes and nothing else.
+//
+// File format: the magic string TRACE_MAGIC, then blocks. A block is a 4 byte little endian length and
+// that many bytes of payload. The payload starts with the cycle count of its first record and a full
+// register set, so every block can be decoded on its own. Then come the records, each a header byte
+// saying which fields follow:
+//      TR_JUMP     IP wasn't where the previous instruction left it, zigzag delta to the real address
+//      TR_WORD     the instruction word, 4 bytes, when it isn't the last word seen at this address
+//      TR_DIRECT   the direct value
+//      TR_REGS     mask of registers changed besides IP and FLG, then a zigzag delta for each one
+//      TR_FLAGS    bits of FLG that changed
+//      TR_MEM      count of memory writes, then for each a zigzag delta from the last address written
+//                  and the value
+//      TR_FAULT    the fault raised
+//      TR_NOINST   the instruction couldn't be fetched, so there is no word
+// Numbers other than the instruction word are LEB128 varints.
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "arch.h"
+
+#define TRACE_MAGIC "CT6KTRC1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_BLOCK_SIZE (256 * 1024)   // a block is sent to the writer once it reaches this size
+#define TRACE_BLOCKS 8                  // blocks in flight before the core has to wait for the writer
+#define TRACE_WORD_CACHE 256            // instruction words remembered by address, power of two
+#define TRACE_RECORD_MAX 128            // room needed for a record, not counting its memory writes
+
+#define TR_JUMP     0x01
+#define TR_WORD     0x02
+#define TR_DIRECT   0x04
+#define TR_REGS     0x08
+#define TR_FLAGS    0x10
+#define TR_MEM      0x20
+#define TR_FAULT    0x40
+#define TR_NOINST   0x80
+
+// State shared by the encoder and decoder, reset at the start of every block.
+struct TraceState {
+    uint32_t Regs[NUMREGS];
+    uint32_t NextIP;
+    uint32_t LastWrite;
+    uint32_t CacheAddr[TRACE_WORD_CACHE];
+    uint32_t CacheWord[TRACE_WORD_CACHE];
+
+    void Start(const uint32_t *Regs);
+};
+
+class TraceRecorder {
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+    bool Open(const std::string &FileName, std::string &Error);
+    bool Close();
+    uint64_t GetRecords() const;
+
+    // Called by the CPU for each instruction: Begin() first, Direct() and Write() as they happen, End()
+    // once the instruction and any fault it raised are done.
+    void Begin(const uint32_t *Regs, uint64_t Cycle)
+    {
+        if ((Cur == nullptr) || (Cur->Len >= TRACE_BLOCK_SIZE))
+            StartBlock(Regs, Cycle);
+    }
+    void Direct(uint32_t Value) { DirectVal = Value; HasDirect = true; }
+    void Write(uint32_t Addr, uint32_t Value) { Writes.emplace_back(Addr, Value); }
+    void End(uint32_t Addr, uint32_t Word, bool Fetched, uint32_t Fault, const uint32_t *Regs);
+
+private:
+    std::ofstream File;
+    std::thread Writer;
+    std::mutex Lock;
+    std::condition_variable Ready;      // a block is waiting to be written, or it's time to stop
+    std::condition_variable Drained;    // a block has been written and can be reused
+    struct Block {
+        std::vector<uint8_t> Data;      // allocated once; Len is how much of it is used
+        size_t Len {0};
+    };
+    std::deque<Block *> Full;
+    std::vector<Block *> Spare;
+    int Allocated {0};
+    bool Stopping {false};
+    bool Failed {false};
+
+    Block *Cur {nullptr};   // block being filled, only touched by the core
+    uint64_t BlockRecords {0};
+    uint64_t Records {0};
+    TraceState State;
+    bool HasDirect {false};
+    uint32_t DirectVal {0};
+    std::vector<std::pair<uint32_t, uint32_t>> Writes;
+
+    void Flush(bool Last);
+    void StartBlock(const uint32_t *Regs, uint64_t Cycle);
+    void WriteBlocks();
+};
+
+// One decoded record. Regs holds the registers after the instruction, except that IP is the address
+// the instruction was fetched from.
+struct TraceRecord {
+    uint64_t Cycle;
+    uint32_t Addr;
+    uint32_t Word;
+    bool Fetched;
+    bool HasDirect;
+    uint32_t Direct;
+    uint32_t Fault;
+    uint32_t Changed;   // mask of registers written, including FLG when any flag changed
+    uint32_t Regs[NUMREGS];
+    std::vector<std::pair<uint32_t, uint32_t>> Writes;
+};
+
+class TraceReader {
+public:
+    bool Open(const std::string &FileName, std::string &Error);
+    bool Next(TraceRecord &Rec, std::string &Error);
+
+private:
+    std::ifstream File;
+    std::vector<uint8_t> Block;
+    size_t Pos {0};
+    uint64_t Cycle {0};
+    TraceState State;
+
+    bool ReadBlock(std::string &Error);
+};
+
+#endif // __TRACE_HPP__
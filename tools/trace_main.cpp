@@ -0,0 +1,142 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// trace_main.cpp - trace6k, turns an execution trace written by batch6k --trace back into text.
+// One line per instruction: the cycle, the address, the instruction word and its disassembly, then
+// the registers and memory it changed and any fault it raised. With a symbol map from asm6k -m, each
+// label is shown where execution reaches it.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include "arch.h"
+#include "instruction.hpp"
+#include "symmap.hpp"
+#include "trace.hpp"
+
+static const char *RegNames[NUMREGS] = {
+    "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
+    "R8", "R9", "R10", "R11", "R12", "FLG", "SP", "IP",
+};
+
+// Display usage. Caller passes in argv[0] so that we can display the name of the command.
+static int Usage(char *Cmd)
+{
+    std::cerr << "Usage: " << Cmd << " [options] tracefile\n";
+    std::cerr << "Options:\n";
+    std::cerr << "\t-s cycle        start at this cycle\n";
+    std::cerr << "\t-n count        stop after this many instructions\n";
+    std::cerr << "\t-m mapfile      show labels from a map written by asm6k -m\n";
+    return 1;
+}
+
+// Format one record.
+static void PrintRecord(std::ostream &Out, const TraceRecord &Rec)
+{
+    char buf[64];
+    std::string text;
+
+    if (Rec.Fetched) {
+        snprintf(buf, sizeof(buf), "%10llu  %08x  %08x  ", (unsigned long long)Rec.Cycle, Rec.Addr, Rec.Word);
+        text = FormatDisasm(Rec.Word, Rec.Direct, nullptr);
+    } else {
+        snprintf(buf, sizeof(buf), "%10llu  %08x  --------  ", (unsigned long long)Rec.Cycle, Rec.Addr);
+        text = "(no fetch)";
+    }
+    Out << buf << text;
+    for (size_t i = text.size(); i < 24; i++)
+        Out << ' ';
+    for (int i = 0; i < NUMREGS; i++)
+        if (Rec.Changed & (1 << i)) {
+            snprintf(buf, sizeof(buf), " %s=%08x", RegNames[i], Rec.Regs[i]);
+            Out << buf;
+        }
+    for (auto &w : Rec.Writes) {
+        snprintf(buf, sizeof(buf), " [%08x]=%08x", w.first, w.second);
+        Out << buf;
+    }
+    if (Rec.Fault)
+        Out << " fault " << Rec.Fault;
+    Out << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    std::string tracename, mapname;
+    uint64_t start {0};
+    uint64_t count {UINT64_MAX};
+
+    for (auto i = 1; i < argc; i++) {
+        std::string TmpArg = argv[i];
+
+        if ((TmpArg == "-s") || (TmpArg == "-n")) {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            try {
+                (TmpArg == "-s" ? start : count) = std::stoull(argv[i], nullptr, 0);
+            } catch (...) {
+                return Usage(argv[0]);
+            }
+            continue;
+        }
+        if (TmpArg == "-m") {
+            if (++i >= argc)
+                return Usage(argv[0]);
+            mapname = argv[i];
+            continue;
+        }
+        if ((TmpArg[0] == '-') || !tracename.empty())
+            return Usage(argv[0]);
+        tracename = TmpArg;
+    }
+    if (tracename.empty())
+        return Usage(argv[0]);
+
+    SymbolMap map;
+    std::string error;
+    if (!mapname.empty()) {
+        std::ifstream mapfile(mapname);
+        if (!mapfile.is_open() || map.Load(mapfile, mapname, error)) {
+            std::cerr << (error.empty() ? "Error opening " + mapname : error) << "\n";
+            return 1;
+        }
+    }
+    TraceReader reader;
+    if (reader.Open(tracename, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    TraceRecord rec;
+    uint64_t shown {0};
+    while ((shown < count) && !reader.Next(rec, error)) {
+        if (rec.Cycle < start)
+            continue;
+        const MapSymbol *sym = map.FindSymbol(rec.Addr);
+        if ((sym != nullptr) && (sym->Addr == rec.Addr))
+            std::cout << sym->Name << ":\n";
+        PrintRecord(std::cout, rec);
+        shown++;
+    }
+    if (!error.empty()) {
+        std::cerr << tracename << ": " << error << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -60,6 +60,8 @@
 #define STATUS_ROW 24
 #define RUN_STATE_COL 50
 #define RUN_STATE_BLANK "                              "
+#define IPS_ROW 23
+#define IPS_COL 64
 #define INSTR_ROW 20
 #define MESSAGE_ROW 21
 #define HELP_WIN_X 4
@@ -74,6 +76,10 @@
 #define ASM_WIN_Y 3
 #define ASM_WIN_WIDTH 40
 #define ASM_WIN_HEIGHT 18
+#define STATS_WIN_X 4
+#define STATS_WIN_Y 1
+#define STATS_WIN_WIDTH 72
+#define STATS_WIN_HEIGHT 21
 #define SCREEN_Y_POT 30
 #define POT_WIN_Y 25
 #define POT_WIN_X 0
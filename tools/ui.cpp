@@ -18,7 +18,9 @@
 // ui.cpp - methods for ui class - ncurses interface for ct6k emulator
 #include "ui.hpp"
 #include "ui-priv.hpp"
+#include "cpu.hpp"
 #include <boost/format.hpp>
+#include <cctype>
 #include <cstring>
 
 
@@ -99,7 +101,7 @@ void UI::DrawStaticElements()
     attron(COLOR_PAIR(CP_DEFAULT));
     mvprintw(1, 29, "COMP-O-TRON 6000 v1.0");
     mvprintw(22, 3, "Run: (S)tep Slo(W) (Q)uick (F)ull / View: Memor(Y) Stac(K) (C)ode");
-    mvprintw(23, 3, "Modify: (R)egister (M)emory (B)reakpoint");
+    mvprintw(23, 3, "Modify: (R)egister (M)emory (B)reak W(A)tch Re(G) (L)ist Cou(N)ts (H)eatmap");
     mvprintw(24, 3, "F1 Help  END Exit  F12 Reset");
     mvprintw(24, 35, "(T)oggle Mode");
     attroff(COLOR_PAIR(CP_DEFAULT));
@@ -259,6 +261,13 @@ void UI::DrawNextInstr(std::string Instruction)
     refresh();
 }
 
+// Show the current execution rate at the bottom right, above the run state.
+void UI::DrawIPS(double IPS)
+{
+    mvprintw(IPS_ROW, IPS_COL, "%10.3f MIPS", IPS / 1e6);
+    refresh();
+}
+
 // Clear the message line. Obvious.
 void UI::ClearMessageLine()
 {
@@ -384,7 +393,32 @@ void UI::ShowDisasmWindow(std::vector<uint32_t>Addrs, std::vector<std::string>In
     return;
 }
 
-// Input a single hex value as the breakpoint for the running program.
+// Modal dialog - show the execution counters, already formatted one per line. Lines past the bottom
+// of the window are not shown.
+void UI::ShowStatsWindow(std::vector<std::string> Lines)
+{
+    WINDOW *statswin;
+    int vpos {1};
+
+    statswin = CreateWindow(STATS_WIN_HEIGHT, STATS_WIN_WIDTH, STATS_WIN_Y, STATS_WIN_X);
+    wattron(statswin, COLOR_PAIR(CP_BLUE));
+    for (auto &line : Lines) {
+        if (vpos >= STATS_WIN_HEIGHT - 1)
+            break;
+        mvwaddstr(statswin, vpos++, 2, line.c_str());
+    }
+    wrefresh(statswin);
+    refresh();
+    getch();
+    wborder(statswin, ' ', ' ', ' ',' ',' ',' ',' ',' ');
+    wrefresh(statswin);
+    refresh();
+    delwin(statswin);
+    RefreshAll();
+    return;
+}
+
+// Input a single hex value, the address of a breakpoint to set, or to clear if there is one already.
 // Returns true if a valid hex number was collected.
 bool UI::InputBreakpoint(uint32_t &BP)
 {
@@ -392,9 +426,78 @@ bool UI::InputBreakpoint(uint32_t &BP)
 
     ClearMessageLine();
     attron(COLOR_PAIR(CP_GREEN));
-    mvprintw(MESSAGE_ROW, 4, "Input Breakpoint Address: [        ]");
+    mvprintw(MESSAGE_ROW, 4, "Set/Clear Breakpoint Address: [        ]");
+    refresh();
+    retval = HexInput(MESSAGE_ROW, 35, BP);
+    attroff(COLOR_PAIR(CP_GREEN));
+    ClearMessageLine();
+    return retval;
+}
+
+// Input the address of a watchpoint, to start a new one there or to clear the ones that start there.
+// Returns true if a valid hex number was collected.
+bool UI::InputWatchpoint(uint32_t &Addr)
+{
+    bool retval {false};
+
+    ClearMessageLine();
+    attron(COLOR_PAIR(CP_GREEN));
+    mvprintw(MESSAGE_ROW, 4, "Set/Clear Watchpoint Address: [        ]");
+    refresh();
+    retval = HexInput(MESSAGE_ROW, 35, Addr);
+    attroff(COLOR_PAIR(CP_GREEN));
+    ClearMessageLine();
+    return retval;
+}
+
+// Input the rest of a new watchpoint: how many words (one if left blank), and which kinds of access.
+// Returns true if at least one kind of access was chosen.
+bool UI::InputWatchRange(uint32_t &Len, uint32_t &Kinds)
+{
+    bool retval {false};
+
+    ClearMessageLine();
+    attron(COLOR_PAIR(CP_GREEN));
+    mvprintw(MESSAGE_ROW, 4, "Words to Watch: [        ]");
+    refresh();
+    if (!HexInput(MESSAGE_ROW, 21, Len))
+        Len = 1;
+    ClearMessageLine();
+    mvprintw(MESSAGE_ROW, 4, "Stop on (R)ead (W)rite (C)hange: [   ]");
+    refresh();
+    retval = KindInput(MESSAGE_ROW, 38, Kinds);
+    attroff(COLOR_PAIR(CP_GREEN));
+    ClearMessageLine();
+    return retval;
+}
+
+// Input the number of a register to watch for changes, or to stop watching.
+// Returns true if a valid register number was collected.
+bool UI::InputRegWatch(uint8_t &RegNum)
+{
+    bool retval {false};
+
+    ClearMessageLine();
+    attron(COLOR_PAIR(CP_GREEN));
+    mvprintw(MESSAGE_ROW, 4, "Watch/Unwatch Register Number: ");
+    refresh();
+    retval = RegNumInput(MESSAGE_ROW, 35, RegNum);
+    attroff(COLOR_PAIR(CP_GREEN));
+    ClearMessageLine();
+    return retval;
+}
+
+// Input the condition for a new breakpoint or watch, see condition.hpp. Left blank, it always stops.
+// Returns true if anything was entered.
+bool UI::InputCondition(std::string &Text)
+{
+    bool retval {false};
+
+    ClearMessageLine();
+    attron(COLOR_PAIR(CP_GREEN));
+    mvprintw(MESSAGE_ROW, 4, "Stop If: ");
     refresh();
-    retval = HexInput(MESSAGE_ROW, 31, BP);
+    retval = TextInput(MESSAGE_ROW, 13, SCREEN_X_MIN - 14, Text);
     attroff(COLOR_PAIR(CP_GREEN));
     ClearMessageLine();
     return retval;
@@ -628,6 +731,77 @@ bool UI::HexInput(int Row, int Col, uint32_t &Input)
     return retval;
 }
 
+// Collect up to three of R, W and C, for the kinds of access a watchpoint stops on.
+// Returns true if any were entered.
+bool UI::KindInput(int Row, int Col, uint32_t &Kinds)
+{
+    int c;
+    std::string instr;
+    bool done {false};
+
+    Kinds = 0;
+    move(Row, Col);
+    curs_set(1);
+    refresh();
+    while (!done) {
+        c = toupper(getch());
+        if ((instr.size() < 3) && ((c == 'R') || (c == 'W') || (c == 'C'))) {
+            addch(c);
+            refresh();
+            instr += c;
+        }
+        if ((c == KEY_BACKSPACE) && !instr.empty()) {
+            instr.pop_back();
+            move(Row, Col + instr.size());
+            addch(' ');
+            move(Row, Col + instr.size());
+            refresh();
+        }
+        if ((c == KEY_ENTER) || (c == KEY_STAB) || (c == '\n'))
+            done = true;
+    }
+    for (auto k : instr)
+        Kinds |= (k == 'R') ? WATCH_READ : (k == 'W') ? WATCH_WRITE : WATCH_CHANGE;
+    // cursor off
+    curs_set(0);
+    refresh();
+    return Kinds != 0;
+}
+
+// Collect a line of printable text, up to Max characters.
+// Returns true if it isn't empty.
+bool UI::TextInput(int Row, int Col, size_t Max, std::string &Input)
+{
+    int c;
+    bool done {false};
+
+    Input.clear();
+    move(Row, Col);
+    curs_set(1);
+    refresh();
+    while (!done) {
+        c = getch();
+        if ((Input.size() < Max) && (c >= ' ') && (c <= '~')) {
+            addch(c);
+            refresh();
+            Input += c;
+        }
+        if ((c == KEY_BACKSPACE) && !Input.empty()) {
+            Input.pop_back();
+            move(Row, Col + Input.size());
+            addch(' ');
+            move(Row, Col + Input.size());
+            refresh();
+        }
+        if ((c == KEY_ENTER) || (c == KEY_STAB) || (c == '\n'))
+            done = true;
+    }
+    // cursor off
+    curs_set(0);
+    refresh();
+    return !Input.empty();
+}
+
 // Input a register number, in decimal - 0 to 15
 // Returns true if valid input, false if not
 bool UI::RegNumInput(int Row, int Col, uint8_t &Input)
@@ -45,10 +45,16 @@ public:
     void DrawRunState(std::string State);
     void DrawNextInstr(std::string Instruction);
     void DrawMessage(std::string Message);
+    void DrawIPS(double IPS);
     // Modal dialogs, called functions get a keystroke and destroy the window
     void ShowHelpWindow();
     void ShowDisasmWindow(std::vector<uint32_t>Addrs, std::vector<std::string>Instructions);
+    void ShowStatsWindow(std::vector<std::string> Lines);
     bool InputBreakpoint(uint32_t &BP);
+    bool InputWatchpoint(uint32_t &Addr);
+    bool InputWatchRange(uint32_t &Len, uint32_t &Kinds);
+    bool InputRegWatch(uint8_t &RegNum);
+    bool InputCondition(std::string &Text);
     bool InputReg(uint8_t &RegNum, uint32_t &NewVal);
     bool InputMem(uint32_t &Addr, std::vector<uint32_t> &Data);
     bool InputMemAddr(uint32_t &Addr);
@@ -74,6 +80,8 @@ private:
     void HighlightFlagRow(int Row, bool On);
     bool RegNumInput(int Row, int Col, uint8_t &Input);
     bool HexInput(int Row, int Col, uint32_t &Input);
+    bool KindInput(int Row, int Col, uint32_t &Kinds);
+    bool TextInput(int Row, int Col, size_t Max, std::string &Input);
     void RedrawRegWindow();
     void ClearMessageLine();
     void RefreshAll(); // must be called after destroying any modal window
@@ -92,7 +100,12 @@ private:
 #define CT6K_KEY_MODREG 'R'
 #define CT6K_KEY_MODMEM 'M'
 #define CT6K_KEY_MODBRK 'B'
+#define CT6K_KEY_VIEWBRK 'L'
+#define CT6K_KEY_MODWATCH 'A'
+#define CT6K_KEY_MODREGWATCH 'G'
 #define CT6K_KEY_MODE 'T'
+#define CT6K_KEY_VIEWSTATS 'N'
+#define CT6K_KEY_VIEWHEAT 'H'
 #define CT6K_KEY_EXIT KEY_END
 #define CT6K_KEY_HELP KEY_F(1)
 #define CT6K_KEY_RESET KEY_F(12)
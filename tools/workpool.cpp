@@ -0,0 +1,91 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// workpool.cpp - definitions for the WorkPool class
+
+#include <thread>
+#include "workpool.hpp"
+
+// Constructor. Sets up one queue per thread; the threads themselves only exist inside Run().
+WorkPool::WorkPool(unsigned Threads)
+{
+    if (Threads == 0)
+        Threads = std::thread::hardware_concurrency();
+    if (Threads == 0)   // the library is allowed to not know
+        Threads = 1;
+    for (unsigned i = 0; i < Threads; i++)
+        Queues.push_back(std::make_unique<TaskQueue>());
+}
+
+unsigned WorkPool::GetThreads() const
+{
+    return Queues.size();
+}
+
+// Add a task. Tasks are dealt out to the queues round-robin. Must not be called while Run() is active.
+void WorkPool::Add(std::function<void()> Task)
+{
+    Queues[NextQueue]->Tasks.push_back(std::move(Task));
+    NextQueue = (NextQueue + 1) % Queues.size();
+}
+
+// Start the threads and wait for them to run out of work. Tasks don't add more tasks, so once a
+// thread finds every queue empty, it is done.
+void WorkPool::Run()
+{
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 1; i < Queues.size(); i++)
+        threads.emplace_back(&WorkPool::Worker, this, i);
+    Worker(0);  // the calling thread does its share
+    for (auto &t : threads)
+        t.join();
+}
+
+void WorkPool::Worker(unsigned Index)
+{
+    std::function<void()> task;
+
+    while (TakeLocal(Index, task) || Steal(Index, task))
+        task();
+}
+
+// Own queue is used from the back, which keeps the owner and thieves at opposite ends.
+bool WorkPool::TakeLocal(unsigned Index, std::function<void()> &Task)
+{
+    std::lock_guard<std::mutex> lock(Queues[Index]->Lock);
+    if (Queues[Index]->Tasks.empty())
+        return false;
+    Task = std::move(Queues[Index]->Tasks.back());
+    Queues[Index]->Tasks.pop_back();
+    return true;
+}
+
+// Look for work in the other queues, starting with the next one along so thieves spread out.
+bool WorkPool::Steal(unsigned Thief, std::function<void()> &Task)
+{
+    for (unsigned n = 1; n < Queues.size(); n++) {
+        TaskQueue &victim = *Queues[(Thief + n) % Queues.size()];
+        std::lock_guard<std::mutex> lock(victim.Lock);
+        if (!victim.Tasks.empty()) {
+            Task = std::move(victim.Tasks.front());
+            victim.Tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
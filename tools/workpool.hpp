@@ -0,0 +1,51 @@
+/*
+    The Comp-o-Tron 6000 software is Copyright (C) 2022 Mitch Williams.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as
+    published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// workpool.hpp - declarations for the WorkPool class
+// A small fixed set of threads that work through a batch of independent tasks. Each thread has its
+// own queue and takes work from the back of it; when that runs dry it steals from the front of the
+// other queues. Good for jobs of wildly different lengths, like a night's worth of guest programs.
+#ifndef __WORKPOOL_HPP__
+#define __WORKPOOL_HPP__
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class WorkPool {
+public:
+    WorkPool(unsigned Threads);     // 0 means one per host core
+    void Add(std::function<void()> Task);
+    void Run();                     // returns when every task has finished
+    unsigned GetThreads() const;
+
+private:
+    struct TaskQueue {
+        std::mutex Lock;
+        std::deque<std::function<void()>> Tasks;
+    };
+    std::vector<std::unique_ptr<TaskQueue>> Queues;
+    unsigned NextQueue {0};
+
+    void Worker(unsigned Index);
+    bool TakeLocal(unsigned Index, std::function<void()> &Task);
+    bool Steal(unsigned Thief, std::function<void()> &Task);
+};
+
+#endif // __WORKPOOL_HPP__